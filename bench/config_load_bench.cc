@@ -0,0 +1,112 @@
+/*
+ * Configuration loading benchmark.
+ * Generates a configuration file with many rows (spread over the pools) and
+ * compares loading it pool by pool (GetConfigFileMaxWindows and ParseCsv for
+ * each pool, which scan the whole file each time) against loading it once
+ * for all pools by ConfigurationLoader.
+ *
+ * usage: config-load-bench [rows] [path]
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <string>
+#include <sys/mman.h>
+#include "ParseCsv.h"
+#include "BinaryLayout.h"
+
+static const char *g_pools[] = {DEFAULT_ANONYMOUS_POOL_NAME, ARENA_POOL_NAME,
+                                FILE_POOL_NAME, BRK_POOL_NAME};
+#define POOLS_COUNT (sizeof(g_pools) / sizeof(g_pools[0]))
+
+static volatile size_t g_sink = 0;
+
+// every pool gets a size row and then consecutive 2MB intervals
+static bool GenerateConfiguration(const char *path, size_t rows) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        return false;
+    }
+    size_t pool_rows = rows / POOLS_COUNT;
+    size_t pool_size = (pool_rows + 1) * (size_t)PageSize::HUGE_2MB;
+    fprintf(file, "type,pageSize,startOffset,endOffset\n");
+    for (size_t p = 0; p < POOLS_COUNT; p++) {
+        fprintf(file, "%s,-1,0,%zu\n", g_pools[p],
+                (p == 2) ? (size_t)PageSize::HUGE_2MB : pool_size);
+    }
+    for (size_t i = 0; i < pool_rows; i++) {
+        for (size_t p = 0; p < POOLS_COUNT; p++) {
+            // file mappings are served from the page cache, so the file
+            // pool is kept on 4KB pages
+            if (p == 2) {
+                continue;
+            }
+            size_t start = i * (size_t)PageSize::HUGE_2MB;
+            fprintf(file, "%s,%zu,%zu,%zu\n", g_pools[p],
+                    (size_t)PageSize::HUGE_2MB, start,
+                    start + (size_t)PageSize::HUGE_2MB);
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+static void LoadPerPool(const char *path) {
+    RoutingTable routes;
+    parseCsv::ParseRoutes(routes, path);
+    for (size_t p = 0; p < POOLS_COUNT; p++) {
+        PoolConfigurationData data;
+        int intervals_size = parseCsv::GetConfigFileMaxWindows(path) * 2 + 1;
+        data.intervalList.Initialize(mmap, munmap, intervals_size);
+        parseCsv::ParseCsv(data, path, g_pools[p]);
+        g_sink += data.intervalList.GetLength();
+    }
+}
+
+static void LoadOnce(const char *path) {
+    RoutingTable routes;
+    ConfigurationLoader loader;
+    loader.Load(path, routes);
+    for (size_t p = 0; p < POOLS_COUNT; p++) {
+        g_sink += loader.GetPool(g_pools[p]).intervalList.GetLength();
+    }
+}
+
+template <typename Func>
+static void Measure(const char *name, size_t rows, Func func) {
+    auto start = std::chrono::steady_clock::now();
+    func();
+    auto end = std::chrono::steady_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(end - start).count();
+    printf("%s,%zu,%.2f\n", name, rows, ms);
+}
+
+int main(int argc, char *argv[]) {
+    size_t rows = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+    const char *path = (argc > 2) ? argv[2] : "config_load_bench.csv";
+    if (rows < POOLS_COUNT) {
+        fprintf(stderr, "usage: %s [rows] [path]\n", argv[0]);
+        return 1;
+    }
+    if (!GenerateConfiguration(path, rows)) {
+        fprintf(stderr, "failed to write %s\n", path);
+        return 1;
+    }
+
+    std::string binary_path = std::string(path) + ".bin";
+    {
+        RoutingTable routes;
+        ConfigurationLoader loader;
+        loader.Load(path, routes);
+        BinaryLayout::Write(binary_path.c_str(), loader, routes);
+    }
+
+    printf("benchmark,rows,ms\n");
+    Measure("per-pool-load", rows, [path]() { LoadPerPool(path); });
+    Measure("single-pass-load", rows, [path]() { LoadOnce(path); });
+    Measure("binary-layout-load", rows,
+            [&binary_path]() { LoadOnce(binary_path.c_str()); });
+    remove(path);
+    remove(binary_path.c_str());
+    return 0;
+}
@@ -0,0 +1,92 @@
+/*
+ * malloc/free microbenchmark.
+ * Run it with and without LD_PRELOAD of an allocator (see
+ * run_malloc_bench.sh) to compare the per-call cost of the allocator entry
+ * points, e.g., libmalloc_auto.so against the system glibc malloc.
+ *
+ * usage: malloc-bench [iterations] [max-size] [threads]
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#define BATCH_SIZE (1024)
+
+static volatile size_t g_sink = 0;
+
+static inline size_t NextRandom(size_t &state) {
+    // xorshift64, deterministic and allocation-free
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+// malloc and free the same small size, the fast path of the allocator
+static void PairedMallocFree(size_t iterations) {
+    size_t sink = 0;
+    for (size_t i = 0; i < iterations; i++) {
+        char *ptr = (char*)malloc(64);
+        ptr[0] = (char)i;
+        sink += (size_t)ptr[0];
+        free(ptr);
+    }
+    g_sink += sink;
+}
+
+// malloc a batch of random sizes and then free it, to exercise the bins
+static void BatchedMallocFree(size_t iterations, size_t max_size) {
+    void *batch[BATCH_SIZE];
+    size_t state = 88172645463325252ull;
+    size_t sink = 0;
+    for (size_t i = 0; i < iterations; i += BATCH_SIZE) {
+        for (int j = 0; j < BATCH_SIZE; j++) {
+            size_t size = 16 + NextRandom(state) % max_size;
+            char *ptr = (char*)malloc(size);
+            ptr[0] = (char)j;
+            batch[j] = ptr;
+        }
+        for (int j = 0; j < BATCH_SIZE; j++) {
+            sink += (size_t)((char*)batch[j])[0];
+            free(batch[j]);
+        }
+    }
+    g_sink += sink;
+}
+
+template <typename Func>
+static void Measure(const char *name, size_t iterations, int threads,
+                    Func func) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back(func);
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    // every iteration is one malloc and one free
+    printf("%s,%d,%.2f\n", name, threads, ns / (2.0 * iterations));
+}
+
+int main(int argc, char *argv[]) {
+    size_t iterations = (argc > 1) ? strtoul(argv[1], NULL, 10) : 10000000;
+    size_t max_size = (argc > 2) ? strtoul(argv[2], NULL, 10) : 4096;
+    int threads = (argc > 3) ? atoi(argv[3]) : 1;
+    if (iterations == 0 || max_size == 0 || threads <= 0) {
+        fprintf(stderr, "usage: %s [iterations] [max-size] [threads]\n", argv[0]);
+        return 1;
+    }
+
+    printf("benchmark,threads,ns-per-call\n");
+    Measure("paired-malloc-free", iterations, threads,
+            [iterations]() { PairedMallocFree(iterations); });
+    Measure("batched-malloc-free", iterations, threads,
+            [iterations, max_size]() { BatchedMallocFree(iterations, max_size); });
+    return 0;
+}
@@ -0,0 +1,25 @@
+#!/bin/bash
+# Compares the malloc/free cost of an allocator library (e.g.,
+# libmalloc_auto.so) against the system glibc malloc.
+# The pools are backed by 4KB pages only, so no hugepages are required.
+#
+# usage: run_malloc_bench.sh <malloc-bench> <allocator-library> [bench args]
+
+if [ $# -lt 2 ]; then
+    echo "usage: $0 <malloc-bench> <allocator-library> [bench args]"
+    exit 1
+fi
+
+bench=$1
+library=$2
+shift 2
+script_dir=$(dirname "$(readlink -f "$0")")
+
+echo "== system glibc malloc"
+"$bench" "$@" || exit 1
+
+echo "== $(basename "$library")"
+HPC_CONFIGURATION_FILE="$script_dir/malloc_bench_config.csv" \
+HPC_MMAP_FIRST_FIT_LIST_SIZE=1048576 \
+HPC_FILE_BACKED_FIRST_FIT_LIST_SIZE=10240 \
+LD_PRELOAD="$library" "$bench" "$@"
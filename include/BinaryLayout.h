@@ -0,0 +1,98 @@
+#ifndef MOSALLOC_BINARYLAYOUT_H
+#define MOSALLOC_BINARYLAYOUT_H
+
+#include <cstddef>
+#include <cstdint>
+#include "MemoryIntervalList.h"
+#include "RoutingTable.h"
+
+#define BINARY_LAYOUT_MAGIC "MOSLAYOT"
+// version 2 added the allocator policy of the pools (the pools of version 1
+// files get the default policy)
+#define BINARY_LAYOUT_VERSION (2)
+#define BINARY_LAYOUT_MIN_VERSION (1)
+
+class ConfigurationLoader;
+
+/*
+ * BinaryLayout is a compact configuration file format for layouts with
+ * millions of intervals, which is mapped and used in place rather than
+ * parsed (see ConfigurationLoader, which detects it by its magic).
+ * The file is:
+ *     Header
+ *     Pool[pools_count]
+ *     Route[routes_count]
+ *     the intervals of each pool (MemoryInterval[intervals_count] at
+ *     intervals_offset), sorted by their start offset
+ * All the fields are in the native byte order, and every structure is a
+ * multiple of 8 bytes, so the interval arrays are aligned. The intervals are
+ * stored in the MemoryInterval layout, so they are the storage of the pools
+ * interval lists as is.
+ * Convert a csv configuration file (in either format) to this format by
+ * tools/mosalloc-convert-layout.
+ */
+class BinaryLayout {
+public:
+    struct Header {
+        char _magic[8];
+        uint32_t _version;
+        uint32_t _pools_count;
+        uint32_t _routes_count;
+        uint32_t _reserved;
+        // the size of the whole file, to detect a truncated file
+        uint64_t _file_size;
+    };
+
+    struct Pool {
+        char _name[MAX_POOL_NAME_LENGTH];
+        uint64_t _size;
+        uint64_t _intervals_offset;
+        uint64_t _intervals_count;
+        // an AllocatorPolicy
+        uint32_t _allocator_policy;
+        uint32_t _reserved;
+    };
+
+    // the pool of version 1, which has no allocator policy
+    struct PoolV1 {
+        char _name[MAX_POOL_NAME_LENGTH];
+        uint64_t _size;
+        uint64_t _intervals_offset;
+        uint64_t _intervals_count;
+    };
+
+    struct Route {
+        // a pool name, "file", or "passthrough" (as in the csv route rows)
+        char _target[MAX_POOL_NAME_LENGTH];
+        uint32_t _class;
+        uint32_t _reserved;
+        uint64_t _min_length;
+        uint64_t _max_length;
+    };
+
+    static bool IsBinaryLayout(const char *file_mmap, size_t size);
+
+    /*
+     * Validate checks that the mapped file is a complete binary layout of
+     * a supported version, that the interval arrays are within the file and
+     * sorted, and that each interval is whole pages of a known page size
+     * inside its pool. It throws on an invalid file.
+     */
+    static const Header* Validate(const char *file_mmap, size_t size);
+    /*
+     * GetPool returns the pool of the given index in the current Pool
+     * layout (the pools of older versions are converted).
+     */
+    static Pool GetPool(const Header *header, uint32_t index);
+    static const Route* GetRoutes(const Header *header);
+    static MemoryInterval* GetIntervals(const Header *header, const Pool &pool);
+
+    /*
+     * Write writes the pools of the loader, and the routes of the routing
+     * table, to a binary layout file.
+     */
+    static void Write(const char *path, ConfigurationLoader &loader,
+                      const RoutingTable &routingTable);
+};
+
+#endif //MOSALLOC_BINARYLAYOUT_H
@@ -0,0 +1,72 @@
+#ifndef MOSALLOC_CONTROLCHANNEL_H
+#define MOSALLOC_CONTROLCHANNEL_H
+
+#include <atomic>
+#include <sys/types.h>
+#include "globals.h"
+#include "RoutingTable.h"
+
+// the control file is read to a stack buffer (no memory is allocated)
+#define MAX_CONTROL_FILE_SIZE (4096)
+#define MAX_CONTROL_COMMANDS (64)
+
+/*
+ * ControlChannel lets an operator change the layout of the pools while the
+ * process runs, e.g., to explore several layouts across the execution
+ * phases of a long-running benchmark without rerunning it.
+ * The operator writes commands to the control file (HPC_CONTROL_FILE) and
+ * sends the control signal (HPC_CONTROL_SIGNAL, SIGUSR2 by default) to the
+ * process. The signal handler only marks the commands as pending, and they
+ * are applied by the next operation of the pools, which is a safe point:
+ * no pool lock is held there, so each command is applied under the lock of
+ * its pool (see HugePageBackedRegion::RemapInterval).
+ * The control file has a command per line (empty lines and lines that
+ * start with '#' are ignored):
+ *     <pool> <start-offset> <end-offset> <page-size>
+ * which remaps [start-offset, end-offset) of the pool (an anonymous pool
+ * or "brk") to pages of <page-size> (4KB, 2MB or 1GB). Offsets and sizes
+ * take an optional unit suffix (KB, MB or GB).
+ * The result of each command is written to stderr.
+ */
+class ControlChannel {
+    public:
+        struct Command {
+            char _pool[MAX_POOL_NAME_LENGTH];
+            off_t _start_offset;
+            off_t _end_offset;
+            PageSize _page_size;
+        };
+
+        constexpr ControlChannel() = default;
+
+        /*
+         * Install sets the control file and installs the handler of the
+         * control signal. It returns 0 on success or -errno on failure.
+         */
+        int Install(const char *path, int signal);
+
+        bool IsPending() const {
+            return _pending.load(std::memory_order_relaxed);
+        }
+
+        /*
+         * TakeCommands clears the pending mark and reads the commands of the
+         * control file. It returns the number of commands, or -errno if the
+         * file cannot be read, or -EINVAL if it has an invalid line.
+         */
+        int TakeCommands(Command *commands, int max_commands);
+
+        static int ParseCommands(const char *text, size_t size,
+                                 Command *commands, int max_commands);
+        static void ReportResult(const Command &command, int result);
+
+    private:
+        static void HandleSignal(int signal);
+
+        const char *_path = nullptr;
+        std::atomic<bool> _pending{false};
+};
+
+extern ControlChannel mosalloc_control_channel;
+
+#endif //MOSALLOC_CONTROLCHANNEL_H
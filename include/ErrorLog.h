@@ -0,0 +1,125 @@
+#ifndef MOSALLOC_ERRORLOG_H
+#define MOSALLOC_ERRORLOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <sys/mman.h>
+#include "MemoryIntervalList.h"
+
+#define CRASH_LOG_MAGIC "MOSALLOC"
+#define DEFAULT_CRASH_LOG_CAPACITY (4096)
+
+/*
+ * The errors that Mosalloc reports while serving requests (the errors of the
+ * configuration, which are found when the pools are initialized, are fatal
+ * and are thrown by THROW_EXCEPTION).
+ */
+enum class MosallocError : int32_t {
+    SUCCESS = 0,
+    POOL_OUT_OF_MEMORY,
+    MMAP_FAILED,
+    MUNMAP_FAILED,
+    MPROTECT_FAILED
+};
+
+/*
+ * ErrorLog reports the runtime errors by their policy, and keeps an optional
+ * crash log: a ring buffer of the last operations of the pools, which is
+ * mapped from a file (MAP_SHARED), so it survives a crash of the process.
+ * The crash log file is a CrashLogHeader followed by <capacity> entries;
+ * entry i holds the operation whose sequence number is i (mod capacity),
+ * and a zero sequence marks an entry that was never written (or that is
+ * being written).
+ * Both reporting and recording are allocation-free and lock-free (a writer
+ * claims an entry by an atomic increment), so they can be called from the
+ * hooks, and the log is constant-initialized, so it can be used before the
+ * static constructors run.
+ */
+class ErrorLog {
+    public:
+        enum class Operation : uint32_t {
+            MMAP = 1,
+            MUNMAP,
+            MPROTECT,
+            BRK,
+            SBRK,
+            // an error that was reported; the result is the MosallocError
+            ERROR
+        };
+
+        struct CrashLogEntry {
+            std::atomic<uint64_t> _sequence;
+            Operation _operation;
+            // 0 on success, errno (or MosallocError for ERROR) otherwise
+            int32_t _result;
+            uint64_t _address;
+            uint64_t _length;
+        };
+
+        struct CrashLogHeader {
+            char _magic[8];
+            uint64_t _capacity;
+            std::atomic<uint64_t> _next_sequence;
+            uint64_t _reserved[5];
+        };
+
+        constexpr ErrorLog() = default;
+
+        /*
+         * Open maps the crash log file (which is created or truncated) with
+         * room for <capacity> entries. It returns 0 on success or -errno on
+         * failure.
+         */
+        int Open(const char *path, size_t capacity,
+                 MmapFuncPtr allocator = mmap,
+                 MunmapFuncPtr deallocator = munmap);
+        void Close();
+        bool IsOpen() const { return _header != nullptr; }
+
+        /*
+         * Record appends an operation to the crash log (if it is open),
+         * overwriting the oldest entry when the log is full.
+         */
+        void Record(Operation operation, const void *address, size_t length,
+                    int32_t result) {
+            if (_header == nullptr) {
+                return;
+            }
+            RecordEntry(operation, address, length, result);
+        }
+
+        /*
+         * Report writes the error to stderr and records it in the crash log.
+         * When fail-fast is set (the default) it exits the process, otherwise
+         * it returns and the caller fails the request with an error code.
+         */
+        void Report(MosallocError error, const char *function, const char *msg);
+        void SetFailFast(bool fail_fast) { _fail_fast = fail_fast; }
+        bool IsFailFast() const { return _fail_fast; }
+
+        /*
+         * GetEntry returns the entry of the i-th last operation (0 is the
+         * last one), or nullptr if there is no such entry.
+         */
+        const CrashLogEntry* GetEntry(size_t i) const;
+
+        static const char* GetErrorName(MosallocError error);
+
+    private:
+        void RecordEntry(Operation operation, const void *address,
+                         size_t length, int32_t result);
+
+        CrashLogHeader *_header = nullptr;
+        CrashLogEntry *_entries = nullptr;
+        size_t _mapped_size = 0;
+        bool _fail_fast = true;
+        MunmapFuncPtr _deallocator = nullptr;
+};
+
+extern ErrorLog mosalloc_error_log;
+
+#define REPORT_ERROR(error, msg) \
+    mosalloc_error_log.Report((error), __FUNCTION__, (msg))
+
+#endif //MOSALLOC_ERRORLOG_H
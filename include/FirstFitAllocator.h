@@ -31,12 +31,38 @@ public:
 
     void *Allocate(size_t size);
 
+    // Allocate exactly [start, start+size), fails if any part of it is
+    // already allocated
+    void *AllocateAt(void *start, size_t size);
+
+    // Allocate the first free region that fits and starts at an address
+    // which is equal to skew modulo alignment
+    void *AllocateAligned(size_t size, size_t alignment, size_t skew = 0);
+
+    // Allocate from the highest free region that fits (last fit)
+    void *AllocateFromTop(size_t size);
+
     int Free(void *start, size_t size);
 
+    // Free all allocated parts of [start, start+size) (like munmap, it is
+    // not an error if the range, or parts of it, are not allocated)
+    int FreeRange(void *start, size_t size);
+
     size_t GetFreeSpace();
 
+    // Find the free region that contains addr, returns false if addr is
+    // allocated (or out of the allocator range)
+    bool FindFreeRegion(void *addr, void **start, void **end);
+
     void *GetTopAddress();
 
+    // The end of the allocator range
+    void *GetEndAddress();
+
+    // The number of unused nodes (each allocation and each free region
+    // takes a node)
+    unsigned int GetFreeNodesCount();
+
     bool IsValidDataStructure();
 
     bool IsAddressAllocated(void *addr);
@@ -60,6 +86,11 @@ private:
 
     int AllocateMemoryRegionNode(int free_node, void *start, size_t size);
 
+    void *AllocateFromFreeNode(int free_node, int prev_free_node,
+                               void *start, size_t size);
+
+    int FreeLocked(void *start, size_t size);
+
     int AddFreedRegionToFreeList(void *start, size_t size);
 
     void CombineAdjacentFreeNodes();
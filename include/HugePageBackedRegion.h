@@ -3,38 +3,225 @@
 
 #include <cstddef>
 #include <sys/types.h>
+#include <sys/mman.h>
 #include <vector>
 #include "../include/globals.h"
 #include "../include/MemoryIntervalList.h"
+#include "../include/ErrorLog.h"
+
+typedef int (*MprotectFuncPtr)(void *, size_t, int);
+
+// Maximal length of a region name, including the terminating null byte
+#define MAX_REGION_NAME_LENGTH (32)
+
+// Maximal number of ranges with a non-default protection that a single
+// region keeps track of (similar to the kernel vm.max_map_count limit)
+#define MAX_PROTECTION_RANGES (4096)
+
+// Maximal number of committed ranges above the region size (the committed
+// prefix) that a single region keeps track of
+#define MAX_COMMITTED_RANGES (4096)
+
+// The size of the slices that RemapInterval copies a remapped page by
+#define REMAP_COPY_SLICE_SIZE (2 * 1024 * 1024)
 
 class HugePageBackedRegion {
     public:
 
+    /*
+     * The memory of the region is mapped, unmapped and protected by the
+     * given functions; inside the library they must be the glibc functions
+     * (rather than the hooks, which serve the pools).
+     */
     void Initialize(size_t region_size,
                     MemoryIntervalList& intervalList,
                     MmapFuncPtr allocator,
                     MunmapFuncPtr deallocator,
+                    MprotectFuncPtr protector,
                     void* region_base = nullptr);
 
         HugePageBackedRegion();
         ~HugePageBackedRegion();
 
+        /*
+         * Resize commits (or releases) the memory of the region from its
+         * base up to new_size, so the region size is a committed prefix.
+         */
         int Resize(size_t new_size);
 
+        /*
+         * Commit maps [addr, addr+len) (rounded out to whole pages) without
+         * committing the memory below it, so a range that is above the
+         * region size is tracked as a committed range until the region
+         * grows over it (a range that starts in the region extends it).
+         * The recorded protection is applied to the new memory. It returns
+         * 0 on success or -errno on failure.
+         */
+        int Commit(void *addr, size_t len);
+
+        /*
+         * Reserve covers the parts of [addr, addr+len) that are not
+         * committed by a PROT_NONE placeholder mapping, so nothing else
+         * could be mapped there until they are committed.
+         */
+        int Reserve(void *addr, size_t len);
+
+        /*
+         * Release unmaps the placeholders of [addr, addr+len), which is no
+         * longer used, and the committed pages (above the region size) that
+         * lie entirely in [free_start, free_start+free_len), the free memory
+         * that contains it.
+         */
+        int Release(void *addr, size_t len, void *free_start, size_t free_len);
+
+        /*
+         * CanProtect returns true if Protect(addr, len, prot) would not fail
+         * on a partially covered huge page.
+         */
+        bool CanProtect(void *addr, size_t len, int prot);
+
         void *GetRegionBase();
 
         size_t GetRegionSize();
         
         size_t GetRegionMaxSize();
 
+        // GetCommittedSize returns the region size and the size of the
+        // committed ranges above it
+        size_t GetCommittedSize();
+
+        /*
+         * GetPageSize returns the page size of the interval that contains
+         * addr (which is inside the region).
+         */
+        size_t GetPageSize(void *addr);
+
+        /*
+         * SetName labels the memory of the region (which must be set before
+         * Initialize, as the memory is mapped by Initialize and Resize).
+         * Each interval is named "mosalloc:<name>:<page-size>" by
+         * prctl(PR_SET_VMA_ANON_NAME), so it is shown in /proc/<pid>/maps and
+         * smaps. Kernels without anonymous VMA names (or hugetlb mappings,
+         * which cannot be named) are left unnamed.
+         */
+        void SetName(const char *name);
+
+        /*
+         * Protect changes the protection of [addr, addr+len) with mprotect
+         * semantics: it returns 0 on success or -errno on failure.
+         * The protection is recorded per range, so it is applied to memory
+         * that is not mapped yet once it is committed (by Resize or Commit).
+         * A huge page cannot be split, so (as mprotect of hugetlb memory)
+         * a range that covers a huge page partially fails with EINVAL,
+         * unless the rest of the page already has the requested protection;
+         * the protection of the region is not changed on failure. Hence all
+         * the parts of a huge page always have the same protection.
+         */
+        int Protect(void *addr, size_t len, int prot);
+
+        /*
+         * ResetProtection drops the protection records of [addr, addr+len)
+         * and restores the default protection of its mapped memory. It is
+         * used when the range is released, so it could be served again.
+         * A huge page that is covered partially keeps its protection (so
+         * its released part takes the protection of the rest of the page).
+         */
+        int ResetProtection(void *addr, size_t len);
+
+        /*
+         * Clear zeroes the mapped memory of [addr, addr+len) regardless of
+         * its protection, which is kept (it is used when a new mapping
+         * replaces the range). It returns 0 on success or -errno on failure.
+         */
+        int Clear(void *addr, size_t len);
+
+        /*
+         * RemapInterval changes the page size of [start_offset, end_offset)
+         * at runtime. It returns 0 on success or -errno on failure.
+         * The part of the range that is not mapped yet only gets the new
+         * page size in the intervals list (so it is mapped by it when the
+         * region is extended); the pages of the mapped part are moved
+         * aside (by mremap, with no copy), the range is mapped again
+         * (MAP_FIXED) by the new page size, and the old pages are copied
+         * back in slices of REMAP_COPY_SLICE_SIZE, page by page, with its
+         * protection restored. If the new pages cannot be allocated (e.g.,
+         * there are not enough free hugepages), the old pages of the failed
+         * page are moved back. Kernels older than 5.16 cannot move hugetlb
+         * pages, so the remapping of hugepages fails there.
+         * The range must be aligned to the new page size and to the page
+         * sizes of the intervals it overlaps (so no page is split), and the
+         * region memory must be aligned to them as well (which holds for
+         * the page sizes of the configured intervals). All the parts of
+         * each new huge page must have the same protection (see Protect).
+         * A range that overlaps committed ranges (see Commit) fails with
+         * EBUSY, as their pages are not described by the intervals.
+         * The copy is not atomic, so the caller must hold the region lock,
+         * and writes of other threads to the range while it is copied are
+         * lost; only cold memory should be remapped.
+         */
+        int RemapInterval(off_t start_offset, off_t end_offset,
+                          PageSize page_size);
+
     private:
+        struct ProtectionRange {
+            off_t _start_offset;
+            off_t _end_offset;
+            int _prot;
+        };
+
+        struct CommittedRange {
+            off_t _start_offset;
+            off_t _end_offset;
+        };
+
+        int SetProtectionRange(off_t start_offset, off_t end_offset, int prot);
+
+        int ApplyProtection(off_t start_offset, off_t end_offset, int prot);
+
+        int ApplyMappedProtection(off_t start_offset, off_t end_offset, int prot);
+
+        int ClearMapped(off_t start_offset, off_t end_offset);
+
+        off_t FindGap(off_t offset, off_t end_offset, off_t &gap_end_offset);
+
+        int MapPages(off_t start_offset, off_t end_offset, PageSize page_size);
+
+        void AddCommittedRange(off_t start_offset, off_t end_offset);
+
+        int RemoveCommittedRange(off_t start_offset, off_t end_offset);
+
+        void AbsorbCommittedRanges();
+
+        void GetPage(off_t offset, off_t &page_start_offset,
+                     off_t &page_end_offset);
+
+        int ApplyProtectionRanges(off_t start_offset, off_t end_offset);
+
+        int GetPageProtection(off_t start_offset, size_t len);
+
+        bool HasProtection(off_t start_offset, off_t end_offset, int prot);
+
+        int CheckPartialPages(off_t start_offset, off_t end_offset, int prot);
+
+        int ProtectPage(off_t start_offset, size_t len);
+
+        void InsertProtectionRange(const ProtectionRange& range);
+
         size_t ExtendRegion(size_t new_size);
 
         size_t ShrinkRegion(size_t new_size);
 
+        int MovePages(void *from, void *to, off_t start_offset,
+                      off_t end_offset, off_t &moved_offset);
+
+        int RemapPage(off_t start_offset, size_t len, PageSize page_size,
+                      size_t copy_len);
+
         void *AllocateMemory(void *start_address, size_t len, PageSize page_size);
 
-        void DeallocateMemory(void *addr, size_t len);
+        int DeallocateMemory(void *addr, size_t len);
+
+        void NameMemory(void *addr, size_t len, PageSize page_size);
 
         void* RegionIntervalListMemAlloc(size_t s);
 
@@ -45,9 +232,18 @@ class HugePageBackedRegion {
         MemoryIntervalList _region_intervals;
         size_t _region_current_size;
         bool _initialized;
+        char _name[MAX_REGION_NAME_LENGTH];
 
         MmapFuncPtr _memory_allocator;
         MunmapFuncPtr _memory_deallocator;
+        MprotectFuncPtr _memory_protector;
+
+        ProtectionRange *_protection_ranges;
+        size_t _protection_ranges_length;
+
+        // sorted, disjoint (and not adjacent) ranges of whole pages
+        CommittedRange *_committed_ranges;
+        size_t _committed_ranges_length;
 };
 
 
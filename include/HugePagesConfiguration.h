@@ -21,12 +21,85 @@ public:
 
     struct HugePagesConfigurationParams {
         char* configuration_file;
+        // the inline layout (see ConfigurationLoader::LoadInline), which
+        // replaces the configuration file, or nullptr
+        char* layout;
         size_t _ffa_list_size;
     };
 
+    /*
+     * POOL: file mappings are placed in the file pool address range.
+     * TRANSPARENT: the file pool range is only reserved (PROT_NONE), and file
+     * mappings are placed in it on 2MB boundaries (when their length allows)
+     * and advised with MADV_HUGEPAGE, so file THP (e.g., on tmpfs or DAX
+     * files) could back them while they still share the page cache.
+     */
+    enum class FileMmapMode {
+        POOL,
+        TRANSPARENT
+    };
+
+    /*
+     * The handling of the pools in a child process that was forked without
+     * exec (e.g., by a pre-forking server):
+     * KEEP: the child keeps using the pools as is.
+     * SHRINK: the child releases the pools memory that is above the top of
+     * their allocations.
+     * PASSTHROUGH: like SHRINK, and the child serves new mmap requests by
+     * the kernel (the brk pool still serves the heap, which must stay
+     * contiguous). The memory that the child inherits is not freed: the
+     * allocations stay in the pools, which keep their address ranges.
+     */
+    enum class ForkPolicy {
+        KEEP,
+        SHRINK,
+        PASSTHROUGH
+    };
+
+    /*
+     * The handling of the errors of serving requests (e.g., a pool that is
+     * out of memory, or a failure to allocate hugepages):
+     * EXIT: report the error and exit (fail-fast).
+     * RETURN: report the error and fail the request (e.g., mmap returns
+     * MAP_FAILED with ENOMEM), so the application could handle it.
+     */
+    enum class ErrorPolicy {
+        EXIT,
+        RETURN
+    };
+
+    /*
+     * The handling of a layout that needs more hugepages than are free (see
+     * PreflightPlanner), which is checked before the pools are mapped:
+     * OFF: do not check the layout.
+     * WARN: report the shortage and run the layout as is.
+     * REFUSE: report the shortage and exit.
+     * DEGRADE: report the shortage, and back the hugepages that do not fit
+     * by the next smaller page size.
+     */
+    enum class PreflightPolicy {
+        OFF,
+        WARN,
+        REFUSE,
+        DEGRADE
+    };
+
     struct GeneralParams {
         bool _analyze_hpbrs;
         unsigned long _verbose_level;
+        FileMmapMode _file_mmap_mode;
+        ForkPolicy _fork_policy;
+        ErrorPolicy _error_policy;
+        PreflightPolicy _preflight_policy;
+        // nullptr if there is no crash log
+        char* _crash_log_file;
+        size_t _crash_log_entries;
+        // nullptr if there is no control channel (see ControlChannel.h)
+        char* _control_file;
+        int _control_signal;
+        // the profiling run (see LayoutProfiler.h) and its hugepages budget
+        bool _profile;
+        size_t _profile_budget;
     };
 
     HugePagesConfiguration();
@@ -45,6 +118,8 @@ private:
 
     void ReadGeneralEnvParams(GeneralParams &params);
 
+    void ReadConfigurationSource(HugePagesConfigurationParams &params);
+
     char* GetEnvironmentVariable(const char *key) const;
     unsigned long GetEnvironmentVariableValue(const char *key) const;
 
@@ -61,9 +136,19 @@ private:
     const char* FILE_BACKED_FFA_SIZE_ENV_VAR =
           "HPC_FILE_BACKED_FIRST_FIT_LIST_SIZE";
     const char* CONFIGURATION_FILE_ENV_VAR= "HPC_CONFIGURATION_FILE";
+    const char* LAYOUT_ENV_VAR = "HPC_LAYOUT";
     const char* VERBOSE_LEVEL_ENV_VAR = "HPC_VERBOSE_LEVEL";
     const char* DEBUG_BREAK_ENV_VAR = "HPC_DEBUG_BREAK";
     const char* ANALYZE_HPBRS_ENV_VAR = "HPC_ANALYZE_HPBRS";
+    const char* FILE_MMAP_MODE_ENV_VAR = "HPC_FILE_MMAP_MODE";
+    const char* FORK_POLICY_ENV_VAR = "HPC_FORK_POLICY";
+    const char* ERROR_POLICY_ENV_VAR = "HPC_ERROR_POLICY";
+    const char* PREFLIGHT_POLICY_ENV_VAR = "HPC_PREFLIGHT";
+    const char* CRASH_LOG_ENV_VAR = "HPC_CRASH_LOG";
+    const char* CRASH_LOG_ENTRIES_ENV_VAR = "HPC_CRASH_LOG_ENTRIES";
+    const char* CONTROL_FILE_ENV_VAR = "HPC_CONTROL_FILE";
+    const char* CONTROL_SIGNAL_ENV_VAR = "HPC_CONTROL_SIGNAL";
+    const char* PROFILE_BUDGET_ENV_VAR = "HPC_PROFILE_BUDGET";
 };
 
 #endif //_HUGE_PAGES_CONFIGURATION_H
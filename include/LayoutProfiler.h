@@ -0,0 +1,106 @@
+#ifndef MOSALLOC_LAYOUTPROFILER_H
+#define MOSALLOC_LAYOUTPROFILER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include "MemoryIntervalList.h"
+#include "PoolConfigurationData.h"
+#include "RoutingTable.h"
+
+// the density is recorded per 2MB chunk of the pools
+#define PROFILE_CHUNK_SIZE ((size_t)PageSize::HUGE_2MB)
+#define PROFILE_CHUNK_PAGES (PROFILE_CHUNK_SIZE / (size_t)PageSize::BASE_4KB)
+#define PROFILE_CHUNKS_PER_1GB ((size_t)PageSize::HUGE_1GB / PROFILE_CHUNK_SIZE)
+// the anonymous pools, brk and file
+#define MAX_PROFILED_POOLS (MAX_ANONYMOUS_POOLS + 2)
+
+/*
+ * LayoutProfiler records the usage of the pools in a profiling run, and
+ * generates the configuration file of the next runs from it, so the layout
+ * is tuned by two runs rather than by hand-editing the pool sizes.
+ * The usage of a pool is its peak extent (the highest end offset of the
+ * ranges that were allocated from it, so a fragmented pool, a last-fit pool
+ * and the reservations at the top of a pool keep their offsets), and the
+ * density of each 2MB chunk of it: the peak number of its 4KB pages that
+ * were touched (i.e., that are resident, by mincore), which is the number
+ * of TLB entries that a 2MB page would replace. The chunks are sampled
+ * before the pool releases them (when its top is lowered) and at exit, so
+ * the density is the peak of the run. The profiling run should use a layout
+ * with no hugepages, as every chunk of a hugepage is dense.
+ * The generated layout sizes each pool by its peak extent (rounded up to
+ * 2MB, and covering every sampled chunk), and backs the densest chunks of
+ * all the pools by 2MB pages, up to the hugepages budget (in bytes); the
+ * ties are broken by the pool order and then by the lower offset, which is
+ * used first. A 1GB-aligned range whose chunks are all selected is backed by
+ * a 1GB page, which costs the same budget.
+ */
+class LayoutProfiler {
+public:
+    LayoutProfiler();
+    ~LayoutProfiler();
+
+    void Initialize(MmapFuncPtr allocator, MunmapFuncPtr deallocator);
+
+    /*
+     * AddPool adds a pool whose region of max_size bytes starts at base,
+     * and returns its index. The chunks of a pool that cannot be backed by
+     * hugepages (the file pool) are not recorded.
+     */
+    int AddPool(const char *name, void *base, size_t max_size,
+                bool hugepages, AllocatorPolicy allocator_policy);
+    int GetPoolsCount() const { return _pools_count; }
+
+    void UpdatePeakExtent(int pool, size_t extent);
+    /*
+     * Sample records the density of the chunks that overlap
+     * [offset, offset + length) of the pool. The chunks are read from their
+     * start, so the pool must be mapped from the chunk of offset.
+     */
+    void Sample(int pool, size_t offset, size_t length);
+    void UpdateChunk(int pool, size_t chunk, size_t touched_pages);
+    size_t GetChunk(int pool, size_t chunk) const;
+
+    /*
+     * Plan selects the hugepages of the pools for the given budget (in
+     * bytes); GetPlannedSize and GetPlannedIntervals return the layout of
+     * a pool after Plan, which is called once.
+     */
+    void Plan(size_t budget);
+    size_t GetPlannedSize(int pool) const;
+    MemoryIntervalList& GetPlannedIntervals(int pool);
+
+    /*
+     * WriteProfile writes the density of the touched chunks, as
+     * "pool,offset,touched-pages" rows.
+     */
+    void WriteProfile(FILE *file) const;
+    /*
+     * WriteLayout writes the planned layout in the new csv format, along
+     * with the allocator rows of the pools and the given routes, so it is
+     * a complete configuration file.
+     */
+    void WriteLayout(FILE *file, const RoutingTable &routes);
+
+private:
+    struct PoolProfile {
+        char _name[MAX_POOL_NAME_LENGTH];
+        void *_base;
+        size_t _peak_extent;
+        AllocatorPolicy _allocator_policy;
+        // the peak touched pages of each chunk (nullptr if the pool cannot
+        // be backed by hugepages)
+        uint16_t *_chunks;
+        size_t _chunks_count;
+        size_t _planned_size;
+        MemoryIntervalList _planned_intervals;
+    };
+
+    PoolProfile _pools[MAX_PROFILED_POOLS];
+    int _pools_count;
+    bool _planned;
+    MmapFuncPtr _mmap;
+    MunmapFuncPtr _munmap;
+};
+
+#endif //MOSALLOC_LAYOUTPROFILER_H
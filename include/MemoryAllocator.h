@@ -5,11 +5,17 @@
 #include <chrono>
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include "../include/GlibcAllocationFunctions.h"
 #include "../include/HugePageBackedRegion.h"
 #include "../include/FirstFitAllocator.h"
 #include "../include/HugePagesConfiguration.h"
+#include "../include/ErrorLog.h"
+#include "../include/ControlChannel.h"
+#include "../include/PreflightPlanner.h"
+#include "../include/LayoutProfiler.h"
 #include "ParseCsv.h"
+#include "RoutingTable.h"
 
 #ifdef THREAD_SAFETY
 #define MUTEX_GUARD(lock) std::lock_guard<std::mutex> guard(lock) 
@@ -24,13 +30,77 @@ class MemoryAllocator {
         MemoryAllocator();
         ~MemoryAllocator();
 
-        void* AllocateFromAnonymousMmapRegion(size_t);
+        RoutingTable::RouteTarget RouteMmapRequest(size_t, int, int, int, int &);
+        void* AllocateFromAnonymousMmapRegion(void *, size_t, int, int,
+                                              int pool = 0,
+                                              size_t alignment = 0);
+        void* AllocateFromArenaPool(void *, size_t, int, int);
+        /*
+         * GetArenaHeapsLimit returns the number of malloc heaps of the given
+         * maximal size that the arena pool could hold (a heap is reserved
+         * with twice its size until it is aligned, see mosalloc_arena.h).
+         */
+        size_t GetArenaHeapsLimit(size_t heap_max_size);
+        /*
+         * AllocateFromNamedPool maps an anonymous range from the given pool
+         * regardless of the routes (see mosalloc_mmap_pool). It fails with
+         * EINVAL if there is no such anonymous pool.
+         */
+        void* AllocateFromNamedPool(const char *pool, size_t length, int prot);
         void* AllocateFromFileMmapRegion(void *, size_t, int, int, int, off_t);
         int DeallocateFromMmapRegion(void*, size_t);
         int ChangeProgramBreak(void *addr);
+
+        /*
+         * Morecore moves the program break of the brk pool by increment
+         * under a single lock, and returns the previous break (or NULL on
+         * failure, as MORECORE). It is the fast path of the heap growth,
+         * which is shared by malloc morecore and the sbrk hook.
+         * GetProgramBreak reads the break without locking.
+         */
+        void* Morecore(intptr_t increment);
+        void* GetProgramBreak() { return _brk_top.load(std::memory_order_acquire); }
+        int ProtectMemory(void *addr, size_t len, int prot);
         void* GetBrkRegionBase();
         bool IsAddressInHugePageRegions(void *addr);
+
+        /*
+         * GetPoolRegionSize and GetPoolCommittedSize return the committed
+         * prefix of an anonymous pool and all its committed memory, and
+         * GetPoolMaxAllocatedSize returns the peak of the bytes that were
+         * allocated from it and GetPoolMaxExtent the peak of the highest end
+         * offset of its allocated ranges (or 0 if there is no such pool).
+         */
+        size_t GetPoolRegionSize(const char *pool);
+        size_t GetPoolCommittedSize(const char *pool);
+        size_t GetPoolMaxAllocatedSize(const char *pool);
+        size_t GetPoolMaxExtent(const char *pool);
         void AnalyzeRegions();
+
+        /*
+         * RecordStartup adds the activation of the hooks (which follows the
+         * pools initialization) to the startup statistics that are reported
+         * by AnalyzeRegions, along with the bytes of the system heap that
+         * were retired so they would not serve allocations.
+         */
+        void RecordStartup(std::chrono::nanoseconds activation_time,
+                           size_t retired_bytes);
+
+        /*
+         * LockPools and UnlockPools hold the pools locks around fork (from
+         * pthread_atfork handlers), so the child will not inherit a lock
+         * that is held by a thread which does not exist in the child. The
+         * brk pool lock is left out unless brk_pool is set, for the fork
+         * handlers that cannot take it before the malloc arena locks (which
+         * are held while malloc calls Morecore). The control commands are
+         * not applied while the pools are locked, so Morecore (which applies
+         * them) does not wait for a pool lock under the arena lock.
+         * ResetAfterFork applies the fork policy in the child (after the
+         * pools are unlocked).
+         */
+        void LockPools(bool brk_pool = true);
+        void UnlockPools(bool brk_pool = true);
+        void ResetAfterFork();
         
         /*
          * IsInitialized is used to detect when the library is already 
@@ -51,33 +121,104 @@ class MemoryAllocator {
         bool IsInitialized() { return _isInitialized; }
 
     private:
+        /*
+         * An anonymous mmap pool; the default pool "mmap" is always the
+         * first pool, and the other pools are named by the routing table.
+         */
+        struct AnonymousMmapPool {
+            FirstFitAllocator _ffa;
+            HugePageBackedRegion _hpbr;
+#ifdef THREAD_SAFETY
+            std::mutex _mutex;
+#endif // THREAD_SAFETY
+            size_t _max_size = 0;
+            // the bytes that are allocated from the pool (including the
+            // reservations) and their peak
+            size_t _bytes = 0;
+            size_t _max_bytes = 0;
+            // the peak of the highest end offset of the allocated ranges
+            size_t _max_extent = 0;
+            AllocatorPolicy _allocator_policy = AllocatorPolicy::FIRST_FIT;
+            // the largest page size of the pool (for PAGE_ALIGNED)
+            size_t _page_alignment = (size_t)PageSize::BASE_4KB;
+        };
+
         void InitRegions(void *brk_region_base);
-        int DeallocateFromAnonymousMmapRegion(void*, size_t);
+        void InitAnonymousMmapPool(AnonymousMmapPool &pool, const char *name,
+                                   ConfigurationLoader &loader,
+                                   size_t ffa_list_size);
+        int FindAnonymousMmapPool(void *addr);
+        int DeallocateFromAnonymousMmapRegion(AnonymousMmapPool&, void*, size_t);
+        void* MapAnonymousRange(AnonymousMmapPool&, void*, size_t, int, bool);
+        int CommitAnonymousRange(AnonymousMmapPool&, void*, size_t, int);
+        int ProtectAnonymousRange(AnonymousMmapPool&, void*, size_t, int,
+                                  bool check_only = false);
+        int FreeAnonymousRange(AnonymousMmapPool&, void*, size_t);
+        int ReplaceAnonymousRange(AnonymousMmapPool&, void*, size_t, int);
+        int ShrinkAnonymousMmapPool(AnonymousMmapPool&, size_t threshold);
+        void* AllocateAcrossPoolEnd(void*, size_t, int, int, int, size_t);
         int DeallocateFromFileMmapRegion(void*, size_t);
-        void SetIntervalConfigList(PoolConfigurationData &configurationData, const char *config_file,
-                                   const char *pool_type);
+        int FreeFileMmapRange(void*, size_t, bool);
+        int ReserveFileMmapRange(void*, size_t);
+        void SetIntervalConfigList(PoolConfigurationData &configurationData);
+        void PreflightPools(ConfigurationLoader &loader,
+                            HugePagesConfiguration::PreflightPolicy policy);
+        int SetProgramBreak(void *addr);
+
+        /*
+         * PollControl is the safe point of the control channel: it is
+         * called by the pools operations before they take a pool lock, and
+         * applies the pending control commands (if any).
+         */
+        void PollControl() {
+            if (mosalloc_control_channel.IsPending()) {
+                ApplyControlCommands();
+            }
+        }
+        void ApplyControlCommands();
+        int RemapPoolInterval(const ControlChannel::Command &command);
+        void ProfileRegions();
 
 
         bool _isInitialized = false;
-        FirstFitAllocator _mmap_anon_ffa;
+        AnonymousMmapPool _anon_pools[MAX_ANONYMOUS_POOLS];
+        int _anon_pools_count = 0;
+        int _arena_pool = 0;
+        RoutingTable _routing_table;
         FirstFitAllocator _mmap_file_ffa;
-        HugePageBackedRegion _mmap_anon_hpbr;
         HugePageBackedRegion _mmap_file_hpbr;
+        HugePagesConfiguration::FileMmapMode _file_mmap_mode;
+        void* _mmap_file_base;
+        size_t _mmap_file_pool_size;
         HugePageBackedRegion _brk_hpbr;
+        // the program break, which is changed under _brk_mutex only
+        std::atomic<void*> _brk_top{nullptr};
         MemoryIntervalsValidator _intervals_configuration_validator;
 
         GlibcAllocationFunctions _glibc_funcs;
 
 #ifdef THREAD_SAFETY
-        std::mutex _anon_mmap_mutex;
         std::mutex _file_mmap_mutex;
         std::mutex _brk_mutex;
+        // the control commands are applied by a single thread at a time
+        std::mutex _control_mutex;
 #endif // THREAD_SAFETY
 
         bool _analyze_hpbrs;
-        size_t _anon_mmap_max_size;
+        HugePagesConfiguration::ForkPolicy _fork_policy;
+        bool _fork_passthrough;
         size_t _file_mmap_max_size;
+        size_t _file_mmap_bytes;
+        size_t _file_mmap_max_bytes;
+        size_t _file_mmap_aligned_bytes;
         size_t _brk_max_size;
+        std::chrono::nanoseconds _startup_time;
+        size_t _startup_retired_bytes;
+        // the profiling run (see LayoutProfiler.h); the profiled pools are
+        // the anonymous pools (by their indexes), brk and file
+        bool _profile;
+        size_t _profile_budget;
+        LayoutProfiler _profiler;
 
 };
 
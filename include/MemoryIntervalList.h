@@ -28,6 +28,16 @@ class MemoryIntervalList {
         void Initialize(MmapFuncPtr allocator,
                 MunmapFuncPtr deallocator,
                 size_t capcaity);
+        /*
+         * InitializeInPlace uses the given (sorted) intervals as the storage
+         * of the list, e.g., the intervals of a mapped binary layout file;
+         * the storage is not owned, so it is not freed by the list.
+         * The allocator and deallocator are used by the copies of the list.
+         */
+        void InitializeInPlace(MmapFuncPtr allocator,
+                MunmapFuncPtr deallocator,
+                MemoryInterval *intervals,
+                size_t length);
         ~MemoryIntervalList();
 
         size_t GetLength();
@@ -35,6 +45,29 @@ class MemoryIntervalList {
 
         void AddInterval(off_t start_offset, off_t end_offset, PageSize page_size);
         void Sort();
+        /*
+         * Coalesce merges adjacent intervals of the same page size (e.g.,
+         * the intervals of consecutive hugepages) in place, so the region is
+         * mapped by fewer mmap calls. The list must be sorted.
+         */
+        void Coalesce();
+        /*
+         * SetPageSize sets the page size of [start_offset, end_offset),
+         * splitting the intervals that it partially covers, and coalesces
+         * the list. The list must be sorted, and it is grown if needed.
+         */
+        void SetPageSize(off_t start_offset, off_t end_offset, PageSize page_size);
+        /*
+         * FillPageSize is SetPageSize that also adds intervals where there
+         * are none (e.g., the 4KB pages of a configuration list), so the
+         * whole range gets the page size.
+         */
+        void FillPageSize(off_t start_offset, off_t end_offset, PageSize page_size);
+        /*
+         * RemoveIntervalsOf removes the intervals of the given page size in
+         * place, keeping the order of the others.
+         */
+        void RemoveIntervalsOf(PageSize page_size);
         MemoryInterval* FirstIntervalOf(PageSize pageSize);
         void CopyMemoryIntervalsOf1GBTo(MemoryIntervalList &listToFillWith1GBIntervals);
         void CopyMemoryIntervalsOf2MBTo(MemoryIntervalList &listToFillWith2MBIntervals);
@@ -42,6 +75,8 @@ class MemoryIntervalList {
 
     private:
         void SwapIntetrvals(int i, int j);
+        void SiftDown(size_t root, size_t length);
+        void Reserve(size_t capacity);
         void* AllocateMemory(size_t size);
         int FreeMemory(void* addr, size_t size);
 
@@ -50,6 +85,7 @@ class MemoryIntervalList {
         size_t _list_length;
         MmapFuncPtr _mmap;
         MunmapFuncPtr _munmap;
+        bool _owns_storage;
 };
 
 #endif //_MEMORY_INTERVAL_LIST_H_
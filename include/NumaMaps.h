@@ -51,6 +51,8 @@ public:
 
     size_t GetTotalAnonymousMemory();
 
+    size_t GetResidentMemory(void *start_address, void *end_address);
+
     const MemoryRange &GetMemoryRange(void *start_address);
 
 private:
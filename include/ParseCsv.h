@@ -5,6 +5,9 @@
 #ifndef MOSALLOC_PARSECSV_H
 #define MOSALLOC_PARSECSV_H
 #include "PoolConfigurationData.h"
+#include <cstdio>
+#include <sys/mman.h>
+#include "RoutingTable.h"
 
 #include "globals.h"
 
@@ -24,12 +27,125 @@ public:
         |"brk", 2097152, ?, ?                           |
         |"file", -1 , 0 , ?                             |
 
+     or in the new format (detected by its header), with a row per pool:
+         ________________________________________________________________________________
+        |"pool_type", "pool_size", "ragions_list_2mb", "offset_2mb", "ragions_list_1gb", "offset_1gb" |
+        |"brk", 4GB, [0-512,1024], 0, [], 0                                              |
+        |"mmap", 200MB, [], 0, [], 0                                                     |
+     where sizes and offsets take an optional unit suffix (KB, MB or GB), and
+     the range lists hold the indexes of the hugepages (from the offset),
+     where a range excludes its end (e.g., [0-512] is the first 512 pages).
+     The hugepages must lie in the pool.
+
      * @param configurationData -- allocated object to put result inside.
      * @param path -- path to configuration file (csv)
      * @param poolType -- the pool type, support {"mmap", "brk", file")
      */
     static void ParseCsv(PoolConfigurationData& configurationData, const char* path, const char* poolType);
+    /***
+     This function parse the route rows of the csv file (see RoutingTable):
+         _______________________________________________
+        |"type", "pageSize", "startOffset", "endOffset" |
+        |"passthrough", route:exec, 0, -1               |
+        |"large", route:anon, 67108864, -1              |
+        |"small", route:anon, 0, 65536                  |
+
+     * @param routingTable -- allocated object to put result inside.
+     * @param path -- path to configuration file (csv)
+     */
+    static void ParseRoutes(RoutingTable& routingTable, const char* path);
     static int GetConfigFileMaxWindows(const char* path);
+    /*
+     * ParseSize parses a size with an optional unit suffix (KB, MB or GB, in
+     * any case), e.g., "4GB" or "1048576". It returns -1 on an invalid size
+     * (including a size that overflows).
+     */
+    static long long int ParseSize(const char *token);
+    /*
+     * The writers of the new format rows, for the layouts that are
+     * generated (see LayoutProfiler and LayoutOptimizer). The range list of
+     * each page size is written from the offset of its first interval
+     * (modulo the page size), so the intervals must be valid (see
+     * MemoryIntervalsValidator).
+     */
+    static void WriteHeader(FILE *file);
+    static void WritePoolRow(FILE *file, const char *poolType, size_t size,
+                             MemoryIntervalList &intervals);
+    static void WriteAllocatorRow(FILE *file, const char *poolType,
+                                  AllocatorPolicy policy);
+    static void WriteRoutes(FILE *file, const RoutingTable &routingTable);
+};
+
+#define MAX_CONFIGURATION_POOLS (16)
+
+// the sizes of the pools that an inline layout does not specify
+#define DEFAULT_MMAP_POOL_SIZE (4ul << 30)
+#define DEFAULT_BRK_POOL_SIZE (4ul << 30)
+#define DEFAULT_FILE_POOL_SIZE (1ul << 30)
+
+/*
+ * ConfigurationLoader reads the configuration file of all the pools at once:
+ * Load maps the file, counts its windows and parses it in a single pass
+ * (the layout and allocator rows into a PoolConfigurationData per pool, and
+ * the route rows into the routing table), and then unmaps it.
+ * An allocator row sets the allocator policy of an anonymous pool:
+ *     <pool>,allocator:<first-fit|last-fit|page-aligned>
+ * The rows of each pool are parsed as in parseCsv::ParseCsv, so both the
+ * legacy and the new formats are supported.
+ * A binary layout file (see BinaryLayout.h) is not parsed: it is kept mapped
+ * while the loader lives, and its interval arrays are the storage of the
+ * pools interval lists.
+ */
+class ConfigurationLoader {
+public:
+    ConfigurationLoader();
+    ~ConfigurationLoader();
+
+    void Load(const char* path, RoutingTable& routingTable,
+              MmapFuncPtr allocator = mmap, MunmapFuncPtr deallocator = munmap);
+    /*
+     * LoadInline reads the pools from a layout string (HPC_LAYOUT) rather
+     * than a file, e.g.:
+     *     "brk:4GB:2MB[0-1024];mmap:200MB;large:2GB:1GB[0]@4KB"
+     * The pools are separated by ';', and each one is
+     *     <pool>:<size>[:<page-size>[<range-list>][@<offset>]]...
+     * where the range lists are as in the new csv format (hugepages indexes
+     * from the offset, which is 0 by default), or a route, or an allocator
+     * policy (see AllocatorPolicy):
+     *     <pool>:route:<class>:<min-length>:<max-length>
+     *     <pool>:allocator:<first-fit|last-fit|page-aligned>
+     * Sizes take an optional unit suffix (KB, MB or GB). The mmap, brk and
+     * file pools that are not specified get the DEFAULT_*_POOL_SIZE sizes
+     * (with no hugepages). The string is parsed in place.
+     */
+    void LoadInline(const char* layout, RoutingTable& routingTable,
+                    MmapFuncPtr allocator = mmap,
+                    MunmapFuncPtr deallocator = munmap);
+    /*
+     * GetPool returns the configuration of the given pool, or an empty
+     * configuration (with no size and no intervals) if the file has no rows
+     * of this pool. It must be called after Load.
+     */
+    PoolConfigurationData& GetPool(const char* poolType);
+    int GetPoolsCount() { return _pools_count; }
+    PoolConfigurationData& At(int i);
+    const char* GetPoolName(int i);
+
+private:
+    int FindPool(const char* poolType);
+    void CheckPoolSizes();
+    int AddPool(const char* poolType, size_t intervals_capacity,
+                MmapFuncPtr allocator, MunmapFuncPtr deallocator);
+    void LoadBinaryLayout(RoutingTable& routingTable, MmapFuncPtr allocator,
+                          MunmapFuncPtr deallocator);
+
+    // the last entry is the empty configuration of the missing pools
+    PoolConfigurationData _pools[MAX_CONFIGURATION_POOLS + 1];
+    char _pool_names[MAX_CONFIGURATION_POOLS][MAX_POOL_NAME_LENGTH];
+    int _one_time_size[MAX_CONFIGURATION_POOLS];
+    int _pools_count;
+    char *_binary_layout;
+    size_t _binary_layout_size;
 };
 
 #endif //MOSALLOC_PARSECSV_H
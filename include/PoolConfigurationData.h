@@ -4,12 +4,33 @@
 
 #ifndef MOSALLOC_POOLCONFIGURATIONDATA_H
 #define MOSALLOC_POOLCONFIGURATIONDATA_H
+#include <cstdint>
 #include "MemoryIntervalList.h"
+
+/*
+ * The placement of the mappings of an anonymous pool:
+ * FIRST_FIT: the lowest free range that fits (the default).
+ * LAST_FIT: the highest free range that fits, e.g., for a pool whose
+ * hugepages are at its top.
+ * PAGE_ALIGNED: the lowest free range that starts at a boundary of the
+ * largest page size of the pool, so a large mapping (e.g., a hash table)
+ * is backed by the largest pages from its start.
+ */
+enum class AllocatorPolicy : uint32_t {
+    FIRST_FIT,
+    LAST_FIT,
+    PAGE_ALIGNED
+};
+
 class PoolConfigurationData {
 public:
     MemoryIntervalList intervalList;
     size_t size;
+    AllocatorPolicy allocatorPolicy;
     PoolConfigurationData();
     ~PoolConfigurationData() {}
+
+    static AllocatorPolicy ParseAllocatorPolicy(const char *policy);
+    static const char* GetAllocatorPolicyName(AllocatorPolicy policy);
 };
 #endif //MOSALLOC_POOLCONFIGURATIONDATA_H
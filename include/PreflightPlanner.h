@@ -0,0 +1,106 @@
+#ifndef MOSALLOC_PREFLIGHTPLANNER_H
+#define MOSALLOC_PREFLIGHTPLANNER_H
+
+#include <cstddef>
+#include <cstdint>
+#include "MemoryIntervalList.h"
+
+// the NUMA nodes are kept in a single word mask
+#define MAX_NUMA_NODES (64)
+#define SYSFS_ROOT "/sys"
+
+/*
+ * PreflightPlanner checks the hugepages that the layout of the pools needs
+ * against the free hugepages of the system before any pool is mapped, so a
+ * layout that does not fit is refused (or degraded) at startup, rather than
+ * failing in the middle of the run when its pool is extended.
+ * The demand of each hugepage size is the number of its pages in the
+ * intervals of the pools (the intervals are aligned to their page size, and
+ * the alignment padding of a region is mapped by 4KB pages, so every page
+ * of an interval is a page of demand and there is no other).
+ * The supply is read from sysfs: the free hugepages of each NUMA node, and
+ * the global reserved and overcommit counters. The hugepages that can be
+ * allocated are the free pages of the nodes that the memory policy (and the
+ * cpuset) allows, less the pages that are reserved by other mappings, plus
+ * the surplus pages that overcommit allows. The demand is placed on the
+ * nodes that the memory policy prefers (the preferred or interleaved nodes,
+ * or the node of the calling CPU), so a node that is short of pages is
+ * reported even if the other nodes can serve the pages remotely. The bound
+ * nodes fall back to each other, so they are checked by their total.
+ * Note that the supply is a snapshot: other processes may allocate (or
+ * free) hugepages after the check.
+ */
+class PreflightPlanner {
+public:
+    // the counters of a single hugepage size
+    struct HugePagesSupply {
+        uint64_t _free[MAX_NUMA_NODES];
+        uint64_t _global_free;
+        uint64_t _reserved;
+        uint64_t _overcommit;
+        uint64_t _surplus;
+    };
+
+    PreflightPlanner();
+
+    /*
+     * AddDemand adds the hugepages of a pool configuration. The list must be
+     * valid (see MemoryIntervalsValidator).
+     */
+    void AddDemand(MemoryIntervalList &intervalList);
+
+    /*
+     * ReadSupply reads the hugepages counters from sysfs. It returns 0 on
+     * success or -errno if the hugepages counters cannot be read.
+     */
+    int ReadSupply(const char *sysfs_root = SYSFS_ROOT);
+
+    /*
+     * ReadMemoryPolicy reads the nodes that the memory policy of the calling
+     * thread (and its cpuset) allows and prefers. It returns 0 on success or
+     * -errno on failure, in which case all the nodes are allowed.
+     */
+    int ReadMemoryPolicy();
+    // bind is set for MPOL_BIND, whose nodes are checked by their total
+    void SetMemoryPolicy(uint64_t allowed_nodes, uint64_t preferred_nodes,
+                         bool bind = false);
+
+    uint64_t GetDemand(PageSize page_size) const;
+    uint64_t GetNodeDemand(PageSize page_size, int node) const;
+    uint64_t GetAvailable(PageSize page_size) const;
+
+    // whether the hugepages of the layout can be allocated at all
+    bool Fits() const;
+    // whether the preferred nodes have the hugepages of the layout
+    bool FitsPreferredNodes() const;
+
+    /*
+     * Degrade trims a pool configuration to the hugepages that are left
+     * after the pools that were degraded before it: the 1GB pages that do
+     * not fit are backed by 2MB pages, and the 2MB pages that do not fit
+     * are backed by 4KB pages (i.e., their intervals are removed). The low
+     * offsets of a pool keep their page size, as they are used first.
+     */
+    void Degrade(MemoryIntervalList &intervalList);
+
+    // Report writes the demand and supply of each hugepage size to fd
+    void Report(int fd) const;
+
+private:
+    static int GetSizeIndex(PageSize page_size);
+    int ReadNodes(const char *sysfs_root);
+    off_t GrantPages(MemoryIntervalList &intervalList, PageSize page_size);
+    void ReportSize(int fd, PageSize page_size) const;
+
+    uint64_t _demand[2];
+    uint64_t _granted[2];
+    HugePagesSupply _supply[2];
+    // the nodes of the system, and the nodes the memory policy allows and
+    // prefers
+    uint64_t _nodes;
+    uint64_t _allowed_nodes;
+    uint64_t _preferred_nodes;
+    bool _bind;
+};
+
+#endif //MOSALLOC_PREFLIGHTPLANNER_H
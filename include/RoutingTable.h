@@ -0,0 +1,105 @@
+#ifndef MOSALLOC_ROUTINGTABLE_H
+#define MOSALLOC_ROUTINGTABLE_H
+
+#include <cstddef>
+#include "globals.h"
+
+#define MAX_ANONYMOUS_POOLS (16)
+#define MAX_ROUTES (64)
+#define MAX_POOL_NAME_LENGTH (32)
+
+#define DEFAULT_ANONYMOUS_POOL_NAME "mmap"
+#define FILE_POOL_NAME "file"
+#define BRK_POOL_NAME "brk"
+#define PASSTHROUGH_NAME "passthrough"
+#define ARENA_POOL_NAME "arena"
+
+/*
+ * RoutingTable dispatches mmap requests to the pools by their class and
+ * length. Each route is read from a configuration file row in the form:
+ *     <pool>,route:<class>,<min-length>,<max-length>
+ * where <class> is one of {anon, file, exec, stack}, the route matches
+ * requests of length in [min-length, max-length) (max-length = -1 means
+ * unlimited), and <pool> is the name of an anonymous pool, "file", or
+ * "passthrough" (which serves the request by the kernel).
+ * Routes are matched by their order in the file (the first matching route
+ * wins); a route whose pool cannot serve the request (e.g., an anonymous
+ * pool for a file-backed request) is skipped. Requests with no matching
+ * route are served by the default pools ("mmap" or "file").
+ * The anonymous pool "mmap" is always defined (at index 0), and any other
+ * anonymous pool that is used by some route is defined by that route (the
+ * pools that are configured but not routed are defined by AddPool, and are
+ * used by mosalloc_mmap_pool only).
+ */
+class RoutingTable {
+public:
+    enum class RouteClass {
+        ANONYMOUS,
+        FILE_BACKED,
+        EXECUTABLE,
+        STACK
+    };
+
+    enum class RouteTarget {
+        ANONYMOUS_POOL,
+        FILE_POOL,
+        PASSTHROUGH
+    };
+
+    struct Route {
+        RouteClass _class;
+        RouteTarget _target;
+        int _pool;
+        size_t _min_length;
+        size_t _max_length;
+    };
+
+    RoutingTable();
+    ~RoutingTable() {}
+
+    /**
+     * Adds a new route after the existing ones.
+     * @param route_class -- the class of the requests to match
+     * @param target -- pool name, "file", or "passthrough"
+     * @param min_length -- the minimal request length (inclusive)
+     * @param max_length -- the maximal request length (exclusive), or
+     *                      (size_t)-1 for unlimited length
+     */
+    void AddRoute(RouteClass route_class, const char *target,
+                  size_t min_length, size_t max_length);
+
+    /**
+     * Finds the pool to serve an mmap request.
+     * @param pool -- set to the anonymous pool index if the returned target
+     *                is RouteTarget::ANONYMOUS_POOL
+     */
+    RouteTarget Find(size_t length, int prot, int flags, int fd,
+                     int &pool) const;
+
+    /**
+     * Defines an anonymous pool (that is not used by any route) and returns
+     * its index.
+     */
+    int AddPool(const char *name);
+    // returns the index of the anonymous pool, or -1 if it is not defined
+    int FindPool(const char *name) const;
+
+    int GetPoolsCount() const { return _pools_count; }
+    const char* GetPoolName(int pool) const;
+    int GetRoutesCount() const { return _routes_count; }
+    const Route& At(int i) const;
+
+    static RouteClass ParseRouteClass(const char *route_class);
+    static const char* GetRouteClassName(RouteClass route_class);
+
+private:
+    static bool IsMatch(const Route &route, size_t length, int prot,
+                        int flags, int fd);
+
+    Route _routes[MAX_ROUTES];
+    int _routes_count;
+    char _pools[MAX_ANONYMOUS_POOLS][MAX_POOL_NAME_LENGTH];
+    int _pools_count;
+};
+
+#endif //MOSALLOC_ROUTINGTABLE_H
@@ -22,22 +22,25 @@
     char msg_buf[] = msg; \
     res |= write(STDERR_FILENO, msg_buf, sizeof(msg_buf)); \
     res |= write(STDERR_FILENO, "\n", 1); \
-    if (res) sync(); \
+    (void)res; \
     _exit(1); \
 }
 
-/* use write and sync for throwing exceptions because they are not allocating
- * new memory or calling memory allocations APIs like other printing APIs or
- * c++ std exceptions.
+/* use write for throwing exceptions because it is not allocating new memory
+ * or calling memory allocations APIs like other printing APIs or c++ std
+ * exceptions (and it is not buffered, so there is nothing to sync on exit).
  * Using or calling memory allocation APIs during thrwoing exceptions causes
  * infinite recursive calls to malloc (because these excpetions will be
  * thrown from malloc, or other allocation APIs)
+ * THROW_EXCEPTION is fatal, so it is used for configuration errors; the
+ * errors of serving requests are reported by REPORT_ERROR (see ErrorLog.h),
+ * whose policy may return them to the caller instead.
 */
 #define THROW_EXCEPTION(msg)    \
 {\
     char prefix_buf[] = "Exception thrown at: "; \
     ssize_t res = write(STDERR_FILENO, prefix_buf, sizeof(prefix_buf)); \
-    if (res) sync(); \
+    (void)res; \
     __WRITE_ERROR_AND_EXIT(msg) \
 }
 
@@ -54,6 +57,9 @@
 #define MMAP_FLAGS (MAP_PRIVATE | MAP_ANONYMOUS)
 #define MAP_HUGE_2MB    (21 << MAP_HUGE_SHIFT)
 #define MAP_HUGE_1GB    (30 << MAP_HUGE_SHIFT)
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
 
 enum class PageSize : size_t {
     BASE_4KB = 4096, // (1 << 12)
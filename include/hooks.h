@@ -24,6 +24,16 @@ int munmap(void *addr, size_t length) __THROW_EXCEPTION;
 int brk(void *addr) __THROW_EXCEPTION;
 void *sbrk(ptrdiff_t increment) __THROW_EXCEPTION;
 void *mosalloc_morecore(ptrdiff_t increment) __THROW_EXCEPTION;
+/*
+ * mosalloc_mmap_pool maps an anonymous private range of the given length
+ * from the named anonymous pool of the configuration (regardless of the
+ * routes), e.g., to place a TLB-critical data structure in a pool of its
+ * own. The range is released by munmap. On failure it returns MAP_FAILED
+ * and sets errno (EINVAL if there is no such pool, or if Mosalloc is not
+ * active).
+ */
+void *mosalloc_mmap_pool(const char *pool, size_t length,
+                         int prot) __THROW_EXCEPTION;
  
 #ifdef __cplusplus
 }  /* end of extern "C" */
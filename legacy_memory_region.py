@@ -1,7 +1,7 @@
 import sys
 from typing import List
 
-import pandas as pd
+import csv
 from collections import namedtuple
 
 IntervalData = namedtuple('IntervalData', ['type', 'page_size', 'start_offset', 'end_offset'])
@@ -58,9 +58,12 @@ class MemoryRegion:
 
     @staticmethod
     def get_list_interval_of_region(csv_config_file: str, region_type: str) -> List[IntervalData]:
-        config_data = pd.read_csv(csv_config_file)
-        return [IntervalData(row[1].type, row[1].pageSize, row[1].startOffset, row[1].endOffset)
-                for row in config_data.iterrows() if row[1].type == region_type]
+        with open(csv_config_file, newline='') as config_file:
+            config_data = list(csv.DictReader(config_file))
+        # the route rows are not part of the pools layout
+        return [IntervalData(row['type'], int(row['pageSize']), int(row['startOffset']), int(row['endOffset']))
+                for row in config_data
+                if row['type'] == region_type and not row['pageSize'].startswith('route:')]
 
     def get_num_of_large_pages(self):
         return self.get_num_of_page_size(LARGE_PAGE_SIZE)
@@ -1,13 +1,12 @@
 import sys
 import warnings
-import pandas as pd
 from enum import Enum
 from typing import NamedTuple
 
 class PageSize(Enum):
     BASE_PAGE_4KB = 1<<12
     HUGE_PAGE_2MB = 2<<20
-    HUGE_PAGE_1GB = 1<<20
+    HUGE_PAGE_1GB = 1<<30
 
 class Size:
     
@@ -66,10 +65,9 @@ class RegionsList:
         else:
             regions_list = RegionsList.list_from_str(self.regions_list_str)
         
-        print(f'===> regions_list: "{regions_list}" <===')
         orig_items_list = RegionsList.list_from_ranges(regions_list)
         # remove duplicates
-        self.items_list = list(set(orig_items_list))
+        self.items_list = sorted(set(orig_items_list))
         self.count = len(self.items_list)
         self.has_duplicates = len(orig_items_list) != len(self.items_list)
         # initialize regions_list after removing duplicates and sorting
@@ -79,20 +77,18 @@ class RegionsList:
         return self.count
     
     def get_region_absolute_values(self, item_size=1, offset=0):
-        ranges_pairs = set()
+        # a range excludes its end (as in list_from_ranges and the Mosalloc
+        # parser), so the range "start-end" ends at the page "end"
+        ranges_pairs = []
         for item_str in self.regions_list:
             if '-' in item_str:
                 start, end = map(int, item_str.split('-'))
-                weighted_range_start = start * item_size + offset
-                weighted_range_end = end * item_size + offset
-                pair = (weighted_range_start, weighted_range_end)
-                ranges_pairs.add(pair)
             else:
-                item_val = int(item_str)
-                weighted_range_start = item_val * item_size + offset
-                weighted_range_end = (item_val + 1) * item_size + offset
-                pair = (weighted_range_start, weighted_range_end)
-                ranges_pairs.add(pair)
+                start = int(item_str)
+                end = start + 1
+            weighted_range_start = start * item_size + offset
+            weighted_range_end = end * item_size + offset
+            ranges_pairs.append((weighted_range_start, weighted_range_end))
         return ranges_pairs
     
     @staticmethod
@@ -112,13 +108,13 @@ class RegionsList:
                 if start == end:
                     ranges.append(str(start))
                 else:
-                    ranges.append(f"{start}-{end}")
+                    ranges.append(f"{start}-{end + 1}")
                 start = lst[i]
                 end = lst[i]
         if start == end:
             ranges.append(str(start))
         else:
-            ranges.append(f"{start}-{end}")
+            ranges.append(f"{start}-{end + 1}")
         return ranges
 
     @staticmethod
@@ -129,9 +125,8 @@ class RegionsList:
                 ranges = RegionsList.list_from_str(ranges)
             if '-' in item:
                 start, end = map(int, item.split('-'))
-                lst.extend(range(start, end + 1))
+                lst.extend(range(start, end))
             else:
-                print(f'==> {item} ({type(item)})')
                 lst.append(int(item))
         return lst
     
@@ -154,6 +149,8 @@ class MosallocPool:
         brk = 1
         mmap = 2
         file = 3
+        # any other (named) anonymous pool
+        anon = 4
 
     class PoolMetadata(NamedTuple):
         pool_type: str
@@ -163,11 +160,12 @@ class MosallocPool:
         ragions_list_1gb: RegionsList
         offset_1gb: Size
 
-    def __init__(self, config_df: pd.DataFrame, pool_type: str):
-        self.config_df = config_df
+    def __init__(self, config_rows: list, pool_type: str):
+        self.config_rows = config_rows
         self.pool_type_str = pool_type
         self.pool_type = MosallocPool.str_too_pool_type(self.pool_type_str)
-        self.pool_row = self.config_df.query(f'pool_type == "{self.pool_type_str}"').iloc[0]
+        self.pool_row = next(row for row in self.config_rows
+                             if row['pool_type'] == self.pool_type_str)
         self.metadata = self.parse_metadata()
 
     def parse_metadata(self) -> PoolMetadata:
@@ -193,6 +191,8 @@ class MosallocPool:
             return MosallocPool.PoolType.mmap
         elif pool_type_str.lower() == 'file':
             return MosallocPool.PoolType.file
+        elif pool_type_str:
+            return MosallocPool.PoolType.anon
         else:
             raise KeyError(f'invalid PoolType: {pool_type_str}')
     
@@ -228,57 +228,50 @@ class MosallocPool:
 class MemoryLayout:
     def __init__(self, config_file_csv: str):
         self.config_file_name = config_file_csv
-        self.config_df = pd.read_csv(self.config_file_name)
-        self.brk_pool = MosallocPool(self.config_df, 'brk')
-        self.mmap_pool = MosallocPool(self.config_df, 'mmap')
-        self.file_pool = MosallocPool(self.config_df, 'file')
+        with open(self.config_file_name, newline='') as config_file:
+            # the range lists are bracketed, so commas inside them do not
+            # separate fields
+            self.config_rows = [MemoryLayout.parse_row(line)
+                                for line in config_file.read().splitlines()
+                                if line.strip()]
+        header = self.config_rows[0]
+        self.config_rows = [dict(zip(header, row)) for row in self.config_rows[1:]]
+        # the route and allocator rows do not define the layout of a pool
+        layout_rows = [row for row in self.config_rows
+                       if not row['pool_size'].startswith(('route:', 'allocator:'))]
+        pool_names = list(dict.fromkeys(row['pool_type'] for row in layout_rows))
+        self.pools = [MosallocPool(layout_rows, name) for name in pool_names]
+        self.brk_pool = MosallocPool(layout_rows, 'brk')
+        self.mmap_pool = MosallocPool(layout_rows, 'mmap')
+        self.file_pool = MosallocPool(layout_rows, 'file')
+
+    def get_hugepages_pools(self) -> list:
+        return [pool for pool in self.pools
+                if pool.pool_type != MosallocPool.PoolType.file]
+
+    @staticmethod
+    def parse_row(line: str) -> list:
+        fields = []
+        field = ''
+        brackets = 0
+        for c in line:
+            if c == ',' and brackets == 0:
+                fields.append(field.strip())
+                field = ''
+                continue
+            if c == '[':
+                brackets += 1
+            elif c == ']':
+                brackets -= 1
+            field += c
+        fields.append(field.strip())
+        return fields
     
     def get_total_hugepages_2mb(self) -> int:
-        return self.brk_pool.get_2mb_pages_count() + self.mmap_pool.get_2mb_pages_count()
+        return sum(pool.get_2mb_pages_count() for pool in self.get_hugepages_pools())
     
     def get_total_hugepages_1gb(self) -> int:
-        return self.brk_pool.get_1gb_pages_count() + self.mmap_pool.get_1gb_pages_count()
-
-    def get_legacy_pool_config_rows(self, pool: MosallocPool):
-        df = pd.DataFrame(columns=['type', 'pageSize', 'startOffset', 'endOffset'])
-        # add 2MB pages
-        offset_2mb = pool.get_2mb_regions_offset()
-        regions_2mb = pool.get_2mb_regions()
-        for start, end in regions_2mb.get_region_absolute_values(PageSize.HUGE_PAGE_2MB.value, offset_2mb):
-            range = pd.DataFrame([{'type': pool.pool_type.name, 
-                                  'pageSize': PageSize.HUGE_PAGE_2MB.value, 
-                                  'startOffset': start, 
-                                  'endOffset': end}])
-            df = pd.concat([df, range], ignore_index=True)
-        # add 1GB pages
-        offset_1gb = pool.get_1gb_regions_offset()
-        regions_1gb = pool.get_1gb_regions()
-        for start, end in regions_1gb.get_region_absolute_values(PageSize.HUGE_PAGE_1GB.value, offset_1gb):
-            range = pd.DataFrame([{'type': pool.pool_type.name, 
-                                  'pageSize': PageSize.HUGE_PAGE_1GB.value, 
-                                  'startOffset': start, 
-                                  'endOffset': end}])
-            df = pd.concat([df, range], ignore_index=True)
-        
-        return df
-            
-    def build_legacy_configuration_layout(self) -> pd.DataFrame:
-        df = pd.DataFrame(columns=['type', 'pageSize', 'startOffset', 'endOffset'])
-        # add pools sizes
-        brk_size_r = pd.DataFrame([{'type': 'brk', 'pageSize': -1, 'startOffset': 0, 'endOffset': self.brk_pool.get_pool_size()}])
-        mmap_size_r = pd.DataFrame([{'type': 'mmap', 'pageSize': -1, 'startOffset': 0, 'endOffset': self.mmap_pool.get_pool_size()}])
-        file_size_r = pd.DataFrame([{'type': 'file', 'pageSize': -1, 'startOffset': 0, 'endOffset': self.file_pool.get_pool_size()}])
-        df = pd.concat([df, brk_size_r, mmap_size_r, file_size_r], ignore_index=True)
-        
-        # add pools hugepages
-        brk_hugepages_df = self.get_legacy_pool_config_rows(self.brk_pool)
-        if len(brk_hugepages_df) > 0:
-            df = pd.concat([df, brk_hugepages_df], ignore_index=True)
-        mmap_hugepages_df = self.get_legacy_pool_config_rows(self.mmap_pool)
-        if len(mmap_hugepages_df) > 0:
-            df = pd.concat([df, mmap_hugepages_df], ignore_index=True)
-        
-        return df
+        return sum(pool.get_1gb_pages_count() for pool in self.get_hugepages_pools())
 
     @staticmethod
     def interleave_ranges(start1, end1, start2, end2):
@@ -319,7 +312,7 @@ class MemoryLayout:
             f"{pool.pool_type} pool's 1GB-region offset is not aligned with 4KB: {pool.get_1gb_regions_offset()}"
         if pool.get_1gb_regions_offset() > 0 and pool.get_2mb_regions_offset() > 0:
             offsets_delta = abs(pool.get_1gb_regions_offset() - pool.get_2mb_regions_offset())
-            assert MemoryLayout.is_aligned(offsets_delta, PageSize.BASE_PAGE_1GB.value), \
+            assert MemoryLayout.is_aligned(offsets_delta, PageSize.HUGE_PAGE_1GB.value), \
                 f"{pool.pool_type} pool's 1GB-region and 2MB-region offsets were set but un-aligned with 1GB. 2MB-region offset: {pool.get_2mb_regions_offset()}, 1GB-region offset: {pool.get_1gb_regions_offset()}"
             
         # 3) validate 2MB and 1GB regions do not interleave
@@ -330,8 +323,8 @@ class MemoryLayout:
                         f'{pool.pool_type} pool has interleave hugepage ranges: 2MB[{start_2mb}-{end_2mb}] - 1GB[{start_1gb}-{end_1gb}]'
         
     def validate_pools(self):
-        self.validate_pool_configuration(self.brk_pool)
-        self.validate_pool_configuration(self.mmap_pool)
+        for pool in self.get_hugepages_pools():
+            self.validate_pool_configuration(pool)
         # TODO: validate that file-mmap'ed pool has no hugepages
     
     @staticmethod
@@ -5,6 +5,7 @@ from subprocess import call
 import os
 import argparse
 import subprocess
+import struct
  
 def parse_arguments():
     parser = argparse.ArgumentParser(description='A tool to run applications while\
@@ -18,6 +19,20 @@ def parse_arguments():
                         help="mosalloc library path to preload.")
     parser.add_argument('-cpf', '--configuration_pools_file', required=True,
                         help="path to csv file with pools configuration")
+    parser.add_argument('-fmm', '--file_mmap_mode', choices=['pool', 'transparent'], default='pool',
+                        help="place file-backed mmaps in the file pool (pool) or in a reserved range on 2MB boundaries (transparent)")
+    parser.add_argument('-fp', '--fork_policy', choices=['keep', 'shrink', 'passthrough'], default='keep',
+                        help="pools handling in children forked without exec: keep them, shrink them, or shrink them and serve new mmaps by the kernel (passthrough)")
+    parser.add_argument('-ep', '--error_policy', choices=['exit', 'return'], default='exit',
+                        help="on a runtime error (e.g., a pool out of memory): exit, or fail the request with an error code")
+    parser.add_argument('-pf', '--preflight', choices=['off', 'warn', 'refuse', 'degrade'], default='warn',
+                        help="when the layout needs more hugepages than are free: run it as is (warn), exit (refuse), or back the missing hugepages by smaller pages (degrade)")
+    parser.add_argument('-cl', '--crash_log', default=None,
+                        help="path of a file that keeps the last pools operations (a ring buffer) for post-mortem analysis")
+    parser.add_argument('-ctl', '--control_file', default=None,
+                        help="path of a control file with page layout changes, which are applied when the program gets SIGUSR2")
+    parser.add_argument('-pb', '--profile_budget', default=None,
+                        help="run a profiling run that generates a layout (mosalloc_layout.<pid>.csv) for the given hugepages budget, e.g., 8GB")
     parser.add_argument('dispatch_program', help="program to execute")
     parser.add_argument('dispatch_args', nargs=argparse.REMAINDER,
                         help="program arguments")
@@ -51,20 +66,50 @@ def update_config_file():
         with open(config_file, 'w+') as file:
             file.write(current_config)
 
+BINARY_LAYOUT_MAGIC = b'MOSLAYOT'
+
+def is_binary_layout_file(config_file: str):
+    with open(config_file, 'rb') as f:
+        return f.read(len(BINARY_LAYOUT_MAGIC)) == BINARY_LAYOUT_MAGIC
+
+def get_binary_layout_hugepages(config_file: str):
+    """
+    returns the counts of the 2MB and 1GB hugepages of all the pools of a
+    binary layout file (see include/BinaryLayout.h)
+    """
+    with open(config_file, 'rb') as f:
+        data = f.read()
+    header_format = '=8sIIIIQ'
+    pool_format = '=32sQQQII'
+    interval_format = '=qqQ'
+    _, version, pools_count, _, _, _ = struct.unpack_from(header_format, data, 0)
+    assert version == 2, f'{config_file} binary layout version {version} is not supported!'
+    counts = {PageSize.HUGE_PAGE_2MB.value: 0, PageSize.HUGE_PAGE_1GB.value: 0}
+    pools_offset = struct.calcsize(header_format)
+    for p in range(pools_count):
+        _, _, intervals_offset, intervals_count, _, _ = struct.unpack_from(
+            pool_format, data, pools_offset + p * struct.calcsize(pool_format))
+        intervals_end = intervals_offset + intervals_count * struct.calcsize(interval_format)
+        for start, end, page_size in struct.iter_unpack(
+                interval_format, data[intervals_offset:intervals_end]):
+            counts[page_size] += (end - start) // page_size
+    return counts[PageSize.HUGE_PAGE_2MB.value], counts[PageSize.HUGE_PAGE_1GB.value]
+
 from memory_layout_config import *
 def run_benchmark(environ: dict, config_file: str, dispatch_program: str, dispatch_args: list, debug=False):
-    memory_layout = MemoryLayout(config_file)
-    memory_layout.validate_pools()
-    legacy_df = memory_layout.build_legacy_configuration_layout()
-    legacy_df.to_csv('legacy_config.csv', index=False)
-    # workaround until Mosalloc config parser moves to parse new format
-    environ.update({'HPC_CONFIGURATION_FILE': 'legacy_config.csv'})
-    
+    # Mosalloc parses the new format natively (HPC_CONFIGURATION_FILE), the
+    # layout is read here only to reserve its hugepages
+    if is_binary_layout_file(config_file):
+        hugepages_2mb_count, hugepages_1gb_count = get_binary_layout_hugepages(config_file)
+    else:
+        memory_layout = MemoryLayout(config_file)
+        memory_layout.validate_pools()
+        hugepages_2mb_count = memory_layout.get_total_hugepages_2mb()
+        hugepages_1gb_count = memory_layout.get_total_hugepages_1gb()
+
     # reserve an additional large/huge page so we can pad the pools with this
     # extra page and allow proper alignment of large/huge pages inside the pools
-    hugepages_2mb_count = memory_layout.get_total_hugepages_2mb()
     hugepages_2mb_count = hugepages_2mb_count + 1 if hugepages_2mb_count > 0 else hugepages_2mb_count
-    hugepages_1gb_count = memory_layout.get_total_hugepages_1gb()
     hugepages_1gb_count = hugepages_1gb_count + 1 if hugepages_1gb_count > 0 else hugepages_1gb_count
 
     try:
@@ -112,10 +157,9 @@ def legacy_run_benchmark(environ, config_file: str, dispatch_program: str, dispa
     except Exception as e:
         raise e
 
-import pandas as pd
 def is_legacy_config_file(config_file: str):
-    df = pd.read_csv(config_file)
-    config_file_cols = df.columns
+    with open(config_file) as f:
+        config_file_cols = [c.strip() for c in f.readline().split(',')]
     
     old_cols = ['type', 'pageSize', 'startOffset', 'endOffset']
     legacy_config = True
@@ -147,6 +191,16 @@ if __name__ == "__main__":
 
     if args.analyze:
         environ["HPC_ANALYZE_HPBRS"] = "1"
+    environ["HPC_FILE_MMAP_MODE"] = args.file_mmap_mode
+    environ["HPC_FORK_POLICY"] = args.fork_policy
+    environ["HPC_ERROR_POLICY"] = args.error_policy
+    environ["HPC_PREFLIGHT"] = args.preflight
+    if args.crash_log is not None:
+        environ["HPC_CRASH_LOG"] = args.crash_log
+    if args.control_file is not None:
+        environ["HPC_CONTROL_FILE"] = args.control_file
+    if args.profile_budget is not None:
+        environ["HPC_PROFILE_BUDGET"] = args.profile_budget
 
     environ.update(os.environ)
 
@@ -161,7 +215,9 @@ if __name__ == "__main__":
     #update_config_file()  #TODO: Alon&Yaron code, should be tested
     
     
-    legacy_mode = is_legacy_config_file(args.configuration_pools_file)
+    # binary layouts are converted from either format, and run as the new one
+    legacy_mode = not is_binary_layout_file(args.configuration_pools_file) and \
+        is_legacy_config_file(args.configuration_pools_file)
     if legacy_mode:
         # print deprecation warning
         msg = f'\n\t using old {sys.argv[0]} format is deprecated and will be removed in the future.' + '\n' + \
@@ -0,0 +1,216 @@
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <type_traits>
+#include "BinaryLayout.h"
+#include "ParseCsv.h"
+
+// the intervals are used in place, so their layout is part of the format
+static_assert(sizeof(MemoryInterval) == 24 &&
+              std::is_standard_layout<MemoryInterval>::value,
+              "MemoryInterval layout does not match the binary layout format");
+static_assert(sizeof(BinaryLayout::Header) % 8 == 0 &&
+              sizeof(BinaryLayout::Pool) % 8 == 0 &&
+              sizeof(BinaryLayout::PoolV1) % 8 == 0 &&
+              sizeof(BinaryLayout::Route) % 8 == 0,
+              "binary layout structures must keep the intervals aligned");
+
+// the size of a pool entry in the file of the header's version
+static size_t GetPoolEntrySize(const BinaryLayout::Header *header) {
+    return (header->_version == 1) ? sizeof(BinaryLayout::PoolV1)
+                                   : sizeof(BinaryLayout::Pool);
+}
+
+bool BinaryLayout::IsBinaryLayout(const char *file_mmap, size_t size) {
+    return size >= sizeof(Header) &&
+           !memcmp(file_mmap, BINARY_LAYOUT_MAGIC, sizeof(Header::_magic));
+}
+
+/*
+ * ValidateInterval checks an interval as the csv parser builds it (see
+ * MemoryIntervalsValidator): a known page size, and whole pages of it from a
+ * 4KB aligned start offset, inside the pool.
+ */
+static void ValidateInterval(const MemoryInterval &interval,
+                             uint64_t pool_size) {
+    PageSize page_size = interval._page_size;
+    if (page_size != PageSize::BASE_4KB && page_size != PageSize::HUGE_2MB &&
+        page_size != PageSize::HUGE_1GB) {
+        THROW_EXCEPTION("binary layout interval has an unknown page size");
+    }
+    if (interval._start_offset < 0 ||
+        interval._end_offset <= interval._start_offset ||
+        (uint64_t)interval._end_offset > pool_size) {
+        THROW_EXCEPTION("binary layout interval is out of its pool");
+    }
+    if (!IS_ALIGNED(interval._start_offset, PageSize::BASE_4KB) ||
+        !IS_ALIGNED(interval._end_offset - interval._start_offset, page_size)) {
+        THROW_EXCEPTION("binary layout interval is not aligned to its pages");
+    }
+}
+
+const BinaryLayout::Header* BinaryLayout::Validate(const char *file_mmap,
+                                                   size_t size) {
+    if (!IsBinaryLayout(file_mmap, size)) {
+        THROW_EXCEPTION("not a binary layout file");
+    }
+    const Header *header = reinterpret_cast<const Header*>(file_mmap);
+    if (header->_version < BINARY_LAYOUT_MIN_VERSION ||
+        header->_version > BINARY_LAYOUT_VERSION) {
+        THROW_EXCEPTION("unsupported binary layout version");
+    }
+    if (header->_file_size != size) {
+        THROW_EXCEPTION("binary layout file is truncated");
+    }
+    if (header->_pools_count > MAX_CONFIGURATION_POOLS ||
+        header->_routes_count > MAX_ROUTES) {
+        THROW_EXCEPTION("binary layout has too many pools or routes");
+    }
+    size_t tables_end = sizeof(Header) +
+                        header->_pools_count * GetPoolEntrySize(header) +
+                        header->_routes_count * sizeof(Route);
+    if (tables_end > size) {
+        THROW_EXCEPTION("binary layout file is corrupted!");
+    }
+
+    for (uint32_t p = 0; p < header->_pools_count; p++) {
+        const Pool pool = GetPool(header, p);
+        if (strnlen(pool._name, MAX_POOL_NAME_LENGTH) == MAX_POOL_NAME_LENGTH) {
+            THROW_EXCEPTION("pool name is too long");
+        }
+        if (pool._intervals_offset < tables_end ||
+            pool._intervals_offset > size ||
+            pool._intervals_offset % 8 != 0 ||
+            pool._intervals_count > (size - pool._intervals_offset) /
+                                    sizeof(MemoryInterval)) {
+            THROW_EXCEPTION("binary layout intervals are out of the file");
+        }
+        if (pool._allocator_policy >
+            static_cast<uint32_t>(AllocatorPolicy::PAGE_ALIGNED)) {
+            THROW_EXCEPTION("unknown allocator policy");
+        }
+        const MemoryInterval *intervals = GetIntervals(header, pool);
+        for (uint64_t i = 0; i < pool._intervals_count; i++) {
+            ValidateInterval(intervals[i], pool._size);
+            if (i > 0 &&
+                MemoryInterval::LessThan(intervals[i], intervals[i - 1])) {
+                THROW_EXCEPTION("binary layout intervals are not sorted");
+            }
+        }
+    }
+    const Route *routes = GetRoutes(header);
+    for (uint32_t r = 0; r < header->_routes_count; r++) {
+        if (strnlen(routes[r]._target, MAX_POOL_NAME_LENGTH) == MAX_POOL_NAME_LENGTH) {
+            THROW_EXCEPTION("route target is too long");
+        }
+        if (routes[r]._class > static_cast<uint32_t>(RoutingTable::RouteClass::STACK)) {
+            THROW_EXCEPTION("unknown route class");
+        }
+    }
+    return header;
+}
+
+BinaryLayout::Pool BinaryLayout::GetPool(const Header *header,
+                                         uint32_t index) {
+    const char *entry = reinterpret_cast<const char*>(header + 1) +
+                        index * GetPoolEntrySize(header);
+    Pool pool;
+    if (header->_version == 1) {
+        const PoolV1 *pool_v1 = reinterpret_cast<const PoolV1*>(entry);
+        memset(&pool, 0, sizeof(pool));
+        memcpy(pool._name, pool_v1->_name, sizeof(pool._name));
+        pool._size = pool_v1->_size;
+        pool._intervals_offset = pool_v1->_intervals_offset;
+        pool._intervals_count = pool_v1->_intervals_count;
+        pool._allocator_policy =
+                static_cast<uint32_t>(AllocatorPolicy::FIRST_FIT);
+    } else {
+        memcpy(&pool, entry, sizeof(pool));
+    }
+    return pool;
+}
+
+const BinaryLayout::Route* BinaryLayout::GetRoutes(const Header *header) {
+    return reinterpret_cast<const Route*>(
+            reinterpret_cast<const char*>(header + 1) +
+            header->_pools_count * GetPoolEntrySize(header));
+}
+
+MemoryInterval* BinaryLayout::GetIntervals(const Header *header,
+                                           const Pool &pool) {
+    return reinterpret_cast<MemoryInterval*>(
+            (char*)header + pool._intervals_offset);
+}
+
+static void WriteAll(int fd, const void *buffer, size_t size) {
+    const char *ptr = static_cast<const char*>(buffer);
+    while (size > 0) {
+        ssize_t written = write(fd, ptr, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            THROW_EXCEPTION("failed to write the binary layout file");
+        }
+        ptr += written;
+        size -= written;
+    }
+}
+
+void BinaryLayout::Write(const char *path, ConfigurationLoader &loader,
+                         const RoutingTable &routingTable) {
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header._magic, BINARY_LAYOUT_MAGIC, sizeof(header._magic));
+    header._version = BINARY_LAYOUT_VERSION;
+    header._pools_count = loader.GetPoolsCount();
+    header._routes_count = routingTable.GetRoutesCount();
+
+    uint64_t offset = sizeof(Header) + header._pools_count * sizeof(Pool) +
+                      header._routes_count * sizeof(Route);
+    Pool pools[MAX_CONFIGURATION_POOLS];
+    memset(pools, 0, sizeof(pools));
+    for (uint32_t p = 0; p < header._pools_count; p++) {
+        PoolConfigurationData &data = loader.At(p);
+        strcpy(pools[p]._name, loader.GetPoolName(p));
+        pools[p]._size = data.size;
+        pools[p]._intervals_offset = offset;
+        pools[p]._intervals_count = data.intervalList.GetLength();
+        pools[p]._allocator_policy =
+                static_cast<uint32_t>(data.allocatorPolicy);
+        offset += pools[p]._intervals_count * sizeof(MemoryInterval);
+    }
+    header._file_size = offset;
+
+    Route routes[MAX_ROUTES];
+    memset(routes, 0, sizeof(routes));
+    for (uint32_t r = 0; r < header._routes_count; r++) {
+        const RoutingTable::Route &route = routingTable.At(r);
+        const char *target = PASSTHROUGH_NAME;
+        if (route._target == RoutingTable::RouteTarget::FILE_POOL) {
+            target = FILE_POOL_NAME;
+        } else if (route._target == RoutingTable::RouteTarget::ANONYMOUS_POOL) {
+            target = routingTable.GetPoolName(route._pool);
+        }
+        strcpy(routes[r]._target, target);
+        routes[r]._class = static_cast<uint32_t>(route._class);
+        routes[r]._min_length = route._min_length;
+        routes[r]._max_length = route._max_length;
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        THROW_EXCEPTION("can not open the binary layout file");
+    }
+    WriteAll(fd, &header, sizeof(header));
+    WriteAll(fd, pools, header._pools_count * sizeof(Pool));
+    WriteAll(fd, routes, header._routes_count * sizeof(Route));
+    for (uint32_t p = 0; p < header._pools_count; p++) {
+        MemoryIntervalList &intervals = loader.At(p).intervalList;
+        if (intervals.GetLength() != 0) {
+            WriteAll(fd, &intervals.At(0),
+                     intervals.GetLength() * sizeof(MemoryInterval));
+        }
+    }
+    close(fd);
+}
@@ -0,0 +1,125 @@
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include "ControlChannel.h"
+#include "ParseCsv.h"
+
+ControlChannel mosalloc_control_channel;
+
+void ControlChannel::HandleSignal(int signal) {
+    (void)signal;
+    mosalloc_control_channel._pending.store(true, std::memory_order_relaxed);
+}
+
+int ControlChannel::Install(const char *path, int signal) {
+    _path = path;
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = HandleSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    if (sigaction(signal, &action, nullptr) != 0) {
+        return -errno;
+    }
+    return 0;
+}
+
+int ControlChannel::TakeCommands(Command *commands, int max_commands) {
+    if (!_pending.exchange(false, std::memory_order_acquire)) {
+        return 0;
+    }
+
+    char text[MAX_CONTROL_FILE_SIZE];
+    int fd = open(_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -errno;
+    }
+    size_t size = 0;
+    while (size < sizeof(text)) {
+        ssize_t res = read(fd, text + size, sizeof(text) - size);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res < 0) {
+            int err = errno;
+            close(fd);
+            return -err;
+        }
+        if (res == 0) {
+            break;
+        }
+        size += res;
+    }
+    close(fd);
+    return ParseCommands(text, size, commands, max_commands);
+}
+
+// copy the next word of the line to token, and return whether there is one
+static bool NextWord(const char *&p, const char *end, char *token,
+                     size_t token_size) {
+    for (; p < end && (*p == ' ' || *p == '\t'); p++);
+    size_t j = 0;
+    for (; p < end && *p != ' ' && *p != '\t'; p++) {
+        if (j + 1 >= token_size) {
+            return false;
+        }
+        token[j++] = *p;
+    }
+    token[j] = 0;
+    return j > 0;
+}
+
+int ControlChannel::ParseCommands(const char *text, size_t size,
+                                  Command *commands, int max_commands) {
+    int count = 0;
+    const char *end = text + size;
+    for (const char *line = text; line < end; ) {
+        const char *line_end = line;
+        for (; line_end < end && *line_end != '\n'; line_end++);
+        const char *p = line;
+        line = line_end + 1;
+
+        char token[MAX_POOL_NAME_LENGTH];
+        if (!NextWord(p, line_end, token, sizeof(token)) || token[0] == '#') {
+            continue;
+        }
+        if (count == max_commands) {
+            return -EINVAL;
+        }
+        Command &command = commands[count];
+        strcpy(command._pool, token);
+
+        long long int values[3];
+        for (int k = 0; k < 3; k++) {
+            if (!NextWord(p, line_end, token, sizeof(token))) {
+                return -EINVAL;
+            }
+            values[k] = parseCsv::ParseSize(token);
+            if (values[k] < 0) {
+                return -EINVAL;
+            }
+        }
+        if (NextWord(p, line_end, token, sizeof(token))) {
+            return -EINVAL;
+        }
+        command._start_offset = values[0];
+        command._end_offset = values[1];
+        command._page_size = static_cast<PageSize>(values[2]);
+        count++;
+    }
+    return count;
+}
+
+void ControlChannel::ReportResult(const Command &command, int result) {
+    // use write (rather than stdio, which may allocate memory)
+    const char *status = (result == 0) ? "done" : strerror(-result);
+    ssize_t res = 0;
+    res |= write(STDERR_FILENO, "mosalloc: control: remap of pool ", 33);
+    res |= write(STDERR_FILENO, command._pool, strlen(command._pool));
+    res |= write(STDERR_FILENO, ": ", 2);
+    res |= write(STDERR_FILENO, status, strlen(status));
+    res |= write(STDERR_FILENO, "\n", 1);
+    (void)res;
+}
@@ -0,0 +1,132 @@
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "ErrorLog.h"
+#include "globals.h"
+
+ErrorLog mosalloc_error_log;
+
+int ErrorLog::Open(const char *path, size_t capacity,
+                   MmapFuncPtr allocator, MunmapFuncPtr deallocator) {
+    if (_header != nullptr) {
+        return -EBUSY;
+    }
+    if (capacity == 0) {
+        return -EINVAL;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return -errno;
+    }
+    size_t size = ROUND_UP(sizeof(CrashLogHeader) +
+                           capacity * sizeof(CrashLogEntry),
+                           PageSize::BASE_4KB);
+    if (ftruncate(fd, size) != 0) {
+        int err = errno;
+        close(fd);
+        return -err;
+    }
+    // the mapping keeps the file open, and the file is zero-filled, so all
+    // the entries are initially empty
+    void *ptr = allocator(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                          fd, 0);
+    int err = errno;
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        return -err;
+    }
+
+    _header = static_cast<CrashLogHeader*>(ptr);
+    memcpy(_header->_magic, CRASH_LOG_MAGIC, sizeof(_header->_magic));
+    _header->_capacity = capacity;
+    _entries = reinterpret_cast<CrashLogEntry*>(_header + 1);
+    _mapped_size = size;
+    _deallocator = deallocator;
+    return 0;
+}
+
+void ErrorLog::Close() {
+    if (_header == nullptr) {
+        return;
+    }
+    void *ptr = _header;
+    _header = nullptr;
+    _entries = nullptr;
+    _deallocator(ptr, _mapped_size);
+    _mapped_size = 0;
+}
+
+void ErrorLog::RecordEntry(Operation operation, const void *address,
+                           size_t length, int32_t result) {
+    uint64_t sequence = _header->_next_sequence.fetch_add(
+            1, std::memory_order_relaxed) + 1;
+    CrashLogEntry &entry = _entries[(sequence - 1) % _header->_capacity];
+    // invalidate the entry while it is written
+    entry._sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    entry._operation = operation;
+    entry._result = result;
+    entry._address = (uint64_t)address;
+    entry._length = length;
+    entry._sequence.store(sequence, std::memory_order_release);
+}
+
+const ErrorLog::CrashLogEntry* ErrorLog::GetEntry(size_t i) const {
+    if (_header == nullptr) {
+        return nullptr;
+    }
+    uint64_t next = _header->_next_sequence.load(std::memory_order_acquire);
+    if (i >= next || i >= _header->_capacity) {
+        return nullptr;
+    }
+    uint64_t sequence = next - i;
+    const CrashLogEntry &entry = _entries[(sequence - 1) % _header->_capacity];
+    if (entry._sequence.load(std::memory_order_acquire) != sequence) {
+        return nullptr;
+    }
+    return &entry;
+}
+
+const char* ErrorLog::GetErrorName(MosallocError error) {
+    switch (error) {
+        case MosallocError::SUCCESS:
+            return "success";
+        case MosallocError::POOL_OUT_OF_MEMORY:
+            return "pool out of memory";
+        case MosallocError::MMAP_FAILED:
+            return "mmap failed";
+        case MosallocError::MUNMAP_FAILED:
+            return "munmap failed";
+        case MosallocError::MPROTECT_FAILED:
+            return "mprotect failed";
+    }
+    return "unknown error";
+}
+
+void ErrorLog::Report(MosallocError error, const char *function,
+                      const char *msg) {
+    int saved_errno = errno;
+    Record(Operation::ERROR, nullptr, 0, (int32_t)error);
+
+    // use write (rather than stdio, which may allocate memory), and do not
+    // sync: the message is not buffered, and the crash log is in the page
+    // cache already, so it is kept when the process exits
+    const char *error_name = GetErrorName(error);
+    ssize_t res = 0;
+    res |= write(STDERR_FILENO, "mosalloc: ", 10);
+    res |= write(STDERR_FILENO, error_name, strlen(error_name));
+    res |= write(STDERR_FILENO, " at ", 4);
+    res |= write(STDERR_FILENO, function, strlen(function));
+    res |= write(STDERR_FILENO, ": ", 2);
+    res |= write(STDERR_FILENO, msg, strlen(msg));
+    res |= write(STDERR_FILENO, "\n", 1);
+    (void)res;
+
+    if (_fail_fast) {
+        _exit(1);
+    }
+    errno = saved_errno;
+}
@@ -16,7 +16,6 @@
 // 1) defragmentation of memory region list
 //    i.e., check if there are two free nodes that can be combined to one
 //    contigious node 
-// 2) freeing partial region, i.e., start_region < free_ptr < end_region
 
 #ifdef THREAD_SAFETY
 #define MUTEX_GUARD(lock) std::lock_guard<std::mutex> guard(lock)
@@ -236,6 +235,145 @@ void *FirstFitAllocator::Allocate(size_t size) {
     return res;
 }
 
+void *FirstFitAllocator::AllocateFromFreeNode(int free_node,
+                                              int prev_free_node,
+                                              void *start,
+                                              size_t size) {
+    void *end = PTR_ADD(start, size);
+    int node = -1;
+    if (start == _array[free_node].start && end == _array[free_node].end) {
+        node = MoveNodeFromFeeListToOccupied(free_node, prev_free_node);
+    } else if (start == _array[free_node].start) {
+        node = AllocateMemoryRegionNode(-1, start, size);
+        if (node >= 0)
+            _array[free_node].start = end;
+    } else if (end == _array[free_node].end) {
+        node = AllocateMemoryRegionNode(-1, start, size);
+        if (node >= 0)
+            _array[free_node].end = start;
+    } else {
+        // the allocated region is in the middle of the free region, so the
+        // free region is split into two regions
+        int tail_node = FindFreeNode();
+        if (tail_node < 0) {
+            return NULL;
+        }
+        _array[tail_node].start = end;
+        _array[tail_node].end = _array[free_node].end;
+        _array[tail_node].next = _array[free_node].next;
+        node = AllocateMemoryRegionNode(-1, start, size);
+        if (node < 0) {
+            _array[tail_node].start = _array[tail_node].end = NULL;
+            _array[tail_node].next = -1;
+            return NULL;
+        }
+        _array[free_node].next = tail_node;
+        _array[free_node].end = start;
+    }
+    if (node < 0) {
+        return NULL;
+    }
+    return start;
+}
+
+void *FirstFitAllocator::AllocateAt(void *start, size_t size) {
+    MUTEX_GUARD(_ffa_mutex);
+
+    TRACE("AllocateAt - start: %p , size: %lu --> ", start, size);
+
+    assert(_is_initialized == true);
+
+    if (size == 0) {
+        return NULL;
+    }
+
+    void *res = NULL;
+    void *end = PTR_ADD(start, size);
+    int prev_i = -1;
+    for (int i = _free_head;
+         i >= 0;
+         prev_i = i, i = _array[i].next) {
+        if (_array[i].start > start) {
+            break;
+        }
+        if (end <= _array[i].end) {
+            res = AllocateFromFreeNode(i, prev_i, start, size);
+            break;
+        }
+    }
+    TRACE("%p\n", res);
+    RUN_VALIDATION();
+    return res;
+}
+
+void *FirstFitAllocator::AllocateAligned(size_t size, size_t alignment,
+                                         size_t skew) {
+    MUTEX_GUARD(_ffa_mutex);
+
+    TRACE("AllocateAligned - size: %lu, alignment: %lu, skew: %lu --> ",
+          size, alignment, skew);
+
+    assert(_is_initialized == true);
+
+    if (size == 0 || alignment == 0) {
+        return NULL;
+    }
+    skew = skew % alignment;
+
+    // find the first free node that fits the aligned region
+    void *res = NULL;
+    int prev_i = -1;
+    for (int i = _free_head;
+         i >= 0;
+         prev_i = i, i = _array[i].next) {
+        // the lowest address in the node that is equal to skew (mod alignment)
+        size_t node_start = (size_t)_array[i].start;
+        size_t start = node_start +
+                (skew + alignment - (node_start % alignment)) % alignment;
+        if (start + size <= (size_t)_array[i].end) {
+            res = AllocateFromFreeNode(i, prev_i, (void*)start, size);
+            break;
+        }
+    }
+    TRACE("%p\n", res);
+    RUN_VALIDATION();
+    return res;
+}
+
+void *FirstFitAllocator::AllocateFromTop(size_t size) {
+    MUTEX_GUARD(_ffa_mutex);
+
+    TRACE("AllocateFromTop - size: %lu --> ", size);
+
+    assert(_is_initialized == true);
+
+    if (size == 0) {
+        return NULL;
+    }
+
+    // find the last fit free node (the free list is sorted by addresses)
+    int last_fit = -1, prev_last_fit = -1;
+    int prev_i = -1;
+    for (int i = _free_head;
+         i >= 0;
+         prev_i = i, i = _array[i].next) {
+        size_t slot_size = (size_t) (PTR_SUB(_array[i].end, _array[i].start));
+        if (slot_size >= size) {
+            last_fit = i;
+            prev_last_fit = prev_i;
+        }
+    }
+
+    void *res = NULL;
+    if (last_fit >= 0) {
+        res = AllocateFromFreeNode(last_fit, prev_last_fit,
+                                   PTR_SUB(_array[last_fit].end, size), size);
+    }
+    TRACE("%p\n", res);
+    RUN_VALIDATION();
+    return res;
+}
+
 int FirstFitAllocator::AddFreedRegionToFreeList(void *start, size_t size) {
     assert(_is_initialized == true);
     // find a region that could be combined with the freed one
@@ -245,10 +383,19 @@ int FirstFitAllocator::AddFreedRegionToFreeList(void *start, size_t size) {
          prev_i = i, i = _array[i].next) {
         if (PTR_ADD(start, size) == _array[i].start) {
             _array[i].start = start;
+            // the freed region could also fill the gap to the previous node
+            if (prev_i >= 0 && _array[prev_i].end == start) {
+                CombineAdjacentFreeNodes();
+            }
             return 0;
         }
         if (_array[i].end == start) {
             _array[i].end = PTR_ADD(start, size);
+            // the freed region could also fill the gap to the next node
+            int next_i = _array[i].next;
+            if (next_i >= 0 && _array[next_i].start == _array[i].end) {
+                CombineAdjacentFreeNodes();
+            }
             return 0;
         }
     }
@@ -350,37 +497,82 @@ int FirstFitAllocator::FreeOccupiedRegionNode(int node) {
 int FirstFitAllocator::Free(void *start, size_t size) {
     MUTEX_GUARD(_ffa_mutex);
    
-    int res = -100;
-
     TRACE("Free - start: %p , size: %lu\n", start, size);
 
+    return FreeLocked(start, size);
+}
+
+int FirstFitAllocator::FreeLocked(void *start, size_t size) {
+    int res = -100;
+
     assert(_is_initialized == true);
     int node = FindOccupiedMemoryRegionNode(start);
     if (node < 0) {
         return node;
     }
-    size_t node_size = (size_t) (PTR_SUB(_array[node].end, _array[node].start));
-    if (node_size < size) {
+    void *end = PTR_ADD(start, size);
+    if (end > _array[node].end) {
+        size_t node_size = (size_t) (PTR_SUB(_array[node].end, start));
         fprintf(stderr, "FirstFitAllocator::Free - [Error]: missmatch sizes\n");
         fprintf(stderr, "\tFree(%p) - node_size: %lu , free_size: %lu\n", start, node_size, size);
         return -2;
     }
-    if (node_size == size) {
+    if (start == _array[node].start && end == _array[node].end) {
         res = FreeOccupiedRegionNode(node);
         if (res < 0) {
             RUN_VALIDATION();
             return res;
         }
+    } else if (start == _array[node].start) {
+        _array[node].start = end;
+    } else if (end == _array[node].end) {
+        _array[node].end = start;
     } else {
-        // TODO: handle freeing memory region from the middle, i.e.,
+        // freeing memory region from the middle, i.e.,
         // region_start < free_ptr < region_end
-        _array[node].start = PTR_ADD(_array[node].start, size);
+        // split the occupied region into two regions
+        void *region_end = _array[node].end;
+        int tail_node = AllocateMemoryRegionNode(-1, end,
+                                                 (size_t) (PTR_SUB(region_end, end)));
+        if (tail_node < 0) {
+            return tail_node;
+        }
+        _array[node].end = start;
     }
     res = AddFreedRegionToFreeList(start, size);
     RUN_VALIDATION();
     return res;
 }
 
+int FirstFitAllocator::FreeRange(void *start, size_t size) {
+    MUTEX_GUARD(_ffa_mutex);
+
+    TRACE("FreeRange - start: %p , size: %lu\n", start, size);
+
+    assert(_is_initialized == true);
+    void *end = PTR_ADD(start, size);
+    // the occupied list is sorted, so free its overlapping regions in order
+    int i = _occupied_head;
+    while (i >= 0) {
+        if (_array[i].start >= end) {
+            break;
+        }
+        int next = _array[i].next;
+        if (_array[i].end > start) {
+            void *free_start = (_array[i].start > start) ? _array[i].start : start;
+            void *free_end = (_array[i].end < end) ? _array[i].end : end;
+            int res = FreeLocked(free_start, (size_t) (PTR_SUB(free_end, free_start)));
+            if (res < 0) {
+                return res;
+            }
+            // the list could be changed, so start over from its head
+            next = _occupied_head;
+        }
+        i = next;
+    }
+    return 0;
+}
+
 FirstFitAllocator::FirstFitAllocator(bool enable_validation, 
                                      bool enable_tracing) 
     : _is_initialized(false), 
@@ -403,12 +595,15 @@ FirstFitAllocator::FirstFitAllocator(bool enable_validation,
 }
 
 FirstFitAllocator::~FirstFitAllocator() {
-    _is_initialized = false;
-    
     if (_enable_tracing && _log_file) {
         fclose(_log_file);
     }
 
+    if (_is_initialized == false) {
+        return;
+    }
+    _is_initialized = false;
+
     size_t aligned_array_size = _len * sizeof(MC);
     aligned_array_size = (4096 - (aligned_array_size % 4096))
                          + aligned_array_size;
@@ -430,6 +625,19 @@ size_t FirstFitAllocator::GetFreeSpace() {
     return sum;
 }
 
+bool FirstFitAllocator::FindFreeRegion(void *addr, void **start, void **end) {
+    MUTEX_GUARD(_ffa_mutex);
+
+    assert(_is_initialized == true);
+    int node = FindFreeMemoryRegionNode(addr);
+    if (node < 0) {
+        return false;
+    }
+    *start = _array[node].start;
+    *end = _array[node].end;
+    return true;
+}
+
 void *FirstFitAllocator::GetTopAddress() {
     MUTEX_GUARD(_ffa_mutex);
     
@@ -445,6 +653,24 @@ void *FirstFitAllocator::GetTopAddress() {
     return top_addr;
 }
 
+void *FirstFitAllocator::GetEndAddress() {
+    assert(_is_initialized == true);
+    return _end;
+}
+
+unsigned int FirstFitAllocator::GetFreeNodesCount() {
+    MUTEX_GUARD(_ffa_mutex);
+
+    assert(_is_initialized == true);
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < _len; i++) {
+        if (_array[i].start == NULL) {
+            count++;
+        }
+    }
+    return count;
+}
+
 bool FirstFitAllocator::Contains(void *addr) {
     assert(_is_initialized == true);
     return (addr >= _start && addr < _end);
@@ -1,5 +1,7 @@
 #include <stdexcept>
+#include <errno.h>
 #include <sys/mman.h>
+#include <sys/prctl.h>
 #include <system_error>
 #include <algorithm>
 #include <assert.h>
@@ -7,6 +9,13 @@
 
 #include "HugePageBackedRegion.h"
 
+#ifndef PR_SET_VMA
+#define PR_SET_VMA 0x53564d41
+#define PR_SET_VMA_ANON_NAME 0
+#endif
+
+#define VMA_NAME_PREFIX "mosalloc:"
+
 
 void* HugePageBackedRegion::RegionIntervalListMemAlloc(size_t s) {
     assert(_memory_allocator != nullptr);
@@ -37,22 +46,50 @@ void *HugePageBackedRegion::AllocateMemory(void *start_address,
     }
     void *ptr = _memory_allocator(start_address, len, MMAP_PROTECTION, mmap_flags, -1, 0);
     if (ptr == MAP_FAILED) {
-        std::error_code ec(errno, std::generic_category());
-        THROW_EXCEPTION("failed to allocate memory by mmap");
+        // e.g., there are not enough free hugepages
+        return MAP_FAILED;
     }
+    NameMemory(ptr, len, page_size);
 
     return ptr;
 }
 
-void HugePageBackedRegion::DeallocateMemory(void *addr, size_t len) {
-    if (len == 0) {
+void HugePageBackedRegion::NameMemory(void *addr, size_t len,
+                                      PageSize page_size) {
+    if (_name[0] == '\0') {
         return;
     }
+    const char *page_size_name = "4KB";
+    if (page_size == PageSize::HUGE_1GB) {
+        page_size_name = "1GB";
+    } else if (page_size == PageSize::HUGE_2MB) {
+        page_size_name = "2MB";
+    }
+    // build the name without snprintf, which may allocate memory
+    char vma_name[sizeof(VMA_NAME_PREFIX) + MAX_REGION_NAME_LENGTH + 4];
+    strcpy(vma_name, VMA_NAME_PREFIX);
+    strcat(vma_name, _name);
+    strcat(vma_name, ":");
+    strcat(vma_name, page_size_name);
+    // the name is only a debugging aid, so ignore failures (e.g., kernels
+    // older than 5.17) and keep the errno of the caller
+    int saved_errno = errno;
+    prctl(PR_SET_VMA, PR_SET_VMA_ANON_NAME, addr, len, vma_name);
+    errno = saved_errno;
+}
+
+int HugePageBackedRegion::DeallocateMemory(void *addr, size_t len) {
+    if (len == 0) {
+        return 0;
+    }
 
     if (_memory_deallocator(addr, len) != 0) {
-        std::error_code ec(errno, std::generic_category());
-        THROW_EXCEPTION("failed to unmap allocated memory by munmap");
+        int err = errno;
+        REPORT_ERROR(MosallocError::MUNMAP_FAILED,
+                     "failed to unmap allocated memory by munmap");
+        return -err;
     }
+    return 0;
 }
 
 size_t HugePageBackedRegion::ExtendRegion(size_t new_size) {
@@ -81,9 +118,11 @@ size_t HugePageBackedRegion::ExtendRegion(size_t new_size) {
             } else {
                 end_offset = interval._end_offset;
             }
-            AllocateMemory((void *) ((size_t) _region_start + start_offset),
-                           end_offset - start_offset,
-                           interval._page_size);
+            // the committed ranges above the region size are kept as is
+            if (MapPages(start_offset, end_offset, interval._page_size) != 0) {
+                // the region is extended up to the failed interval
+                break;
+            }
             updated_region_size = (size_t) end_offset;
         }
     }
@@ -127,18 +166,446 @@ size_t HugePageBackedRegion::ShrinkRegion(size_t new_size) {
     return updated_region_size;
 }
 
-HugePageBackedRegion::HugePageBackedRegion() : _initialized(false) {}
+int HugePageBackedRegion::GetPageProtection(off_t start_offset, size_t len) {
+    off_t end_offset = start_offset + len;
+    int prot = PROT_NONE;
+    size_t covered_len = 0;
+    for (size_t i = 0; i < _protection_ranges_length; i++) {
+        ProtectionRange& range = _protection_ranges[i];
+        if (range._end_offset <= start_offset || range._start_offset >= end_offset) {
+            continue;
+        }
+        off_t overlap_start = std::max(range._start_offset, start_offset);
+        off_t overlap_end = std::min(range._end_offset, end_offset);
+        covered_len += overlap_end - overlap_start;
+        prot |= range._prot;
+    }
+    // parts of the page that are not covered by any range have the default
+    // protection
+    if (covered_len < len) {
+        prot |= MMAP_PROTECTION;
+    }
+    return prot;
+}
+
+/*
+ * HasProtection checks whether all of [start_offset, end_offset) has the
+ * given protection (either recorded or the default one).
+ */
+bool HugePageBackedRegion::HasProtection(off_t start_offset, off_t end_offset,
+                                         int prot) {
+    size_t covered_len = 0;
+    for (size_t i = 0; i < _protection_ranges_length; i++) {
+        ProtectionRange& range = _protection_ranges[i];
+        if (range._end_offset <= start_offset || range._start_offset >= end_offset) {
+            continue;
+        }
+        if (range._prot != prot) {
+            return false;
+        }
+        off_t overlap_start = std::max(range._start_offset, start_offset);
+        off_t overlap_end = std::min(range._end_offset, end_offset);
+        covered_len += overlap_end - overlap_start;
+    }
+    return covered_len == (size_t) (end_offset - start_offset)
+        || prot == MMAP_PROTECTION;
+}
+
+/*
+ * CheckPartialPages returns -EINVAL if [start_offset, end_offset) covers a
+ * huge page partially and the rest of the page does not have the given
+ * protection, as the page cannot be split.
+ */
+int HugePageBackedRegion::CheckPartialPages(off_t start_offset,
+                                            off_t end_offset,
+                                            int prot) {
+    size_t intervals_length = _region_intervals.GetLength();
+    for (unsigned int i = 0; i < intervals_length; i++) {
+        MemoryInterval& interval = _region_intervals.At(i);
+        if (interval._end_offset <= start_offset
+            || interval._start_offset >= end_offset
+            || interval._page_size == PageSize::BASE_4KB) {
+            continue;
+        }
+        size_t page_size = static_cast<size_t>(interval._page_size);
+        off_t head_page_offset = interval._start_offset + ROUND_DOWN(
+            std::max(start_offset, interval._start_offset) - interval._start_offset,
+            page_size);
+        off_t tail_page_end_offset = interval._start_offset + ROUND_UP(
+            std::min(end_offset, interval._end_offset) - interval._start_offset,
+            page_size);
+        if (head_page_offset < start_offset
+            && !HasProtection(head_page_offset, start_offset, prot)) {
+            return -EINVAL;
+        }
+        if (tail_page_end_offset > end_offset
+            && !HasProtection(end_offset, tail_page_end_offset, prot)) {
+            return -EINVAL;
+        }
+    }
+    return 0;
+}
+
+int HugePageBackedRegion::ProtectPage(off_t start_offset, size_t len) {
+    int prot = GetPageProtection(start_offset, len);
+    // the parts of a page always have the same protection (see Protect)
+    if (!HasProtection(start_offset, start_offset + len, prot)) {
+        return -EINVAL;
+    }
+    void *addr = (void *) ((size_t) _region_start + start_offset);
+    if (_memory_protector(addr, len, prot) != 0) {
+        return -errno;
+    }
+    return 0;
+}
+
+int HugePageBackedRegion::ApplyProtection(off_t start_offset,
+                                          off_t end_offset,
+                                          int prot) {
+    // memory that is not committed yet gets its protection when it is
+    // committed
+    int res = 0;
+    if ((size_t) start_offset < _region_current_size) {
+        res = ApplyMappedProtection(start_offset,
+                                    std::min(end_offset, (off_t) _region_current_size),
+                                    prot);
+    }
+    for (size_t i = 0; i < _committed_ranges_length && res == 0; i++) {
+        CommittedRange& range = _committed_ranges[i];
+        if (range._end_offset <= start_offset || range._start_offset >= end_offset) {
+            continue;
+        }
+        res = ApplyMappedProtection(std::max(range._start_offset, start_offset),
+                                    std::min(range._end_offset, end_offset),
+                                    prot);
+    }
+    return res;
+}
+
+int HugePageBackedRegion::ApplyMappedProtection(off_t start_offset,
+                                                off_t end_offset,
+                                                int prot) {
+    size_t intervals_length = _region_intervals.GetLength();
+    for (unsigned int i = 0; i < intervals_length && start_offset < end_offset; i++) {
+        MemoryInterval& interval = _region_intervals.At(i);
+        if (interval._end_offset <= start_offset
+            || interval._start_offset >= end_offset) {
+            continue;
+        }
+        size_t page_size = static_cast<size_t>(interval._page_size);
+        size_t start_addr = (size_t) _region_start
+            + std::max(start_offset, interval._start_offset);
+        size_t end_addr = (size_t) _region_start
+            + std::min(end_offset, interval._end_offset);
+        size_t aligned_start_addr = ROUND_UP(start_addr, page_size);
+        size_t aligned_end_addr = ROUND_DOWN(end_addr, page_size);
+        if (aligned_start_addr < aligned_end_addr) {
+            if (_memory_protector((void *) aligned_start_addr,
+                                  aligned_end_addr - aligned_start_addr,
+                                  prot) != 0) {
+                return -errno;
+            }
+        }
+        // huge pages that are covered partially by the range cannot be
+        // split, so protect them as a whole (all of their parts have the
+        // same protection)
+        int res = 0;
+        size_t head_page_addr = ROUND_DOWN(start_addr, page_size);
+        size_t tail_page_addr = ROUND_DOWN(end_addr, page_size);
+        if (start_addr != aligned_start_addr) {
+            res = ProtectPage(head_page_addr - (size_t) _region_start, page_size);
+        }
+        if (res == 0 && end_addr != aligned_end_addr
+            && (start_addr == aligned_start_addr || tail_page_addr != head_page_addr)) {
+            res = ProtectPage(tail_page_addr - (size_t) _region_start, page_size);
+        }
+        if (res != 0) {
+            return res;
+        }
+    }
+    return 0;
+}
+
+int HugePageBackedRegion::ApplyProtectionRanges(off_t start_offset,
+                                                off_t end_offset) {
+    for (size_t i = 0; i < _protection_ranges_length; i++) {
+        ProtectionRange& range = _protection_ranges[i];
+        if (range._end_offset <= start_offset || range._start_offset >= end_offset) {
+            continue;
+        }
+        int res = ApplyProtection(std::max(range._start_offset, start_offset),
+                                  std::min(range._end_offset, end_offset),
+                                  range._prot);
+        if (res != 0) {
+            return res;
+        }
+    }
+    return 0;
+}
+
+void HugePageBackedRegion::InsertProtectionRange(const ProtectionRange& range) {
+    assert(_protection_ranges_length < MAX_PROTECTION_RANGES);
+    // keep the ranges sorted by their start offsets
+    size_t i = _protection_ranges_length;
+    while (i > 0 && _protection_ranges[i - 1]._start_offset > range._start_offset) {
+        _protection_ranges[i] = _protection_ranges[i - 1];
+        i--;
+    }
+    _protection_ranges[i] = range;
+    _protection_ranges_length++;
+}
+
+int HugePageBackedRegion::SetProtectionRange(off_t start_offset,
+                                             off_t end_offset,
+                                             int prot) {
+    if (_protection_ranges == nullptr) {
+        return -ENOMEM;
+    }
+    // Check first that there is enough room for the updated ranges: an
+    // existing range could be split into two and a new range is added
+    // unless the default protection is restored
+    size_t removed_ranges = 0;
+    size_t added_ranges = (prot == MMAP_PROTECTION) ? 0 : 1;
+    for (size_t i = 0; i < _protection_ranges_length; i++) {
+        ProtectionRange& range = _protection_ranges[i];
+        if (range._start_offset >= start_offset && range._end_offset <= end_offset) {
+            removed_ranges++;
+        } else if (range._start_offset < start_offset && range._end_offset > end_offset) {
+            added_ranges++;
+        }
+    }
+    if (_protection_ranges_length + added_ranges - removed_ranges
+        > MAX_PROTECTION_RANGES) {
+        return -ENOMEM;
+    }
+
+    // Trim (or drop) all ranges that overlap the new one
+    bool is_split = false;
+    ProtectionRange split_range;
+    size_t length = 0;
+    for (size_t i = 0; i < _protection_ranges_length; i++) {
+        ProtectionRange range = _protection_ranges[i];
+        if (range._end_offset > start_offset && range._start_offset < end_offset) {
+            if (range._start_offset < start_offset && range._end_offset > end_offset) {
+                split_range._start_offset = end_offset;
+                split_range._end_offset = range._end_offset;
+                split_range._prot = range._prot;
+                is_split = true;
+                range._end_offset = start_offset;
+            } else if (range._start_offset < start_offset) {
+                range._end_offset = start_offset;
+            } else if (range._end_offset > end_offset) {
+                range._start_offset = end_offset;
+            } else {
+                continue;
+            }
+        }
+        _protection_ranges[length++] = range;
+    }
+    _protection_ranges_length = length;
+
+    if (is_split) {
+        InsertProtectionRange(split_range);
+    }
+    if (prot != MMAP_PROTECTION) {
+        ProtectionRange range;
+        range._start_offset = start_offset;
+        range._end_offset = end_offset;
+        range._prot = prot;
+        InsertProtectionRange(range);
+    }
+
+    // Merge adjacent ranges with the same protection
+    length = 0;
+    for (size_t i = 0; i < _protection_ranges_length; i++) {
+        ProtectionRange& range = _protection_ranges[i];
+        if (length > 0
+            && _protection_ranges[length - 1]._end_offset == range._start_offset
+            && _protection_ranges[length - 1]._prot == range._prot) {
+            _protection_ranges[length - 1]._end_offset = range._end_offset;
+        } else {
+            _protection_ranges[length++] = range;
+        }
+    }
+    _protection_ranges_length = length;
+
+    return 0;
+}
+
+int HugePageBackedRegion::Protect(void *addr, size_t len, int prot) {
+    assert(_initialized);
+
+    if (!IS_ALIGNED(addr, PageSize::BASE_4KB)) {
+        return -EINVAL;
+    }
+    if (len == 0) {
+        return 0;
+    }
+    off_t start_offset = (off_t) addr - (off_t) _region_start;
+    off_t end_offset = start_offset + ROUND_UP(len, PageSize::BASE_4KB);
+    if (addr < _region_start || (size_t) end_offset > _region_max_size) {
+        return -ENOMEM;
+    }
+
+    // most of the memory has the default protection, so avoid calling
+    // mprotect when it is not changed
+    if (prot == MMAP_PROTECTION && HasProtection(start_offset, end_offset, prot)) {
+        return 0;
+    }
+
+    int res = CheckPartialPages(start_offset, end_offset, prot);
+    if (res != 0) {
+        return res;
+    }
+    res = SetProtectionRange(start_offset, end_offset, prot);
+    if (res != 0) {
+        return res;
+    }
+    return ApplyProtection(start_offset, end_offset, prot);
+}
+
+int HugePageBackedRegion::ResetProtection(void *addr, size_t len) {
+    assert(_initialized);
+
+    off_t start_offset = (off_t) addr - (off_t) _region_start;
+    off_t end_offset = start_offset + ROUND_UP(len, PageSize::BASE_4KB);
+
+    // Most of the memory has the default protection, so avoid calling
+    // mprotect when no protection was set inside the range
+    bool is_protected = false;
+    for (size_t i = 0; i < _protection_ranges_length; i++) {
+        ProtectionRange& range = _protection_ranges[i];
+        if (range._end_offset > start_offset && range._start_offset < end_offset) {
+            is_protected = true;
+            break;
+        }
+    }
+    if (!is_protected) {
+        return 0;
+    }
+
+    // only the huge pages that are covered entirely are reset, the rest of
+    // a partially covered page is still in use
+    size_t intervals_length = _region_intervals.GetLength();
+    for (unsigned int i = 0; i < intervals_length; i++) {
+        MemoryInterval& interval = _region_intervals.At(i);
+        if (interval._end_offset <= start_offset
+            || interval._start_offset >= end_offset) {
+            continue;
+        }
+        size_t page_size = static_cast<size_t>(interval._page_size);
+        off_t reset_start_offset = interval._start_offset + ROUND_UP(
+            std::max(start_offset, interval._start_offset) - interval._start_offset,
+            page_size);
+        off_t reset_end_offset = interval._start_offset + ROUND_DOWN(
+            std::min(end_offset, interval._end_offset) - interval._start_offset,
+            page_size);
+        if (reset_start_offset >= reset_end_offset) {
+            continue;
+        }
+        int res = SetProtectionRange(reset_start_offset, reset_end_offset,
+                                     MMAP_PROTECTION);
+        if (res == 0) {
+            res = ApplyProtection(reset_start_offset, reset_end_offset,
+                                  MMAP_PROTECTION);
+        }
+        if (res != 0) {
+            return res;
+        }
+    }
+    return 0;
+}
+
+int HugePageBackedRegion::Clear(void *addr, size_t len) {
+    assert(_initialized);
+
+    off_t start_offset = (off_t) addr - (off_t) _region_start;
+    off_t end_offset = start_offset + (off_t) len;
+    int res = 0;
+    if ((size_t) start_offset < _region_current_size) {
+        res = ClearMapped(start_offset,
+                          std::min(end_offset, (off_t) _region_current_size));
+    }
+    for (size_t i = 0; i < _committed_ranges_length && res == 0; i++) {
+        CommittedRange& range = _committed_ranges[i];
+        if (range._end_offset <= start_offset || range._start_offset >= end_offset) {
+            continue;
+        }
+        res = ClearMapped(std::max(range._start_offset, start_offset),
+                          std::min(range._end_offset, end_offset));
+    }
+    return res;
+}
+
+int HugePageBackedRegion::ClearMapped(off_t start_offset, off_t end_offset) {
+    // make the pages that cover the range writable (a protection cannot be
+    // changed for a part of a huge page), and then restore their protection
+    off_t page_start_offset = start_offset;
+    off_t page_end_offset = end_offset;
+    size_t intervals_length = _region_intervals.GetLength();
+    for (unsigned int i = 0; i < intervals_length; i++) {
+        MemoryInterval& interval = _region_intervals.At(i);
+        size_t page_size = static_cast<size_t>(interval._page_size);
+        if (start_offset >= interval._start_offset
+            && start_offset < interval._end_offset) {
+            page_start_offset = interval._start_offset + ROUND_DOWN(
+                start_offset - interval._start_offset, page_size);
+        }
+        if (end_offset > interval._start_offset
+            && end_offset <= interval._end_offset) {
+            page_end_offset = interval._start_offset + ROUND_UP(
+                end_offset - interval._start_offset, page_size);
+        }
+    }
+    void *page_addr = (void *) ((size_t) _region_start + page_start_offset);
+    if (_memory_protector(page_addr, page_end_offset - page_start_offset,
+                          MMAP_PROTECTION) != 0) {
+        return -errno;
+    }
+    memset((void *) ((size_t) _region_start + start_offset), 0,
+           end_offset - start_offset);
+    return ApplyProtectionRanges(page_start_offset, page_end_offset);
+}
+
+HugePageBackedRegion::HugePageBackedRegion() :
+    _initialized(false),
+    _protection_ranges(nullptr), _protection_ranges_length(0),
+    _committed_ranges(nullptr), _committed_ranges_length(0) {
+    _name[0] = '\0';
+}
+
+void HugePageBackedRegion::SetName(const char *name) {
+    if (strlen(name) >= MAX_REGION_NAME_LENGTH) {
+        THROW_EXCEPTION("region name is too long");
+    }
+    strcpy(_name, name);
+}
 
 void HugePageBackedRegion::Initialize(size_t region_size,
                                       MemoryIntervalList& intervalList,
                                       MmapFuncPtr allocator,
                                       MunmapFuncPtr deallocator,
+                                      MprotectFuncPtr protector,
                                       void* region_base) {
     _region_start = nullptr;
     _region_max_size = region_size;
     _region_current_size = 0;
     _memory_allocator = allocator;
     _memory_deallocator = deallocator;
+    _memory_protector = protector;
+
+    _protection_ranges = static_cast<ProtectionRange*>(
+        RegionIntervalListMemAlloc(MAX_PROTECTION_RANGES * sizeof(ProtectionRange)));
+    if (_protection_ranges == MAP_FAILED) {
+        THROW_EXCEPTION("failed to allocate the protection ranges list");
+    }
+    _protection_ranges_length = 0;
+    _committed_ranges = static_cast<CommittedRange*>(
+        RegionIntervalListMemAlloc(MAX_COMMITTED_RANGES * sizeof(CommittedRange)));
+    if (_committed_ranges == MAP_FAILED) {
+        THROW_EXCEPTION("failed to allocate the committed ranges list");
+    }
+    _committed_ranges_length = 0;
 
     size_t max_size = (2 * intervalList.GetLength()) + 1; //In worst case there will be 4KB area between each interval
     _region_intervals.Initialize(allocator, deallocator, max_size);
@@ -175,6 +642,9 @@ void HugePageBackedRegion::Initialize(size_t region_size,
     // Allocate the rounded-up size with 4KB pages
     void *base_addr = AllocateMemory(region_base, _region_current_size,
                                      PageSize::BASE_4KB);
+    if (base_addr == MAP_FAILED) {
+        THROW_EXCEPTION("failed to allocate memory by mmap");
+    }
 
     // Update _region_start to be aligned with largest page size
     if (first_region_1gb != nullptr) {
@@ -203,6 +673,9 @@ void HugePageBackedRegion::Initialize(size_t region_size,
     }
 
     _region_intervals.Sort();
+    // merge the intervals of consecutive hugepages, so each run of them is
+    // mapped by a single mmap call
+    _region_intervals.Coalesce();
     // Add 4KB intervals
     off_t prev_start_offset = 0;
     size_t intervals_length = _region_intervals.GetLength();
@@ -227,7 +700,9 @@ void HugePageBackedRegion::Initialize(size_t region_size,
     _region_current_size = 0;
 
     //Reallocate region with exact pages sizes (call Resize(size))
-    Resize(_region_max_size);
+    if (Resize(_region_max_size) != 0) {
+        THROW_EXCEPTION("failed to allocate the region memory");
+    }
     _region_max_size = _region_current_size;
 
 }
@@ -244,6 +719,21 @@ HugePageBackedRegion::~HugePageBackedRegion() {
     //DeallocateMemory(_region_start, _region_current_size);
     //_region_max_size = _region_current_size = 0;
     //_region_intervals.clear();
+
+    // the protection ranges list is used by the region only (and the hooks
+    // do not serve the pools after they are destructed)
+    if (_protection_ranges != nullptr) {
+        RegionIntervalListMemDealloc(_protection_ranges,
+                                     MAX_PROTECTION_RANGES * sizeof(ProtectionRange));
+        _protection_ranges = nullptr;
+        _protection_ranges_length = 0;
+    }
+    if (_committed_ranges != nullptr) {
+        RegionIntervalListMemDealloc(_committed_ranges,
+                                     MAX_COMMITTED_RANGES * sizeof(CommittedRange));
+        _committed_ranges = nullptr;
+        _committed_ranges_length = 0;
+    }
 }
 
 int HugePageBackedRegion::Resize(size_t new_size) {
@@ -254,7 +744,27 @@ int HugePageBackedRegion::Resize(size_t new_size) {
     }
 
     if (new_size > _region_current_size) {
+        off_t prev_size = (off_t) _region_current_size;
         _region_current_size = ExtendRegion(new_size);
+        int err = errno;
+        off_t mapped_size = (off_t) _region_current_size;
+        AbsorbCommittedRanges();
+        if (_region_current_size >= new_size) {
+            err = 0;
+        }
+        // the new memory is mapped with the default protection, so restore
+        // the protection that was set for it (if any)
+        int res = ApplyProtectionRanges(prev_size, mapped_size);
+        if (res != 0) {
+            REPORT_ERROR(MosallocError::MPROTECT_FAILED,
+                         "failed to restore memory protection by mprotect");
+            return res;
+        }
+        if (err != 0) {
+            REPORT_ERROR(MosallocError::MMAP_FAILED,
+                         "failed to allocate memory by mmap");
+            return -err;
+        }
     }
     else if (new_size < _region_current_size) {
         _region_current_size = ShrinkRegion(new_size);
@@ -262,6 +772,199 @@ int HugePageBackedRegion::Resize(size_t new_size) {
     return 0;
 }
 
+int HugePageBackedRegion::MovePages(void *from, void *to, off_t start_offset,
+                                    off_t end_offset, off_t &moved_offset) {
+    moved_offset = start_offset;
+    while (moved_offset < end_offset) {
+        // the run of pages of a single page size that starts at moved_offset
+        PageSize page_size = PageSize::BASE_4KB;
+        off_t run_end_offset = end_offset;
+        size_t intervals_length = _region_intervals.GetLength();
+        for (size_t i = 0; i < intervals_length; i++) {
+            MemoryInterval &interval = _region_intervals.At(i);
+            if (interval._end_offset <= moved_offset) {
+                continue;
+            }
+            if (interval._start_offset <= moved_offset) {
+                page_size = interval._page_size;
+                run_end_offset = std::min(run_end_offset, interval._end_offset);
+            } else {
+                run_end_offset = std::min(run_end_offset, interval._start_offset);
+            }
+        }
+
+        // a run could span several mappings, which mremap cannot move at once
+        size_t move_len = run_end_offset - moved_offset;
+        for (off_t offset = moved_offset; offset < run_end_offset;
+             offset += move_len) {
+            move_len = std::min(move_len, (size_t) (run_end_offset - offset));
+            off_t delta = offset - start_offset;
+            void *res = mremap((void *) ((size_t) from + delta), move_len,
+                               move_len, MREMAP_MAYMOVE | MREMAP_FIXED,
+                               (void *) ((size_t) to + delta));
+            if (res == MAP_FAILED) {
+                if (errno != EFAULT || move_len == (size_t) page_size) {
+                    return -errno;
+                }
+                move_len = (size_t) page_size;
+                offset -= move_len;
+                continue;
+            }
+            moved_offset = offset + move_len;
+        }
+    }
+    return 0;
+}
+
+int HugePageBackedRegion::RemapPage(off_t start_offset, size_t len,
+                                    PageSize page_size, size_t copy_len) {
+    void *addr = (void *) ((size_t) _region_start + start_offset);
+    void *old_pages = nullptr;
+    void *reservation = MAP_FAILED;
+    if (copy_len != 0) {
+        // the page may be protected (e.g., PROT_NONE guard pages), and it
+        // is discarded anyway
+        if (_memory_protector(addr, copy_len, MMAP_PROTECTION) != 0) {
+            return -errno;
+        }
+        // move the current pages aside rather than copy them, so no buffer
+        // of the page size is needed (the moved pages must stay aligned to
+        // their page size)
+        reservation = _memory_allocator(NULL, 2 * len, PROT_NONE,
+                                        MMAP_FLAGS | MAP_NORESERVE, -1, 0);
+        if (reservation == MAP_FAILED) {
+            return -errno;
+        }
+        old_pages = (void *) ROUND_UP((size_t) reservation, len);
+        off_t moved_offset;
+        int res = MovePages(addr, old_pages, start_offset,
+                            start_offset + copy_len, moved_offset);
+        if (res != 0) {
+            // e.g., kernels older than 5.16 cannot move hugetlb pages
+            off_t restored_offset;
+            MovePages(old_pages, addr, start_offset, moved_offset,
+                      restored_offset);
+            _memory_deallocator(reservation, 2 * len);
+            return res;
+        }
+    }
+
+    int res = 0;
+    void *ptr = AllocateMemory(addr, len, page_size);
+    if (ptr == MAP_FAILED) {
+        // e.g., there are not enough free hugepages, so move the current
+        // pages back (the intervals list is not changed yet)
+        res = -errno;
+        if (copy_len != 0) {
+            off_t moved_offset;
+            if (MovePages(old_pages, addr, start_offset,
+                          start_offset + copy_len, moved_offset) != 0) {
+                REPORT_ERROR(MosallocError::MMAP_FAILED,
+                             "failed to restore remapped memory by mremap");
+                return res;
+            }
+            _memory_deallocator(reservation, 2 * len);
+        }
+    } else {
+        _region_intervals.SetPageSize(start_offset, start_offset + len,
+                                      page_size);
+        if (copy_len != 0) {
+            // the old pages are released slice by slice as they are copied
+            // (hugepages are released as a whole when they are unmapped)
+            for (size_t copied = 0; copied < copy_len;
+                 copied += REMAP_COPY_SLICE_SIZE) {
+                size_t slice = std::min((size_t) REMAP_COPY_SLICE_SIZE,
+                                        copy_len - copied);
+                memcpy((void *) ((size_t) addr + copied),
+                       (void *) ((size_t) old_pages + copied), slice);
+                madvise((void *) ((size_t) old_pages + copied), slice,
+                        MADV_DONTNEED);
+            }
+            _memory_deallocator(reservation, 2 * len);
+        }
+    }
+
+    int prot_res = ApplyProtectionRanges(start_offset, start_offset + len);
+    if (prot_res != 0) {
+        REPORT_ERROR(MosallocError::MPROTECT_FAILED,
+                     "failed to restore memory protection by mprotect");
+        return prot_res;
+    }
+    return res;
+}
+
+int HugePageBackedRegion::RemapInterval(off_t start_offset, off_t end_offset,
+                                        PageSize page_size) {
+    assert(_initialized);
+
+    if (page_size != PageSize::BASE_4KB && page_size != PageSize::HUGE_2MB &&
+        page_size != PageSize::HUGE_1GB) {
+        return -EINVAL;
+    }
+    if (start_offset < 0 || start_offset >= end_offset ||
+        (size_t) end_offset > _region_max_size) {
+        return -EINVAL;
+    }
+
+    // the range is remapped by pages of the largest page size involved, so
+    // neither a current page nor a new one is split
+    size_t chunk_size = static_cast<size_t>(page_size);
+    size_t intervals_length = _region_intervals.GetLength();
+    for (size_t i = 0; i < intervals_length; i++) {
+        MemoryInterval &interval = _region_intervals.At(i);
+        if (interval._end_offset > start_offset &&
+            interval._start_offset < end_offset) {
+            chunk_size = std::max(chunk_size,
+                                  static_cast<size_t>(interval._page_size));
+        }
+    }
+    if (!IS_ALIGNED(start_offset, chunk_size) ||
+        !IS_ALIGNED(end_offset, chunk_size) ||
+        !IS_ALIGNED((size_t) _region_start + start_offset, chunk_size)) {
+        return -EINVAL;
+    }
+    // the pages of the committed ranges are not tracked by the intervals
+    // (the range must be in the prefix or not committed at all)
+    for (size_t i = 0; i < _committed_ranges_length; i++) {
+        CommittedRange &range = _committed_ranges[i];
+        if (range._end_offset > start_offset && range._start_offset < end_offset) {
+            return -EBUSY;
+        }
+    }
+    // the parts of a new huge page must have the same protection
+    if (page_size != PageSize::BASE_4KB) {
+        for (off_t offset = start_offset; offset < end_offset;
+             offset += chunk_size) {
+            int prot = GetPageProtection(offset, (size_t) PageSize::BASE_4KB);
+            if (!HasProtection(offset, offset + chunk_size, prot)) {
+                return -EINVAL;
+            }
+        }
+    }
+
+    size_t mapped_size = _region_current_size;
+    off_t offset = start_offset;
+    for (; offset < end_offset && (size_t) offset < mapped_size;
+         offset += chunk_size) {
+        // the region could end in the middle of the page
+        size_t copy_len = std::min(chunk_size, mapped_size - offset);
+        int res = RemapPage(offset, chunk_size, page_size, copy_len);
+        if (res != 0) {
+            return res;
+        }
+        if (_region_current_size < (size_t) offset + chunk_size) {
+            _region_current_size = (size_t) offset + chunk_size;
+        }
+    }
+
+    // the rest of the range is mapped by the new page size when the region
+    // is extended over it
+    if (offset < end_offset) {
+        _region_intervals.SetPageSize(offset, end_offset, page_size);
+    }
+    return 0;
+}
+
 void *HugePageBackedRegion::GetRegionBase() {
     assert(_initialized);
     return _region_start;
@@ -276,3 +979,337 @@ size_t HugePageBackedRegion::GetRegionMaxSize() {
     assert(_initialized);
     return _region_max_size;
 }
+
+size_t HugePageBackedRegion::GetCommittedSize() {
+    assert(_initialized);
+    size_t committed_size = _region_current_size;
+    for (size_t i = 0; i < _committed_ranges_length; i++) {
+        committed_size += _committed_ranges[i]._end_offset
+            - _committed_ranges[i]._start_offset;
+    }
+    return committed_size;
+}
+
+/*
+ * FindGap returns the first offset of [offset, end_offset) that is not
+ * committed (or end_offset if there is none), and sets gap_end_offset to the
+ * end of the uncommitted part that starts there.
+ */
+off_t HugePageBackedRegion::FindGap(off_t offset, off_t end_offset,
+                                    off_t &gap_end_offset) {
+    // the ranges are sorted and do not touch each other
+    for (size_t i = 0; i < _committed_ranges_length; i++) {
+        CommittedRange &range = _committed_ranges[i];
+        if (range._end_offset <= offset) {
+            continue;
+        }
+        if (range._start_offset <= offset) {
+            offset = range._end_offset;
+            continue;
+        }
+        gap_end_offset = std::min(range._start_offset, end_offset);
+        return std::min(offset, end_offset);
+    }
+    gap_end_offset = end_offset;
+    return std::min(offset, end_offset);
+}
+
+/*
+ * MapPages maps the parts of [start_offset, end_offset) that are not
+ * committed by pages of the given size.
+ */
+int HugePageBackedRegion::MapPages(off_t start_offset, off_t end_offset,
+                                   PageSize page_size) {
+    off_t offset = start_offset;
+    while (offset < end_offset) {
+        off_t gap_end_offset;
+        offset = FindGap(offset, end_offset, gap_end_offset);
+        if (offset >= gap_end_offset) {
+            break;
+        }
+        if (AllocateMemory((void *) ((size_t) _region_start + offset),
+                           gap_end_offset - offset, page_size) == MAP_FAILED) {
+            return -errno;
+        }
+        offset = gap_end_offset;
+    }
+    return 0;
+}
+
+void HugePageBackedRegion::AddCommittedRange(off_t start_offset,
+                                             off_t end_offset) {
+    // merge the ranges that overlap (or touch) the new one into it
+    CommittedRange merged_range;
+    merged_range._start_offset = start_offset;
+    merged_range._end_offset = end_offset;
+    size_t length = 0;
+    for (size_t i = 0; i < _committed_ranges_length; i++) {
+        CommittedRange range = _committed_ranges[i];
+        if (range._end_offset >= merged_range._start_offset &&
+            range._start_offset <= merged_range._end_offset) {
+            merged_range._start_offset = std::min(range._start_offset,
+                                                  merged_range._start_offset);
+            merged_range._end_offset = std::max(range._end_offset,
+                                                merged_range._end_offset);
+            continue;
+        }
+        _committed_ranges[length++] = range;
+    }
+    assert(length < MAX_COMMITTED_RANGES);
+    // keep the ranges sorted by their start offsets
+    size_t i = length;
+    while (i > 0 && _committed_ranges[i - 1]._start_offset > merged_range._start_offset) {
+        _committed_ranges[i] = _committed_ranges[i - 1];
+        i--;
+    }
+    _committed_ranges[i] = merged_range;
+    _committed_ranges_length = length + 1;
+}
+
+int HugePageBackedRegion::RemoveCommittedRange(off_t start_offset,
+                                               off_t end_offset) {
+    for (size_t i = 0; i < _committed_ranges_length; i++) {
+        CommittedRange range = _committed_ranges[i];
+        if (range._end_offset <= start_offset || range._start_offset >= end_offset) {
+            continue;
+        }
+        if (range._start_offset < start_offset && range._end_offset > end_offset) {
+            // the range is split into two
+            if (_committed_ranges_length == MAX_COMMITTED_RANGES) {
+                return -ENOMEM;
+            }
+            for (size_t j = _committed_ranges_length; j > i + 1; j--) {
+                _committed_ranges[j] = _committed_ranges[j - 1];
+            }
+            _committed_ranges[i]._end_offset = start_offset;
+            _committed_ranges[i + 1]._start_offset = end_offset;
+            _committed_ranges[i + 1]._end_offset = range._end_offset;
+            _committed_ranges_length++;
+            return 0;
+        }
+    }
+    size_t length = 0;
+    for (size_t i = 0; i < _committed_ranges_length; i++) {
+        CommittedRange range = _committed_ranges[i];
+        if (range._end_offset > start_offset && range._start_offset < end_offset) {
+            if (range._start_offset < start_offset) {
+                range._end_offset = start_offset;
+            } else if (range._end_offset > end_offset) {
+                range._start_offset = end_offset;
+            } else {
+                continue;
+            }
+        }
+        _committed_ranges[length++] = range;
+    }
+    _committed_ranges_length = length;
+    return 0;
+}
+
+void HugePageBackedRegion::AbsorbCommittedRanges() {
+    // the committed ranges that the region size reaches are merged into it
+    size_t absorbed = 0;
+    while (absorbed < _committed_ranges_length &&
+           _committed_ranges[absorbed]._start_offset <= (off_t) _region_current_size) {
+        _region_current_size = std::max(_region_current_size,
+                (size_t) _committed_ranges[absorbed]._end_offset);
+        absorbed++;
+    }
+    if (absorbed == 0) {
+        return;
+    }
+    for (size_t i = absorbed; i < _committed_ranges_length; i++) {
+        _committed_ranges[i - absorbed] = _committed_ranges[i];
+    }
+    _committed_ranges_length -= absorbed;
+}
+
+void HugePageBackedRegion::GetPage(off_t offset, off_t &page_start_offset,
+                                   off_t &page_end_offset) {
+    page_start_offset = offset;
+    page_end_offset = offset + (off_t) PageSize::BASE_4KB;
+    size_t intervals_length = _region_intervals.GetLength();
+    for (unsigned int i = 0; i < intervals_length; i++) {
+        MemoryInterval& interval = _region_intervals.At(i);
+        if (offset >= interval._start_offset && offset < interval._end_offset) {
+            size_t page_size = static_cast<size_t>(interval._page_size);
+            page_start_offset = interval._start_offset + ROUND_DOWN(
+                offset - interval._start_offset, page_size);
+            page_end_offset = page_start_offset + page_size;
+            return;
+        }
+    }
+}
+
+int HugePageBackedRegion::Commit(void *addr, size_t len) {
+    assert(_initialized);
+
+    off_t start_offset = (off_t) addr - (off_t) _region_start;
+    off_t end_offset = start_offset + ROUND_UP(len, PageSize::BASE_4KB);
+    if (addr < _region_start || (size_t) end_offset > _region_max_size) {
+        return -ENOMEM;
+    }
+    if ((size_t) end_offset <= _region_current_size) {
+        return 0;
+    }
+    if ((size_t) start_offset <= _region_current_size) {
+        return Resize(end_offset);
+    }
+    // the pages of the range are merged into a single committed range
+    if (_committed_ranges_length == MAX_COMMITTED_RANGES) {
+        return -ENOMEM;
+    }
+
+    off_t commit_start_offset, commit_end_offset, page_end_offset;
+    GetPage(start_offset, commit_start_offset, page_end_offset);
+    commit_end_offset = commit_start_offset;
+    int res = 0;
+    size_t intervals_length = _region_intervals.GetLength();
+    for (unsigned int i = 0; i < intervals_length && res == 0; i++) {
+        MemoryInterval& interval = _region_intervals.At(i);
+        if (interval._end_offset <= start_offset
+            || interval._start_offset >= end_offset) {
+            continue;
+        }
+        off_t page_start_offset;
+        GetPage(std::max(start_offset, interval._start_offset),
+                page_start_offset, page_end_offset);
+        off_t last_page_start_offset;
+        GetPage(std::min(end_offset, interval._end_offset) - 1,
+                last_page_start_offset, page_end_offset);
+        res = MapPages(page_start_offset, page_end_offset, interval._page_size);
+        if (res == 0) {
+            commit_end_offset = page_end_offset;
+        }
+    }
+    if (commit_start_offset < commit_end_offset) {
+        AddCommittedRange(commit_start_offset, commit_end_offset);
+        // the new memory is mapped with the default protection
+        int prot_res = ApplyProtectionRanges(commit_start_offset,
+                                             commit_end_offset);
+        AbsorbCommittedRanges();
+        if (prot_res != 0) {
+            REPORT_ERROR(MosallocError::MPROTECT_FAILED,
+                         "failed to restore memory protection by mprotect");
+            return prot_res;
+        }
+    }
+    if (res != 0) {
+        REPORT_ERROR(MosallocError::MMAP_FAILED,
+                     "failed to allocate memory by mmap");
+    }
+    return res;
+}
+
+int HugePageBackedRegion::Reserve(void *addr, size_t len) {
+    assert(_initialized);
+
+    off_t end_offset = (off_t) addr - (off_t) _region_start
+        + ROUND_UP(len, PageSize::BASE_4KB);
+    off_t offset = std::max((off_t) addr - (off_t) _region_start,
+                            (off_t) _region_current_size);
+    while (offset < end_offset) {
+        off_t gap_end_offset;
+        offset = FindGap(offset, end_offset, gap_end_offset);
+        if (offset >= gap_end_offset) {
+            break;
+        }
+        void *ptr = _memory_allocator((void *) ((size_t) _region_start + offset),
+                                      gap_end_offset - offset, PROT_NONE,
+                                      MMAP_FLAGS | MAP_NORESERVE | MAP_FIXED,
+                                      -1, 0);
+        if (ptr == MAP_FAILED) {
+            return -errno;
+        }
+        offset = gap_end_offset;
+    }
+    return 0;
+}
+
+int HugePageBackedRegion::Release(void *addr, size_t len,
+                                  void *free_start, size_t free_len) {
+    assert(_initialized);
+
+    off_t end_offset = (off_t) addr - (off_t) _region_start
+        + ROUND_UP(len, PageSize::BASE_4KB);
+    // the placeholders of the range (the rest of the free memory may be
+    // unmapped already, and then something else could be mapped there)
+    off_t offset = std::max((off_t) addr - (off_t) _region_start,
+                            (off_t) _region_current_size);
+    while (offset < end_offset) {
+        off_t gap_end_offset;
+        offset = FindGap(offset, end_offset, gap_end_offset);
+        if (offset >= gap_end_offset) {
+            break;
+        }
+        int res = DeallocateMemory((void *) ((size_t) _region_start + offset),
+                                   gap_end_offset - offset);
+        if (res != 0) {
+            return res;
+        }
+        offset = gap_end_offset;
+    }
+    // the committed pages that lie entirely in the free memory
+    end_offset = (off_t) free_start - (off_t) _region_start + (off_t) free_len;
+    offset = std::max((off_t) free_start - (off_t) _region_start,
+                      (off_t) _region_current_size);
+    while (offset < end_offset) {
+        size_t i = 0;
+        while (i < _committed_ranges_length &&
+               _committed_ranges[i]._end_offset <= offset) {
+            i++;
+        }
+        if (i == _committed_ranges_length ||
+            _committed_ranges[i]._start_offset >= end_offset) {
+            break;
+        }
+        off_t range_start_offset = std::max(_committed_ranges[i]._start_offset,
+                                            offset);
+        off_t range_end_offset = std::min(_committed_ranges[i]._end_offset,
+                                          end_offset);
+        off_t page_start_offset, page_end_offset;
+        GetPage(range_start_offset, page_start_offset, page_end_offset);
+        off_t release_start_offset = (page_start_offset == range_start_offset) ?
+            range_start_offset : page_end_offset;
+        GetPage(range_end_offset - 1, page_start_offset, page_end_offset);
+        off_t release_end_offset = (page_end_offset == range_end_offset) ?
+            range_end_offset : page_start_offset;
+        // a range that cannot be split (as the list is full) is kept
+        if (release_start_offset < release_end_offset &&
+            RemoveCommittedRange(release_start_offset, release_end_offset) == 0) {
+            int res = DeallocateMemory(
+                (void *) ((size_t) _region_start + release_start_offset),
+                release_end_offset - release_start_offset);
+            if (res != 0) {
+                return res;
+            }
+        }
+        offset = range_end_offset;
+    }
+    return 0;
+}
+
+bool HugePageBackedRegion::CanProtect(void *addr, size_t len, int prot) {
+    assert(_initialized);
+
+    off_t start_offset = (off_t) addr - (off_t) _region_start;
+    off_t end_offset = start_offset + ROUND_UP(len, PageSize::BASE_4KB);
+    if (addr < _region_start || (size_t) end_offset > _region_max_size
+        || !IS_ALIGNED(addr, PageSize::BASE_4KB)) {
+        return false;
+    }
+    return CheckPartialPages(start_offset, end_offset, prot) == 0;
+}
+
+size_t HugePageBackedRegion::GetPageSize(void *addr) {
+    assert(_initialized);
+    off_t offset = (off_t) addr - (off_t) _region_start;
+    size_t intervals_length = _region_intervals.GetLength();
+    for (unsigned int i = 0; i < intervals_length; i++) {
+        MemoryInterval& interval = _region_intervals.At(i);
+        if (offset >= interval._start_offset && offset < interval._end_offset) {
+            return static_cast<size_t>(interval._page_size);
+        }
+    }
+    return static_cast<size_t>(PageSize::BASE_4KB);
+}
@@ -1,7 +1,9 @@
 #include <iostream>
 #include <cstring>
+#include <csignal>
 #include "HugePagesConfiguration.h"
 #include "globals.h"
+#include "ErrorLog.h"
 
 HugePagesConfiguration::HugePagesConfiguration() {
     ReadBrkPoolEnvParams(_brk_pool_params);
@@ -55,24 +57,102 @@ void HugePagesConfiguration::ReadGeneralEnvParams(
     
     char *verbose_val = getenv(VERBOSE_LEVEL_ENV_VAR);
     params._verbose_level = (verbose_val == NULL) ? 0 : stoul(verbose_val);
+
+    char *file_mmap_mode_val = getenv(FILE_MMAP_MODE_ENV_VAR);
+    if (file_mmap_mode_val == NULL || !strcmp(file_mmap_mode_val, "pool")) {
+        params._file_mmap_mode = FileMmapMode::POOL;
+    } else if (!strcmp(file_mmap_mode_val, "transparent")) {
+        params._file_mmap_mode = FileMmapMode::TRANSPARENT;
+    } else {
+        THROW_EXCEPTION("unknown file mmap mode");
+    }
+
+    char *fork_policy_val = getenv(FORK_POLICY_ENV_VAR);
+    if (fork_policy_val == NULL || !strcmp(fork_policy_val, "keep")) {
+        params._fork_policy = ForkPolicy::KEEP;
+    } else if (!strcmp(fork_policy_val, "shrink")) {
+        params._fork_policy = ForkPolicy::SHRINK;
+    } else if (!strcmp(fork_policy_val, "passthrough")) {
+        params._fork_policy = ForkPolicy::PASSTHROUGH;
+    } else {
+        THROW_EXCEPTION("unknown fork policy");
+    }
+
+    char *error_policy_val = getenv(ERROR_POLICY_ENV_VAR);
+    if (error_policy_val == NULL || !strcmp(error_policy_val, "exit")) {
+        params._error_policy = ErrorPolicy::EXIT;
+    } else if (!strcmp(error_policy_val, "return")) {
+        params._error_policy = ErrorPolicy::RETURN;
+    } else {
+        THROW_EXCEPTION("unknown error policy");
+    }
+
+    char *preflight_policy_val = getenv(PREFLIGHT_POLICY_ENV_VAR);
+    if (preflight_policy_val == NULL || !strcmp(preflight_policy_val, "warn")) {
+        params._preflight_policy = PreflightPolicy::WARN;
+    } else if (!strcmp(preflight_policy_val, "off")) {
+        params._preflight_policy = PreflightPolicy::OFF;
+    } else if (!strcmp(preflight_policy_val, "refuse")) {
+        params._preflight_policy = PreflightPolicy::REFUSE;
+    } else if (!strcmp(preflight_policy_val, "degrade")) {
+        params._preflight_policy = PreflightPolicy::DEGRADE;
+    } else {
+        THROW_EXCEPTION("unknown preflight policy");
+    }
+
+    params._crash_log_file = getenv(CRASH_LOG_ENV_VAR);
+    char *crash_log_entries_val = getenv(CRASH_LOG_ENTRIES_ENV_VAR);
+    params._crash_log_entries = (crash_log_entries_val == NULL)
+        ? DEFAULT_CRASH_LOG_CAPACITY : stoul(crash_log_entries_val);
+
+    params._control_file = getenv(CONTROL_FILE_ENV_VAR);
+    char *control_signal_val = getenv(CONTROL_SIGNAL_ENV_VAR);
+    params._control_signal = (control_signal_val == NULL)
+        ? SIGUSR2 : stoi(control_signal_val);
+
+    char *profile_budget_val = getenv(PROFILE_BUDGET_ENV_VAR);
+    params._profile = (profile_budget_val != NULL);
+    params._profile_budget = 0;
+    if (params._profile) {
+        long long int budget = parseCsv::ParseSize(profile_budget_val);
+        if (budget < 0) {
+            THROW_EXCEPTION("invalid profile hugepages budget");
+        }
+        params._profile_budget = budget;
+    }
+}
+
+// the pools are configured either by a file or by an inline layout
+void HugePagesConfiguration::ReadConfigurationSource(
+        HugePagesConfiguration::HugePagesConfigurationParams &params) {
+    params.layout = getenv(LAYOUT_ENV_VAR);
+    if (params.layout == NULL) {
+        params.configuration_file =
+                GetEnvironmentVariable(CONFIGURATION_FILE_ENV_VAR);
+        return;
+    }
+    params.configuration_file = getenv(CONFIGURATION_FILE_ENV_VAR);
+    if (params.configuration_file != NULL) {
+        THROW_EXCEPTION("both a configuration file and an inline layout are given");
+    }
 }
 
 void HugePagesConfiguration::ReadMmapPoolEnvParams(
         HugePagesConfiguration::HugePagesConfigurationParams &params) {
-    params.configuration_file =
-            GetEnvironmentVariable(CONFIGURATION_FILE_ENV_VAR);
+    ReadConfigurationSource(params);
     params._ffa_list_size = GetEnvironmentVariableValue(MMAP_FFA_SIZE_ENV_VAR);
 }
 
 void HugePagesConfiguration::ReadBrkPoolEnvParams(
         HugePagesConfiguration::HugePagesConfigurationParams &params) {
-    params.configuration_file = GetEnvironmentVariable(CONFIGURATION_FILE_ENV_VAR);
+    ReadConfigurationSource(params);
     params._ffa_list_size = 0;
 }
 
 void HugePagesConfiguration::ReadFileBackedPoolEnvParams(
         HugePagesConfiguration::HugePagesConfigurationParams &params) {
     params.configuration_file = nullptr;
+    params.layout = nullptr;
     params._ffa_list_size = GetEnvironmentVariableValue(
             FILE_BACKED_FFA_SIZE_ENV_VAR);
 }
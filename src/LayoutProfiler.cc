@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <assert.h>
+#include <vector>
+#include <sys/mman.h>
+#include "LayoutProfiler.h"
+#include "ParseCsv.h"
+
+LayoutProfiler::LayoutProfiler() :
+    _pools_count(0),
+    _planned(false),
+    _mmap(mmap),
+    _munmap(munmap) {
+}
+
+LayoutProfiler::~LayoutProfiler() {
+    for (int i = 0; i < _pools_count; i++) {
+        if (_pools[i]._chunks != nullptr) {
+            _munmap(_pools[i]._chunks, ROUND_UP(_pools[i]._chunks_count *
+                                                sizeof(uint16_t),
+                                                PageSize::BASE_4KB));
+        }
+    }
+}
+
+void LayoutProfiler::Initialize(MmapFuncPtr allocator,
+                                MunmapFuncPtr deallocator) {
+    _mmap = allocator;
+    _munmap = deallocator;
+}
+
+int LayoutProfiler::AddPool(const char *name, void *base, size_t max_size,
+                            bool hugepages, AllocatorPolicy allocator_policy) {
+    if (_pools_count == MAX_PROFILED_POOLS) {
+        THROW_EXCEPTION("too many profiled pools");
+    }
+    if (strlen(name) >= MAX_POOL_NAME_LENGTH) {
+        THROW_EXCEPTION("pool name is too long");
+    }
+    PoolProfile &pool = _pools[_pools_count];
+    strcpy(pool._name, name);
+    pool._base = base;
+    pool._peak_extent = 0;
+    pool._allocator_policy = allocator_policy;
+    pool._chunks = nullptr;
+    pool._chunks_count = 0;
+    pool._planned_size = 0;
+    if (hugepages && max_size != 0) {
+        // the counters are mapped (rather than allocated) as the pools
+        // serve malloc, and the pages of unused chunks are never touched
+        size_t chunks_count = ROUND_UP(max_size, PROFILE_CHUNK_SIZE) /
+                              PROFILE_CHUNK_SIZE;
+        void *chunks = _mmap(nullptr, ROUND_UP(chunks_count * sizeof(uint16_t),
+                                               PageSize::BASE_4KB),
+                             MMAP_PROTECTION, MMAP_FLAGS | MAP_NORESERVE,
+                             -1, 0);
+        if (chunks == MAP_FAILED) {
+            THROW_EXCEPTION("failed to allocate the pool profile");
+        }
+        pool._chunks = static_cast<uint16_t*>(chunks);
+        pool._chunks_count = chunks_count;
+    }
+    return _pools_count++;
+}
+
+void LayoutProfiler::UpdatePeakExtent(int pool, size_t extent) {
+    _pools[pool]._peak_extent = std::max(_pools[pool]._peak_extent, extent);
+}
+
+void LayoutProfiler::Sample(int pool, size_t offset, size_t length) {
+    PoolProfile &profile = _pools[pool];
+    if (profile._chunks == nullptr || length == 0) {
+        return;
+    }
+    // mincore reports a byte per 4KB page; a chunk is read at a time
+    unsigned char residency[PROFILE_CHUNK_PAGES];
+    size_t end = std::min(offset + length,
+                          profile._chunks_count * PROFILE_CHUNK_SIZE);
+    for (size_t chunk = offset / PROFILE_CHUNK_SIZE;
+         chunk * PROFILE_CHUNK_SIZE < end; chunk++) {
+        size_t chunk_start = chunk * PROFILE_CHUNK_SIZE;
+        size_t chunk_end = std::min((chunk + 1) * PROFILE_CHUNK_SIZE, end);
+        size_t pages = ROUND_UP(chunk_end - chunk_start, PageSize::BASE_4KB) /
+                       (size_t)PageSize::BASE_4KB;
+        if (mincore((char*)profile._base + chunk_start,
+                    pages * (size_t)PageSize::BASE_4KB, residency) != 0) {
+            continue;
+        }
+        size_t touched = 0;
+        for (size_t p = 0; p < pages; p++) {
+            touched += residency[p] & 1;
+        }
+        UpdateChunk(pool, chunk, touched);
+    }
+}
+
+void LayoutProfiler::UpdateChunk(int pool, size_t chunk, size_t touched_pages) {
+    PoolProfile &profile = _pools[pool];
+    if (chunk >= profile._chunks_count) {
+        return;
+    }
+    if (touched_pages > profile._chunks[chunk]) {
+        profile._chunks[chunk] = (uint16_t)touched_pages;
+    }
+}
+
+size_t LayoutProfiler::GetChunk(int pool, size_t chunk) const {
+    const PoolProfile &profile = _pools[pool];
+    return (chunk < profile._chunks_count) ? profile._chunks[chunk] : 0;
+}
+
+void LayoutProfiler::Plan(size_t budget) {
+    // the planned intervals lists are initialized once
+    assert(_planned == false);
+    _planned = true;
+    struct Candidate {
+        int _pool;
+        size_t _chunk;
+        size_t _touched_pages;
+    };
+    // every sampled chunk is a candidate, and the pool is sized to cover
+    // them all, so their offsets are kept
+    std::vector<Candidate> candidates;
+    for (int i = 0; i < _pools_count; i++) {
+        PoolProfile &profile = _pools[i];
+        size_t planned_size = std::max(profile._peak_extent,
+                                       PROFILE_CHUNK_SIZE);
+        for (size_t c = 0; c < profile._chunks_count; c++) {
+            if (profile._chunks[c] != 0) {
+                candidates.push_back({i, c, profile._chunks[c]});
+                planned_size = std::max(planned_size,
+                                        (c + 1) * PROFILE_CHUNK_SIZE);
+            }
+        }
+        profile._planned_size = ROUND_UP(planned_size, PROFILE_CHUNK_SIZE);
+    }
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [](const Candidate &lhs, const Candidate &rhs) {
+                         return lhs._touched_pages > rhs._touched_pages;
+                     });
+    size_t selected_count = std::min(candidates.size(),
+                                     budget / PROFILE_CHUNK_SIZE);
+
+    std::vector<std::vector<bool>> selected(_pools_count);
+    std::vector<size_t> pool_selected_count(_pools_count, 0);
+    for (int i = 0; i < _pools_count; i++) {
+        selected[i].resize(_pools[i]._chunks_count, false);
+    }
+    for (size_t k = 0; k < selected_count; k++) {
+        selected[candidates[k]._pool][candidates[k]._chunk] = true;
+        pool_selected_count[candidates[k]._pool]++;
+    }
+
+    for (int i = 0; i < _pools_count; i++) {
+        PoolProfile &profile = _pools[i];
+        profile._planned_intervals.Initialize(_mmap, _munmap,
+                                              pool_selected_count[i] + 1);
+        size_t chunks = selected[i].size();
+        for (size_t c = 0; c < chunks; ) {
+            // a 1GB-aligned range of selected chunks is a 1GB page
+            if (c % PROFILE_CHUNKS_PER_1GB == 0 &&
+                c + PROFILE_CHUNKS_PER_1GB <= chunks &&
+                std::all_of(selected[i].begin() + c,
+                            selected[i].begin() + c + PROFILE_CHUNKS_PER_1GB,
+                            [](bool s) { return s; })) {
+                profile._planned_intervals.AddInterval(
+                        c * PROFILE_CHUNK_SIZE,
+                        (c + PROFILE_CHUNKS_PER_1GB) * PROFILE_CHUNK_SIZE,
+                        PageSize::HUGE_1GB);
+                c += PROFILE_CHUNKS_PER_1GB;
+                continue;
+            }
+            if (selected[i][c]) {
+                profile._planned_intervals.AddInterval(
+                        c * PROFILE_CHUNK_SIZE, (c + 1) * PROFILE_CHUNK_SIZE,
+                        PageSize::HUGE_2MB);
+            }
+            c++;
+        }
+        profile._planned_intervals.Coalesce();
+    }
+}
+
+size_t LayoutProfiler::GetPlannedSize(int pool) const {
+    return _pools[pool]._planned_size;
+}
+
+MemoryIntervalList& LayoutProfiler::GetPlannedIntervals(int pool) {
+    return _pools[pool]._planned_intervals;
+}
+
+void LayoutProfiler::WriteProfile(FILE *file) const {
+    fprintf(file, "pool,offset,touched-pages\n");
+    for (int i = 0; i < _pools_count; i++) {
+        const PoolProfile &profile = _pools[i];
+        for (size_t c = 0; c < profile._chunks_count; c++) {
+            if (profile._chunks[c] != 0) {
+                fprintf(file, "%s,%zu,%u\n", profile._name,
+                        c * PROFILE_CHUNK_SIZE, profile._chunks[c]);
+            }
+        }
+    }
+}
+
+void LayoutProfiler::WriteLayout(FILE *file, const RoutingTable &routes) {
+    parseCsv::WriteHeader(file);
+    for (int i = 0; i < _pools_count; i++) {
+        parseCsv::WritePoolRow(file, _pools[i]._name, _pools[i]._planned_size,
+                               _pools[i]._planned_intervals);
+    }
+    for (int i = 0; i < _pools_count; i++) {
+        if (_pools[i]._allocator_policy != AllocatorPolicy::FIRST_FIT) {
+            parseCsv::WriteAllocatorRow(file, _pools[i]._name,
+                                        _pools[i]._allocator_policy);
+        }
+    }
+    parseCsv::WriteRoutes(file, routes);
+}
@@ -3,7 +3,9 @@
 #include <fstream>
 #include <sys/syscall.h>
 #include <assert.h>
+#include <algorithm>
 #include "MemoryAllocator.h"
+#include "NumaMaps.h"
 
 /*
 #ifdef THREAD_SAFETY
@@ -14,6 +16,8 @@
 */
 
 #define RESIZE_THRESHOLD (2097152)
+// the FFA nodes that a MAP_FIXED mapping which replaces memory may take
+#define REPLACE_FFA_NODES (4)
 
 void *_brk_region_base = 0;
 
@@ -28,11 +32,12 @@ int GlibcMunmap(void *addr, size_t length) {
     return glibc_funcs.CallGlibcMunmap(addr, length);
 }
 
-void MemoryAllocator::SetIntervalConfigList(PoolConfigurationData &configurationData, const char *config_file,
-                                            const char* pool_type) {
-    int intervals_size = parseCsv::GetConfigFileMaxWindows(config_file) * 2 + 1;
-    configurationData.intervalList.Initialize(GlibcMmap, GlibcMunmap, intervals_size);
-    parseCsv::ParseCsv(configurationData, config_file, pool_type);
+int GlibcMprotect(void *addr, size_t len, int prot) {
+    static GlibcAllocationFunctions glibc_funcs;
+    return glibc_funcs.CallGlibcMprotect(addr, len, prot);
+}
+
+void MemoryAllocator::SetIntervalConfigList(PoolConfigurationData &configurationData) {
     auto validate_result = _intervals_configuration_validator.Validate(configurationData.intervalList);
     if(validate_result != ValidatorErrorMessage::SUCCESS) {
         THROW_EXCEPTION("interval list is invalid")
@@ -42,68 +47,251 @@ void MemoryAllocator::SetIntervalConfigList(PoolConfigurationData &configuration
     }
 }
 
+void MemoryAllocator::PreflightPools(ConfigurationLoader &loader,
+                                     HugePagesConfiguration::PreflightPolicy policy) {
+    if (policy == HugePagesConfiguration::PreflightPolicy::OFF) {
+        return;
+    }
+    // the brk pool is planned first, as it serves the heap
+    PoolConfigurationData *pools[MAX_ANONYMOUS_POOLS + 1];
+    int pools_count = 0;
+    pools[pools_count++] = &loader.GetPool(BRK_POOL_NAME);
+    for (int i = 0; i < _anon_pools_count; i++) {
+        pools[pools_count++] = &loader.GetPool(_routing_table.GetPoolName(i));
+    }
+    PreflightPlanner planner;
+    for (int i = 0; i < pools_count; i++) {
+        SetIntervalConfigList(*pools[i]);
+        planner.AddDemand(pools[i]->intervalList);
+    }
+    if (planner.GetDemand(PageSize::HUGE_2MB) == 0 &&
+        planner.GetDemand(PageSize::HUGE_1GB) == 0) {
+        return;
+    }
+    if (planner.ReadSupply() != 0) {
+        // the layout is run as is, and fails later if the pages are missing
+        return;
+    }
+    planner.ReadMemoryPolicy();
+
+    if (planner.Fits()) {
+        if (!planner.FitsPreferredNodes()) {
+            const char msg[] = "mosalloc: preflight: some hugepages "
+                               "will be allocated on remote nodes\n";
+            ssize_t res = write(STDERR_FILENO, msg, sizeof(msg) - 1);
+            (void)res;
+            planner.Report(STDERR_FILENO);
+        }
+        return;
+    }
+    const char msg[] = "mosalloc: preflight: the layout needs more "
+                       "hugepages than are free\n";
+    ssize_t res = write(STDERR_FILENO, msg, sizeof(msg) - 1);
+    (void)res;
+    planner.Report(STDERR_FILENO);
+    if (policy == HugePagesConfiguration::PreflightPolicy::REFUSE) {
+        THROW_EXCEPTION("not enough free hugepages for the layout");
+    }
+    if (policy == HugePagesConfiguration::PreflightPolicy::DEGRADE) {
+        for (int i = 0; i < pools_count; i++) {
+            planner.Degrade(pools[i]->intervalList);
+            // the pools are mapped by the degraded intervals
+            SetIntervalConfigList(*pools[i]);
+        }
+    }
+}
+
+void MemoryAllocator::InitAnonymousMmapPool(AnonymousMmapPool &pool,
+                                            const char *name,
+                                            ConfigurationLoader &loader,
+                                            size_t ffa_list_size) {
+    PoolConfigurationData &mmap_configuration_data = loader.GetPool(name);
+    SetIntervalConfigList(mmap_configuration_data);
+    if (mmap_configuration_data.size == 0) {
+        THROW_EXCEPTION("anonymous mmap pool size is missing");
+    }
+    pool._hpbr.SetName(name);
+    pool._hpbr.Initialize(mmap_configuration_data.size, mmap_configuration_data.intervalList, GlibcMmap,
+                          GlibcMunmap, GlibcMprotect);
+
+    void* start = pool._hpbr.GetRegionBase();
+    void* end = (void*)((size_t)start + mmap_configuration_data.size);
+    pool._ffa.Initialize(ffa_list_size, start, end, GlibcMmap, GlibcMunmap);
+    pool._max_size = 0;
+    pool._bytes = 0;
+    pool._max_bytes = 0;
+    pool._max_extent = 0;
+    pool._allocator_policy = mmap_configuration_data.allocatorPolicy;
+    MemoryIntervalList &intervals = mmap_configuration_data.intervalList;
+    if (intervals.FirstIntervalOf(PageSize::HUGE_1GB) != nullptr) {
+        pool._page_alignment = (size_t)PageSize::HUGE_1GB;
+    } else if (intervals.FirstIntervalOf(PageSize::HUGE_2MB) != nullptr) {
+        pool._page_alignment = (size_t)PageSize::HUGE_2MB;
+    } else {
+        pool._page_alignment = (size_t)PageSize::BASE_4KB;
+    }
+}
+
 void MemoryAllocator::InitRegions(void *brk_region_base) {
     HugePagesConfiguration hppc;
     auto mmap_params = hppc.ReadFromEnvironmentVariables(HugePagesConfiguration::ConfigType::MMAP_POOL);
-    PoolConfigurationData mmap_configuration_data;
-    std::string mmap_type = "mmap";
-    SetIntervalConfigList(mmap_configuration_data, mmap_params.configuration_file, mmap_type.c_str());
-    _mmap_anon_hpbr.Initialize(mmap_configuration_data.size, mmap_configuration_data.intervalList, GlibcMmap,
-                               GlibcMunmap);
 
-    void* start = _mmap_anon_hpbr.GetRegionBase();
-    void* end = (void*)((size_t)start + mmap_configuration_data.size);
-    _mmap_anon_ffa.Initialize(mmap_params._ffa_list_size, start, end, GlibcMmap, GlibcMunmap);
+    // the crash log records the pools operations from their initialization
+    auto general_params = hppc.GetGeneralParams();
+    mosalloc_error_log.SetFailFast(general_params._error_policy ==
+                                   HugePagesConfiguration::ErrorPolicy::EXIT);
+    if (general_params._crash_log_file != nullptr &&
+        mosalloc_error_log.Open(general_params._crash_log_file,
+                                general_params._crash_log_entries,
+                                GlibcMmap, GlibcMunmap) != 0) {
+        THROW_EXCEPTION("failed to open the crash log file");
+    }
+    if (general_params._control_file != nullptr &&
+        mosalloc_control_channel.Install(general_params._control_file,
+                                         general_params._control_signal) != 0) {
+        THROW_EXCEPTION("failed to install the control signal handler");
+    }
+
+    // all the pools are configured by the same file (or inline layout), so
+    // it is read once; the routes name the anonymous pools (besides the
+    // default one)
+    ConfigurationLoader loader;
+    if (mmap_params.layout != nullptr) {
+        loader.LoadInline(mmap_params.layout, _routing_table,
+                          GlibcMmap, GlibcMunmap);
+    } else {
+        loader.Load(mmap_params.configuration_file, _routing_table,
+                    GlibcMmap, GlibcMunmap);
+    }
+    // every configured pool (other than brk and file) is an anonymous pool,
+    // including the pools that no route uses, which serve
+    // mosalloc_mmap_pool; the heaps of the malloc arenas are served by the
+    // "arena" pool if it is configured, and by the default pool otherwise
+    for (int p = 0; p < loader.GetPoolsCount(); p++) {
+        const char *name = loader.GetPoolName(p);
+        if (!strcmp(name, BRK_POOL_NAME) || !strcmp(name, FILE_POOL_NAME)) {
+            if (loader.At(p).allocatorPolicy != AllocatorPolicy::FIRST_FIT) {
+                THROW_EXCEPTION("allocator policy is for anonymous pools only");
+            }
+            continue;
+        }
+        if (loader.At(p).size == 0 && _routing_table.FindPool(name) < 0) {
+            // an empty pool that no route uses has nothing to serve
+            continue;
+        }
+        int pool = _routing_table.AddPool(name);
+        if (!strcmp(name, ARENA_POOL_NAME)) {
+            _arena_pool = pool;
+        }
+    }
+    _anon_pools_count = _routing_table.GetPoolsCount();
+    // the hugepages of all the pools are checked before any of them is
+    // mapped
+    PreflightPools(loader, general_params._preflight_policy);
+    for (int i = 0; i < _anon_pools_count; i++) {
+        InitAnonymousMmapPool(_anon_pools[i], _routing_table.GetPoolName(i),
+                              loader, mmap_params._ffa_list_size);
+    }
 
     auto mmap_file_params = hppc.ReadFromEnvironmentVariables
             (HugePagesConfiguration::ConfigType::FILE_BACKED_POOL);
 
+    PoolConfigurationData &mmap_file_configuration_list =
+            loader.GetPool(FILE_POOL_NAME);
+    SetIntervalConfigList(mmap_file_configuration_list);
 
+    _file_mmap_mode = general_params._file_mmap_mode;
+    _mmap_file_pool_size = mmap_file_configuration_list.size;
+    if (_file_mmap_mode == HugePagesConfiguration::FileMmapMode::TRANSPARENT) {
+        // file mappings are served from the page cache, so the hugepages
+        // intervals of the pool (of older layouts) are not used
+        if (mmap_file_configuration_list.intervalList.GetLength() != 0) {
+            const char msg[] = "mosalloc: the hugepages intervals of the file "
+                               "pool are ignored in the transparent mode\n";
+            ssize_t res = write(STDERR_FILENO, msg, sizeof(msg) - 1);
+            (void)res;
+        }
+        // reserve the pool address space only (it is never backed by the
+        // pool), and align it so file mappings could be placed on 2MB
+        // boundaries
+        size_t reserved_size = _mmap_file_pool_size + (size_t)PageSize::HUGE_2MB;
+        void* reserved = GlibcMmap(nullptr, reserved_size, PROT_NONE,
+                                   MMAP_FLAGS | MAP_NORESERVE, -1, 0);
+        if (reserved == MAP_FAILED) {
+            THROW_EXCEPTION("failed to reserve the file mmap pool");
+        }
+        _mmap_file_base = (void*)ROUND_UP(reserved, PageSize::HUGE_2MB);
+    } else {
+        _mmap_file_hpbr.SetName(FILE_POOL_NAME);
+        _mmap_file_hpbr.Initialize(mmap_file_configuration_list.size,
+                                   mmap_file_configuration_list.intervalList,
+                                   GlibcMmap,
+                                   GlibcMunmap,
+                                   GlibcMprotect);
+        _mmap_file_base = _mmap_file_hpbr.GetRegionBase();
+    }
 
-    PoolConfigurationData mmap_file_configuration_list;
-    std::string file_type = "file";
-    SetIntervalConfigList(mmap_file_configuration_list, mmap_params.configuration_file, file_type.c_str());
-
-    mmap_file_configuration_list.intervalList.Initialize(GlibcMmap, GlibcMunmap, 0);
-    _mmap_file_hpbr.Initialize(mmap_file_configuration_list.size,
-                               mmap_file_configuration_list.intervalList,
-                               GlibcMmap,
-                               GlibcMunmap);
-
-    void* mmap_file_start = _mmap_file_hpbr.GetRegionBase();
-    void* mmap_file_end = (void*)((size_t)start + mmap_file_configuration_list.size);
+    void* mmap_file_start = _mmap_file_base;
+    void* mmap_file_end = PTR_ADD(mmap_file_start, _mmap_file_pool_size);
     _mmap_file_ffa.Initialize(mmap_file_params._ffa_list_size, mmap_file_start,
                               mmap_file_end, GlibcMmap, GlibcMunmap);
 
-    auto brk_params = hppc.ReadFromEnvironmentVariables
-            (HugePagesConfiguration::ConfigType::BRK_POOL);
-    PoolConfigurationData brk_configuration_list;
-    std::string brk_type = "brk";
-    SetIntervalConfigList(brk_configuration_list, brk_params.configuration_file, brk_type.c_str());
+    PoolConfigurationData &brk_configuration_list =
+            loader.GetPool(BRK_POOL_NAME);
+    SetIntervalConfigList(brk_configuration_list);
+    _brk_hpbr.SetName(BRK_POOL_NAME);
     _brk_hpbr.Initialize(brk_configuration_list.size,
                          brk_configuration_list.intervalList,
                          GlibcMmap,
                          GlibcMunmap,
+                         GlibcMprotect,
                          brk_region_base);
 
-    _mmap_anon_hpbr.Resize(0);
-    _mmap_file_hpbr.Resize(0);
+    for (int i = 0; i < _anon_pools_count; i++) {
+        _anon_pools[i]._hpbr.Resize(0);
+    }
+    if (_file_mmap_mode == HugePagesConfiguration::FileMmapMode::POOL) {
+        _mmap_file_hpbr.Resize(0);
+    }
     _brk_hpbr.Resize(0);
+    _brk_top.store(_brk_hpbr.GetRegionBase(), std::memory_order_release);
 
-    _anon_mmap_max_size = 0;
     _file_mmap_max_size = 0;
+    _file_mmap_bytes = 0;
+    _file_mmap_max_bytes = 0;
+    _file_mmap_aligned_bytes = 0;
     _brk_max_size = 0;
 
-    auto general_params = hppc.GetGeneralParams();
-    _analyze_hpbrs = general_params._analyze_hpbrs;
+    // the profile is reported along with the pools sizes
+    _profile = general_params._profile;
+    _profile_budget = general_params._profile_budget;
+    _analyze_hpbrs = general_params._analyze_hpbrs || _profile;
+    _fork_policy = general_params._fork_policy;
+
+    if (_profile) {
+        _profiler.Initialize(GlibcMmap, GlibcMunmap);
+        for (int i = 0; i < _anon_pools_count; i++) {
+            _profiler.AddPool(_routing_table.GetPoolName(i),
+                              _anon_pools[i]._hpbr.GetRegionBase(),
+                              _anon_pools[i]._hpbr.GetRegionMaxSize(), true,
+                              _anon_pools[i]._allocator_policy);
+        }
+        _profiler.AddPool(BRK_POOL_NAME, _brk_hpbr.GetRegionBase(),
+                          _brk_hpbr.GetRegionMaxSize(), true,
+                          AllocatorPolicy::FIRST_FIT);
+        // file mappings cannot be backed by hugepages
+        _profiler.AddPool(FILE_POOL_NAME, _mmap_file_base,
+                          _mmap_file_pool_size, false,
+                          AllocatorPolicy::FIRST_FIT);
+    }
 
     if (_analyze_hpbrs) {
-        void* anon_start = _mmap_anon_hpbr.GetRegionBase();
-        void* anon_end = PTR_ADD(anon_start, _mmap_anon_hpbr.GetRegionMaxSize());
+        void* anon_start = _anon_pools[0]._hpbr.GetRegionBase();
+        void* anon_end = PTR_ADD(anon_start, _anon_pools[0]._hpbr.GetRegionMaxSize());
         void* brk_start = _brk_hpbr.GetRegionBase();
         void* brk_end = PTR_ADD(brk_start, _brk_hpbr.GetRegionMaxSize());
-        void* file_start = _mmap_file_hpbr.GetRegionBase();
-        void* file_end = PTR_ADD(file_start, _mmap_file_hpbr.GetRegionMaxSize());
+        void* file_start = _mmap_file_base;
+        void* file_end = PTR_ADD(file_start, _mmap_file_pool_size);
 
         pid_t pid = getpid();
         pid_t tid = syscall(SYS_gettid);
@@ -127,18 +315,62 @@ void MemoryAllocator::InitRegions(void *brk_region_base) {
 }
 
 MemoryAllocator::MemoryAllocator() : 
-    _isInitialized(true), _analyze_hpbrs(false),
-    _anon_mmap_max_size(0), _file_mmap_max_size(0), _brk_max_size(0)
+    _isInitialized(true),
+    _file_mmap_mode(HugePagesConfiguration::FileMmapMode::POOL),
+    _mmap_file_base(nullptr), _mmap_file_pool_size(0),
+    _analyze_hpbrs(false),
+    _fork_policy(HugePagesConfiguration::ForkPolicy::KEEP),
+    _fork_passthrough(false), _file_mmap_max_size(0),
+    _file_mmap_bytes(0), _file_mmap_max_bytes(0), _file_mmap_aligned_bytes(0), _brk_max_size(0),
+    _startup_time(0), _startup_retired_bytes(0),
+    _profile(false), _profile_budget(0)
 {
+    auto start = std::chrono::steady_clock::now();
     InitRegions(_brk_region_base);
+    _startup_time = std::chrono::steady_clock::now() - start;
 }
 
 MemoryAllocator::~MemoryAllocator() {
     _isInitialized = false;
 }
 
+/*
+ * ProfileRegions samples the pools at exit, and writes the profile of the
+ * run (mosalloc_profile.<pid>.csv) and the layout that is generated from it
+ * (mosalloc_layout.<pid>.csv).
+ */
+void MemoryAllocator::ProfileRegions() {
+    for (int i = 0; i < _anon_pools_count; i++) {
+        _profiler.Sample(i, 0, _anon_pools[i]._hpbr.GetRegionSize());
+        _profiler.UpdatePeakExtent(i, _anon_pools[i]._max_extent);
+    }
+    // the brk pool is allocated up to the program break
+    _profiler.Sample(_anon_pools_count, 0, _brk_hpbr.GetRegionSize());
+    _profiler.UpdatePeakExtent(_anon_pools_count, _brk_max_size);
+    _profiler.UpdatePeakExtent(_anon_pools_count + 1, _file_mmap_max_size);
+    _profiler.Plan(_profile_budget);
+
+    std::string pid_str = std::to_string(getpid());
+    std::string fileName = "mosalloc_profile." + pid_str + ".csv";
+    FILE *profile_file = fopen(fileName.c_str(), "w+");
+    if (profile_file != NULL) {
+        _profiler.WriteProfile(profile_file);
+        fclose(profile_file);
+    }
+    fileName = "mosalloc_layout." + pid_str + ".csv";
+    FILE *layout_file = fopen(fileName.c_str(), "w+");
+    if (layout_file != NULL) {
+        _profiler.WriteLayout(layout_file, _routing_table);
+        fclose(layout_file);
+    }
+}
+
 void MemoryAllocator::AnalyzeRegions() {
 
+    if (_profile) {
+        ProfileRegions();
+    }
+
     if (_analyze_hpbrs) {
         /* Write regions max size to log file */
         std::string pid_str;
@@ -150,8 +382,36 @@ void MemoryAllocator::AnalyzeRegions() {
         FILE *log_file = fopen (fileName.c_str(), "w+");
         fprintf(log_file, "region,max-size\n");
         fprintf(log_file, "brk,%lu\n", _brk_max_size);
-        fprintf(log_file, "anon-mmap,%lu\n", _anon_mmap_max_size);
+        fprintf(log_file, "anon-mmap,%lu\n", _anon_pools[0]._max_size);
+        for (int i = 1; i < _anon_pools_count; i++) {
+            fprintf(log_file, "anon-mmap:%s,%lu\n",
+                    _routing_table.GetPoolName(i), _anon_pools[i]._max_size);
+        }
         fprintf(log_file, "file-mmap,%lu\n", _file_mmap_max_size);
+        fprintf(log_file, "file-mmap-mapped,%lu\n", _file_mmap_max_bytes);
+        fprintf(log_file, "file-mmap-2mb-aligned,%lu\n", _file_mmap_aligned_bytes);
+        fprintf(log_file, "startup-time-ns,%lld\n", (long long)_startup_time.count());
+        fprintf(log_file, "startup-retired-bytes,%lu\n", _startup_retired_bytes);
+        if (_profile) {
+            // the memory of each pool that is resident at exit (of all
+            // page sizes), by numa_maps
+            try {
+                NumaMaps numa_maps(getpid());
+                for (int i = 0; i < _anon_pools_count; i++) {
+                    void* base = _anon_pools[i]._hpbr.GetRegionBase();
+                    fprintf(log_file, "resident:%s,%lu\n",
+                            _routing_table.GetPoolName(i),
+                            numa_maps.GetResidentMemory(base,
+                                    PTR_ADD(base, _anon_pools[i]._hpbr.GetRegionMaxSize())));
+                }
+                void* brk_base = _brk_hpbr.GetRegionBase();
+                fprintf(log_file, "resident:brk,%lu\n",
+                        numa_maps.GetResidentMemory(brk_base,
+                                PTR_ADD(brk_base, _brk_hpbr.GetRegionMaxSize())));
+            } catch (const std::exception &) {
+                // numa_maps is not available (e.g., no NUMA support)
+            }
+        }
         fclose(log_file);
         /*
            std::string fileName = "mosalloc_hpbrs_sizes." + pid_str + ".csv";
@@ -164,75 +424,561 @@ void MemoryAllocator::AnalyzeRegions() {
     }
 }
 
+void MemoryAllocator::RecordStartup(std::chrono::nanoseconds activation_time,
+                                    size_t retired_bytes) {
+    _startup_time += activation_time;
+    _startup_retired_bytes += retired_bytes;
+}
+
+void MemoryAllocator::LockPools(bool brk_pool) {
+#ifdef THREAD_SAFETY
+    _control_mutex.lock();
+    for (int i = 0; i < _anon_pools_count; i++) {
+        _anon_pools[i]._mutex.lock();
+    }
+    _file_mmap_mutex.lock();
+    if (brk_pool) {
+        _brk_mutex.lock();
+    }
+#endif // THREAD_SAFETY
+}
+
+void MemoryAllocator::UnlockPools(bool brk_pool) {
+#ifdef THREAD_SAFETY
+    if (brk_pool) {
+        _brk_mutex.unlock();
+    }
+    _file_mmap_mutex.unlock();
+    for (int i = _anon_pools_count - 1; i >= 0; i--) {
+        _anon_pools[i]._mutex.unlock();
+    }
+    _control_mutex.unlock();
+#endif // THREAD_SAFETY
+}
+
+void MemoryAllocator::ResetAfterFork() {
+    if (_fork_policy == HugePagesConfiguration::ForkPolicy::KEEP) {
+        return;
+    }
+
+    // release the committed memory above the top of the allocations (the
+    // brk pool is already committed up to the program break only)
+    for (int i = 0; i < _anon_pools_count; i++) {
+        AnonymousMmapPool &pool = _anon_pools[i];
+        MUTEX_GUARD(pool._mutex);
+        ShrinkAnonymousMmapPool(pool, 0);
+    }
+
+    if (_fork_policy == HugePagesConfiguration::ForkPolicy::PASSTHROUGH) {
+        _fork_passthrough = true;
+    }
+}
+
 void* MemoryAllocator::GetBrkRegionBase() {
     return _brk_hpbr.GetRegionBase();
 }
 
-void* MemoryAllocator::AllocateFromAnonymousMmapRegion(size_t length) {
-    MUTEX_GUARD(_anon_mmap_mutex);
+/*
+ * MapAnonymousRange backs [ptr, ptr+length), which was just allocated from
+ * the anonymous FFA, with memory of the requested protection.
+ * PROT_NONE reservations get address space only: the part of the range that
+ * is not committed is covered by a PROT_NONE placeholder mapping (so nothing
+ * else could be mapped there), and it is committed when it becomes
+ * accessible (e.g., by a later mprotect).
+ */
+void* MemoryAllocator::MapAnonymousRange(AnonymousMmapPool &pool, void *ptr,
+                                         size_t length, int prot, bool replace) {
+    int res = CommitAnonymousRange(pool, ptr, length, prot);
+    if (res == 0 && replace) {
+        // a new mapping is zero-filled, so clear the memory it replaces
+        res = pool._hpbr.Clear(ptr, length);
+    }
+    if (res == 0) {
+        res = ProtectAnonymousRange(pool, ptr, length, prot);
+    }
+    if (res != 0) {
+        errno = -res;
+        return MAP_FAILED;
+    }
+    return ptr;
+}
+
+/*
+ * CommitAnonymousRange commits [ptr, ptr+length) only (rather than the pool
+ * memory below it), or reserves it if it is not accessible.
+ */
+int MemoryAllocator::CommitAnonymousRange(AnonymousMmapPool &pool, void *ptr,
+                                          size_t length, int prot) {
+    if (prot == PROT_NONE) {
+        return pool._hpbr.Reserve(ptr, length);
+    }
+    if (pool._hpbr.Commit(ptr, length) != 0) {
+        return -ENOMEM;
+    }
+    if (pool._max_size < pool._hpbr.GetCommittedSize()) {
+        pool._max_size = pool._hpbr.GetCommittedSize();
+    }
+    return 0;
+}
+
+/*
+ * ProtectAnonymousRange protects [addr, addr+len) of the pool. A hugepage
+ * cannot be split, so the free parts of the hugepages at the edges of the
+ * range get its protection as well (and the rest of them must already have
+ * it, see HugePageBackedRegion::Protect). With check_only it only checks
+ * that the range could be protected.
+ */
+int MemoryAllocator::ProtectAnonymousRange(AnonymousMmapPool &pool, void *addr,
+                                           size_t len, int prot,
+                                           bool check_only) {
+    size_t start_addr = (size_t)addr;
+    size_t end_addr = ROUND_UP(start_addr + len, PageSize::BASE_4KB);
+    void *free_start, *free_end;
+    size_t page_addr = ROUND_DOWN(start_addr, pool._hpbr.GetPageSize(addr));
+    if (page_addr < start_addr &&
+        pool._ffa.FindFreeRegion((void*)page_addr, &free_start, &free_end) &&
+        (size_t)free_end >= start_addr) {
+        start_addr = page_addr;
+    }
+    page_addr = ROUND_UP(end_addr, pool._hpbr.GetPageSize((void*)(end_addr - 1)));
+    if (page_addr > end_addr &&
+        pool._ffa.FindFreeRegion((void*)end_addr, &free_start, &free_end) &&
+        (size_t)free_end >= page_addr) {
+        end_addr = page_addr;
+    }
+    if (check_only) {
+        return pool._hpbr.CanProtect((void*)start_addr, end_addr - start_addr,
+                                     prot) ? 0 : -EINVAL;
+    }
+    return pool._hpbr.Protect((void*)start_addr, end_addr - start_addr, prot);
+}
+
+/*
+ * FreeAnonymousRange returns [addr, addr+length) to the pool. The free
+ * memory around it could be served again, so its protection is reset (the
+ * hugepages that it shares with memory in use keep their protection).
+ */
+int MemoryAllocator::FreeAnonymousRange(AnonymousMmapPool &pool, void *addr,
+                                        size_t length) {
+    int res = pool._ffa.Free(addr, length);
+    if (res != 0) {
+        return res;
+    }
+    pool._bytes -= std::min(length, pool._bytes);
+    void *free_start = addr, *free_end = PTR_ADD(addr, length);
+    pool._ffa.FindFreeRegion(addr, &free_start, &free_end);
+    size_t free_length = (size_t)PTR_SUB(free_end, free_start);
+    res = pool._hpbr.ResetProtection(free_start, free_length);
+    if (res == 0) {
+        // the memory above the committed prefix is not kept once it is free
+        res = pool._hpbr.Release(addr, length, free_start, free_length);
+    }
+    return res;
+}
+
+/*
+ * ShrinkAnonymousMmapPool releases the free memory at the top of the
+ * committed prefix of the pool, if it is larger than the threshold.
+ */
+int MemoryAllocator::ShrinkAnonymousMmapPool(AnonymousMmapPool &pool,
+                                             size_t threshold) {
+    size_t region_size = pool._hpbr.GetRegionSize();
+    void *free_start, *free_end;
+    if (region_size == 0 ||
+        !pool._ffa.FindFreeRegion(PTR_ADD(pool._hpbr.GetRegionBase(),
+                                          region_size - 1),
+                                  &free_start, &free_end)) {
+        return 0;
+    }
+    auto new_size = (size_t)(PTR_SUB(free_start, pool._hpbr.GetRegionBase()));
+    if (region_size - new_size <= threshold) {
+        return 0;
+    }
+    if (_profile) {
+        // record the density of the memory before it is released
+        _profiler.Sample((int)(&pool - _anon_pools), new_size,
+                         region_size - new_size);
+    }
+    return pool._hpbr.Resize(new_size);
+}
+
+RoutingTable::RouteTarget MemoryAllocator::RouteMmapRequest(
+        size_t length, int prot, int flags, int fd, int &pool) {
+    if (_fork_passthrough) {
+        return RoutingTable::RouteTarget::PASSTHROUGH;
+    }
+    return _routing_table.Find(length, prot, flags, fd, pool);
+}
+
+int MemoryAllocator::FindAnonymousMmapPool(void *addr) {
+    for (int i = 0; i < _anon_pools_count; i++) {
+        if (_anon_pools[i]._ffa.Contains(addr)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void* MemoryAllocator::AllocateFromAnonymousMmapRegion(void *addr, size_t length,
+                                                       int prot, int flags,
+                                                       int pool_index,
+                                                       size_t alignment) {
+    PollControl();
+    bool is_fixed = (flags & (MAP_FIXED | MAP_FIXED_NOREPLACE)) != 0;
+    // fixed mappings are placed in the pool that contains them, regardless
+    // of the pool they were routed to
+    if (is_fixed && addr != NULL) {
+        int fixed_pool_index = FindAnonymousMmapPool(addr);
+        if (fixed_pool_index >= 0) {
+            pool_index = fixed_pool_index;
+            void *pool_end = _anon_pools[pool_index]._ffa.GetEndAddress();
+            size_t pool_length = (size_t)PTR_SUB(pool_end, addr);
+            if (ROUND_UP(length, PageSize::BASE_4KB) > pool_length) {
+                return AllocateAcrossPoolEnd(addr, length, prot, flags,
+                                             pool_index, pool_length);
+            }
+        }
+    }
+    AnonymousMmapPool &pool = _anon_pools[pool_index];
+    MUTEX_GUARD(pool._mutex);
+
+    // mmap returns page-aligned mappings
+    length = ROUND_UP(length, PageSize::BASE_4KB);
+
+    void *ptr = NULL;
+    bool is_replaced = false;
+    if (addr != NULL && IS_ALIGNED(addr, PageSize::BASE_4KB)
+        && pool._ffa.Contains(addr)
+        && pool._ffa.Contains(PTR_ADD(addr, length - 1))) {
+        if ((flags & MAP_FIXED) && !(flags & MAP_FIXED_NOREPLACE)) {
+            // MAP_FIXED replaces any existing mapping in the range, so make
+            // sure that the new mapping could be placed before the existing
+            // one is dropped
+            int res = ReplaceAnonymousRange(pool, addr, length, prot);
+            if (res != 0) {
+                errno = -res;
+                return MAP_FAILED;
+            }
+            is_replaced = true;
+        }
+        // try to use the address (hint) as is
+        ptr = pool._ffa.AllocateAt(addr, length);
+    }
+    if (ptr == NULL && is_fixed) {
+        errno = (flags & MAP_FIXED_NOREPLACE) ? EEXIST : EINVAL;
+        return MAP_FAILED;
+    }
 
-    void *ptr = _mmap_anon_ffa.Allocate(length);
     if (ptr == NULL) {
-        THROW_EXCEPTION("Anonymous mmap pool is out of memory\n");
+        // keep reservations away from the bottom of the pool, which is
+        // committed first, so they will not be backed by hugepages when the
+        // region grows for other allocations
+        if (alignment != 0) {
+            ptr = pool._ffa.AllocateAligned(length, alignment);
+        } else if (pool._allocator_policy == AllocatorPolicy::PAGE_ALIGNED &&
+                   length >= pool._page_alignment) {
+            // fall back to the first fit if no aligned range is free
+            ptr = pool._ffa.AllocateAligned(length, pool._page_alignment);
+            if (ptr == NULL) {
+                ptr = pool._ffa.Allocate(length);
+            }
+        } else if (prot == PROT_NONE ||
+                   pool._allocator_policy == AllocatorPolicy::LAST_FIT) {
+            ptr = pool._ffa.AllocateFromTop(length);
+        } else {
+            ptr = pool._ffa.Allocate(length);
+        }
+        if (ptr == NULL) {
+            REPORT_ERROR(MosallocError::POOL_OUT_OF_MEMORY,
+                         "anonymous mmap pool is out of memory");
+            errno = ENOMEM;
+            return MAP_FAILED;
+        }
     }
-    size_t hpbr_top_addr = (size_t)_mmap_anon_hpbr.GetRegionBase() +
-            _mmap_anon_hpbr.GetRegionSize();
-    size_t alloc_mem_top_addr = (size_t)ptr + length;
+    pool._bytes += length;
 
-    if (alloc_mem_top_addr > hpbr_top_addr) {
-        size_t size = alloc_mem_top_addr - (size_t)_mmap_anon_hpbr.GetRegionBase();
-        _mmap_anon_hpbr.Resize(size);
+    void *res = MapAnonymousRange(pool, ptr, length, prot, is_replaced);
+    if (res == MAP_FAILED && errno == EINVAL && !is_fixed) {
+        // the range shares a hugepage with memory of another protection, so
+        // place it on hugepages of its own (their free tail keeps its
+        // protection)
+        FreeAnonymousRange(pool, ptr, length);
+        size_t page_size = std::max(pool._page_alignment,
+                                    pool._hpbr.GetPageSize(ptr));
+        size_t aligned_length = ROUND_UP(length, page_size);
+        ptr = pool._ffa.AllocateAligned(aligned_length, page_size);
+        if (ptr == NULL) {
+            REPORT_ERROR(MosallocError::POOL_OUT_OF_MEMORY,
+                         "anonymous mmap pool is out of memory");
+            errno = ENOMEM;
+            return MAP_FAILED;
+        }
+        pool._bytes += aligned_length;
+        res = MapAnonymousRange(pool, ptr, aligned_length, prot, false);
+        if (res != MAP_FAILED) {
+            FreeAnonymousRange(pool, PTR_ADD(ptr, length),
+                               aligned_length - length);
+        } else {
+            length = aligned_length;
+        }
     }
+    if (res == MAP_FAILED) {
+        int err = errno;
+        FreeAnonymousRange(pool, ptr, length);
+        errno = err;
+    } else {
+        if (pool._max_bytes < pool._bytes) {
+            pool._max_bytes = pool._bytes;
+        }
+        size_t extent = (size_t)PTR_ADD(res, length) -
+                        (size_t)pool._hpbr.GetRegionBase();
+        if (pool._max_extent < extent) {
+            pool._max_extent = extent;
+        }
+    }
+    return res;
+}
 
-    if (_anon_mmap_max_size < _mmap_anon_hpbr.GetRegionSize()) {
-        _anon_mmap_max_size = _mmap_anon_hpbr.GetRegionSize();
+/*
+ * ReplaceAnonymousRange frees [addr, addr+length) of the pool for a MAP_FIXED
+ * mapping that replaces it. The range is committed (or reserved) and its
+ * protection is checked first, so the existing mappings are kept if the new
+ * one cannot be placed (as mmap leaves them on failure).
+ */
+int MemoryAllocator::ReplaceAnonymousRange(AnonymousMmapPool &pool, void *addr,
+                                           size_t length, int prot) {
+    // freeing the range and allocating it again splits up to two occupied
+    // regions and up to two free regions
+    if (pool._ffa.GetFreeNodesCount() < REPLACE_FFA_NODES) {
+        return -ENOMEM;
+    }
+    int res = CommitAnonymousRange(pool, addr, length, prot);
+    if (res == 0) {
+        res = ProtectAnonymousRange(pool, addr, length, prot, true);
+    }
+    if (res == 0) {
+        size_t free_space = pool._ffa.GetFreeSpace();
+        if (pool._ffa.FreeRange(addr, length) < 0) {
+            return -ENOMEM;
+        }
+        size_t freed_bytes = pool._ffa.GetFreeSpace() - free_space;
+        pool._bytes -= std::min(freed_bytes, pool._bytes);
     }
+    return res;
+}
 
-    return ptr;
+/*
+ * AllocateAcrossPoolEnd serves a MAP_FIXED mapping that starts in an
+ * anonymous pool and ends beyond it: the part beyond the pool is mapped by
+ * the kernel (or by the pool that contains it) as it would be without the
+ * pools.
+ */
+void* MemoryAllocator::AllocateAcrossPoolEnd(void *addr, size_t length,
+                                             int prot, int flags,
+                                             int pool_index,
+                                             size_t pool_length) {
+    void *rest_addr = PTR_ADD(addr, pool_length);
+    size_t rest_length = length - pool_length;
+    void *rest = MAP_FAILED;
+    if (FindAnonymousMmapPool(rest_addr) >= 0) {
+        rest = AllocateFromAnonymousMmapRegion(rest_addr, rest_length, prot,
+                                               flags, pool_index);
+    } else if (IsAddressInHugePageRegions(rest_addr)) {
+        // the brk and file pools cannot serve anonymous mappings
+        errno = EINVAL;
+    } else {
+        rest = GlibcMmap(rest_addr, rest_length, prot, flags, -1, 0);
+    }
+    if (rest == MAP_FAILED) {
+        return MAP_FAILED;
+    }
+    void *res = AllocateFromAnonymousMmapRegion(addr, pool_length, prot, flags,
+                                                pool_index);
+    if (res == MAP_FAILED) {
+        int err = errno;
+        if (FindAnonymousMmapPool(rest_addr) >= 0) {
+            DeallocateFromMmapRegion(rest_addr, rest_length);
+        } else {
+            GlibcMunmap(rest_addr, rest_length);
+        }
+        errno = err;
+    }
+    return res;
+}
+
+/*
+ * AllocateFromArenaPool serves the heaps of the malloc arenas (see
+ * mosalloc_arena.h). A heap is placed on an address that is aligned to the
+ * largest power of two that fits its length (so a HEAP_MAX_SIZE heap is
+ * aligned to HEAP_MAX_SIZE on the first attempt), and the heaps are placed
+ * from the bottom of the pool (even though they are reserved as PROT_NONE),
+ * because they are used right away. Each heap commits only the part that
+ * grow_heap makes accessible (by mprotect).
+ */
+void* MemoryAllocator::AllocateFromArenaPool(void *addr, size_t length,
+                                             int prot, int flags) {
+    size_t alignment = 0;
+    if ((flags & (MAP_FIXED | MAP_FIXED_NOREPLACE)) == 0 && length != 0) {
+        alignment = (size_t)1 << (63 - __builtin_clzl(length));
+        alignment = std::max(alignment, (size_t)PageSize::BASE_4KB);
+    }
+    // the pool commits reservations when they become accessible
+    flags &= ~MAP_NORESERVE;
+    return AllocateFromAnonymousMmapRegion(addr, length, prot, flags,
+                                           _arena_pool, alignment);
+}
+
+size_t MemoryAllocator::GetArenaHeapsLimit(size_t heap_max_size) {
+    AnonymousMmapPool &pool = _anon_pools[_arena_pool];
+    size_t pool_size = (size_t)PTR_SUB(pool._ffa.GetEndAddress(),
+                                       pool._hpbr.GetRegionBase());
+    // the last heap needs room for its double reservation
+    size_t heaps = pool_size / heap_max_size;
+    return (heaps > 0) ? heaps - 1 : 0;
+}
+
+void* MemoryAllocator::AllocateFromNamedPool(const char *pool, size_t length,
+                                             int prot) {
+    int pool_index = _routing_table.FindPool(pool);
+    if (pool_index < 0 || length == 0) {
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+    return AllocateFromAnonymousMmapRegion(NULL, length, prot, MMAP_FLAGS,
+                                           pool_index);
 }
 
 void* MemoryAllocator::AllocateFromFileMmapRegion(
         void *addr, size_t length, int prot, 
         int flags, int fd, off_t offset) {
+    // MAP_FIXED mappings outside of the pool are placed by the caller
+    bool is_fixed = (flags & (MAP_FIXED | MAP_FIXED_NOREPLACE)) != 0;
+    if (is_fixed && !_mmap_file_ffa.Contains(addr)) {
+        return GlibcMmap(addr, length, prot, flags, fd, offset);
+    }
+
     MUTEX_GUARD(_file_mmap_mutex);
 
-    void* ptr = addr;
+    // mmap returns page-aligned mappings
+    length = ROUND_UP(length, PageSize::BASE_4KB);
+
+    void* ptr = NULL;
+    if (addr != NULL && IS_ALIGNED(addr, PageSize::BASE_4KB)
+        && _mmap_file_ffa.Contains(addr)
+        && _mmap_file_ffa.Contains(PTR_ADD(addr, length - 1))) {
+        if ((flags & MAP_FIXED) && !(flags & MAP_FIXED_NOREPLACE)) {
+            // MAP_FIXED replaces any existing mapping in the range
+            FreeFileMmapRange(addr, length, true);
+        }
+        // try to use the address (hint) as is
+        ptr = _mmap_file_ffa.AllocateAt(addr, length);
+    }
+    if (ptr == NULL && is_fixed) {
+        errno = (flags & MAP_FIXED_NOREPLACE) ? EEXIST : EINVAL;
+        return MAP_FAILED;
+    }
+
+    bool is_transparent =
+        (_file_mmap_mode == HugePagesConfiguration::FileMmapMode::TRANSPARENT);
+    if (ptr == NULL && is_transparent && length >= (size_t)PageSize::HUGE_2MB) {
+        // place the mapping so its 2MB file-offset chunks fall on 2MB
+        // virtual boundaries, which file THP requires
+        ptr = _mmap_file_ffa.AllocateAligned(length, (size_t)PageSize::HUGE_2MB,
+                                             offset % (size_t)PageSize::HUGE_2MB);
+    }
     if (ptr == NULL) {
         ptr = _mmap_file_ffa.Allocate(length);
         if (ptr == NULL) {
-            THROW_EXCEPTION("File mmap pool is out of memory\n");
+            REPORT_ERROR(MosallocError::POOL_OUT_OF_MEMORY,
+                         "file mmap pool is out of memory");
+            errno = ENOMEM;
+            return MAP_FAILED;
+        }
+    }
+
+    // the range is already reserved by the pool, so replace it
+    int mmap_flags = (flags & ~MAP_FIXED_NOREPLACE) | MAP_FIXED;
+    void* res = GlibcMmap(ptr, length, prot, mmap_flags, fd, offset);
+    if (res == MAP_FAILED) {
+        int err = errno;
+        _mmap_file_ffa.Free(ptr, length);
+        if (is_transparent) {
+            ReserveFileMmapRange(ptr, length);
         }
+        errno = err;
+        return MAP_FAILED;
     }
 
-    size_t ffa_max_size = (size_t)_mmap_file_ffa.GetTopAddress() - (size_t)_mmap_file_hpbr.GetRegionBase();
+    if (is_transparent && length >= (size_t)PageSize::HUGE_2MB) {
+        // a hint only: it fails for files that cannot use hugepages
+        madvise(res, length, MADV_HUGEPAGE);
+    }
+
+    _file_mmap_bytes += length;
+    if (_file_mmap_max_bytes < _file_mmap_bytes) {
+        _file_mmap_max_bytes = _file_mmap_bytes;
+    }
+    if (IS_ALIGNED(res, PageSize::HUGE_2MB) &&
+        IS_ALIGNED(offset, PageSize::HUGE_2MB)) {
+        _file_mmap_aligned_bytes += length;
+    }
+    size_t ffa_max_size = (size_t)_mmap_file_ffa.GetTopAddress() - (size_t)_mmap_file_base;
     if (_file_mmap_max_size < ffa_max_size) {
         _file_mmap_max_size = ffa_max_size;
     }
 
-    return GlibcMmap(ptr, length, prot, MAP_FIXED | flags, fd, offset);
+    return res;
 }
 
-int MemoryAllocator::DeallocateFromAnonymousMmapRegion(void* addr, size_t length) {
-    MUTEX_GUARD(_anon_mmap_mutex);
-    int res = _mmap_anon_ffa.Free(addr, length);
-    auto ffa_top_size = (size_t)(PTR_SUB(_mmap_anon_ffa.GetTopAddress(),
-                                           _mmap_anon_hpbr.GetRegionBase()));
-    if (res == 0
-        && ffa_top_size < _mmap_anon_hpbr.GetRegionSize()) {
-        if ((_mmap_anon_hpbr.GetRegionSize() - ffa_top_size)
-            > RESIZE_THRESHOLD) {
-            return _mmap_anon_hpbr.Resize(ffa_top_size);
-        }
+int MemoryAllocator::ReserveFileMmapRange(void* addr, size_t length) {
+    void* res = GlibcMmap(addr, length, PROT_NONE,
+                          MMAP_FLAGS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+    return (res == MAP_FAILED) ? -1 : 0;
+}
+
+/*
+ * FreeFileMmapRange releases [addr, addr+length) from the file pool.
+ * In the transparent mode the range is reserved again (so nothing else could
+ * be mapped there), unless it is about to be replaced by a new mapping.
+ */
+int MemoryAllocator::FreeFileMmapRange(void* addr, size_t length,
+                                       bool replace) {
+    size_t free_space = _mmap_file_ffa.GetFreeSpace();
+    int res = _mmap_file_ffa.FreeRange(addr, length);
+    if (res < 0)
+        return res;
+    size_t freed_bytes = _mmap_file_ffa.GetFreeSpace() - free_space;
+    _file_mmap_bytes -= std::min(freed_bytes, _file_mmap_bytes);
+
+    if (replace) {
+        return 0;
     }
+    if (_file_mmap_mode == HugePagesConfiguration::FileMmapMode::TRANSPARENT) {
+        return ReserveFileMmapRange(addr, length);
+    }
+    return GlibcMunmap(addr, length);
+}
 
+int MemoryAllocator::DeallocateFromAnonymousMmapRegion(AnonymousMmapPool &pool,
+                                                       void* addr, size_t length) {
+    MUTEX_GUARD(pool._mutex);
+    int res = FreeAnonymousRange(pool, addr, length);
+    if (res == 0) {
+        res = ShrinkAnonymousMmapPool(pool, RESIZE_THRESHOLD);
+    }
     return res;
 }
 
 int MemoryAllocator::DeallocateFromFileMmapRegion(void* addr, size_t length) {
     MUTEX_GUARD(_file_mmap_mutex);
+    if (_file_mmap_mode == HugePagesConfiguration::FileMmapMode::TRANSPARENT) {
+        return FreeFileMmapRange(addr, length, false);
+    }
+
     int res = _mmap_file_ffa.Free(addr, length);
     if (res < 0) 
         return res;
+    _file_mmap_bytes -= std::min(length, _file_mmap_bytes);
     
     auto ffa_top_size = (size_t)(PTR_SUB(_mmap_file_ffa.GetTopAddress(),
                                            _mmap_file_hpbr.GetRegionBase()));
@@ -247,13 +993,39 @@ int MemoryAllocator::DeallocateFromFileMmapRegion(void* addr, size_t length) {
 }
 
 int MemoryAllocator::ChangeProgramBreak(void *addr) {
+    PollControl();
     MUTEX_GUARD(_brk_mutex);
+    return SetProgramBreak(addr);
+}
+
+void* MemoryAllocator::Morecore(intptr_t increment) {
+    if (increment == 0) {
+        return GetProgramBreak();
+    }
+
+    PollControl();
+    MUTEX_GUARD(_brk_mutex);
+    void* prev_brk = _brk_top.load(std::memory_order_relaxed);
+    void* new_brk = (void*)((intptr_t)prev_brk + increment);
+    if (SetProgramBreak(new_brk) != 0) {
+        return nullptr;
+    }
+    return prev_brk;
+}
 
+// must be called with _brk_mutex held
+int MemoryAllocator::SetProgramBreak(void *addr) {
     /* 
      * On success, brk() returns zero.  On error, -1 is returned, 
      * and errno is set to ENOMEM. 
     */
     size_t new_size = (size_t)addr - (size_t)_brk_hpbr.GetRegionBase();
+    if (_profile && addr >= _brk_hpbr.GetRegionBase() &&
+        new_size < _brk_hpbr.GetRegionSize()) {
+        // record the density of the memory before it is released
+        _profiler.Sample(_anon_pools_count, new_size,
+                         _brk_hpbr.GetRegionSize() - new_size);
+    }
     if (addr < _brk_hpbr.GetRegionBase() ||
         _brk_hpbr.Resize(new_size) != 0) {
         errno = ENOMEM;
@@ -261,24 +1033,50 @@ int MemoryAllocator::ChangeProgramBreak(void *addr) {
         return -1;
     }
 
+    // memory above the program break is released, so drop its protection
+    int res = _brk_hpbr.ResetProtection(addr,
+                                        _brk_hpbr.GetRegionMaxSize() - new_size);
+    if (res != 0) {
+        errno = -res;
+        return -1;
+    }
+
     if (_brk_max_size < _brk_hpbr.GetRegionSize()) {
         _brk_max_size = _brk_hpbr.GetRegionSize();
     }
 
+    _brk_top.store(addr, std::memory_order_release);
     return 0;
 }
 
 int MemoryAllocator::DeallocateFromMmapRegion(void *addr, size_t size) {
-    _anon_mmap_mutex.lock();
-    bool isAddrInAnonMmapPool = _mmap_anon_ffa.Contains(addr);
-    _anon_mmap_mutex.unlock();
+    PollControl();
+    // munmap removes whole pages
+    size = ROUND_UP(size, PageSize::BASE_4KB);
 
-    _file_mmap_mutex.lock();
-    bool isAddrInFileMmapPool = _mmap_file_ffa.Contains(addr);
-    _file_mmap_mutex.unlock();
+    // the pools boundaries are fixed after initialization
+    int anon_pool_index = FindAnonymousMmapPool(addr);
 
-    if (isAddrInAnonMmapPool) {
-        return DeallocateFromAnonymousMmapRegion(addr, size);
+    bool isAddrInFileMmapPool;
+    {
+        MUTEX_GUARD(_file_mmap_mutex);
+        isAddrInFileMmapPool = _mmap_file_ffa.Contains(addr);
+    }
+
+    if (anon_pool_index >= 0) {
+        AnonymousMmapPool &pool = _anon_pools[anon_pool_index];
+        void *pool_end = pool._ffa.GetEndAddress();
+        size_t pool_size = std::min(size, (size_t)PTR_SUB(pool_end, addr));
+        if (pool_size < size) {
+            // the part beyond the pool was not mapped by the pool
+            int res = IsAddressInHugePageRegions(pool_end) ?
+                DeallocateFromMmapRegion(pool_end, size - pool_size) :
+                GlibcMunmap(pool_end, size - pool_size);
+            if (res != 0) {
+                return res;
+            }
+        }
+        return DeallocateFromAnonymousMmapRegion(pool, addr, pool_size);
     }
     else if (isAddrInFileMmapPool) {
         return DeallocateFromFileMmapRegion(addr, size);
@@ -288,11 +1086,101 @@ int MemoryAllocator::DeallocateFromMmapRegion(void *addr, size_t size) {
     }
 }
 
+int MemoryAllocator::ProtectMemory(void *addr, size_t len, int prot) {
+    /*
+     * On success, mprotect() returns zero.  On error, -1 is returned,
+     * and errno is set appropriately.
+    */
+    int res = 0;
+    int anon_pool_index = FindAnonymousMmapPool(addr);
+    if (anon_pool_index >= 0) {
+        AnonymousMmapPool &pool = _anon_pools[anon_pool_index];
+        void *pool_end = pool._ffa.GetEndAddress();
+        size_t pool_len = std::min(ROUND_UP(len, PageSize::BASE_4KB),
+                                   (size_t)PTR_SUB(pool_end, addr));
+        if (pool_len < len) {
+            // the part beyond the pool was not mapped by the pool
+            res = IsAddressInHugePageRegions(pool_end) ?
+                ProtectMemory(pool_end, len - pool_len, prot) :
+                GlibcMprotect(pool_end, len - pool_len, prot);
+            if (res != 0) {
+                return res;
+            }
+        }
+        MUTEX_GUARD(pool._mutex);
+        // commit reservations (the range only) that become accessible
+        if (prot != PROT_NONE) {
+            res = CommitAnonymousRange(pool, addr, pool_len, prot);
+        }
+        if (res == 0) {
+            res = ProtectAnonymousRange(pool, addr, pool_len, prot);
+        }
+    } else if (_mmap_file_ffa.Contains(addr)) {
+        // file mappings are mapped directly by the kernel
+        return GlibcMprotect(addr, len, prot);
+    } else {
+        MUTEX_GUARD(_brk_mutex);
+        res = _brk_hpbr.Protect(addr, len, prot);
+    }
+
+    if (res != 0) {
+        errno = -res;
+        return -1;
+    }
+    return 0;
+}
+
+void MemoryAllocator::ApplyControlCommands() {
+#ifdef THREAD_SAFETY
+    // another thread applies the commands, or the pools are locked for fork
+    // and the commands are left pending (Morecore polls under the arena
+    // lock, which the forking thread takes after the pools locks)
+    std::unique_lock<std::mutex> lock(_control_mutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return;
+    }
+#endif // THREAD_SAFETY
+    ControlChannel::Command commands[MAX_CONTROL_COMMANDS];
+    int count = mosalloc_control_channel.TakeCommands(commands,
+                                                      MAX_CONTROL_COMMANDS);
+    if (count < 0) {
+        ControlChannel::Command all;
+        strcpy(all._pool, "*");
+        ControlChannel::ReportResult(all, count);
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        ControlChannel::ReportResult(commands[i],
+                                     RemapPoolInterval(commands[i]));
+    }
+}
+
+int MemoryAllocator::RemapPoolInterval(const ControlChannel::Command &command) {
+    if (!strcmp(command._pool, BRK_POOL_NAME)) {
+        MUTEX_GUARD(_brk_mutex);
+        return _brk_hpbr.RemapInterval(command._start_offset,
+                                       command._end_offset,
+                                       command._page_size);
+    }
+    // the file pool memory is replaced by the file mappings, so it cannot
+    // be remapped
+    for (int i = 0; i < _anon_pools_count; i++) {
+        if (!strcmp(command._pool, _routing_table.GetPoolName(i))) {
+            AnonymousMmapPool &pool = _anon_pools[i];
+            MUTEX_GUARD(pool._mutex);
+            return pool._hpbr.RemapInterval(command._start_offset,
+                                            command._end_offset,
+                                            command._page_size);
+        }
+    }
+    return -EINVAL;
+}
+
 bool MemoryAllocator::IsAddressInHugePageRegions(void *addr) {
     if (!_isInitialized)
         return false;
 
-    bool isAddrInAnonMmapPool = _mmap_anon_ffa.Contains(addr);
+    bool isAddrInAnonMmapPool = (FindAnonymousMmapPool(addr) >= 0);
 
     bool isAddrInFileMmapPool = _mmap_file_ffa.Contains(addr);
     
@@ -302,3 +1190,39 @@ bool MemoryAllocator::IsAddressInHugePageRegions(void *addr) {
 
     return (isAddrInAnonMmapPool || isAddrInFileMmapPool || isAddrInBrkPool);
 }
+
+size_t MemoryAllocator::GetPoolRegionSize(const char *pool) {
+    int pool_index = _routing_table.FindPool(pool);
+    if (pool_index < 0) {
+        return 0;
+    }
+    MUTEX_GUARD(_anon_pools[pool_index]._mutex);
+    return _anon_pools[pool_index]._hpbr.GetRegionSize();
+}
+
+size_t MemoryAllocator::GetPoolCommittedSize(const char *pool) {
+    int pool_index = _routing_table.FindPool(pool);
+    if (pool_index < 0) {
+        return 0;
+    }
+    MUTEX_GUARD(_anon_pools[pool_index]._mutex);
+    return _anon_pools[pool_index]._hpbr.GetCommittedSize();
+}
+
+size_t MemoryAllocator::GetPoolMaxAllocatedSize(const char *pool) {
+    int pool_index = _routing_table.FindPool(pool);
+    if (pool_index < 0) {
+        return 0;
+    }
+    MUTEX_GUARD(_anon_pools[pool_index]._mutex);
+    return _anon_pools[pool_index]._max_bytes;
+}
+
+size_t MemoryAllocator::GetPoolMaxExtent(const char *pool) {
+    int pool_index = _routing_table.FindPool(pool);
+    if (pool_index < 0) {
+        return 0;
+    }
+    MUTEX_GUARD(_anon_pools[pool_index]._mutex);
+    return _anon_pools[pool_index]._max_extent;
+}
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <system_error>
 #include <sys/mman.h> 
 #include "MemoryIntervalList.h"
@@ -5,7 +6,8 @@
 
 MemoryIntervalList::MemoryIntervalList() :
     _list_capcaity(0),
-    _list_length(0) {
+    _list_length(0),
+    _owns_storage(true) {
     }
 
 void *MemoryIntervalList::AllocateMemory(size_t size) {
@@ -37,8 +39,23 @@ void MemoryIntervalList::Initialize(MmapFuncPtr allocator,
     }
 }
 
+void MemoryIntervalList::InitializeInPlace(MmapFuncPtr allocator,
+        MunmapFuncPtr deallocator,
+        MemoryInterval *intervals,
+        size_t length) {
+    _list_capcaity = length;
+    _list_length = length;
+    _mmap = allocator;
+    _munmap = deallocator;
+    _interval_list = intervals;
+    _owns_storage = false;
+}
+
 MemoryIntervalList::~MemoryIntervalList() {
-    int res = FreeMemory(_interval_list, _list_capcaity);
+    if (!_owns_storage) {
+        return;
+    }
+    int res = FreeMemory(_interval_list, _list_capcaity * sizeof(MemoryInterval));
     if (res != 0) {
         THROW_EXCEPTION("Failed to deallocate Memory Region Interval List");
     }
@@ -71,16 +88,165 @@ void MemoryIntervalList::SwapIntetrvals(int i, int j) {
     _interval_list[j]._page_size = page_size;
 }
 
+void MemoryIntervalList::SiftDown(size_t root, size_t length) {
+    while (2 * root + 1 < length) {
+        size_t child = 2 * root + 1;
+        if (child + 1 < length &&
+            MemoryInterval::LessThan(_interval_list[child],
+                                     _interval_list[child + 1])) {
+            child++;
+        }
+        if (!MemoryInterval::LessThan(_interval_list[root],
+                                      _interval_list[child])) {
+            return;
+        }
+        SwapIntetrvals(root, child);
+        root = child;
+    }
+}
+
 void MemoryIntervalList::Sort() {
-    // Min/Max Sort
-    for (unsigned int i=0; i<_list_length; i++) {
-        for (unsigned int j=i; j<_list_length; j++) {
-            if (!MemoryInterval::LessThan(_interval_list[i],
-                        _interval_list[j])) {
-                SwapIntetrvals(i, j);
-            }
+    // the lists are usually sorted already (e.g., they are sorted by the
+    // parser, or are used in place from a binary layout), so check it first
+    // rather than rewrite the whole list
+    size_t sorted = 1;
+    for (; sorted < _list_length; sorted++) {
+        if (MemoryInterval::LessThan(_interval_list[sorted],
+                                     _interval_list[sorted - 1])) {
+            break;
+        }
+    }
+    if (sorted >= _list_length) {
+        return;
+    }
+    // Heap sort: in place and O(n log n), since the parser could produce
+    // an interval per hugepage
+    for (size_t i = _list_length / 2; i > 0; i--) {
+        SiftDown(i - 1, _list_length);
+    }
+    for (size_t end = _list_length; end > 1; end--) {
+        SwapIntetrvals(0, end - 1);
+        SiftDown(0, end - 1);
+    }
+}
+
+void MemoryIntervalList::Coalesce() {
+    if (_list_length == 0) {
+        return;
+    }
+    size_t last = 0;
+    for (size_t i = 1; i < _list_length; i++) {
+        MemoryInterval &interval = _interval_list[i];
+        MemoryInterval &prev = _interval_list[last];
+        if (interval._page_size == prev._page_size &&
+            interval._start_offset == prev._end_offset) {
+            prev._end_offset = interval._end_offset;
+            continue;
+        }
+        last++;
+        if (last != i) {
+            _interval_list[last]._start_offset = interval._start_offset;
+            _interval_list[last]._end_offset = interval._end_offset;
+            _interval_list[last]._page_size = interval._page_size;
+        }
+    }
+    _list_length = last + 1;
+}
+
+void MemoryIntervalList::Reserve(size_t capacity) {
+    if (capacity <= _list_capcaity) {
+        return;
+    }
+    MemoryInterval *old_list = _interval_list;
+    size_t old_capacity = _list_capcaity;
+    MemoryInterval *new_list = static_cast<MemoryInterval*>(
+            AllocateMemory(capacity * sizeof(MemoryInterval)));
+    if (new_list == MAP_FAILED) {
+        THROW_EXCEPTION("Failed to grow Memory Region Interval List");
+    }
+    for (size_t i = 0; i < _list_length; i++) {
+        new_list[i]._start_offset = old_list[i]._start_offset;
+        new_list[i]._end_offset = old_list[i]._end_offset;
+        new_list[i]._page_size = old_list[i]._page_size;
+    }
+    _interval_list = new_list;
+    _list_capcaity = capacity;
+    if (_owns_storage) {
+        FreeMemory(old_list, old_capacity * sizeof(MemoryInterval));
+    }
+    _owns_storage = true;
+}
+
+void MemoryIntervalList::SetPageSize(off_t start_offset, off_t end_offset,
+                                     PageSize page_size) {
+    // each split adds at most two intervals
+    if (_list_length + 2 > _list_capcaity) {
+        Reserve(2 * _list_capcaity + 2);
+    }
+    size_t length = _list_length;
+    for (size_t i = 0; i < length; i++) {
+        MemoryInterval &interval = _interval_list[i];
+        if (interval._end_offset <= start_offset ||
+            interval._start_offset >= end_offset) {
+            continue;
+        }
+        if (interval._start_offset < start_offset) {
+            AddInterval(interval._start_offset, start_offset, interval._page_size);
+            interval._start_offset = start_offset;
+        }
+        if (interval._end_offset > end_offset) {
+            AddInterval(end_offset, interval._end_offset, interval._page_size);
+            interval._end_offset = end_offset;
+        }
+        interval._page_size = page_size;
+    }
+    Sort();
+    Coalesce();
+}
+
+void MemoryIntervalList::FillPageSize(off_t start_offset, off_t end_offset,
+                                      PageSize page_size) {
+    SetPageSize(start_offset, end_offset, page_size);
+
+    // there is a gap at most before each interval and after the last one
+    if (2 * _list_length + 1 > _list_capcaity) {
+        Reserve(2 * _list_length + 1);
+    }
+    size_t length = _list_length;
+    off_t covered_offset = start_offset;
+    for (size_t i = 0; i < length && covered_offset < end_offset; i++) {
+        off_t interval_start = _interval_list[i]._start_offset;
+        off_t interval_end = _interval_list[i]._end_offset;
+        if (interval_end <= covered_offset) {
+            continue;
+        }
+        if (interval_start > covered_offset) {
+            AddInterval(covered_offset, std::min(interval_start, end_offset),
+                        page_size);
+        }
+        covered_offset = interval_end;
+    }
+    if (covered_offset < end_offset) {
+        AddInterval(covered_offset, end_offset, page_size);
+    }
+    Sort();
+    Coalesce();
+}
+
+void MemoryIntervalList::RemoveIntervalsOf(PageSize page_size) {
+    size_t last = 0;
+    for (size_t i = 0; i < _list_length; i++) {
+        if (_interval_list[i]._page_size == page_size) {
+            continue;
+        }
+        if (last != i) {
+            _interval_list[last]._start_offset = _interval_list[i]._start_offset;
+            _interval_list[last]._end_offset = _interval_list[i]._end_offset;
+            _interval_list[last]._page_size = _interval_list[i]._page_size;
         }
+        last++;
     }
+    _list_length = last;
 }
 
 size_t MemoryIntervalList::GetLength()
@@ -151,6 +151,21 @@ size_t NumaMaps::GetTotalAnonymousMemory() {
                    static_cast<size_t>(PageSize::HUGE_1GB);
 }
 
+/*
+ * Return the memory (of all page sizes) allocated for the memory ranges that
+ * start in [@start_address, @end_address), e.g., the ranges of a pool
+ */
+size_t NumaMaps::GetResidentMemory(void *start_address, void *end_address) {
+    size_t total_size = 0;
+    for (auto mem_range : _numa_maps) {
+        if (mem_range._start_address >= start_address &&
+            mem_range._start_address < end_address) {
+            total_size += mem_range._total_size;
+        }
+    }
+    return total_size;
+}
+
 /*
  * Get the number of Numa Nodes in current system by reading
  * /sys/devices/system/node file system and count nodeX folders inside it.
@@ -2,19 +2,34 @@
 #include "ParseCsv.h"
 #include "globals.h"
 #include <cstdio>
+#include <cerrno>
+#include <climits>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 
 #include "GlibcAllocationFunctions.h"
+#include "BinaryLayout.h"
 
 #define MOVE_TO_NEXT_LINE()\
     for (; i < size && file_mmap[i++] != '\n'; );
 
+// move to the end of the current line (the main loop skips the '\n')
+#define MOVE_TO_END_OF_LINE()\
+    for (; i < size && file_mmap[i] != '\n'; i++);
+
+#define ROUTE_PREFIX "route:"
+#define IS_ROUTE(token) (!strncmp(token, ROUTE_PREFIX, strlen(ROUTE_PREFIX)))
+#define ALLOCATOR_PREFIX "allocator:"
+#define IS_ALLOCATOR(token) \
+    (!strncmp(token, ALLOCATOR_PREFIX, strlen(ALLOCATOR_PREFIX)))
+
+// commas inside brackets (the range lists of the new format) are part of
+// the token
 #define NEXT_TOKEN() \
-    for (j=0; j<token_size && i<size; i++) { \
-        if(file_mmap[i] == ',' || file_mmap[i] == '\n'){ \
+    for (j=0, brackets=0; j<token_size && i<size; i++) { \
+        if(brackets == 0 && (file_mmap[i] == ',' || file_mmap[i] == '\n')){ \
             token[j] = 0; \
             if(file_mmap[i] == ',') i++; \
             break; \
@@ -22,41 +37,386 @@
         if (file_mmap[i] == ' '){ \
             continue; \
         } \
+        if (file_mmap[i] == '[') brackets++; \
+        if (file_mmap[i] == ']') brackets--; \
         token[j++] = file_mmap[i]; \
     }
 
-int parseCsv::GetConfigFileMaxWindows(const char* path){
-    int count = 0;
-    int fd;
+#define NEW_FORMAT_HEADER "pool_type"
+#define IS_NEW_FORMAT(file_mmap, size) \
+    ((size) >= strlen(NEW_FORMAT_HEADER) && \
+     !strncmp(file_mmap, NEW_FORMAT_HEADER, strlen(NEW_FORMAT_HEADER)))
+
+long long int parseCsv::ParseSize(const char *token) {
+    char *end = nullptr;
+    errno = 0;
+    long long int size = strtoll(token, &end, 10);
+    if (end == token || size < 0 || errno == ERANGE) {
+        return -1;
+    }
+    if (*end == 0) {
+        return size;
+    }
+    long long int unit = 0;
+    switch (end[0] | 0x20) {
+        case 'k': unit = 1ll << 10; break;
+        case 'm': unit = 1ll << 20; break;
+        case 'g': unit = 1ll << 30; break;
+        default: return -1;
+    }
+    if ((end[1] | 0x20) != 'b' || end[2] != 0) {
+        return -1;
+    }
+    if (size > LLONG_MAX / unit) {
+        return -1;
+    }
+    return size * unit;
+}
+
+void parseCsv::WriteHeader(FILE *file) {
+    fprintf(file, "pool_type,pool_size,ragions_list_2mb,offset_2mb,"
+                  "ragions_list_1gb,offset_1gb\n");
+}
+
+// writes the range list and the offset of the intervals of page_size
+static void WriteRangeList(FILE *file, MemoryIntervalList &intervals,
+                           PageSize page_size) {
+    MemoryInterval *first = intervals.FirstIntervalOf(page_size);
+    size_t offset = (first == nullptr) ? 0 :
+                    first->_start_offset % (size_t)page_size;
+    const char *separator = "";
+    fprintf(file, "[");
+    for (size_t k = 0; k < intervals.GetLength(); k++) {
+        MemoryInterval &interval = intervals.At(k);
+        if (interval._page_size != page_size) {
+            continue;
+        }
+        size_t first_page = (interval._start_offset - offset) / (size_t)page_size;
+        size_t end_page = (interval._end_offset - offset) / (size_t)page_size;
+        if (end_page == first_page + 1) {
+            fprintf(file, "%s%zu", separator, first_page);
+        } else {
+            fprintf(file, "%s%zu-%zu", separator, first_page, end_page);
+        }
+        separator = ",";
+    }
+    fprintf(file, "],%zu", offset);
+}
+
+void parseCsv::WritePoolRow(FILE *file, const char *poolType, size_t size,
+                            MemoryIntervalList &intervals) {
+    fprintf(file, "%s,%zu,", poolType, size);
+    WriteRangeList(file, intervals, PageSize::HUGE_2MB);
+    fprintf(file, ",");
+    WriteRangeList(file, intervals, PageSize::HUGE_1GB);
+    fprintf(file, "\n");
+}
+
+void parseCsv::WriteAllocatorRow(FILE *file, const char *poolType,
+                                 AllocatorPolicy policy) {
+    fprintf(file, "%s,%s%s\n", poolType, ALLOCATOR_PREFIX,
+            PoolConfigurationData::GetAllocatorPolicyName(policy));
+}
+
+void parseCsv::WriteRoutes(FILE *file, const RoutingTable &routingTable) {
+    for (int r = 0; r < routingTable.GetRoutesCount(); r++) {
+        const RoutingTable::Route &route = routingTable.At(r);
+        const char *target = PASSTHROUGH_NAME;
+        if (route._target == RoutingTable::RouteTarget::ANONYMOUS_POOL) {
+            target = routingTable.GetPoolName(route._pool);
+        } else if (route._target == RoutingTable::RouteTarget::FILE_POOL) {
+            target = FILE_POOL_NAME;
+        }
+        fprintf(file, "%s,%s%s,%zu,", target, ROUTE_PREFIX,
+                RoutingTable::GetRouteClassName(route._class),
+                route._min_length);
+        if (route._max_length == (size_t)-1) {
+            fprintf(file, "-1\n");
+        } else {
+            fprintf(file, "%zu\n", route._max_length);
+        }
+    }
+}
+
+// skip the next field (like NEXT_TOKEN), and set [start, end) to its text
+#define NEXT_FIELD(start, end) \
+    for (start=i, brackets=0; i<size; i++) { \
+        if(brackets == 0 && (file_mmap[i] == ',' || file_mmap[i] == '\n')){ \
+            break; \
+        } \
+        if (file_mmap[i] == '[') brackets++; \
+        if (file_mmap[i] == ']') brackets--; \
+    } \
+    end = i; \
+    if (i < size && file_mmap[i] == ',') i++;
+
+// parse a page index of a range list, skipping spaces
+static long long int ParseIndex(const char *&p, const char *end) {
+    for (; p < end && *p == ' '; p++);
+    const char *start = p;
+    long long int index = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        if (index > (LLONG_MAX - (*p - '0')) / 10) {
+            THROW_EXCEPTION("range list index is too large");
+        }
+        index = index * 10 + (*p - '0');
+    }
+    for (; p < end && *p == ' '; p++);
+    return (p == start) ? -1 : index;
+}
+
+/*
+ * AddRangeList expands a range list of the new format, e.g., "[0-511,1024]",
+ * into intervals of the given page size: the items are page indexes from the
+ * offset, and a range excludes its end (so "[0-512]" is 512 pages, as in
+ * the layouts that runMosalloc used to convert). The intervals must lie in
+ * the pool. The list is read in place (from the mapped file), and contiguous
+ * items are merged into a single interval.
+ */
+static void AddRangeList(MemoryIntervalList &intervalList,
+                         const char *list, const char *list_end,
+                         PageSize page_size, long long int offset,
+                         long long int pool_size) {
+    for (; list < list_end && *list == ' '; list++);
+    for (; list_end > list && list_end[-1] == ' '; list_end--);
+    if (list < list_end && *list == '[') {
+        list++;
+        if (list_end[-1] != ']') {
+            THROW_EXCEPTION("range list is not closed");
+        }
+        list_end--;
+    }
+
+    long long int page = (long long int)page_size;
+    if (offset > pool_size) {
+        THROW_EXCEPTION("range list offset exceeds the pool size");
+    }
+    // the number of pages from the offset to the end of the pool
+    long long int pool_pages = (pool_size - offset) / page;
+    long long int start_offset = -1, end_offset = -1;
+    const char *p = list;
+    for (; p < list_end && *p == ' '; p++);
+    while (p < list_end) {
+        long long int first = ParseIndex(p, list_end);
+        long long int last = (first < 0) ? -1 : first + 1;
+        if (first >= 0 && p < list_end && *p == '-') {
+            p++;
+            last = ParseIndex(p, list_end);
+        }
+        if (first < 0 || last <= first) {
+            THROW_EXCEPTION("invalid range in range list");
+        }
+        if (last > pool_pages) {
+            THROW_EXCEPTION("range list exceeds the pool size");
+        }
+        if (p < list_end) {
+            if (*p != ',') {
+                THROW_EXCEPTION("invalid range list");
+            }
+            p++;
+        }
+
+        long long int item_start = offset + first * page;
+        long long int item_end = offset + last * page;
+        if (item_start == end_offset) {
+            end_offset = item_end;
+            continue;
+        }
+        if (start_offset >= 0) {
+            intervalList.AddInterval(start_offset, end_offset, page_size);
+        }
+        start_offset = item_start;
+        end_offset = item_end;
+    }
+    if (start_offset >= 0) {
+        intervalList.AddInterval(start_offset, end_offset, page_size);
+    }
+}
+
+#define TOKEN_SIZE (1024)
+
+// map the whole file privately (the file is closed, the mapping is kept)
+static char* MapFile(const char* path, size_t &size, int prot = PROT_READ) {
     struct stat s;
-    char *file_mmap;
 
     // Open the file for reading.
-    fd = open (path, O_RDONLY);
+    int fd = open (path, O_RDONLY);
     if (fd < 0) {
         THROW_EXCEPTION("can not open csv file");
     }
-    
+
     // Get the size of the file.
     if (fstat (fd, &s) < 0) {
         THROW_EXCEPTION("can not stat the csv file");
     }
-    size_t size = s.st_size;
+    size = s.st_size;
 
     GlibcAllocationFunctions glibc_funcs;
     // Memory-map the file.
-    file_mmap = (char*)glibc_funcs.CallGlibcMmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    char *file_mmap = (char*)glibc_funcs.CallGlibcMmap(NULL, size, prot, MAP_PRIVATE, fd, 0);
     if (file_mmap == MAP_FAILED)
         THROW_EXCEPTION("can not mmap csv file");
 
-    /* count the end-of-line characters */
+    close(fd);
+    return file_mmap;
+}
+
+static void UnmapFile(char *file_mmap, size_t size) {
+    GlibcAllocationFunctions glibc_funcs;
+    glibc_funcs.CallGlibcMunmap(file_mmap, size);
+}
+
+/* count the end-of-line characters, and the items of the range lists
+ * (each of them could be a window of its own) */
+static int CountWindows(const char *file_mmap, size_t size) {
+    int count = 0;
+    int brackets = 0;
     for (size_t i = 0; i < size; i++) {
         if (file_mmap[i] == '\n') {
             count++;
+        } else if (file_mmap[i] == '[') {
+            brackets++;
+            count++;
+        } else if (file_mmap[i] == ']') {
+            brackets--;
+        } else if (file_mmap[i] == ',' && brackets > 0) {
+            count++;
         }
     }
+    return count;
+}
 
-    close(fd);
+/*
+ * ParsePoolRow parses the rest of a pool row, whose second token (the page
+ * size, or the pool size in the new format) was read to token already.
+ */
+static void ParsePoolRow(PoolConfigurationData& configurationData,
+                         const char *file_mmap, size_t size, size_t &i,
+                         char *token, bool is_new_format, int &one_time_size) {
+    size_t token_size = TOKEN_SIZE;
+    size_t j = 0;
+    int brackets = 0;
+    long long int _start_offset, _end_offset, _page_size;
+
+    if (is_new_format) {
+        // pool_size,ragions_list_2mb,offset_2mb,ragions_list_1gb,offset_1gb
+        if (one_time_size)
+            THROW_EXCEPTION("pool size already exist");
+        one_time_size = 1;
+        long long int pool_size = parseCsv::ParseSize(token);
+        if (pool_size < 0)
+            THROW_EXCEPTION("invalid pool size");
+        configurationData.size = pool_size;
+
+        const PageSize page_sizes[] = {PageSize::HUGE_2MB, PageSize::HUGE_1GB};
+        for (PageSize page_size : page_sizes) {
+            size_t list, list_end;
+            NEXT_FIELD(list, list_end)
+            NEXT_TOKEN()
+            long long int offset = parseCsv::ParseSize(token);
+            if (offset < 0)
+                THROW_EXCEPTION("invalid range list offset");
+            AddRangeList(configurationData.intervalList,
+                         file_mmap + list, file_mmap + list_end,
+                         page_size, offset, pool_size);
+        }
+
+        if(i < size && file_mmap[i] != '\n')
+            THROW_EXCEPTION("csv configuration file is corrupted!");
+        return;
+    }
+
+    _page_size = atoll(token);
+    if( _page_size!=-1 && _page_size!= static_cast<size_t>(PageSize::HUGE_1GB) && _page_size!= static_cast<size_t>(PageSize::HUGE_2MB)){
+        THROW_EXCEPTION("unknown page size");
+    }
+
+    if(_page_size == -1 ){
+        if(!one_time_size){
+            one_time_size = 1;
+        }
+        else THROW_EXCEPTION("pool size already exist");
+    }
+
+    NEXT_TOKEN()
+    _start_offset = atoll(token);
+    if(_start_offset < 0 )
+        THROW_EXCEPTION("start offset negative");
+
+    NEXT_TOKEN()
+    _end_offset = atoll(token);
+    if(_end_offset < 0)
+        THROW_EXCEPTION("end offset negative");
+
+    if(file_mmap[i] != '\n')
+        THROW_EXCEPTION("csv configuration file is corrupted!");
+
+    if(_page_size !=-1) configurationData.intervalList.AddInterval(_start_offset, _end_offset, (PageSize)_page_size);
+    else configurationData.size= _end_offset - _start_offset;
+}
+
+/*
+ * ParseRouteLength parses a route length (see ParseSize), where a max length
+ * of -1 is unlimited. It throws on an invalid length.
+ */
+static size_t ParseRouteLength(const char *token, bool is_max_length) {
+    if (is_max_length && !strcmp(token, "-1")) {
+        return (size_t)-1;
+    }
+    long long int length = parseCsv::ParseSize(token);
+    if (length < 0) {
+        THROW_EXCEPTION("invalid route length");
+    }
+    return (size_t)length;
+}
+
+/*
+ * ParseRouteRow parses the rest of a route row of the given pool, whose
+ * second token (route:<class>) was read to token already.
+ */
+static void ParseRouteRow(RoutingTable& routingTable, const char *pool,
+                          const char *file_mmap, size_t size, size_t &i,
+                          char *token) {
+    size_t token_size = TOKEN_SIZE;
+    size_t j = 0;
+    int brackets = 0;
+    size_t _min_length, _max_length;
+
+    RoutingTable::RouteClass route_class =
+            RoutingTable::ParseRouteClass(token + strlen(ROUTE_PREFIX));
+
+    NEXT_TOKEN()
+    _min_length = ParseRouteLength(token, false);
+
+    NEXT_TOKEN()
+    _max_length = ParseRouteLength(token, true);
+
+    if(i < size && file_mmap[i] != '\n')
+        THROW_EXCEPTION("csv configuration file is corrupted!");
+
+    // the length range must not be empty (see AddRoute)
+    routingTable.AddRoute(route_class, pool, _min_length, _max_length);
+}
+
+/*
+ * ParseAllocatorRow parses an allocator row of a pool, whose second (and
+ * last) token (allocator:<policy>) was read to token already.
+ */
+static void ParseAllocatorRow(PoolConfigurationData& configurationData,
+                              const char *file_mmap, size_t size, size_t i,
+                              const char *token) {
+    if (i < size && file_mmap[i] != '\n')
+        THROW_EXCEPTION("csv configuration file is corrupted!");
+    configurationData.allocatorPolicy =
+            PoolConfigurationData::ParseAllocatorPolicy(
+                    token + strlen(ALLOCATOR_PREFIX));
+}
+
+int parseCsv::GetConfigFileMaxWindows(const char* path){
+    size_t size = 0;
+    char *file_mmap = MapFile(path, size);
+    int count = CountWindows(file_mmap, size);
+    UnmapFile(file_mmap, size);
     return count;
 }
 
@@ -69,32 +429,15 @@ int parseCsv::GetConfigFileMaxWindows(const char* path){
  *
  */
 void parseCsv::ParseCsv(PoolConfigurationData& configurationData, const char* path, const char* poolType){
-    int fd;
-    struct stat s;
-    char *file_mmap;
-    size_t token_size = 1024;
-    char token[1024] = {0};
+    size_t token_size = TOKEN_SIZE;
+    char token[TOKEN_SIZE] = {0};
+    int brackets = 0;
     int one_time_size = 0;
-    long long int _start_offset, _end_offset, _page_size;
 
-    // Open the file for reading.
-    fd = open (path, O_RDONLY);
-    if (fd < 0) {
-        THROW_EXCEPTION("can not open csv file");
-    }
-    
-    // Get the size of the file.
-    if (fstat (fd, &s) < 0) {
-        THROW_EXCEPTION("can not stat the csv file");
-    }
-    size_t size = s.st_size;
-
-    GlibcAllocationFunctions glibc_funcs;
-    // Memory-map the file.
-    file_mmap = (char*)glibc_funcs.CallGlibcMmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
-    if (file_mmap == MAP_FAILED)
-        THROW_EXCEPTION("can not mmap csv file");
+    size_t size = 0;
+    char *file_mmap = MapFile(path, size);
 
+    bool is_new_format = IS_NEW_FORMAT(file_mmap, size);
     size_t i=0, j=0;
     // read the header line
     MOVE_TO_NEXT_LINE()
@@ -104,38 +447,394 @@ void parseCsv::ParseCsv(PoolConfigurationData& configurationData, const char* pa
         if (token[0] == 0)
             continue;
         if(strcmp(token, poolType)){
+            MOVE_TO_END_OF_LINE()
+            continue;
+        }
+
+        NEXT_TOKEN()
+        if (IS_ROUTE(token)) {
+            MOVE_TO_END_OF_LINE()
+            continue;
+        }
+        if (IS_ALLOCATOR(token)) {
+            ParseAllocatorRow(configurationData, file_mmap, size, i, token);
             continue;
         }
+        ParsePoolRow(configurationData, file_mmap, size, i, token,
+                     is_new_format, one_time_size);
+    }
+    configurationData.intervalList.Sort();
+    UnmapFile(file_mmap, size);
+}
+
+/**
+ *
+ * @param routingTable -- the table to add the routes to
+ * @param path to csv file with route rows in structure:
+ *        _pool,route:_class,_min_length,_max_length
+ *
+ */
+void parseCsv::ParseRoutes(RoutingTable& routingTable, const char* path){
+    size_t token_size = TOKEN_SIZE;
+    char token[TOKEN_SIZE] = {0};
+    char pool[TOKEN_SIZE] = {0};
+    int brackets = 0;
+
+    size_t size = 0;
+    char *file_mmap = MapFile(path, size);
+
+    size_t i=0, j=0;
+    // read the header line
+    MOVE_TO_NEXT_LINE()
+    // Parse the file
+    for (; i < size; i++) {
+        NEXT_TOKEN()
+        if (token[0] == 0)
+            continue;
+        strcpy(pool, token);
 
         NEXT_TOKEN()
-        _page_size = atoll(token);
-        if( _page_size!=-1 && _page_size!= static_cast<size_t>(PageSize::HUGE_1GB) && _page_size!= static_cast<size_t>(PageSize::HUGE_2MB)){
-            THROW_EXCEPTION("unknown page size");
+        if (!IS_ROUTE(token)) {
+            MOVE_TO_END_OF_LINE()
+            continue;
         }
+        ParseRouteRow(routingTable, pool, file_mmap, size, i, token);
+    }
+    UnmapFile(file_mmap, size);
+}
 
-        if(_page_size == -1 ){
-            if(!one_time_size){
-                one_time_size = 1;
-            }
-            else THROW_EXCEPTION("pool size already exist");
+ConfigurationLoader::ConfigurationLoader() :
+    _pools_count(0),
+    _binary_layout(nullptr),
+    _binary_layout_size(0) {
+    for (int i = 0; i < MAX_CONFIGURATION_POOLS; i++) {
+        _pool_names[i][0] = 0;
+        _one_time_size[i] = 0;
+    }
+}
+
+ConfigurationLoader::~ConfigurationLoader() {
+    // the pools of a binary layout are used in place
+    if (_binary_layout != nullptr) {
+        UnmapFile(_binary_layout, _binary_layout_size);
+    }
+}
+
+int ConfigurationLoader::AddPool(const char *poolType,
+                                 size_t intervals_capacity,
+                                 MmapFuncPtr allocator,
+                                 MunmapFuncPtr deallocator) {
+    if (_pools_count == MAX_CONFIGURATION_POOLS) {
+        THROW_EXCEPTION("too many pools in the configuration file");
+    }
+    if (strlen(poolType) >= MAX_POOL_NAME_LENGTH) {
+        THROW_EXCEPTION("pool name is too long");
+    }
+    int pool_index = _pools_count++;
+    strcpy(_pool_names[pool_index], poolType);
+    _pools[pool_index].intervalList.Initialize(allocator, deallocator,
+                                               intervals_capacity);
+    return pool_index;
+}
+
+void ConfigurationLoader::LoadBinaryLayout(RoutingTable& routingTable,
+                                           MmapFuncPtr allocator,
+                                           MunmapFuncPtr deallocator) {
+    const BinaryLayout::Header *header =
+            BinaryLayout::Validate(_binary_layout, _binary_layout_size);
+    for (uint32_t p = 0; p < header->_pools_count; p++) {
+        const BinaryLayout::Pool pool = BinaryLayout::GetPool(header, p);
+        if (FindPool(pool._name) >= 0) {
+            THROW_EXCEPTION("binary layout pool is duplicated");
         }
+        strcpy(_pool_names[p], pool._name);
+        _pools[p].size = pool._size;
+        _pools[p].allocatorPolicy =
+                static_cast<AllocatorPolicy>(pool._allocator_policy);
+        _pools[p].intervalList.InitializeInPlace(
+                allocator, deallocator,
+                BinaryLayout::GetIntervals(header, pool),
+                pool._intervals_count);
+        _pools_count++;
+    }
+
+    const BinaryLayout::Route *routes = BinaryLayout::GetRoutes(header);
+    for (uint32_t r = 0; r < header->_routes_count; r++) {
+        routingTable.AddRoute(
+                static_cast<RoutingTable::RouteClass>(routes[r]._class),
+                routes[r]._target, routes[r]._min_length,
+                routes[r]._max_length);
+    }
+}
+
+int ConfigurationLoader::FindPool(const char *poolType) {
+    for (int i = 0; i < _pools_count; i++) {
+        if (!strcmp(_pool_names[i], poolType)) {
+            return i;
+        }
+    }
+    return -1;
+}
 
+void ConfigurationLoader::Load(const char* path, RoutingTable& routingTable,
+                               MmapFuncPtr allocator,
+                               MunmapFuncPtr deallocator) {
+    size_t token_size = TOKEN_SIZE;
+    char token[TOKEN_SIZE] = {0};
+    char pool[TOKEN_SIZE] = {0};
+    int brackets = 0;
+
+    _pools[MAX_CONFIGURATION_POOLS].intervalList.Initialize(allocator,
+                                                            deallocator, 1);
+
+    // the mapping is writable (privately), since the pools of a binary
+    // layout are used in place as interval lists
+    size_t size = 0;
+    char *file_mmap = MapFile(path, size, PROT_READ | PROT_WRITE);
+    if (BinaryLayout::IsBinaryLayout(file_mmap, size)) {
+        _binary_layout = file_mmap;
+        _binary_layout_size = size;
+        LoadBinaryLayout(routingTable, allocator, deallocator);
+        return;
+    }
+
+    // every pool could have all the windows of the file
+    size_t intervals_capacity = CountWindows(file_mmap, size) * 2 + 1;
+
+    bool is_new_format = IS_NEW_FORMAT(file_mmap, size);
+    size_t i=0, j=0;
+    // read the header line
+    MOVE_TO_NEXT_LINE()
+    // Parse the file
+    for (; i < size; i++) {
         NEXT_TOKEN()
-        _start_offset = atoll(token);
-        if(_start_offset < 0 )
-            THROW_EXCEPTION("start offset negative");
-        
+        if (token[0] == 0)
+            continue;
+        strcpy(pool, token);
+
         NEXT_TOKEN()
-        _end_offset = atoll(token);
-        if(_end_offset < 0)
-            THROW_EXCEPTION("end offset negative");
-      
-        if(file_mmap[i] != '\n')
-            THROW_EXCEPTION("csv configuration file is corrupted!");
-        
-        if(_page_size !=-1) configurationData.intervalList.AddInterval(_start_offset, _end_offset, (PageSize)_page_size);
-        else configurationData.size= _end_offset - _start_offset;
+        if (IS_ROUTE(token)) {
+            ParseRouteRow(routingTable, pool, file_mmap, size, i, token);
+            continue;
+        }
+
+        int pool_index = FindPool(pool);
+        if (pool_index < 0) {
+            pool_index = AddPool(pool, intervals_capacity, allocator,
+                                 deallocator);
+        }
+        if (IS_ALLOCATOR(token)) {
+            ParseAllocatorRow(_pools[pool_index], file_mmap, size, i, token);
+            continue;
+        }
+        ParsePoolRow(_pools[pool_index], file_mmap, size, i, token,
+                     is_new_format, _one_time_size[pool_index]);
+    }
+    UnmapFile(file_mmap, size);
+
+    CheckPoolSizes();
+    for (int p = 0; p < _pools_count; p++) {
+        _pools[p].intervalList.Sort();
+    }
+}
+
+// the pools that only have an allocator row (or hugepages rows) have no
+// memory to allocate from, which is a mistake of the layout
+void ConfigurationLoader::CheckPoolSizes() {
+    for (int p = 0; p < _pools_count; p++) {
+        if (_one_time_size[p] || !strcmp(_pool_names[p], BRK_POOL_NAME) ||
+            !strcmp(_pool_names[p], FILE_POOL_NAME)) {
+            continue;
+        }
+        THROW_EXCEPTION("pool size is missing (a pool needs a size row)");
+    }
+}
+
+PoolConfigurationData& ConfigurationLoader::At(int i) {
+    if (i < 0 || i >= _pools_count) {
+        THROW_EXCEPTION("pool index is out of range");
+    }
+    return _pools[i];
+}
+
+const char* ConfigurationLoader::GetPoolName(int i) {
+    if (i < 0 || i >= _pools_count) {
+        THROW_EXCEPTION("pool index is out of range");
+    }
+    return _pool_names[i];
+}
+
+PoolConfigurationData& ConfigurationLoader::GetPool(const char* poolType) {
+    int pool_index = FindPool(poolType);
+    return _pools[(pool_index >= 0) ? pool_index : MAX_CONFIGURATION_POOLS];
+}
+
+// copy the field [start, end) to token (without spaces)
+static void CopyField(const char *start, const char *end, char *token,
+                      size_t token_size) {
+    size_t j = 0;
+    for (; start < end; start++) {
+        if (*start == ' ') {
+            continue;
+        }
+        if (j + 1 >= token_size) {
+            THROW_EXCEPTION("inline layout field is too long");
+        }
+        token[j++] = *start;
+    }
+    token[j] = 0;
+}
+
+// find the end of the field that starts at p (a separator out of brackets)
+static const char* FieldEnd(const char *p, const char *end, char separator) {
+    int brackets = 0;
+    for (; p < end; p++) {
+        if (*p == '[') brackets++;
+        if (*p == ']') brackets--;
+        if (brackets == 0 && *p == separator) break;
+    }
+    return p;
+}
+
+/*
+ * ParseInlinePages parses a hugepages field of an inline layout:
+ * <page-size>[<range-list>][@<offset>], e.g., "2MB[0-512,1024]@1GB".
+ */
+static void ParseInlinePages(MemoryIntervalList &intervalList,
+                             const char *field, const char *field_end,
+                             long long int pool_size) {
+    char token[TOKEN_SIZE];
+    const char *list = field;
+    for (; list < field_end && *list != '['; list++);
+    const char *list_end = FieldEnd(list, field_end, '@');
+    CopyField(field, list, token, TOKEN_SIZE);
+    long long int page_size = parseCsv::ParseSize(token);
+    if (page_size != static_cast<long long int>(PageSize::HUGE_2MB) &&
+        page_size != static_cast<long long int>(PageSize::HUGE_1GB)) {
+        THROW_EXCEPTION("unknown page size");
+    }
+
+    long long int offset = 0;
+    if (list_end < field_end) {
+        CopyField(list_end + 1, field_end, token, TOKEN_SIZE);
+        offset = parseCsv::ParseSize(token);
+        if (offset < 0)
+            THROW_EXCEPTION("invalid range list offset");
+    }
+    AddRangeList(intervalList, list, list_end, (PageSize)page_size, offset,
+                 pool_size);
+}
+
+void ConfigurationLoader::LoadInline(const char* layout,
+                                     RoutingTable& routingTable,
+                                     MmapFuncPtr allocator,
+                                     MunmapFuncPtr deallocator) {
+    char token[TOKEN_SIZE];
+    char pool[TOKEN_SIZE];
+    _pools[MAX_CONFIGURATION_POOLS].intervalList.Initialize(allocator,
+                                                            deallocator, 1);
+
+    size_t size = strlen(layout);
+    const char *end = layout + size;
+    // every pool could have all the windows of the layout
+    size_t intervals_capacity = CountWindows(layout, size) * 2 + 1;
+
+    for (const char *spec = layout; spec < end; ) {
+        const char *spec_end = FieldEnd(spec, end, ';');
+        const char *field_end = FieldEnd(spec, spec_end, ':');
+        CopyField(spec, field_end, pool, TOKEN_SIZE);
+        const char *field = field_end;
+        if (pool[0] == 0) {
+            // an empty pool spec (e.g., a trailing ';')
+            if (field != spec_end)
+                THROW_EXCEPTION("inline layout pool name is missing");
+            spec = spec_end + 1;
+            continue;
+        }
+        if (field == spec_end)
+            THROW_EXCEPTION("inline layout pool size is missing");
+        field++;
+        field_end = FieldEnd(field, spec_end, ':');
+        CopyField(field, field_end, token, TOKEN_SIZE);
+
+        if (!strcmp(token, "route")) {
+            // <pool>:route:<class>:<min-length>:<max-length>
+            char route_class[TOKEN_SIZE];
+            size_t lengths[2];
+            field = field_end;
+            for (int k = -1; k < 2; k++) {
+                if (field == spec_end)
+                    THROW_EXCEPTION("inline layout route is incomplete");
+                field++;
+                field_end = FieldEnd(field, spec_end, ':');
+                CopyField(field, field_end, token, TOKEN_SIZE);
+                if (k < 0) {
+                    strcpy(route_class, token);
+                } else {
+                    lengths[k] = ParseRouteLength(token, k == 1);
+                }
+                field = field_end;
+            }
+            if (field != spec_end)
+                THROW_EXCEPTION("inline layout route is corrupted!");
+            // the length range must not be empty (see AddRoute)
+            routingTable.AddRoute(RoutingTable::ParseRouteClass(route_class),
+                                  pool, lengths[0], lengths[1]);
+            spec = spec_end + 1;
+            continue;
+        }
+
+        int pool_index = FindPool(pool);
+        if (pool_index < 0) {
+            pool_index = AddPool(pool, intervals_capacity, allocator,
+                                 deallocator);
+        }
+        if (!strcmp(token, "allocator")) {
+            // <pool>:allocator:<policy>
+            if (field_end == spec_end)
+                THROW_EXCEPTION("inline layout allocator policy is missing");
+            CopyField(field_end + 1, spec_end, token, TOKEN_SIZE);
+            _pools[pool_index].allocatorPolicy =
+                    PoolConfigurationData::ParseAllocatorPolicy(token);
+            spec = spec_end + 1;
+            continue;
+        }
+
+        // <pool>:<size>[:<page-size>[<range-list>][@<offset>]]...
+        if (_one_time_size[pool_index])
+            THROW_EXCEPTION("pool size already exist");
+        _one_time_size[pool_index] = 1;
+        long long int pool_size = parseCsv::ParseSize(token);
+        if (pool_size < 0)
+            THROW_EXCEPTION("invalid pool size");
+        _pools[pool_index].size = pool_size;
+        for (field = field_end; field < spec_end; field = field_end) {
+            field++;
+            field_end = FieldEnd(field, spec_end, ':');
+            ParseInlinePages(_pools[pool_index].intervalList, field, field_end,
+                             pool_size);
+        }
+        spec = spec_end + 1;
+    }
+
+    // the pools that are not specified get their default sizes
+    const char *default_pools[] = {DEFAULT_ANONYMOUS_POOL_NAME, BRK_POOL_NAME,
+                                   FILE_POOL_NAME};
+    const size_t default_sizes[] = {DEFAULT_MMAP_POOL_SIZE, DEFAULT_BRK_POOL_SIZE,
+                                    DEFAULT_FILE_POOL_SIZE};
+    for (int p = 0; p < 3; p++) {
+        int pool_index = FindPool(default_pools[p]);
+        if (pool_index < 0) {
+            pool_index = AddPool(default_pools[p], 1, allocator, deallocator);
+        }
+        if (!_one_time_size[pool_index]) {
+            _pools[pool_index].size = default_sizes[p];
+            _one_time_size[pool_index] = 1;
+        }
+    }
+    CheckPoolSizes();
+
+    for (int p = 0; p < _pools_count; p++) {
+        _pools[p].intervalList.Sort();
     }
-    configurationData.intervalList.Sort();
-    close(fd);
 }
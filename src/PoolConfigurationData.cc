@@ -1,10 +1,29 @@
 #include <sys/mman.h>
 #include "PoolConfigurationData.h"
 
-PoolConfigurationData::PoolConfigurationData(): size(0){
+PoolConfigurationData::PoolConfigurationData():
+    size(0), allocatorPolicy(AllocatorPolicy::FIRST_FIT) {
 }
 
+AllocatorPolicy PoolConfigurationData::ParseAllocatorPolicy(const char *policy) {
+    if (!strcmp(policy, "first-fit")) {
+        return AllocatorPolicy::FIRST_FIT;
+    } else if (!strcmp(policy, "last-fit")) {
+        return AllocatorPolicy::LAST_FIT;
+    } else if (!strcmp(policy, "page-aligned")) {
+        return AllocatorPolicy::PAGE_ALIGNED;
+    }
+    THROW_EXCEPTION("unknown allocator policy");
+}
 
-
-
-
+const char* PoolConfigurationData::GetAllocatorPolicyName(AllocatorPolicy policy) {
+    switch (policy) {
+        case AllocatorPolicy::FIRST_FIT:
+            return "first-fit";
+        case AllocatorPolicy::LAST_FIT:
+            return "last-fit";
+        case AllocatorPolicy::PAGE_ALIGNED:
+            return "page-aligned";
+    }
+    THROW_EXCEPTION("unknown allocator policy");
+}
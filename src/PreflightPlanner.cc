@@ -0,0 +1,370 @@
+#include <fcntl.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include "PreflightPlanner.h"
+
+#define PATH_LENGTH (256)
+#define COUNTER_LENGTH (32)
+
+// build the paths and messages without snprintf, which may allocate memory
+static char* AppendNumber(char *buffer, uint64_t value) {
+    char digits[20];
+    int length = 0;
+    do {
+        digits[length++] = '0' + (value % 10);
+        value /= 10;
+    } while (value != 0);
+    buffer += strlen(buffer);
+    while (length > 0) {
+        *buffer++ = digits[--length];
+    }
+    *buffer = '\0';
+    return buffer;
+}
+
+// read a sysfs counter to value; returns 0 on success or -errno
+static int ReadCounter(const char *path, uint64_t &value) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -errno;
+    }
+    char text[COUNTER_LENGTH];
+    ssize_t size = read(fd, text, sizeof(text) - 1);
+    int err = errno;
+    close(fd);
+    if (size < 0) {
+        return -err;
+    }
+    text[size] = '\0';
+    value = strtoull(text, nullptr, 10);
+    return 0;
+}
+
+static int CountNodes(uint64_t nodes) {
+    return __builtin_popcountll(nodes);
+}
+
+PreflightPlanner::PreflightPlanner() :
+    _nodes(1), _allowed_nodes(~0ull), _preferred_nodes(0), _bind(false) {
+    memset(_demand, 0, sizeof(_demand));
+    memset(_granted, 0, sizeof(_granted));
+    memset(_supply, 0, sizeof(_supply));
+}
+
+int PreflightPlanner::GetSizeIndex(PageSize page_size) {
+    return (page_size == PageSize::HUGE_1GB) ? 1 : 0;
+}
+
+void PreflightPlanner::AddDemand(MemoryIntervalList &intervalList) {
+    for (size_t i = 0; i < intervalList.GetLength(); i++) {
+        MemoryInterval &interval = intervalList.At(i);
+        if (interval._page_size != PageSize::HUGE_2MB &&
+            interval._page_size != PageSize::HUGE_1GB) {
+            continue;
+        }
+        size_t length = interval._end_offset - interval._start_offset;
+        _demand[GetSizeIndex(interval._page_size)] +=
+                length / static_cast<size_t>(interval._page_size);
+    }
+}
+
+// the online nodes file holds a range list, e.g., "0-3,5"
+int PreflightPlanner::ReadNodes(const char *sysfs_root) {
+    char path[PATH_LENGTH];
+    strcpy(path, sysfs_root);
+    strcat(path, "/devices/system/node/online");
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -errno;
+    }
+    char text[PATH_LENGTH];
+    ssize_t size = read(fd, text, sizeof(text) - 1);
+    int err = errno;
+    close(fd);
+    if (size < 0) {
+        return -err;
+    }
+    text[size] = '\0';
+
+    uint64_t nodes = 0;
+    char *p = text;
+    while (*p >= '0' && *p <= '9') {
+        unsigned long first = strtoul(p, &p, 10);
+        unsigned long last = first;
+        if (*p == '-') {
+            last = strtoul(p + 1, &p, 10);
+        }
+        for (unsigned long node = first;
+             node <= last && node < MAX_NUMA_NODES; node++) {
+            nodes |= 1ull << node;
+        }
+        if (*p == ',') {
+            p++;
+        }
+    }
+    if (nodes == 0) {
+        return -EINVAL;
+    }
+    _nodes = nodes;
+    return 0;
+}
+
+int PreflightPlanner::ReadSupply(const char *sysfs_root) {
+    // kernels without NUMA have no node directories, so all the pages are
+    // of node 0
+    bool per_node = (ReadNodes(sysfs_root) == 0);
+    const PageSize page_sizes[] = {PageSize::HUGE_2MB, PageSize::HUGE_1GB};
+    for (PageSize page_size : page_sizes) {
+        HugePagesSupply &supply = _supply[GetSizeIndex(page_size)];
+        memset(&supply, 0, sizeof(supply));
+        char size_dir[PATH_LENGTH];
+        strcpy(size_dir, "/hugepages/hugepages-");
+        AppendNumber(size_dir, static_cast<size_t>(page_size) / 1024);
+        strcat(size_dir, "kB/");
+
+        char path[PATH_LENGTH];
+        strcpy(path, sysfs_root);
+        strcat(path, "/kernel/mm");
+        strcat(path, size_dir);
+        size_t dir_length = strlen(path);
+        strcpy(path + dir_length, "free_hugepages");
+        int res = ReadCounter(path, supply._global_free);
+        if (res == -ENOENT) {
+            // the kernel does not support this page size (or hugetlb)
+            continue;
+        }
+        if (res != 0) {
+            return res;
+        }
+        strcpy(path + dir_length, "resv_hugepages");
+        ReadCounter(path, supply._reserved);
+        strcpy(path + dir_length, "nr_overcommit_hugepages");
+        ReadCounter(path, supply._overcommit);
+        strcpy(path + dir_length, "surplus_hugepages");
+        ReadCounter(path, supply._surplus);
+
+        if (!per_node) {
+            supply._free[0] = supply._global_free;
+            continue;
+        }
+        for (int node = 0; node < MAX_NUMA_NODES; node++) {
+            if (!(_nodes & (1ull << node))) {
+                continue;
+            }
+            strcpy(path, sysfs_root);
+            strcat(path, "/devices/system/node/node");
+            AppendNumber(path, node);
+            strcat(path, size_dir);
+            strcat(path, "free_hugepages");
+            ReadCounter(path, supply._free[node]);
+        }
+    }
+    return 0;
+}
+
+int PreflightPlanner::ReadMemoryPolicy() {
+    unsigned long mems_allowed = 0;
+    if (syscall(SYS_get_mempolicy, nullptr, &mems_allowed,
+                MAX_NUMA_NODES, nullptr, MPOL_F_MEMS_ALLOWED) != 0) {
+        return -errno;
+    }
+    int mode = MPOL_DEFAULT;
+    unsigned long policy_nodes = 0;
+    if (syscall(SYS_get_mempolicy, &mode, &policy_nodes,
+                MAX_NUMA_NODES, nullptr, 0) != 0) {
+        return -errno;
+    }
+    uint64_t allowed_nodes = mems_allowed;
+    bool bind = ((mode & ~MPOL_MODE_FLAGS) == MPOL_BIND);
+    if (bind) {
+        allowed_nodes &= policy_nodes;
+    }
+    uint64_t preferred_nodes = policy_nodes;
+    if (preferred_nodes == 0) {
+        // the default (and local) policy allocates on the node of the CPU
+        // that touches the page first, which is assumed to be this one
+        unsigned int cpu = 0, node = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0 &&
+            node < MAX_NUMA_NODES) {
+            preferred_nodes = 1ull << node;
+        }
+    }
+    SetMemoryPolicy(allowed_nodes, preferred_nodes, bind);
+    return 0;
+}
+
+void PreflightPlanner::SetMemoryPolicy(uint64_t allowed_nodes,
+                                       uint64_t preferred_nodes, bool bind) {
+    _allowed_nodes = allowed_nodes;
+    _preferred_nodes = preferred_nodes;
+    _bind = bind;
+}
+
+uint64_t PreflightPlanner::GetDemand(PageSize page_size) const {
+    return _demand[GetSizeIndex(page_size)];
+}
+
+uint64_t PreflightPlanner::GetNodeDemand(PageSize page_size, int node) const {
+    uint64_t nodes = _nodes & _allowed_nodes & _preferred_nodes;
+    if (nodes == 0) {
+        nodes = _nodes & _allowed_nodes;
+    }
+    if (!(nodes & (1ull << node))) {
+        return 0;
+    }
+    if (_bind) {
+        // the bound nodes serve each other's pages, so the demand fills
+        // their free pages in order, and the last node takes the rest
+        const HugePagesSupply &supply = _supply[GetSizeIndex(page_size)];
+        uint64_t left = GetDemand(page_size);
+        for (int n = 0; n < node; n++) {
+            if (nodes & (1ull << n)) {
+                left -= (supply._free[n] < left) ? supply._free[n] : left;
+            }
+        }
+        bool is_last = !(nodes & ~((2ull << node) - 1));
+        if (is_last || supply._free[node] > left) {
+            return left;
+        }
+        return supply._free[node];
+    }
+    // the demand is spread evenly on the preferred nodes (which is exact
+    // for a single preferred node, and for interleaving)
+    int count = CountNodes(nodes);
+    int index = CountNodes(nodes & ((1ull << node) - 1));
+    uint64_t demand = GetDemand(page_size);
+    return demand / count + ((uint64_t)index < demand % count ? 1 : 0);
+}
+
+uint64_t PreflightPlanner::GetAvailable(PageSize page_size) const {
+    const HugePagesSupply &supply = _supply[GetSizeIndex(page_size)];
+    uint64_t nodes_free = 0;
+    for (int node = 0; node < MAX_NUMA_NODES; node++) {
+        if (_nodes & _allowed_nodes & (1ull << node)) {
+            nodes_free += supply._free[node];
+        }
+    }
+    // the free pages include the pages that other mappings reserved
+    uint64_t unreserved = (supply._global_free > supply._reserved)
+        ? supply._global_free - supply._reserved : 0;
+    uint64_t available = (nodes_free < unreserved) ? nodes_free : unreserved;
+    if (supply._overcommit > supply._surplus) {
+        available += supply._overcommit - supply._surplus;
+    }
+    return available;
+}
+
+bool PreflightPlanner::Fits() const {
+    return GetDemand(PageSize::HUGE_2MB) <= GetAvailable(PageSize::HUGE_2MB) &&
+           GetDemand(PageSize::HUGE_1GB) <= GetAvailable(PageSize::HUGE_1GB);
+}
+
+bool PreflightPlanner::FitsPreferredNodes() const {
+    const PageSize page_sizes[] = {PageSize::HUGE_2MB, PageSize::HUGE_1GB};
+    for (PageSize page_size : page_sizes) {
+        const HugePagesSupply &supply = _supply[GetSizeIndex(page_size)];
+        for (int node = 0; node < MAX_NUMA_NODES; node++) {
+            if (GetNodeDemand(page_size, node) > supply._free[node]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// grants the pages of the given size from the lowest offset of the (sorted)
+// list, and returns the offset where the available pages run out, or -1 if
+// all of them are granted
+off_t PreflightPlanner::GrantPages(MemoryIntervalList &intervalList,
+                                   PageSize page_size) {
+    uint64_t &granted = _granted[GetSizeIndex(page_size)];
+    uint64_t available = GetAvailable(page_size);
+    for (size_t i = 0; i < intervalList.GetLength(); i++) {
+        MemoryInterval &interval = intervalList.At(i);
+        if (interval._page_size != page_size) {
+            continue;
+        }
+        uint64_t pages = (interval._end_offset - interval._start_offset) /
+                         static_cast<size_t>(page_size);
+        uint64_t left = (available > granted) ? available - granted : 0;
+        if (pages > left) {
+            granted += left;
+            return interval._start_offset + left * static_cast<size_t>(page_size);
+        }
+        granted += pages;
+    }
+    return -1;
+}
+
+// changes the page size of the intervals of one size from the cut offset on
+static void ChangePageSize(MemoryIntervalList &intervalList, off_t cut,
+                           PageSize from, PageSize to) {
+    off_t split_end = -1;
+    for (size_t i = 0; i < intervalList.GetLength(); i++) {
+        MemoryInterval &interval = intervalList.At(i);
+        if (interval._page_size != from || interval._end_offset <= cut) {
+            continue;
+        }
+        if (interval._start_offset < cut) {
+            split_end = interval._end_offset;
+        } else {
+            interval._page_size = to;
+        }
+    }
+    if (split_end >= 0) {
+        intervalList.SetPageSize(cut, split_end, to);
+    } else {
+        intervalList.Coalesce();
+    }
+}
+
+void PreflightPlanner::Degrade(MemoryIntervalList &intervalList) {
+    intervalList.Sort();
+    // 1GB pages are 2MB aligned, so they can always be backed by 2MB pages
+    off_t cut = GrantPages(intervalList, PageSize::HUGE_1GB);
+    if (cut >= 0) {
+        ChangePageSize(intervalList, cut, PageSize::HUGE_1GB, PageSize::HUGE_2MB);
+    }
+    cut = GrantPages(intervalList, PageSize::HUGE_2MB);
+    if (cut >= 0) {
+        ChangePageSize(intervalList, cut, PageSize::HUGE_2MB, PageSize::BASE_4KB);
+        // the ranges without intervals are backed by 4KB pages
+        intervalList.RemoveIntervalsOf(PageSize::BASE_4KB);
+    }
+}
+
+void PreflightPlanner::ReportSize(int fd, PageSize page_size) const {
+    const HugePagesSupply &supply = _supply[GetSizeIndex(page_size)];
+    char line[PATH_LENGTH];
+    strcpy(line, "mosalloc: preflight: ");
+    strcat(line, (page_size == PageSize::HUGE_1GB) ? "1GB" : "2MB");
+    strcat(line, " pages: demand ");
+    AppendNumber(line, GetDemand(page_size));
+    strcat(line, ", available ");
+    AppendNumber(line, GetAvailable(page_size));
+    strcat(line, "\n");
+    ssize_t res = write(fd, line, strlen(line));
+    for (int node = 0; node < MAX_NUMA_NODES; node++) {
+        if (!(_nodes & _allowed_nodes & (1ull << node))) {
+            continue;
+        }
+        strcpy(line, "mosalloc: preflight:     node ");
+        AppendNumber(line, node);
+        strcat(line, ": free ");
+        AppendNumber(line, supply._free[node]);
+        strcat(line, ", demand ");
+        AppendNumber(line, GetNodeDemand(page_size, node));
+        strcat(line, "\n");
+        res |= write(fd, line, strlen(line));
+    }
+    (void)res;
+}
+
+void PreflightPlanner::Report(int fd) const {
+    ReportSize(fd, PageSize::HUGE_2MB);
+    ReportSize(fd, PageSize::HUGE_1GB);
+}
@@ -0,0 +1,138 @@
+#include <sys/mman.h>
+#include "RoutingTable.h"
+
+RoutingTable::RoutingTable() : _routes_count(0), _pools_count(0) {
+    AddPool(DEFAULT_ANONYMOUS_POOL_NAME);
+}
+
+int RoutingTable::FindPool(const char *name) const {
+    for (int i = 0; i < _pools_count; i++) {
+        if (!strcmp(_pools[i], name)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int RoutingTable::AddPool(const char *name) {
+    int pool = FindPool(name);
+    if (pool >= 0) {
+        return pool;
+    }
+    if (_pools_count >= MAX_ANONYMOUS_POOLS) {
+        THROW_EXCEPTION("too many anonymous pools");
+    }
+    if (strlen(name) >= MAX_POOL_NAME_LENGTH) {
+        THROW_EXCEPTION("pool name is too long");
+    }
+    strcpy(_pools[_pools_count], name);
+    return _pools_count++;
+}
+
+void RoutingTable::AddRoute(RouteClass route_class, const char *target,
+                            size_t min_length, size_t max_length) {
+    if (_routes_count >= MAX_ROUTES) {
+        THROW_EXCEPTION("too many routes");
+    }
+    if (min_length >= max_length) {
+        THROW_EXCEPTION("route length range is empty");
+    }
+
+    Route &route = _routes[_routes_count];
+    route._class = route_class;
+    route._pool = -1;
+    route._min_length = min_length;
+    route._max_length = max_length;
+    if (!strcmp(target, PASSTHROUGH_NAME)) {
+        route._target = RouteTarget::PASSTHROUGH;
+    } else if (!strcmp(target, FILE_POOL_NAME)) {
+        route._target = RouteTarget::FILE_POOL;
+    } else if (!strcmp(target, BRK_POOL_NAME)) {
+        THROW_EXCEPTION("mmap requests cannot be routed to the brk pool");
+    } else {
+        route._target = RouteTarget::ANONYMOUS_POOL;
+        route._pool = AddPool(target);
+    }
+    _routes_count++;
+}
+
+bool RoutingTable::IsMatch(const Route &route, size_t length, int prot,
+                           int flags, int fd) {
+    if (length < route._min_length || length >= route._max_length) {
+        return false;
+    }
+
+    // anonymous pools cannot back file mappings and vice versa
+    bool is_file_backed = (fd >= 0);
+    if ((route._target == RouteTarget::ANONYMOUS_POOL && is_file_backed) ||
+        (route._target == RouteTarget::FILE_POOL && !is_file_backed)) {
+        return false;
+    }
+
+    switch (route._class) {
+        case RouteClass::ANONYMOUS:
+            return !is_file_backed;
+        case RouteClass::FILE_BACKED:
+            return is_file_backed;
+        case RouteClass::EXECUTABLE:
+            return (prot & PROT_EXEC) != 0;
+        case RouteClass::STACK:
+            return (flags & MAP_STACK) != 0;
+        default:
+            return false;
+    }
+}
+
+RoutingTable::RouteTarget RoutingTable::Find(size_t length, int prot,
+                                             int flags, int fd,
+                                             int &pool) const {
+    for (int i = 0; i < _routes_count; i++) {
+        if (IsMatch(_routes[i], length, prot, flags, fd)) {
+            pool = _routes[i]._pool;
+            return _routes[i]._target;
+        }
+    }
+    pool = (fd >= 0) ? -1 : 0;
+    return (fd >= 0) ? RouteTarget::FILE_POOL : RouteTarget::ANONYMOUS_POOL;
+}
+
+const char* RoutingTable::GetPoolName(int pool) const {
+    if (pool < 0 || pool >= _pools_count) {
+        THROW_EXCEPTION("pool index is out of range");
+    }
+    return _pools[pool];
+}
+
+const RoutingTable::Route& RoutingTable::At(int i) const {
+    if (i < 0 || i >= _routes_count) {
+        THROW_EXCEPTION("route index is out of range");
+    }
+    return _routes[i];
+}
+
+RoutingTable::RouteClass RoutingTable::ParseRouteClass(const char *route_class) {
+    if (!strcmp(route_class, "anon")) {
+        return RouteClass::ANONYMOUS;
+    } else if (!strcmp(route_class, "file")) {
+        return RouteClass::FILE_BACKED;
+    } else if (!strcmp(route_class, "exec")) {
+        return RouteClass::EXECUTABLE;
+    } else if (!strcmp(route_class, "stack")) {
+        return RouteClass::STACK;
+    }
+    THROW_EXCEPTION("unknown route class");
+}
+
+const char* RoutingTable::GetRouteClassName(RouteClass route_class) {
+    switch (route_class) {
+        case RouteClass::ANONYMOUS:
+            return "anon";
+        case RouteClass::FILE_BACKED:
+            return "file";
+        case RouteClass::EXECUTABLE:
+            return "exec";
+        case RouteClass::STACK:
+            return "stack";
+    }
+    THROW_EXCEPTION("unknown route class");
+}
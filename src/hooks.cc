@@ -8,6 +8,7 @@
 #include <string.h>
 #include <fcntl.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "hooks.h"
 #include "GlibcAllocationFunctions.h"
@@ -19,13 +20,9 @@ static void setup_morecore();
 
 MemoryAllocator hpbrs_allocator;
 void* sys_heap_top = nullptr;
-void* brk_top = nullptr;
 bool is_library_initialized = false;
-std::mutex g_hook_sbrk_mutex;
-std::mutex g_hook_brk_mutex;
 std::mutex g_hook_mmap_mutex;
 //std::mutex g_hook_malloc_mutex;
-bool alloc_request_intercepted = false;
 
 // Declare __morecore function pointer (defined in glibc's malloc.c)
 extern "C" {
@@ -63,21 +60,91 @@ bool is_inside_malloc_api = false;
  * want to serve them from Mosalloc pools. For preventing such a scenario we
  * will consume all leftover free slots remained in glibc before loading 
  * Mosalloc to force all allocation requests to be served by Mosalloc pools.
+ *
+ * glibc has no interface that takes the free chunks out of its bins (the
+ * standalone build patches malloc.c for that, see mosalloc_heap.h), so only
+ * the top chunk is retired deterministically, and the bins are drained by
+ * bounded probing:
+ * - malloc_trim consolidates the fast bins (it cannot shrink the system
+ *   heap, as morecore already serves the brk pool);
+ * - the top chunk (mallinfo keepcost) is taken by a single request, which
+ *   leaves only the room of the fenceposts that sysmalloc puts at the end
+ *   of a heap that the next (foreign) morecore memory does not continue;
+ * - each size is requested until it is served by the brk pool (and then it
+ *   is freed back), from the free bytes down (halving), so the large slots
+ *   are split, and then over every size of the tcache and the fast and
+ *   small bins, which are served by exact size only.
+ * Each leftover slot takes at least the requested size of the free bytes,
+ * so the requests are bounded by the free bytes (a glibc that ignores
+ * __morecore, i.e., 2.34 and later, never serves them by the brk pool).
+ * The leftover slots are kept allocated, so they will never be reused.
+ * Returns the number of consumed bytes.
  */
-void consume_glibc_free_slots() {
-    size_t chunk_size = 16;
-    while(true) {
-        alloc_request_intercepted = false;
-        GlibcAllocationFunctions local_glibc_funcs;
-        void* ptr = local_glibc_funcs.CallGlibcMalloc(chunk_size);
-        if (!ptr) {
+#define FREE_SLOTS_EXACT_MAX_SIZE (1032)
+#define FREE_SLOTS_EXACT_SIZE_STEP (16)
+// the minimal chunk size and the chunk header of glibc malloc
+#define MALLOC_MIN_CHUNK_SIZE (4 * sizeof(size_t))
+#define MALLOC_CHUNK_HEADER_SIZE (sizeof(size_t))
+
+static size_t consume_glibc_free_slots_of_size(GlibcAllocationFunctions &glibc_funcs,
+                                               size_t size, size_t &budget) {
+    size_t consumed = 0;
+    while (size <= budget) {
+        void* ptr = glibc_funcs.CallGlibcMalloc(size);
+        if (ptr == nullptr) {
             break;
         }
-        if (alloc_request_intercepted == true) {
-            //local_glibc_funcs.CallGlibcMalloc(4096 - chunk_size - 16);
+        if (hpbrs_allocator.IsAddressInHugePageRegions(ptr)) {
+            glibc_funcs.CallGlibcFree(ptr);
             break;
         }
+        // a leftover slot: keep it allocated so it will never be reused
+        consumed += size;
+        budget -= size;
     }
+    return consumed;
+}
+
+size_t consume_glibc_free_slots() {
+    GlibcAllocationFunctions local_glibc_funcs;
+    size_t consumed = 0;
+
+    malloc_trim(0);
+#if __GLIBC_PREREQ(2, 33)
+    size_t top_size = mallinfo2().keepcost;
+#else
+    size_t top_size = (size_t)mallinfo().keepcost;
+#endif
+    if (top_size >= 2 * MALLOC_MIN_CHUNK_SIZE) {
+        size_t size = top_size - MALLOC_MIN_CHUNK_SIZE - MALLOC_CHUNK_HEADER_SIZE;
+        void* ptr = local_glibc_funcs.CallGlibcMalloc(size);
+        if (ptr != nullptr && hpbrs_allocator.IsAddressInHugePageRegions(ptr)) {
+            local_glibc_funcs.CallGlibcFree(ptr);
+        } else if (ptr != nullptr) {
+            consumed += size;
+        }
+    }
+
+#if __GLIBC_PREREQ(2, 33)
+    size_t free_bytes = mallinfo2().fordblks;
+#else
+    size_t free_bytes = (size_t)mallinfo().fordblks;
+#endif
+    size_t budget = free_bytes;
+    size_t size = FREE_SLOTS_EXACT_MAX_SIZE;
+    while (size * 2 <= free_bytes) {
+        size *= 2;
+    }
+    for (; size > FREE_SLOTS_EXACT_MAX_SIZE; size /= 2) {
+        consumed += consume_glibc_free_slots_of_size(local_glibc_funcs, size,
+                                                     budget);
+    }
+    for (size = FREE_SLOTS_EXACT_MAX_SIZE; size >= FREE_SLOTS_EXACT_SIZE_STEP;
+         size -= FREE_SLOTS_EXACT_SIZE_STEP) {
+        consumed += consume_glibc_free_slots_of_size(local_glibc_funcs, size,
+                                                     budget);
+    }
+    return consumed;
 }
 
 static void setup_morecore() {
@@ -109,10 +176,41 @@ static void setup_morecore() {
     __morecore = mosalloc_morecore;
 }
 
+/*
+ * The fork handlers hold the hooks and pools locks while fork is running,
+ * so the child (which has only the forking thread) will not inherit a lock
+ * that is held by another thread. The locks are taken in the same order as
+ * the hooks take them (hook lock first, then the pool lock).
+ * glibc fork locks the malloc arenas only after the prepare handlers, and
+ * malloc calls morecore (which takes the brk pool lock) under the arena
+ * lock, so the brk pool lock is not taken here (or a thread that grows the
+ * heap and the forking thread would wait for each other). It is free in the
+ * child anyway: the other paths that take it (the brk, sbrk and mprotect
+ * hooks) hold the hook lock, and morecore holds the arena lock.
+ */
+static void prepare_fork() {
+    g_hook_mmap_mutex.lock();
+    hpbrs_allocator.LockPools(false);
+}
+
+static void unlock_after_fork() {
+    hpbrs_allocator.UnlockPools(false);
+    g_hook_mmap_mutex.unlock();
+}
+
+static void child_after_fork() {
+    unlock_after_fork();
+    hpbrs_allocator.ResetAfterFork();
+}
+
 static void activate_mosalloc() {
+    auto start = std::chrono::steady_clock::now();
     is_library_initialized = true;
     setup_morecore();
-    consume_glibc_free_slots();
+    size_t consumed = consume_glibc_free_slots();
+    hpbrs_allocator.RecordStartup(std::chrono::steady_clock::now() - start,
+                                  consumed);
+    pthread_atfork(prepare_fork, unlock_after_fork, child_after_fork);
 }
 
 static void deactivate_mosalloc() {
@@ -136,7 +234,11 @@ static void destructor() {
 int mprotect(void *addr, size_t len, int prot) __THROW_EXCEPTION {
     if (hpbrs_allocator.IsInitialized() == true &&
         hpbrs_allocator.IsAddressInHugePageRegions(addr) == true) {
-        return 0;
+        MUTEX_GUARD(g_hook_mmap_mutex);
+        int res = hpbrs_allocator.ProtectMemory(addr, len, prot);
+        mosalloc_error_log.Record(ErrorLog::Operation::MPROTECT, addr, len,
+                                  (res == 0) ? 0 : errno);
+        return res;
     }
     GlibcAllocationFunctions local_glibc_funcs;
     return local_glibc_funcs.CallGlibcMprotect(addr, len, prot);
@@ -151,12 +253,60 @@ void *mmap(void *addr, size_t length, int prot, int flags, int fd,
     
     MUTEX_GUARD(g_hook_mmap_mutex);
 
+    // dispatch the request by the routes of the configuration file, but
+    // keep fixed mappings over pools memory in the pools (so they will be
+    // unmapped by the pools)
+    int pool = 0;
+    RoutingTable::RouteTarget target =
+        hpbrs_allocator.RouteMmapRequest(length, prot, flags, fd, pool);
+    bool is_fixed_in_pools = (flags & (MAP_FIXED | MAP_FIXED_NOREPLACE)) &&
+        hpbrs_allocator.IsAddressInHugePageRegions(addr);
+    if (target == RoutingTable::RouteTarget::PASSTHROUGH && !is_fixed_in_pools) {
+        GlibcAllocationFunctions local_glibc_funcs;
+        return local_glibc_funcs.CallGlibcMmap(addr, length, prot, flags, fd, offset);
+    }
+    if (pool < 0) {
+        pool = 0;
+    }
+
+    void *res = MAP_FAILED;
     if (fd >= 0) {
-        return hpbrs_allocator.AllocateFromFileMmapRegion(addr, length, prot, flags, fd, offset);
-        //GlibcAllocationFunctions local_glibc_funcs;
-        //return local_glibc_funcs.CallGlibcMmap(addr, length, prot, flags, fd, offset);
+        res = hpbrs_allocator.AllocateFromFileMmapRegion(addr, length, prot, flags, fd, offset);
+        mosalloc_error_log.Record(ErrorLog::Operation::MMAP, res, length,
+                                  (res == MAP_FAILED) ? errno : 0);
+        return res;
+    }
+
+    // MAP_NORESERVE mappings ask for address space that is committed lazily
+    // by the kernel, and MAP_FIXED mappings outside of the pools are placed
+    // by the caller, so both are served by the kernel.
+    // PROT_NONE reservations are served from the pools (and committed when
+    // they become accessible).
+    if (((flags & MAP_NORESERVE) && prot != PROT_NONE) ||
+        ((flags & (MAP_FIXED | MAP_FIXED_NOREPLACE)) &&
+         !hpbrs_allocator.IsAddressInHugePageRegions(addr))) {
+        GlibcAllocationFunctions local_glibc_funcs;
+        return local_glibc_funcs.CallGlibcMmap(addr, length, prot, flags, fd, offset);
     }
-    return hpbrs_allocator.AllocateFromAnonymousMmapRegion(length);
+    res = hpbrs_allocator.AllocateFromAnonymousMmapRegion(addr, length, prot, flags, pool);
+    mosalloc_error_log.Record(ErrorLog::Operation::MMAP, res, length,
+                              (res == MAP_FAILED) ? errno : 0);
+    return res;
+}
+
+void *mosalloc_mmap_pool(const char *pool, size_t length,
+                         int prot) __THROW_EXCEPTION {
+    if (hpbrs_allocator.IsInitialized() == false) {
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+
+    MUTEX_GUARD(g_hook_mmap_mutex);
+
+    void *res = hpbrs_allocator.AllocateFromNamedPool(pool, length, prot);
+    mosalloc_error_log.Record(ErrorLog::Operation::MMAP, res, length,
+                              (res == MAP_FAILED) ? errno : 0);
+    return res;
 }
 
 int munmap(void *addr, size_t length) __THROW_EXCEPTION {
@@ -165,9 +315,17 @@ int munmap(void *addr, size_t length) __THROW_EXCEPTION {
         return local_glibc_funcs.CallGlibcMunmap(addr, length);
     }
 
+    // mappings that were served by the kernel are unmapped by the kernel
+    if (hpbrs_allocator.IsAddressInHugePageRegions(addr) == false) {
+        GlibcAllocationFunctions local_glibc_funcs;
+        return local_glibc_funcs.CallGlibcMunmap(addr, length);
+    }
+
     MUTEX_GUARD(g_hook_mmap_mutex);
 
     int res = hpbrs_allocator.DeallocateFromMmapRegion(addr, length);
+    mosalloc_error_log.Record(ErrorLog::Operation::MUNMAP, addr, length,
+                              (res == 0) ? 0 : errno);
     return res;
 }
 
@@ -176,16 +334,28 @@ int brk(void *addr) __THROW_EXCEPTION {
         GlibcAllocationFunctions local_glibc_funcs;
         return local_glibc_funcs.CallGlibcBrk(addr);
     }
-    
-    MUTEX_GUARD(g_hook_brk_mutex);
 
-    return hpbrs_allocator.ChangeProgramBreak(addr);
+    MUTEX_GUARD(g_hook_mmap_mutex);
+    int res = hpbrs_allocator.ChangeProgramBreak(addr);
+    mosalloc_error_log.Record(ErrorLog::Operation::BRK, addr, 0,
+                              (res == 0) ? 0 : errno);
+    return res;
 }
 
 void *mosalloc_morecore(intptr_t increment) __THROW_EXCEPTION {
-    alloc_request_intercepted = true;
-    void* ptr = sbrk(increment);
-    return ptr;
+    if (hpbrs_allocator.IsInitialized() == false) {
+        GlibcAllocationFunctions local_glibc_funcs;
+        void* ptr = local_glibc_funcs.CallGlibcSbrk(increment);
+        // MORECORE_FAILURE is NULL (rather than the (void*)-1 of sbrk)
+        return (ptr == (void*)-1) ? nullptr : ptr;
+    }
+
+    // the heap growth fast path: it takes only the brk pool lock (rather
+    // than going through the sbrk and brk hooks)
+    void* prev_brk = hpbrs_allocator.Morecore(increment);
+    mosalloc_error_log.Record(ErrorLog::Operation::SBRK, prev_brk, increment,
+                              (prev_brk == nullptr) ? errno : 0);
+    return prev_brk;
 }
 
 void *sbrk(intptr_t increment) __THROW_EXCEPTION {
@@ -194,29 +364,19 @@ void *sbrk(intptr_t increment) __THROW_EXCEPTION {
         return local_glibc_funcs.CallGlibcSbrk(increment);
     }
     
-    MUTEX_GUARD(g_hook_sbrk_mutex);
-
-    // if this the first call to sbrk after pools were initialized
-    // then initialize brk_top to be the brk pool base address
-    if (brk_top == nullptr) {
-        brk_top = hpbrs_allocator.GetBrkRegionBase();
-    }
-
     /*
      * On success, sbrk() returns the previous program break.  (If the break 
      * was increased, then this value is a pointer to the start of the newly 
      * allocated memory).  On error, (void *) -1 is returned, and errno is 
      * set to ENOMEM.
     */
-    
-    void* prev_brk = brk_top;
-    void* new_brk = (void*) ((intptr_t)brk_top + increment);
-
-    if (brk(new_brk) < 0) {
+    MUTEX_GUARD(g_hook_mmap_mutex);
+    void* prev_brk = hpbrs_allocator.Morecore(increment);
+    mosalloc_error_log.Record(ErrorLog::Operation::SBRK, prev_brk, increment,
+                              (prev_brk == nullptr) ? errno : 0);
+    if (prev_brk == nullptr) {
         return ((void*)-1);
     }
-
-    brk_top = new_brk;
     return prev_brk;
 }
 
@@ -24,6 +24,23 @@ endif
 CFLAGS := $(CFLAGS_BASE)
 CFLAGS += -Wimplicit-function-declaration
 
+# TRACE=1 -> compile tracing into the malloc wrappers (see include/trace.h)
+TRACE ?= 0
+ifeq ($(TRACE),1)
+  CFLAGS += -DMALLOC_AUTO_TRACE
+endif
+
+# Malloc locks (see include/special_shims/libc-lock.h):
+# LOCK_SPIN=<n>  -> spin n times on a contended lock before sleeping
+# PTHREAD_LOCK=1 -> use pthread mutexes instead of the futex-based lock
+LOCK_SPIN ?= 0
+PTHREAD_LOCK ?= 0
+ifeq ($(PTHREAD_LOCK),1)
+  CFLAGS += -DMALLOC_AUTO_PTHREAD_LOCK
+else
+  CFLAGS += -DMALLOC_AUTO_LOCK_SPIN=$(LOCK_SPIN)
+endif
+
 # === Optional: depfiles for incremental rebuilds (enabled by default) ===
 #
 # Why this exists even though the "main" workflow is script-driven:
@@ -79,14 +96,45 @@ build/malloc.o: CFLAGS += -fvisibility=hidden
 all: clone-glibc run_build
 
 # Target for CMake to generate source files (deletes glibc after success to save space)
-mosalloc: clone-glibc run_build patch-morecore
+mosalloc: clone-glibc run_build patch-morecore patch-arena patch-heap
 	@echo "Cleaning up glibc source to save space..."
 	rm -rf $(GLIBC_SRC)
 
+# Patches of malloc.c (see scripts/patch_malloc.py); each one is anchored on
+# the glibc source rather than on an exact line, is idempotent, and fails the
+# build if the glibc version is not supported
+PATCH_MALLOC := python3 scripts/patch_malloc.py src/malloc.c
+
 # Patch malloc.c to use customizable __morecore function pointer
 patch-morecore: run_build
 	@echo "Patching malloc.c to use __morecore function pointer..."
-	sed -i 's|#define MORECORE         (\*__glibc_morecore)|#define MORECORE         (*__morecore)\nvoid * __glibc_morecore (ptrdiff_t);\nvoid *(*__morecore)(ptrdiff_t) = __glibc_morecore;|' src/malloc.c
+	$(PATCH_MALLOC) --patch morecore
+
+# Patch malloc.c to serve the non-main arenas heaps from the Mosalloc arena
+# pool (see include/mosalloc_arena.h)
+patch-arena: run_build
+	@echo "Patching malloc.c to serve arena heaps from Mosalloc..."
+	$(PATCH_MALLOC) --patch arena
+
+# Patch malloc.c to retire the system heap when Mosalloc is activated
+# (see include/mosalloc_heap.h)
+patch-heap: run_build
+	@echo "Patching malloc.c to retire the system heap..."
+	$(PATCH_MALLOC) --patch heap
+
+# Verify that the patches apply to the malloc.c of each of the GLIBC_TAGS
+# (requires a full clone in GLIBC_SRC), e.g.:
+#   make -f generate.mk patch-matrix GLIBC_TAGS="glibc-2.31 glibc-2.39"
+GLIBC_TAGS ?= glibc-2.31 glibc-2.33 glibc-2.34 glibc-2.35 glibc-2.38 glibc-2.39 glibc-2.40
+patch-matrix: clone-glibc
+	@mkdir -p build/patch-matrix
+	@failed=0; \
+	for tag in $(GLIBC_TAGS); do \
+	  out=build/patch-matrix/malloc-$$tag.c; \
+	  git -C $(GLIBC_SRC) show $$tag:malloc/malloc.c > $$out || { failed=1; continue; }; \
+	  python3 scripts/patch_malloc.py --check $$out || failed=1; \
+	done; \
+	exit $$failed
 
 # This is the exact target the autoinclude script builds each iteration
 malloc-standalone: $(TARGET)
@@ -147,15 +195,30 @@ deps: | build
 	| tr ' ' '\n' | sed '/^$$/d' | sort -u > build/malloc.deps.txt
 	@echo "Wrote build/malloc.deps.txt"
 
-check-exports: $(TARGET)
-	nm -D $(TARGET) | egrep ' (T|W) (malloc|free|calloc|realloc|posix_memalign|aligned_alloc|morecore)$$' \
-	  || (echo "Missing allocator symbols"; exit 1)
+# The malloc family that must be served by the standalone allocator (a call
+# that resolves to the system libc would mix two heaps).
+# CHECK_LIB selects the library to check (e.g., the one built by CMake).
+EXPORTED_SYMBOLS := malloc free calloc realloc reallocarray \
+                    posix_memalign aligned_alloc memalign valloc pvalloc \
+                    malloc_usable_size mallopt malloc_trim malloc_stats \
+                    malloc_info mallinfo mallinfo2
+CHECK_LIB ?= $(TARGET)
+
+check-exports: $(CHECK_LIB)
+	@missing=0; \
+	for sym in $(EXPORTED_SYMBOLS); do \
+	  if ! nm -D --defined-only $(CHECK_LIB) | egrep -q " (T|W|i) $$sym(@.*)?$$"; then \
+	    echo "Missing allocator symbol: $$sym"; missing=1; \
+	  fi; \
+	done; \
+	if [ $$missing -ne 0 ]; then exit 1; fi; \
+	echo "All allocator symbols are exported by $(CHECK_LIB)"
 
 clean:
 	rm -rf build include/glibc-src include/compat_next
 	rm -f src/arena.c src/malloc.c src/malloc-hugepages.c src/morecore.c
 	rm -rf $(GLIBC_SRC)
-.PHONY: all mosalloc malloc-standalone run_build clone-glibc clean deps check-exports print-preload
+.PHONY: all mosalloc malloc-standalone run_build clone-glibc clean deps check-exports print-preload patch-morecore patch-arena patch-heap patch-matrix
 
 ifeq ($(USE_DEPS),1)
 -include $(DEPS)
@@ -215,55 +215,12 @@ extern "C" {
 #endif
 
 /* ------------------------------------------------------------------ */
-/*  Lock type & macros (fallback if libc-lock.h shim not included)    */
+/*  Lock type & macros                                                */
 /* ------------------------------------------------------------------ */
 
-#ifndef LLL_LOCK_INITIALIZER
-# define LLL_LOCK_INITIALIZER PTHREAD_MUTEX_INITIALIZER
-#endif
-
-#ifndef _LIBC_LOCK_INITIALIZER
-# define _LIBC_LOCK_INITIALIZER LLL_LOCK_INITIALIZER
-#endif
-
-#ifndef __libc_lock_t
-typedef pthread_mutex_t __libc_lock_t;
-#endif
-
-#ifndef __libc_lock_define
-# define __libc_lock_define(CLASS, NAME) \
-    CLASS __libc_lock_t NAME
-#endif
-
-#ifndef __libc_lock_define_initialized
-# define __libc_lock_define_initialized(CLASS, NAME) \
-    CLASS __libc_lock_t NAME = _LIBC_LOCK_INITIALIZER
-#endif
-
-#ifndef __libc_lock_init
-# define __libc_lock_init(NAME) \
-    (pthread_mutex_init (&(NAME), NULL))
-#endif
-
-#ifndef __libc_lock_lock
-# define __libc_lock_lock(NAME) \
-    (pthread_mutex_lock (&(NAME)))
-#endif
-
-#ifndef __libc_lock_unlock
-# define __libc_lock_unlock(NAME) \
-    (pthread_mutex_unlock (&(NAME)))
-#endif
-
-#ifndef __libc_lock_trylock
-# define __libc_lock_trylock(NAME) \
-    (pthread_mutex_trylock (&(NAME)))
-#endif
-
-#ifndef __libc_lock_destroy
-# define __libc_lock_destroy(NAME) \
-    (pthread_mutex_destroy (&(NAME)))
-#endif
+/* The futex-based low-level lock of the libc-lock.h shim, so every user of
+   __libc_lock_* gets the same lock whether or not it includes the shim. */
+#include "special_shims/libc-lock.h"
 
 /* ------------------------------------------------------------------ */
 /*  Security flag stub                                                */
@@ -0,0 +1,42 @@
+#ifndef MOSALLOC_ARENA_H
+#define MOSALLOC_ARENA_H
+
+/*
+ * Redirects the heaps of the non-main arenas to a Mosalloc pool.
+ *
+ * glibc creates the heaps of the non-main arenas with its internal mmap
+ * (new_heap/alloc_new_heap), grows them with mprotect (grow_heap) and shrinks
+ * them with mmap(MAP_FIXED) (shrink_heap). generate.mk includes this header
+ * right before arena.c in malloc.c (and mosalloc_arena_end.h right after
+ * it), so these calls are served by the Mosalloc arena pool, which places
+ * each heap on an address that is aligned to its size (the heap lookup
+ * requires HEAP_MAX_SIZE alignment) and commits it with the pool pages.
+ */
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* HEAP_MAX_SIZE of arena.c (for the default DEFAULT_MMAP_THRESHOLD_MAX),
+   which limits the number of arenas by the size of the arena pool.  */
+#define MOSALLOC_HEAP_MAX_SIZE (2 * 4 * 1024 * 1024 * sizeof (long))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void *mosalloc_arena_mmap (void *addr, size_t length, int prot, int flags,
+                           int fd, off_t offset);
+int mosalloc_arena_munmap (void *addr, size_t length);
+int mosalloc_arena_mprotect (void *addr, size_t length, int prot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifndef __cplusplus
+# define __mmap mosalloc_arena_mmap
+# define __munmap mosalloc_arena_munmap
+# define __mprotect mosalloc_arena_mprotect
+#endif
+
+#endif /* MOSALLOC_ARENA_H */
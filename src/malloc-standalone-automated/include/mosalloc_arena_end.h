@@ -0,0 +1,7 @@
+/*
+ * Ends the redirection of mosalloc_arena.h, so the rest of malloc.c keeps
+ * using the glibc_compat.h wrappers.
+ */
+#undef __mmap
+#undef __munmap
+#undef __mprotect
@@ -0,0 +1,76 @@
+#ifndef MOSALLOC_HEAP_H
+#define MOSALLOC_HEAP_H
+
+/*
+ * Retires the memory that the main arena got before Mosalloc was activated
+ * (i.e., the system heap, which was extended by sbrk before __morecore was
+ * redirected to Mosalloc), so it will not serve allocations that should be
+ * served by the brk pool.
+ *
+ * generate.mk includes this header at the end of malloc.c, as it works on
+ * the malloc internals. The free chunks are taken out of the bins and marked
+ * as in use, and the top chunk is closed by fenceposts (as sysmalloc does
+ * for a foreign sbrk) and marked as in use, so all of them are leaked, and
+ * the next allocation that is not served by the tcache calls MORECORE.
+ * The tcache of the calling thread is drained by the caller (by plain
+ * allocations), since its layout differs between glibc versions.
+ * Returns the number of retired bytes.
+ */
+size_t
+__malloc_retire_heap (void)
+{
+  mstate av = &main_arena;
+  size_t retired = 0;
+
+  __libc_lock_lock (av->mutex);
+
+  /* Fast chunks are marked as in use already */
+  for (int i = 0; i < NFASTBINS; i++)
+    {
+      for (mchunkptr p = av->fastbinsY[i]; p != NULL;
+#ifdef REVEAL_PTR
+           p = REVEAL_PTR (p->fd)
+#else
+           p = p->fd
+#endif
+          )
+        retired += chunksize (p);
+      av->fastbinsY[i] = NULL;
+    }
+  av->have_fastchunks = false;
+
+  for (int i = 1; i < NBINS; i++)
+    {
+      mbinptr bin = bin_at (av, i);
+      for (mchunkptr p = last (bin); p != bin; p = p->bk)
+        {
+          set_inuse_bit_at_offset (p, chunksize (p));
+          retired += chunksize (p);
+        }
+      bin->fd = bin->bk = bin;
+    }
+  memset (av->binmap, 0, sizeof (av->binmap));
+  /* The last remainder was in the unsorted bin, so it is retired too */
+  av->last_remainder = NULL;
+
+  mchunkptr old_top = av->top;
+  if (old_top != initial_top (av))
+    {
+      /* Shrink the top chunk to insert fenceposts (they overwrite the top
+         chunk if it is MINSIZE, which is lost anyway) */
+      size_t old_size = (chunksize (old_top) - 2 * CHUNK_HDR_SZ)
+                        & ~MALLOC_ALIGN_MASK;
+      set_head (old_top, old_size | PREV_INUSE);
+      set_head (chunk_at_offset (old_top, old_size),
+                CHUNK_HDR_SZ | PREV_INUSE);
+      set_head (chunk_at_offset (old_top, old_size + CHUNK_HDR_SZ),
+                CHUNK_HDR_SZ | PREV_INUSE);
+      retired += old_size;
+      av->top = initial_top (av);
+    }
+
+  __libc_lock_unlock (av->mutex);
+  return retired;
+}
+
+#endif /* MOSALLOC_HEAP_H */
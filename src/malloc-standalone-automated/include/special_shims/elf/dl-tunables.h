@@ -2,10 +2,17 @@
 #define MALLOC_STANDALONE_DL_TUNABLES_H
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 /*
- * Stand-ins for the tunables machinery. malloc/arena touches these
- * but standalone builds don't need real tunables.
+ * Stand-ins for the tunables machinery. The real tunables are parsed by
+ * ld.so, which does not know about the standalone malloc, so the malloc
+ * tunables are looked up here when malloc/arena reads them (once, from
+ * ptmalloc_init):
+ *   GLIBC_TUNABLES=glibc.malloc.<name>=<value>:glibc.malloc.<name>=<value>
+ * and the MALLOC_*_ environment aliases (e.g., MALLOC_ARENA_MAX), where
+ * GLIBC_TUNABLES wins. The lookup is allocation-free (malloc is not ready).
  */
 typedef intmax_t tunable_num_t;
 
@@ -16,18 +23,134 @@ typedef struct
 
 typedef void (*tunable_callback_t) (tunable_val_t *);
 
-#ifndef TUNABLE_CALLBACK_FNDECL
-# define TUNABLE_CALLBACK_FNDECL(__name, __type) \
-    static int __name (tunable_val_t *valp)
-#endif
+#define TUNABLES_ENV_NAME "GLIBC_TUNABLES"
+#define TUNABLES_MALLOC_PREFIX "glibc.malloc."
+
+/* The malloc tunables of glibc's dl-tunables.list with their bounds. */
+struct __mosalloc_tunable
+{
+  const char *name;
+  const char *env_alias;
+  tunable_num_t min;
+  tunable_num_t max;
+};
+
+static const struct __mosalloc_tunable __mosalloc_tunables[] =
+{
+  { "top_pad",               "MALLOC_TOP_PAD_",        0, INTMAX_MAX },
+  { "perturb",               "MALLOC_PERTURB_",        0, 0xff },
+  { "mmap_threshold",        "MALLOC_MMAP_THRESHOLD_", 0, INTMAX_MAX },
+  { "trim_threshold",        "MALLOC_TRIM_THRESHOLD_", 0, INTMAX_MAX },
+  { "mmap_max",              "MALLOC_MMAP_MAX_",       0, INT32_MAX },
+  { "arena_max",             "MALLOC_ARENA_MAX",       1, INTMAX_MAX },
+  { "arena_test",            "MALLOC_ARENA_TEST",      1, INTMAX_MAX },
+  { "tcache_max",            NULL,                     0, INTMAX_MAX },
+  { "tcache_count",          NULL,                     0, 65535 },
+  { "tcache_unsorted_limit", NULL,                     0, INTMAX_MAX },
+  { "mxfast",                NULL,                     0, INTMAX_MAX },
+  { "hugetlb",               NULL,                     0, 2 },
+};
+
+/* Returns the value of glibc.malloc.<id> in a "name=value:..." list */
+static const char *
+__mosalloc_tunables_find (const char *list, const char *id)
+{
+  size_t prefix_len = strlen (TUNABLES_MALLOC_PREFIX);
+  size_t id_len = strlen (id);
+
+  while (list != NULL && *list != '\0')
+    {
+      if (strncmp (list, TUNABLES_MALLOC_PREFIX, prefix_len) == 0
+          && strncmp (list + prefix_len, id, id_len) == 0
+          && list[prefix_len + id_len] == '=')
+        return list + prefix_len + id_len + 1;
+      list = strchr (list, ':');
+      if (list != NULL)
+        list++;
+    }
+  return NULL;
+}
+
+/* Parses a decimal, 0x-hexadecimal or 0-octal value (as _dl_strtoul) */
+static int
+__mosalloc_tunable_parse (const char *str, tunable_num_t *val)
+{
+  tunable_num_t result = 0;
+  int base = 10;
+
+  if (str[0] == '0' && (str[1] == 'x' || str[1] == 'X'))
+    {
+      base = 16;
+      str += 2;
+    }
+  else if (str[0] == '0' && str[1] != '\0' && str[1] != ':')
+    {
+      base = 8;
+      str++;
+    }
+
+  const char *start = str;
+  for (; *str != '\0' && *str != ':'; str++)
+    {
+      int c = *str | 0x20;
+      int digit;
+      if (*str >= '0' && *str <= '9')
+        digit = *str - '0';
+      else if (c >= 'a' && c <= 'f')
+        digit = c - 'a' + 10;
+      else
+        return 0;
+      if (digit >= base || result > (INTMAX_MAX - digit) / base)
+        return 0;
+      result = result * base + digit;
+    }
+  if (str == start)
+    return 0;
+
+  *val = result;
+  return 1;
+}
+
+/* Calls the callback of the tunable if it is set to a valid value */
+static void __attribute__ ((unused))
+__mosalloc_tunable_get (const char *id, tunable_callback_t callback)
+{
+  const struct __mosalloc_tunable *tunable = NULL;
+  for (size_t i = 0;
+       i < sizeof (__mosalloc_tunables) / sizeof (__mosalloc_tunables[0]); i++)
+    if (strcmp (__mosalloc_tunables[i].name, id) == 0)
+      tunable = &__mosalloc_tunables[i];
+  if (tunable == NULL)
+    return;
+
+  const char *str = __mosalloc_tunables_find (getenv (TUNABLES_ENV_NAME), id);
+  if (str == NULL && tunable->env_alias != NULL)
+    str = getenv (tunable->env_alias);
+
+  tunable_val_t val;
+  if (str == NULL || !__mosalloc_tunable_parse (str, &val.numval)
+      || val.numval < tunable->min || val.numval > tunable->max)
+    return;
+  callback (&val);
+}
 
 #ifndef TUNABLE_CALLBACK
 # define TUNABLE_CALLBACK(__name) __name
 #endif
 
+#ifndef TUNABLE_CALLBACK_FNDECL
+# define TUNABLE_CALLBACK_FNDECL(__name, __type) \
+    static inline int do_ ## __name (__type value); \
+    static void TUNABLE_CALLBACK (__name) (tunable_val_t *valp) \
+    { \
+      __type value = (__type) (valp)->numval; \
+      do_ ## __name (value); \
+    }
+#endif
+
 #ifndef TUNABLE_GET
-# define TUNABLE_GET(__name, __type, __callback) \
-    do { (void) (__callback); } while (0)
+# define TUNABLE_GET(__id, __type, __callback) \
+    __mosalloc_tunable_get (#__id, (__callback))
 #endif
 
 #ifndef TUNABLE_IS_INITIALIZED
@@ -1,26 +1,117 @@
 #ifndef MALLOC_STANDALONE_LIBC_LOCK_H
 #define MALLOC_STANDALONE_LIBC_LOCK_H
 
+/*
+ * Low-level lock for standalone malloc, matching glibc's internal lll_lock:
+ * the lock is a single int that is 0 (unlocked), 1 (locked, no waiters) or
+ * 2 (locked, possibly with waiters). The uncontended lock/unlock is a single
+ * atomic instruction, and only contended locks enter the kernel (futex).
+ *
+ * MALLOC_AUTO_LOCK_SPIN=<n> makes a contended lock spin up to n times before
+ * sleeping (adaptive spinning, 0 means no spinning as in glibc).
+ * MALLOC_AUTO_PTHREAD_LOCK falls back to pthread_mutex_t (for comparison).
+ */
+
+#ifdef MALLOC_AUTO_PTHREAD_LOCK
+
 #include <pthread.h>
 
-/* Minimal lock type for standalone malloc. */
 typedef pthread_mutex_t __libc_lock_t;
 
+#define LLL_LOCK_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+
+#define __libc_lock_init(NAME)    (pthread_mutex_init (&(NAME), NULL))
+#define __libc_lock_lock(NAME)    (pthread_mutex_lock (&(NAME)))
+#define __libc_lock_trylock(NAME) (pthread_mutex_trylock (&(NAME)))
+#define __libc_lock_unlock(NAME)  (pthread_mutex_unlock (&(NAME)))
+#define __libc_lock_destroy(NAME) (pthread_mutex_destroy (&(NAME)))
+
+#else /* !MALLOC_AUTO_PTHREAD_LOCK */
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#ifndef MALLOC_AUTO_LOCK_SPIN
+# define MALLOC_AUTO_LOCK_SPIN 0
+#endif
+
+typedef int __libc_lock_t;
+
+#define LLL_LOCK_INITIALIZER 0
+
+static inline void __mosalloc_lll_futex_wait (int *futex, int val)
+{
+  syscall (SYS_futex, futex, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static inline void __mosalloc_lll_futex_wake (int *futex)
+{
+  syscall (SYS_futex, futex, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+static inline int __mosalloc_lll_trylock (int *futex)
+{
+  int expected = 0;
+  return __atomic_compare_exchange_n (futex, &expected, 1, 0,
+                                      __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)
+         ? 0 : EBUSY;
+}
+
+/* Slow path of a contended lock (glibc's __lll_lock_wait). */
+static void __attribute__ ((noinline, unused))
+__mosalloc_lll_lock_wait (int *futex)
+{
+#if MALLOC_AUTO_LOCK_SPIN > 0
+  /* Spin while the holder has no waiters, i.e., it is likely to release
+     the lock soon, and take the lock as soon as it is released */
+  for (int i = 0; i < MALLOC_AUTO_LOCK_SPIN; i++)
+    {
+      int val = __atomic_load_n (futex, __ATOMIC_RELAXED);
+      if (val == 0 && __mosalloc_lll_trylock (futex) == 0)
+        return;
+      if (val == 2)
+        break;
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause ();
+#endif
+    }
+#endif
+  /* Mark the lock as contended, so the holder wakes us when it unlocks */
+  while (__atomic_exchange_n (futex, 2, __ATOMIC_ACQUIRE) != 0)
+    __mosalloc_lll_futex_wait (futex, 2);
+}
+
+static inline void __mosalloc_lll_lock (int *futex)
+{
+  if (__builtin_expect (__mosalloc_lll_trylock (futex) != 0, 0))
+    __mosalloc_lll_lock_wait (futex);
+}
+
+static inline void __mosalloc_lll_unlock (int *futex)
+{
+  if (__builtin_expect (__atomic_exchange_n (futex, 0, __ATOMIC_RELEASE) > 1,
+                        0))
+    __mosalloc_lll_futex_wake (futex);
+}
+
+#define __libc_lock_init(NAME)    ((void) ((NAME) = LLL_LOCK_INITIALIZER))
+#define __libc_lock_lock(NAME)    (__mosalloc_lll_lock (&(NAME)))
+#define __libc_lock_trylock(NAME) (__mosalloc_lll_trylock (&(NAME)))
+#define __libc_lock_unlock(NAME)  (__mosalloc_lll_unlock (&(NAME)))
+#define __libc_lock_destroy(NAME) ((void) 0)
+
+#endif /* MALLOC_AUTO_PTHREAD_LOCK */
+
 #define __libc_lock_define(CLASS, NAME) \
   CLASS __libc_lock_t NAME
 
 #define __libc_lock_define_initialized(CLASS, NAME) \
-  CLASS __libc_lock_t NAME = PTHREAD_MUTEX_INITIALIZER
-
-#define LLL_LOCK_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+  CLASS __libc_lock_t NAME = LLL_LOCK_INITIALIZER
 
 #ifndef _LIBC_LOCK_INITIALIZER
 # define _LIBC_LOCK_INITIALIZER LLL_LOCK_INITIALIZER
 #endif
 
-#define __libc_lock_init(NAME)    (pthread_mutex_init (&(NAME), NULL))
-#define __libc_lock_lock(NAME)    (pthread_mutex_lock (&(NAME)))
-#define __libc_lock_unlock(NAME)  (pthread_mutex_unlock (&(NAME)))
-#define __libc_lock_destroy(NAME) (pthread_mutex_destroy (&(NAME)))
-
 #endif /* MALLOC_STANDALONE_LIBC_LOCK_H */
@@ -2,17 +2,50 @@
 #define MALLOC_STANDALONE_SETVMANAME_H
 
 #include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/prctl.h>
+
+#ifndef PR_SET_VMA
+# define PR_SET_VMA 0x53564d41
+# define PR_SET_VMA_ANON_NAME 0
+#endif
 
 /*
- * glibc uses this to label VMAs via prctl(PR_SET_VMA...).
- * Standalone malloc does not need it; keep as no-op.
+ * glibc uses this to label its heaps via prctl(PR_SET_VMA...), e.g.,
+ * "glibc: malloc arena". As in glibc, the labels are opt-in by
+ * GLIBC_TUNABLES=glibc.mem.decorate_maps=1, because they replace the
+ * "mosalloc:<pool>:<page-size>" labels of the pools the heaps are served
+ * from. Failures are ignored and errno is kept (as INTERNAL_SYSCALL does).
  */
+static inline int
+__set_vma_name_enabled (void)
+{
+  /* -1 until GLIBC_TUNABLES is read, then 0 or 1 */
+  static int enabled = -1;
+  int state = __atomic_load_n (&enabled, __ATOMIC_RELAXED);
+  if (state < 0)
+    {
+      const char *tunables = getenv ("GLIBC_TUNABLES");
+      const char *value = (tunables != NULL)
+                          ? strstr (tunables, "glibc.mem.decorate_maps=")
+                          : NULL;
+      state = (value != NULL
+               && value[sizeof ("glibc.mem.decorate_maps=") - 1] == '1');
+      __atomic_store_n (&enabled, state, __ATOMIC_RELAXED);
+    }
+  return state;
+}
+
 static inline void
-__set_vma_name (void *start __attribute__((unused)),
-                size_t len __attribute__((unused)),
-                const char *name __attribute__((unused)))
+__set_vma_name (void *start, size_t len, const char *name)
 {
-  /* no-op */
+  if (!__set_vma_name_enabled ())
+    return;
+  int saved_errno = errno;
+  prctl (PR_SET_VMA, PR_SET_VMA_ANON_NAME, start, len, name);
+  errno = saved_errno;
 }
 
 #endif /* MALLOC_STANDALONE_SETVMANAME_H */
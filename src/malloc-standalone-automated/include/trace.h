@@ -4,6 +4,13 @@
 #include <stdlib.h>
 
 /* ---------- tiny, allocation-free tracing ---------- */
+/*
+ * Tracing is compiled in only when MALLOC_AUTO_TRACE is defined (the
+ * MALLOC_AUTO_TRACE CMake option or TRACE=1 in generate.mk), so release
+ * builds do not pay for it in the malloc wrappers. When it is compiled in,
+ * it is enabled at runtime by MALLOC_FORK_TRACE=1.
+ */
+#ifdef MALLOC_AUTO_TRACE
 static inline int trace_enabled(void) {
     static int cached = -1;
     if (cached == -1) {
@@ -16,4 +23,7 @@ static inline void trace_msg(const char *s) {
     if (!trace_enabled()) return;
     (void)!write(2, s, (unsigned)strlen(s));
     (void)!write(2, "\n", 1);
-}
\ No newline at end of file
+}
+#else
+#define trace_msg(s) ((void)0)
+#endif
@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+"""
+patch_malloc.py
+
+Applies the Mosalloc patches to the glibc malloc.c that autoinclude.py copied
+into src/:
+- morecore: makes MORECORE call through the `__morecore` function pointer, so
+  Mosalloc can redirect the main arena to its brk pool. glibc < 2.34 already
+  has `__morecore`; newer versions call their morecore function directly.
+- arena:    wraps `#include "arena.c"` with include/mosalloc_arena.h and
+  include/mosalloc_arena_end.h, so the non-main arenas heaps are served by
+  the Mosalloc arena pool.
+- heap:     appends include/mosalloc_heap.h, which retires the system heap
+  when Mosalloc is activated.
+
+Each patch is anchored on a regular expression rather than an exact line, and
+is marked in the output, so:
+- applying a patch twice is a no-op,
+- a malloc.c that no known anchor matches fails the build loudly (instead of
+  silently producing an unpatched allocator).
+
+Use --check to verify that the patches apply (without writing the file),
+e.g., against the malloc.c of several glibc tags (see `make patch-matrix`).
+"""
+
+import re
+import sys
+import argparse
+from pathlib import Path
+from typing import Optional
+
+MARKER = "/* mosalloc: {} patch */"
+
+# ---------------------------------------------------------------------------
+# Patches: each one returns the patched text, or None if no anchor matched
+# ---------------------------------------------------------------------------
+
+# glibc >= 2.34: #define MORECORE (*__glibc_morecore)
+# glibc <  2.34: #define MORECORE (*__morecore)   (already hookable)
+MORECORE_RE = re.compile(r"^#\s*define\s+MORECORE\s+\(\*(\w+)\)[ \t]*$",
+                         re.MULTILINE)
+
+
+def patch_morecore(text: str) -> Optional[str]:
+    m = MORECORE_RE.search(text)
+    if m is None:
+        return None
+    func = m.group(1)
+    if func == "__morecore":
+        # the pointer is defined by malloc.c itself (glibc < 2.34)
+        return text
+    replacement = (
+        "#define MORECORE         (*__morecore)\n"
+        f"void * {func} (ptrdiff_t);\n"
+        f"void *(*__morecore)(ptrdiff_t) = {func};"
+    )
+    return text[:m.start()] + replacement + text[m.end():]
+
+
+ARENA_RE = re.compile(r'^#\s*include\s+"arena\.c"[ \t]*$', re.MULTILINE)
+
+
+def patch_arena(text: str) -> Optional[str]:
+    m = ARENA_RE.search(text)
+    if m is None:
+        return None
+    replacement = ('#include "mosalloc_arena.h"\n'
+                   '#include "arena.c"\n'
+                   '#include "mosalloc_arena_end.h"')
+    return text[:m.start()] + replacement + text[m.end():]
+
+
+# mosalloc_heap.h works on the main arena, so malloc.c must define it
+MAIN_ARENA_RE = re.compile(r"^static\s+struct\s+malloc_state\s+main_arena\b",
+                           re.MULTILINE)
+
+
+def patch_heap(text: str) -> Optional[str]:
+    if MAIN_ARENA_RE.search(text) is None:
+        return None
+    return text.rstrip("\n") + '\n\n#include "mosalloc_heap.h"\n'
+
+
+PATCHES = {
+    "morecore": patch_morecore,
+    "arena": patch_arena,
+    "heap": patch_heap,
+}
+
+# ---------------------------------------------------------------------------
+# Driver
+# ---------------------------------------------------------------------------
+
+def apply(text: str, name: str) -> str:
+    marker = MARKER.format(name)
+    if marker in text:
+        return text
+    patched = PATCHES[name](text)
+    if patched is None:
+        raise RuntimeError(f"no known anchor for the '{name}' patch "
+                           "(unsupported glibc version?)")
+    return marker + "\n" + patched
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("malloc_c", type=Path, help="path of malloc.c")
+    parser.add_argument("--patch", action="append", choices=sorted(PATCHES),
+                        help="patch to apply (default: all of them)")
+    parser.add_argument("--check", action="store_true",
+                        help="only verify that the patches apply")
+    args = parser.parse_args()
+
+    text = args.malloc_c.read_text()
+    try:
+        for name in args.patch or PATCHES:
+            text = apply(text, name)
+    except RuntimeError as e:
+        print(f"{args.malloc_c}: {e}", file=sys.stderr)
+        return 1
+
+    if args.check:
+        print(f"{args.malloc_c}: all patches apply")
+    else:
+        args.malloc_c.write_text(text)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -11,33 +11,31 @@
 #include <stddef.h>   // size_t, ptrdiff_t
 #include <unistd.h>   // write
 #include "trace.h"
-#include <stdatomic.h>
 #include <stdint.h>
-
-extern  void __ptmalloc_init(void);
-
-static atomic_int g_malloc_inited = 0;
-static atomic_int g_malloc_init_in_progress = 0;
-
-static inline void ensure_ptmalloc_init(void)
+#include <stdio.h>    // FILE
+#include <string.h>   // memset
+#include <errno.h>    // ENOMEM
+#include <malloc.h>   // struct mallinfo
+
+extern  void __ptmalloc_init(void) __attribute__((weak));
+
+/*
+ * Initialize malloc once, when the library is loaded, instead of checking
+ * it on every call of the wrappers (the hottest path in the process).
+ * Calls that arrive before the constructor runs (e.g., from the loader or
+ * from the constructors of libraries that are initialized earlier) are
+ * still safe, because glibc malloc initializes itself lazily on its
+ * allocating entry points (__libc_malloc, __libc_calloc, ...) and free does
+ * not need the initialization.
+ * The constructor priority runs it before the Mosalloc hooks constructor.
+ */
+__attribute__((constructor(101)))
+static void init_ptmalloc(void)
 {
-    if (atomic_load_explicit(&g_malloc_inited, memory_order_acquire))
-        return;
-
-    // startup is effectively single-threaded, but be safe:
-    int was = atomic_exchange_explicit(&g_malloc_init_in_progress, 1, memory_order_acq_rel);
-    if (was == 0) {
-        if (__ptmalloc_init)
-            __ptmalloc_init();
-        atomic_store_explicit(&g_malloc_inited, 1, memory_order_release);
-    } else {
-        while (!atomic_load_explicit(&g_malloc_inited, memory_order_acquire)) {
-            __asm__ __volatile__("pause");
-        }
-    }
+    if (__ptmalloc_init)
+        __ptmalloc_init();
 }
 
-
 /* ------------------------------------------------------------ */
 /* Internal allocator entry points from glibc malloc.c          */
 /* ------------------------------------------------------------ */
@@ -49,8 +47,18 @@ void *__libc_realloc (void *, size_t);
 void *__libc_memalign (size_t, size_t);
 int __libc_mallopt (int, int);
 
+void *__libc_valloc (size_t);
+void *__libc_pvalloc (size_t);
+int __posix_memalign (void **, size_t, size_t);
+size_t __malloc_usable_size (void *);
+int __malloc_trim (size_t);
+void __malloc_stats (void);
+int __malloc_info (int, FILE *);
+
 /* May or may not exist depending on glibc version */
 void *__libc_aligned_alloc (size_t, size_t) __attribute__((weak));
+struct mallinfo __libc_mallinfo (void) __attribute__((weak));
+struct mallinfo2 __libc_mallinfo2 (void) __attribute__((weak));
 
 /* ------------------------------------------------------------ */
 /* Public malloc-family symbols (LD_PRELOAD interposition)      */
@@ -59,7 +67,6 @@ void *__libc_aligned_alloc (size_t, size_t) __attribute__((weak));
 void *
 malloc (size_t n)
 {
-    ensure_ptmalloc_init();
     trace_msg("[mf] wrapper: malloc\n");
     return __libc_malloc (n);
 }
@@ -67,7 +74,6 @@ malloc (size_t n)
 void
 free (void *p)
 {
-    ensure_ptmalloc_init();
     trace_msg("[mf] wrapper: free\n");
     __libc_free (p);
 }
@@ -75,7 +81,6 @@ free (void *p)
 void *
 calloc (size_t n, size_t s)
 {
-    ensure_ptmalloc_init();
     trace_msg("[mf] wrapper: calloc\n");
     return __libc_calloc (n, s);
 }
@@ -83,7 +88,6 @@ calloc (size_t n, size_t s)
 void *
 realloc (void *p, size_t n)
 {
-    ensure_ptmalloc_init();
     trace_msg("[mf] wrapper: realloc\n");
     return __libc_realloc (p, n);
 }
@@ -92,7 +96,6 @@ __attribute__((visibility("default")))
 int
 mallopt (int param, int value)
 {
-    ensure_ptmalloc_init();
     trace_msg("[mf] wrapper: mallopt\n");
     return __libc_mallopt (param, value);
 }
@@ -113,13 +116,117 @@ aligned_alloc (size_t alignment, size_t size)
 }
 
 /* ------------------------------------------------------------ */
-/* GNU extension (optional)                                     */
+/* POSIX / obsolete aligned allocations                         */
 /* ------------------------------------------------------------ */
-#ifdef MALLOC_FORK_EXPORT_GNU_MEMALIGN
+
+int
+posix_memalign (void **memptr, size_t alignment, size_t size)
+{
+    trace_msg("[mf] wrapper: posix_memalign\n");
+    return __posix_memalign (memptr, alignment, size);
+}
+
 void *
 memalign (size_t alignment, size_t size)
 {
     trace_msg("[mf] wrapper: memalign\n");
     return __libc_memalign (alignment, size);
 }
-#endif
\ No newline at end of file
+
+void *
+valloc (size_t size)
+{
+    trace_msg("[mf] wrapper: valloc\n");
+    return __libc_valloc (size);
+}
+
+void *
+pvalloc (size_t size)
+{
+    trace_msg("[mf] wrapper: pvalloc\n");
+    return __libc_pvalloc (size);
+}
+
+/* ------------------------------------------------------------ */
+/* reallocarray (defined outside malloc.c in glibc)             */
+/* ------------------------------------------------------------ */
+
+void *
+reallocarray (void *p, size_t n, size_t s)
+{
+    trace_msg("[mf] wrapper: reallocarray\n");
+    size_t bytes;
+    if (__builtin_mul_overflow (n, s, &bytes)) {
+        __set_errno (ENOMEM);
+        return NULL;
+    }
+    return __libc_realloc (p, bytes);
+}
+
+/* ------------------------------------------------------------ */
+/* GNU extensions (introspection and tuning)                    */
+/* ------------------------------------------------------------ */
+
+size_t
+malloc_usable_size (void *p)
+{
+    trace_msg("[mf] wrapper: malloc_usable_size\n");
+    return __malloc_usable_size (p);
+}
+
+int
+malloc_trim (size_t pad)
+{
+    trace_msg("[mf] wrapper: malloc_trim\n");
+    return __malloc_trim (pad);
+}
+
+void
+malloc_stats (void)
+{
+    trace_msg("[mf] wrapper: malloc_stats\n");
+    __malloc_stats ();
+}
+
+int
+malloc_info (int options, FILE *fp)
+{
+    trace_msg("[mf] wrapper: malloc_info\n");
+    return __malloc_info (options, fp);
+}
+
+struct mallinfo2
+mallinfo2 (void)
+{
+    trace_msg("[mf] wrapper: mallinfo2\n");
+    if (__libc_mallinfo2)
+        return __libc_mallinfo2 ();
+
+    /* Older glibc snapshots do not collect the statistics */
+    struct mallinfo2 m;
+    memset (&m, 0, sizeof (m));
+    return m;
+}
+
+struct mallinfo
+mallinfo (void)
+{
+    trace_msg("[mf] wrapper: mallinfo\n");
+    if (__libc_mallinfo)
+        return __libc_mallinfo ();
+
+    /* Snapshots without it: derive it from mallinfo2 (truncating) */
+    struct mallinfo2 m2 = mallinfo2 ();
+    struct mallinfo m;
+    m.arena = (int) m2.arena;
+    m.ordblks = (int) m2.ordblks;
+    m.smblks = (int) m2.smblks;
+    m.hblks = (int) m2.hblks;
+    m.hblkhd = (int) m2.hblkhd;
+    m.usmblks = (int) m2.usmblks;
+    m.fsmblks = (int) m2.fsmblks;
+    m.uordblks = (int) m2.uordblks;
+    m.fordblks = (int) m2.fordblks;
+    m.keepcost = (int) m2.keepcost;
+    return m;
+}
@@ -8,9 +8,13 @@
 #include <string.h>
 #include <fcntl.h>
 #include <assert.h>
+#include <pthread.h>
+#include <limits.h>
+#include <algorithm>
 
 #include "hooks.h"
 #include "MemoryAllocator.h"
+#include "mosalloc_arena.h"
 
 // Forward declarations for malloc.c symbols
 extern "C" {
@@ -29,6 +33,15 @@ extern "C" {
     #ifndef M_ARENA_MAX
     #define M_ARENA_MAX -8
     #endif
+    // malloc arenas fork handlers (defined in arena.c); glibc fork calls
+    // its own malloc handlers, so ours have to be registered explicitly
+    extern void __malloc_fork_lock_parent(void);
+    extern void __malloc_fork_unlock_parent(void);
+    extern void __malloc_fork_unlock_child(void);
+    // retires the system heap from the main arena (see mosalloc_heap.h)
+    extern size_t __malloc_retire_heap(void);
+    extern void *__libc_malloc(size_t bytes);
+    extern void __libc_free(void *mem);
 }
 
 static void constructor() __attribute__((constructor));
@@ -37,32 +50,40 @@ static void setup_morecore();
 
 MemoryAllocator hpbrs_allocator;
 void* sys_heap_top = nullptr;
-void* brk_top = nullptr;
 bool is_library_initialized = false;
-std::mutex g_hook_sbrk_mutex;
-std::mutex g_hook_brk_mutex;
 std::mutex g_hook_mmap_mutex;
-volatile  bool alloc_request_intercepted = false;
 bool is_inside_malloc_api = false;
 
-// Verify that mosalloc_morecore is being called by our malloc
-// Keep allocating until morecore is triggered
-static void consume_glibc_free_slots() {
-    size_t chunk_size = 16;
-    while(true) {
-        alloc_request_intercepted = false;
-        GlibcAllocationFunctions local_glibc_funcs;
-        void* ptr = local_glibc_funcs.CallGlibcMalloc(chunk_size);
-        if (!ptr) {
-            break;
-        }
-        if (alloc_request_intercepted == true) {
-            free(ptr);
-            break;
+/*
+ * The memory that malloc got before Mosalloc was activated (the system
+ * heap) must not serve allocations, as it is not backed by the pools.
+ * The free chunks and the top chunk of the main arena are retired by malloc
+ * itself (see mosalloc_heap.h), and the tcache of the activating thread is
+ * drained by requesting each of its sizes until a request is served by the
+ * brk pool (which is freed back).
+ * Returns the number of retired bytes.
+ */
+#define TCACHE_MAX_REQUEST_SIZE (1032)
+#define TCACHE_REQUEST_SIZE_STEP (16)
+
+static size_t consume_glibc_free_slots() {
+    size_t consumed = __malloc_retire_heap();
+    for (size_t size = TCACHE_MAX_REQUEST_SIZE; size >= TCACHE_REQUEST_SIZE_STEP;
+         size -= TCACHE_REQUEST_SIZE_STEP) {
+        while (true) {
+            void* ptr = __libc_malloc(size);
+            if (ptr == nullptr) {
+                break;
+            }
+            if (hpbrs_allocator.IsAddressInHugePageRegions(ptr)) {
+                __libc_free(ptr);
+                break;
+            }
+            // a leftover tcache slot: keep it allocated so it is not reused
+            consumed += size;
         }
-        // Don't free - we want to exhaust pre-existing memory to force morecore call
-        chunk_size *= 2;  // Double size to speed up exhaustion
     }
+    return consumed;
 }
 
 static void setup_morecore() {
@@ -76,14 +97,52 @@ static void setup_morecore() {
     mallopt(M_MMAP_MAX, 0);
     mallopt(M_TRIM_THRESHOLD, -1);
     mallopt(M_TOP_PAD, 0);
-    mallopt(M_ARENA_MAX, 1);
-    
+    // the heaps of the arenas are served by the arena pool (see
+    // mosalloc_arena.h), so there is an arena for each heap that fits in
+    // the pool (and the main arena, which uses the brk pool); the arenas
+    // are reused once the pool is full, rather than failing to create one
+    size_t heaps = hpbrs_allocator.GetArenaHeapsLimit(MOSALLOC_HEAP_MAX_SIZE);
+    mallopt(M_ARENA_MAX, (int)std::min(heaps + 1, (size_t)INT_MAX));
+
     __morecore = mosalloc_morecore;
 }
 
+/*
+ * The fork handlers hold all the malloc, hooks and pools locks while fork is
+ * running, so the child (which has only the forking thread) will not inherit
+ * a lock that is held by another thread. The locks are taken in the same
+ * order as they are nested (malloc calls morecore, which takes the hook
+ * lock and then the pool lock).
+ */
+static void prepare_fork() {
+    __malloc_fork_lock_parent();
+    g_hook_mmap_mutex.lock();
+    hpbrs_allocator.LockPools();
+}
+
+static void unlock_hooks_after_fork() {
+    hpbrs_allocator.UnlockPools();
+    g_hook_mmap_mutex.unlock();
+}
+
+static void parent_after_fork() {
+    unlock_hooks_after_fork();
+    __malloc_fork_unlock_parent();
+}
+
+static void child_after_fork() {
+    unlock_hooks_after_fork();
+    hpbrs_allocator.ResetAfterFork();
+    __malloc_fork_unlock_child();
+}
+
 static void activate_mosalloc() {
+    auto start = std::chrono::steady_clock::now();
     setup_morecore();
-    consume_glibc_free_slots();
+    size_t consumed = consume_glibc_free_slots();
+    hpbrs_allocator.RecordStartup(std::chrono::steady_clock::now() - start,
+                                  consumed);
+    pthread_atfork(prepare_fork, parent_after_fork, child_after_fork);
     is_library_initialized = true;
 }
 
@@ -107,7 +166,10 @@ static void destructor() {
 int mprotect(void *addr, size_t len, int prot) __THROW_EXCEPTION {
     if (is_library_initialized == true && hpbrs_allocator.IsInitialized() == true &&
         hpbrs_allocator.IsAddressInHugePageRegions(addr) == true) {
-        return 0;
+        int res = hpbrs_allocator.ProtectMemory(addr, len, prot);
+        mosalloc_error_log.Record(ErrorLog::Operation::MPROTECT, addr, len,
+                                  (res == 0) ? 0 : errno);
+        return res;
     }
     GlibcAllocationFunctions local_glibc_funcs;
     return local_glibc_funcs.CallGlibcMprotect(addr, len, prot);
@@ -122,10 +184,60 @@ void *mmap(void *addr, size_t length, int prot, int flags, int fd,
     
     MUTEX_GUARD(g_hook_mmap_mutex);
 
+    // dispatch the request by the routes of the configuration file, but
+    // keep fixed mappings over pools memory in the pools (so they will be
+    // unmapped by the pools)
+    int pool = 0;
+    RoutingTable::RouteTarget target =
+        hpbrs_allocator.RouteMmapRequest(length, prot, flags, fd, pool);
+    bool is_fixed_in_pools = (flags & (MAP_FIXED | MAP_FIXED_NOREPLACE)) &&
+        hpbrs_allocator.IsAddressInHugePageRegions(addr);
+    if (target == RoutingTable::RouteTarget::PASSTHROUGH && !is_fixed_in_pools) {
+        GlibcAllocationFunctions local_glibc_funcs;
+        return local_glibc_funcs.CallGlibcMmap(addr, length, prot, flags, fd, offset);
+    }
+    if (pool < 0) {
+        pool = 0;
+    }
+
+    void *res = MAP_FAILED;
     if (fd >= 0) {
-        return hpbrs_allocator.AllocateFromFileMmapRegion(addr, length, prot, flags, fd, offset);
+        res = hpbrs_allocator.AllocateFromFileMmapRegion(addr, length, prot, flags, fd, offset);
+        mosalloc_error_log.Record(ErrorLog::Operation::MMAP, res, length,
+                                  (res == MAP_FAILED) ? errno : 0);
+        return res;
+    }
+
+    // MAP_NORESERVE mappings ask for address space that is committed lazily
+    // by the kernel, and MAP_FIXED mappings outside of the pools are placed
+    // by the caller, so both are served by the kernel.
+    // PROT_NONE reservations are served from the pools (and committed when
+    // they become accessible).
+    if (((flags & MAP_NORESERVE) && prot != PROT_NONE) ||
+        ((flags & (MAP_FIXED | MAP_FIXED_NOREPLACE)) &&
+         !hpbrs_allocator.IsAddressInHugePageRegions(addr))) {
+        GlibcAllocationFunctions local_glibc_funcs;
+        return local_glibc_funcs.CallGlibcMmap(addr, length, prot, flags, fd, offset);
     }
-    return hpbrs_allocator.AllocateFromAnonymousMmapRegion(length);
+    res = hpbrs_allocator.AllocateFromAnonymousMmapRegion(addr, length, prot, flags, pool);
+    mosalloc_error_log.Record(ErrorLog::Operation::MMAP, res, length,
+                              (res == MAP_FAILED) ? errno : 0);
+    return res;
+}
+
+void *mosalloc_mmap_pool(const char *pool, size_t length,
+                         int prot) __THROW_EXCEPTION {
+    if (is_library_initialized == false || hpbrs_allocator.IsInitialized() == false) {
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+
+    MUTEX_GUARD(g_hook_mmap_mutex);
+
+    void *res = hpbrs_allocator.AllocateFromNamedPool(pool, length, prot);
+    mosalloc_error_log.Record(ErrorLog::Operation::MMAP, res, length,
+                              (res == MAP_FAILED) ? errno : 0);
+    return res;
 }
 
 int munmap(void *addr, size_t length) __THROW_EXCEPTION {
@@ -134,9 +246,17 @@ int munmap(void *addr, size_t length) __THROW_EXCEPTION {
         return local_glibc_funcs.CallGlibcMunmap(addr, length);
     }
 
+    // mappings that were served by the kernel are unmapped by the kernel
+    if (hpbrs_allocator.IsAddressInHugePageRegions(addr) == false) {
+        GlibcAllocationFunctions local_glibc_funcs;
+        return local_glibc_funcs.CallGlibcMunmap(addr, length);
+    }
+
     MUTEX_GUARD(g_hook_mmap_mutex);
 
     int res = hpbrs_allocator.DeallocateFromMmapRegion(addr, length);
+    mosalloc_error_log.Record(ErrorLog::Operation::MUNMAP, addr, length,
+                              (res == 0) ? 0 : errno);
     return res;
 }
 
@@ -145,16 +265,51 @@ int brk(void *addr) __THROW_EXCEPTION {
         GlibcAllocationFunctions local_glibc_funcs;
         return local_glibc_funcs.CallGlibcBrk(addr);
     }
-    
-    MUTEX_GUARD(g_hook_brk_mutex);
 
-    return hpbrs_allocator.ChangeProgramBreak(addr);
+    int res = hpbrs_allocator.ChangeProgramBreak(addr);
+    mosalloc_error_log.Record(ErrorLog::Operation::BRK, addr, 0,
+                              (res == 0) ? 0 : errno);
+    return res;
+}
+
+void *mosalloc_arena_mmap(void *addr, size_t length, int prot, int flags,
+                          int fd, off_t offset) {
+    // fixed mappings outside of the pools (e.g., shrinking a heap that was
+    // created before the library was initialized) are served by the kernel
+    if (is_library_initialized == false || hpbrs_allocator.IsInitialized() == false ||
+        ((flags & (MAP_FIXED | MAP_FIXED_NOREPLACE)) &&
+         !hpbrs_allocator.IsAddressInHugePageRegions(addr))) {
+        GlibcAllocationFunctions local_glibc_funcs;
+        return local_glibc_funcs.CallGlibcMmap(addr, length, prot, flags, fd, offset);
+    }
+
+    MUTEX_GUARD(g_hook_mmap_mutex);
+
+    return hpbrs_allocator.AllocateFromArenaPool(addr, length, prot, flags);
+}
+
+int mosalloc_arena_munmap(void *addr, size_t length) {
+    return munmap(addr, length);
+}
+
+int mosalloc_arena_mprotect(void *addr, size_t length, int prot) {
+    return mprotect(addr, length, prot);
 }
 
 void *mosalloc_morecore(intptr_t increment) __THROW_EXCEPTION {
-    alloc_request_intercepted = true;
-    void* ptr = sbrk(increment);
-    return ptr;
+    if (hpbrs_allocator.IsInitialized() == false) {
+        GlibcAllocationFunctions local_glibc_funcs;
+        void* ptr = local_glibc_funcs.CallGlibcSbrk(increment);
+        // MORECORE_FAILURE is NULL (rather than the (void*)-1 of sbrk)
+        return (ptr == (void*)-1) ? nullptr : ptr;
+    }
+
+    // the heap growth fast path: it takes only the brk pool lock (rather
+    // than going through the sbrk and brk hooks)
+    void* prev_brk = hpbrs_allocator.Morecore(increment);
+    mosalloc_error_log.Record(ErrorLog::Operation::SBRK, prev_brk, increment,
+                              (prev_brk == nullptr) ? errno : 0);
+    return prev_brk;
 }
 
 void *sbrk(intptr_t increment) __THROW_EXCEPTION {
@@ -163,28 +318,17 @@ void *sbrk(intptr_t increment) __THROW_EXCEPTION {
         return local_glibc_funcs.CallGlibcSbrk(increment);
     }
     
-    MUTEX_GUARD(g_hook_sbrk_mutex);
-
-    // if this the first call to sbrk after pools were initialized
-    // then initialize brk_top to be the brk pool base address
-    if (brk_top == nullptr) {
-        brk_top = hpbrs_allocator.GetBrkRegionBase();
-    }
-
     /*
      * On success, sbrk() returns the previous program break.  (If the break 
      * was increased, then this value is a pointer to the start of the newly 
      * allocated memory).  On error, (void *) -1 is returned, and errno is 
      * set to ENOMEM.
     */
-    
-    void* prev_brk = brk_top;
-    void* new_brk = (void*) ((intptr_t)brk_top + increment);
-
-    if (brk(new_brk) < 0) {
+    void* prev_brk = hpbrs_allocator.Morecore(increment);
+    mosalloc_error_log.Record(ErrorLog::Operation::SBRK, prev_brk, increment,
+                              (prev_brk == nullptr) ? errno : 0);
+    if (prev_brk == nullptr) {
         return ((void*)-1);
     }
-
-    brk_top = new_brk;
     return prev_brk;
 }
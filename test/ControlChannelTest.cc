@@ -0,0 +1,37 @@
+#include <errno.h>
+#include <string.h>
+
+#include "gtest/gtest.h"
+#include "ControlChannel.h"
+
+TEST(ControlChannelTest, CommandsAreParsed) {
+    const char *text = "# remap the first 1GB of the heap to 2MB pages\n"
+                       "brk 0 1GB 2MB\n"
+                       "\n"
+                       "  large   4194304 8MB 4KB\n";
+    ControlChannel::Command commands[MAX_CONTROL_COMMANDS];
+    int count = ControlChannel::ParseCommands(text, strlen(text), commands,
+                                              MAX_CONTROL_COMMANDS);
+    ASSERT_EQ(count, 2);
+    EXPECT_STREQ(commands[0]._pool, "brk");
+    EXPECT_EQ(commands[0]._start_offset, 0);
+    EXPECT_EQ(commands[0]._end_offset, 1l << 30);
+    EXPECT_EQ(commands[0]._page_size, PageSize::HUGE_2MB);
+    EXPECT_STREQ(commands[1]._pool, "large");
+    EXPECT_EQ(commands[1]._start_offset, 4l << 20);
+    EXPECT_EQ(commands[1]._end_offset, 8l << 20);
+    EXPECT_EQ(commands[1]._page_size, PageSize::BASE_4KB);
+}
+
+TEST(ControlChannelTest, InvalidCommandsAreRejected) {
+    ControlChannel::Command commands[1];
+    const char *missing = "brk 0 1GB\n";
+    EXPECT_EQ(ControlChannel::ParseCommands(missing, strlen(missing),
+                                            commands, 1), -EINVAL);
+    const char *extra = "brk 0 1GB 2MB 4KB\n";
+    EXPECT_EQ(ControlChannel::ParseCommands(extra, strlen(extra),
+                                            commands, 1), -EINVAL);
+    const char *too_many = "brk 0 2MB 2MB\nbrk 2MB 4MB 2MB\n";
+    EXPECT_EQ(ControlChannel::ParseCommands(too_many, strlen(too_many),
+                                            commands, 1), -EINVAL);
+}
@@ -0,0 +1,100 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "gtest/gtest.h"
+#include "ErrorLog.h"
+
+class ErrorLogTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        char path[] = "/tmp/mosalloc-crash-log-XXXXXX";
+        int fd = mkstemp(path);
+        ASSERT_GE(fd, 0);
+        close(fd);
+        _path = path;
+    }
+
+    void TearDown() override {
+        _log.Close();
+        unlink(_path.c_str());
+    }
+
+    ErrorLog _log;
+    std::string _path;
+};
+
+TEST_F(ErrorLogTest, RecordsAreIgnoredWhenClosed) {
+    EXPECT_FALSE(_log.IsOpen());
+    _log.Record(ErrorLog::Operation::MMAP, nullptr, 4096, 0);
+    EXPECT_EQ(_log.GetEntry(0), nullptr);
+}
+
+TEST_F(ErrorLogTest, KeepsTheLastOperations) {
+    const size_t capacity = 4;
+    ASSERT_EQ(_log.Open(_path.c_str(), capacity), 0);
+    EXPECT_TRUE(_log.IsOpen());
+
+    for (size_t i = 1; i <= 6; i++) {
+        _log.Record(ErrorLog::Operation::MMAP, (void*)(i * 4096), i, 0);
+    }
+    _log.Record(ErrorLog::Operation::MUNMAP, (void*)4096, 1, EINVAL);
+
+    const ErrorLog::CrashLogEntry *last = _log.GetEntry(0);
+    ASSERT_NE(last, nullptr);
+    EXPECT_EQ(last->_sequence.load(), 7u);
+    EXPECT_EQ(last->_operation, ErrorLog::Operation::MUNMAP);
+    EXPECT_EQ(last->_result, EINVAL);
+
+    // the older operations were overwritten
+    for (size_t i = 1; i < capacity; i++) {
+        const ErrorLog::CrashLogEntry *entry = _log.GetEntry(i);
+        ASSERT_NE(entry, nullptr);
+        EXPECT_EQ(entry->_operation, ErrorLog::Operation::MMAP);
+        EXPECT_EQ(entry->_length, 6 - (i - 1));
+    }
+    EXPECT_EQ(_log.GetEntry(capacity), nullptr);
+}
+
+TEST_F(ErrorLogTest, LogIsKeptInTheFile) {
+    ASSERT_EQ(_log.Open(_path.c_str(), 16), 0);
+    _log.Record(ErrorLog::Operation::BRK, (void*)0x1000, 0, ENOMEM);
+    _log.Close();
+
+    int fd = open(_path.c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0);
+    ErrorLog::CrashLogHeader header;
+    ErrorLog::CrashLogEntry entry;
+    ASSERT_EQ(read(fd, &header, sizeof(header)), (ssize_t)sizeof(header));
+    ASSERT_EQ(read(fd, &entry, sizeof(entry)), (ssize_t)sizeof(entry));
+    close(fd);
+
+    EXPECT_EQ(memcmp(header._magic, CRASH_LOG_MAGIC, sizeof(header._magic)), 0);
+    EXPECT_EQ(header._capacity, 16u);
+    EXPECT_EQ(header._next_sequence.load(), 1u);
+    EXPECT_EQ(entry._sequence.load(), 1u);
+    EXPECT_EQ(entry._operation, ErrorLog::Operation::BRK);
+    EXPECT_EQ(entry._address, 0x1000u);
+    EXPECT_EQ(entry._result, ENOMEM);
+}
+
+TEST_F(ErrorLogTest, ReportReturnsWhenNotFailFast) {
+    ASSERT_EQ(_log.Open(_path.c_str(), 16), 0);
+    EXPECT_TRUE(_log.IsFailFast());
+    _log.SetFailFast(false);
+
+    errno = ENOMEM;
+    _log.Report(MosallocError::POOL_OUT_OF_MEMORY, __FUNCTION__, "test");
+    EXPECT_EQ(errno, ENOMEM);
+
+    const ErrorLog::CrashLogEntry *entry = _log.GetEntry(0);
+    ASSERT_NE(entry, nullptr);
+    EXPECT_EQ(entry->_operation, ErrorLog::Operation::ERROR);
+    EXPECT_EQ(entry->_result, (int32_t)MosallocError::POOL_OUT_OF_MEMORY);
+}
+
+TEST_F(ErrorLogTest, ReportExitsWhenFailFast) {
+    EXPECT_EXIT(_log.Report(MosallocError::MMAP_FAILED, __FUNCTION__, "test"),
+                ::testing::ExitedWithCode(1), "mmap failed");
+}
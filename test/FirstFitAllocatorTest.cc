@@ -382,3 +382,134 @@ TEST(FirstFitAllocatorTest, AllocateFreeTopHalfAllocateAllMemory) {
 		EXPECT_EQ(ffa.GetFreeSpace(), (total_space - total_alloc));
 	}
 }
+
+TEST(FirstFitAllocatorTest, AllocateAtFixedAddresses) {
+	FirstFitAllocator ffa(true, false);
+	void *const start = (void *) (1ul << 30); // 1GB
+	void *const end = (void *) (2ul << 30); // 2GB
+	const unsigned int len = 256;
+	size_t total_space = (size_t) (PTR_SUB(end, start));
+	size_t region_size = total_space / len;
+
+	ffa.Initialize(len, start, end);
+
+	// allocate from the middle, the start and the end of the free region
+	void *middle = PTR_ADD(start, 10 * region_size);
+	EXPECT_EQ(ffa.AllocateAt(middle, region_size), middle);
+	EXPECT_EQ(ffa.AllocateAt(start, region_size), start);
+	void *last = PTR_SUB(end, region_size);
+	EXPECT_EQ(ffa.AllocateAt(last, region_size), last);
+	EXPECT_EQ(ffa.GetFreeSpace(), total_space - 3 * region_size);
+
+	// overlapping ranges cannot be allocated
+	EXPECT_EQ(ffa.AllocateAt(PTR_ADD(middle, region_size / 2), region_size), nullptr);
+	EXPECT_EQ(ffa.AllocateAt(PTR_SUB(middle, region_size / 2), region_size), nullptr);
+
+	// first fit still finds the free hole after start
+	EXPECT_EQ(ffa.Allocate(region_size), PTR_ADD(start, region_size));
+
+	// the hole between the allocations is exactly reused
+	EXPECT_EQ(ffa.Free(middle, region_size), 0);
+	EXPECT_EQ(ffa.AllocateAt(middle, region_size), middle);
+	EXPECT_EQ(ffa.GetFreeSpace(), total_space - 4 * region_size);
+}
+
+TEST(FirstFitAllocatorTest, AllocateFromTop) {
+	FirstFitAllocator ffa(true, false);
+	void *const start = (void *) (1ul << 30); // 1GB
+	void *const end = (void *) (2ul << 30); // 2GB
+	const unsigned int len = 256;
+	size_t total_space = (size_t) (PTR_SUB(end, start));
+	size_t region_size = total_space / len;
+
+	ffa.Initialize(len, start, end);
+
+	EXPECT_EQ(ffa.Allocate(region_size), start);
+	EXPECT_EQ(ffa.AllocateFromTop(region_size), PTR_SUB(end, region_size));
+	EXPECT_EQ(ffa.AllocateFromTop(region_size), PTR_SUB(end, 2 * region_size));
+	EXPECT_EQ(ffa.Allocate(region_size), PTR_ADD(start, region_size));
+	EXPECT_EQ(ffa.GetTopAddress(), end);
+
+	EXPECT_EQ(ffa.Free(PTR_SUB(end, 2 * region_size), 2 * region_size), -2);
+	EXPECT_EQ(ffa.Free(PTR_SUB(end, region_size), region_size), 0);
+	EXPECT_EQ(ffa.Free(PTR_SUB(end, 2 * region_size), region_size), 0);
+	EXPECT_EQ(ffa.GetTopAddress(), PTR_ADD(start, 2 * region_size));
+	EXPECT_EQ(ffa.GetFreeSpace(), total_space - 2 * region_size);
+}
+
+TEST(FirstFitAllocatorTest, AllocateAligned) {
+	FirstFitAllocator ffa(true, false);
+	void *const start = (void *) (1ul << 30); // 1GB
+	void *const end = (void *) (2ul << 30); // 2GB
+	const unsigned int len = 256;
+	const size_t alignment = 2ul << 20; // 2MB
+	const size_t page_size = 4096;
+	size_t total_space = (size_t) (PTR_SUB(end, start));
+
+	ffa.Initialize(len, start, end);
+
+	EXPECT_EQ(ffa.Allocate(page_size), start);
+	// the first aligned address above the allocated page
+	EXPECT_EQ(ffa.AllocateAligned(alignment, alignment), PTR_ADD(start, alignment));
+	// aligned with a skew, in the gap below the previous allocation
+	EXPECT_EQ(ffa.AllocateAligned(page_size, alignment, 3 * page_size),
+		  PTR_ADD(start, 3 * page_size));
+	EXPECT_EQ(ffa.AllocateAligned(alignment, alignment, page_size),
+		  PTR_ADD(start, 2 * alignment + page_size));
+	// the skew is taken modulo the alignment
+	EXPECT_EQ(ffa.AllocateAligned(page_size, alignment, alignment + page_size),
+		  PTR_ADD(start, page_size));
+	EXPECT_EQ(ffa.AllocateAligned(total_space, alignment), (void*)NULL);
+	EXPECT_EQ(ffa.GetFreeSpace(),
+		  total_space - 2 * alignment - 3 * page_size);
+}
+
+TEST(FirstFitAllocatorTest, FreePartialRegions) {
+	FirstFitAllocator ffa(true, false);
+	void *const start = (void *) (1ul << 30); // 1GB
+	void *const end = (void *) (2ul << 30); // 2GB
+	const unsigned int len = 256;
+	size_t total_space = (size_t) (PTR_SUB(end, start));
+	size_t region_size = total_space / len;
+
+	ffa.Initialize(len, start, end);
+
+	void *region_start = ffa.Allocate(4 * region_size);
+	EXPECT_EQ(region_start, start);
+
+	// free the tail, the middle and the head of the region
+	EXPECT_EQ(ffa.Free(PTR_ADD(start, 3 * region_size), region_size), 0);
+	EXPECT_EQ(ffa.GetTopAddress(), PTR_ADD(start, 3 * region_size));
+	EXPECT_EQ(ffa.Free(PTR_ADD(start, region_size), region_size), 0);
+	EXPECT_EQ(ffa.Free(start, region_size), 0);
+	EXPECT_EQ(ffa.GetFreeSpace(), total_space - region_size);
+	EXPECT_EQ(ffa.Allocate(2 * region_size), start);
+
+	// free everything inside a range, allocated or not
+	EXPECT_EQ(ffa.FreeRange(start, 8 * region_size), 0);
+	EXPECT_EQ(ffa.GetFreeSpace(), total_space);
+	EXPECT_EQ(ffa.Allocate(total_space), start);
+}
+
+TEST(FirstFitAllocatorTest, FindFreeRegion) {
+	FirstFitAllocator ffa(true, false);
+	void *const start = (void *) (1ul << 30); // 1GB
+	void *const end = (void *) (2ul << 30); // 2GB
+	const unsigned int len = 256;
+	size_t total_space = (size_t) (PTR_SUB(end, start));
+	size_t region_size = total_space / len;
+
+	ffa.Initialize(len, start, end);
+	EXPECT_EQ(ffa.Allocate(3 * region_size), start);
+	EXPECT_EQ(ffa.Free(PTR_ADD(start, region_size), region_size), 0);
+
+	void *free_start = NULL, *free_end = NULL;
+	EXPECT_TRUE(ffa.FindFreeRegion(PTR_ADD(start, region_size + 1),
+				       &free_start, &free_end));
+	EXPECT_EQ(free_start, PTR_ADD(start, region_size));
+	EXPECT_EQ(free_end, PTR_ADD(start, 2 * region_size));
+	EXPECT_FALSE(ffa.FindFreeRegion(start, &free_start, &free_end));
+	EXPECT_TRUE(ffa.FindFreeRegion(PTR_ADD(start, 3 * region_size),
+				       &free_start, &free_end));
+	EXPECT_EQ(free_end, end);
+}
@@ -7,6 +7,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <sys/mman.h>
+#include <sys/prctl.h>
 #include <cstdlib>
 
 #include <string>
@@ -21,6 +22,7 @@
 
 #define GB (1073741824)
 #define MB (1048576)
+#define KB (1024)
 
 class HugePageBackedRegionTest : public ::testing::Test {
  public:
@@ -50,7 +52,7 @@ class HugePageBackedRegionTest : public ::testing::Test {
 
    void test_huge_page_backed_region(size_t size,
                                      MemoryIntervalList& configurationList) {
-       _hpbr.Initialize(size, configurationList, mmap, munmap);
+       _hpbr.Initialize(size, configurationList, mmap, munmap, mprotect);
        void *region_base = _hpbr.GetRegionBase();
        _hpbr.Resize(0);
        _hpbr.Resize(size);
@@ -372,7 +374,7 @@ TEST_F(HugePageBackedRegionTest, TestAllocateRegionOfPages_4KB_2MB_Unaligned) {
     configurationList.Initialize(mmap, munmap, 1);
     configurationList.AddInterval(start_2mb, end_2mb, PageSize::HUGE_2MB);
 
-    _hpbr.Initialize(size, configurationList, mmap, munmap);
+    _hpbr.Initialize(size, configurationList, mmap, munmap, mprotect);
     void *region_base = _hpbr.GetRegionBase();
 
     for (unsigned int i=0; i<=size; i += (MB)) {
@@ -394,7 +396,7 @@ TEST_F(HugePageBackedRegionTest, TestAllocateRegionOfPages_1GB_AndResize) {
     configurationList.Initialize(mmap, munmap, 1);
     configurationList.AddInterval(0, size, PageSize::HUGE_1GB);
 
-    _hpbr.Initialize(size, configurationList, mmap, munmap);
+    _hpbr.Initialize(size, configurationList, mmap, munmap, mprotect);
     void *region_base = _hpbr.GetRegionBase();
     _hpbr.Resize(0);
     _hpbr.Resize(size);
@@ -408,3 +410,213 @@ TEST_F(HugePageBackedRegionTest, TestAllocateRegionOfPages_1GB_AndResize) {
     }
     _hpbr.Resize(0);
 }
+
+// Returns the permissions string (e.g., "rw-p") of the mapping that contains
+// addr as reported by /proc/self/maps
+std::string GetMappingPermissions(void *addr) {
+    FILE *maps = fopen("/proc/self/maps", "r");
+    char line[512];
+    std::string permissions;
+    while (fgets(line, sizeof(line), maps) != NULL) {
+        unsigned long start, end;
+        char perms[5];
+        if (sscanf(line, "%lx-%lx %4s", &start, &end, perms) != 3) {
+            continue;
+        }
+        if ((unsigned long)addr >= start && (unsigned long)addr < end) {
+            permissions = perms;
+            break;
+        }
+    }
+    fclose(maps);
+    return permissions;
+}
+
+// Returns the name (e.g., "[anon:mosalloc:mmap:4KB]") of the mapping that
+// contains addr as reported by /proc/self/maps
+std::string GetMappingName(void *addr) {
+    FILE *maps = fopen("/proc/self/maps", "r");
+    char line[512];
+    std::string name;
+    while (fgets(line, sizeof(line), maps) != NULL) {
+        unsigned long start, end;
+        int name_pos = 0;
+        if (sscanf(line, "%lx-%lx %*s %*s %*s %*s %n", &start, &end, &name_pos) != 2) {
+            continue;
+        }
+        if ((unsigned long)addr >= start && (unsigned long)addr < end) {
+            name = line + name_pos;
+            name.erase(name.find_last_not_of(" \n") + 1);
+            break;
+        }
+    }
+    fclose(maps);
+    return name;
+}
+
+// The following tests use base pages only, so they do not require
+// pre-allocated hugepages
+TEST(HugePageBackedRegionProtectionTest, ProtectIsRestoredAfterResize) {
+    size_t size = 16*MB;
+    MemoryIntervalList configurationList;
+    configurationList.Initialize(mmap, munmap, 0);
+
+    HugePageBackedRegion hpbr;
+    hpbr.Initialize(size, configurationList, mmap, munmap, mprotect);
+    char *region_base = (char*)hpbr.GetRegionBase();
+    char *protected_page = region_base + 8*MB;
+
+    ASSERT_EQ(hpbr.Protect(protected_page, 4*KB, PROT_READ), 0);
+    EXPECT_EQ(GetMappingPermissions(protected_page), "r--p");
+    EXPECT_EQ(GetMappingPermissions(protected_page + 4*KB), "rw-p");
+
+    // unmapping and remapping the region should keep the page protection
+    hpbr.Resize(0);
+    hpbr.Resize(size);
+    EXPECT_EQ(GetMappingPermissions(protected_page), "r--p");
+    EXPECT_EQ(GetMappingPermissions(protected_page - 4*KB), "rw-p");
+
+    ASSERT_EQ(hpbr.ResetProtection(protected_page, 4*KB), 0);
+    EXPECT_EQ(GetMappingPermissions(protected_page), "rw-p");
+    hpbr.Resize(0);
+}
+
+TEST(HugePageBackedRegionProtectionTest, ProtectBeyondRegionSize) {
+    size_t size = 16*MB;
+    MemoryIntervalList configurationList;
+    configurationList.Initialize(mmap, munmap, 0);
+
+    HugePageBackedRegion hpbr;
+    hpbr.Initialize(size, configurationList, mmap, munmap, mprotect);
+    char *region_base = (char*)hpbr.GetRegionBase();
+    hpbr.Resize(4*MB);
+
+    // the protection of memory that is not mapped yet is applied once the
+    // region is extended over it
+    ASSERT_EQ(hpbr.Protect(region_base + 2*MB, 4*MB, PROT_NONE), 0);
+    EXPECT_EQ(GetMappingPermissions(region_base + 2*MB), "---p");
+    hpbr.Resize(size);
+    EXPECT_EQ(GetMappingPermissions(region_base + 5*MB), "---p");
+    EXPECT_EQ(GetMappingPermissions(region_base + 6*MB), "rw-p");
+
+    EXPECT_EQ(hpbr.Protect(region_base + 1, 4*KB, PROT_READ), -EINVAL);
+    EXPECT_EQ(hpbr.Protect(region_base + size - 4*KB, 8*KB, PROT_READ), -ENOMEM);
+    hpbr.Resize(0);
+}
+
+TEST(HugePageBackedRegionProtectionTest, RegionIsNamed) {
+    // anonymous VMA names require Linux 5.17+ with CONFIG_ANON_VMA_NAME
+    void *probe = mmap(NULL, 4*KB, MMAP_PROTECTION, MMAP_FLAGS, -1, 0);
+    int supported = prctl(PR_SET_VMA, PR_SET_VMA_ANON_NAME, probe, 4*KB, "probe");
+    munmap(probe, 4*KB);
+    if (supported != 0) {
+        GTEST_SKIP() << "anonymous VMA names are not supported";
+    }
+
+    size_t size = 16*MB;
+    MemoryIntervalList configurationList;
+    configurationList.Initialize(mmap, munmap, 0);
+
+    HugePageBackedRegion hpbr;
+    hpbr.SetName("test");
+    hpbr.Initialize(size, configurationList, mmap, munmap, mprotect);
+    char *region_base = (char*)hpbr.GetRegionBase();
+    EXPECT_EQ(GetMappingName(region_base), "[anon:mosalloc:test:4KB]");
+    EXPECT_EQ(GetMappingName(region_base + size - 4*KB), "[anon:mosalloc:test:4KB]");
+
+    // the memory is named again when the region is extended
+    hpbr.Resize(0);
+    hpbr.Resize(size);
+    EXPECT_EQ(GetMappingName(region_base + 8*MB), "[anon:mosalloc:test:4KB]");
+    hpbr.Resize(0);
+}
+
+// backs the hugepages intervals by base pages, so the remapping logic could
+// be tested without pre-allocated hugepages
+static void* BasePagesMmap(void *addr, size_t length, int prot, int flags,
+                           int fd, off_t offset) {
+    flags &= ~(MAP_HUGETLB | MAP_HUGE_2MB | MAP_HUGE_1GB);
+    return mmap(addr, length, prot, flags, fd, offset);
+}
+
+TEST(HugePageBackedRegionProtectionTest, RemapIntervalKeepsData) {
+    size_t size = 16*MB;
+    MemoryIntervalList configurationList;
+    configurationList.Initialize(mmap, munmap, 1);
+    configurationList.AddInterval(4*MB, 8*MB, PageSize::HUGE_2MB);
+
+    HugePageBackedRegion hpbr;
+    hpbr.Initialize(size, configurationList, BasePagesMmap, munmap, mprotect);
+    char *region_base = (char*)hpbr.GetRegionBase();
+    hpbr.Resize(10*MB);
+    for (size_t offset = 0; offset < 10*MB; offset += 4*KB) {
+        region_base[offset] = (char)(offset / (4*KB));
+    }
+    ASSERT_EQ(hpbr.Protect(region_base + 2*MB, 4*KB, PROT_READ), 0);
+
+    // 2MB to 4KB, and 4KB to 2MB (partially mapped, up to 10MB)
+    ASSERT_EQ(hpbr.RemapInterval(4*MB, 6*MB, PageSize::BASE_4KB), 0);
+    ASSERT_EQ(hpbr.RemapInterval(0, 2*MB, PageSize::HUGE_2MB), 0);
+    ASSERT_EQ(hpbr.RemapInterval(8*MB, 12*MB, PageSize::HUGE_2MB), 0);
+    for (size_t offset = 0; offset < 10*MB; offset += 4*KB) {
+        ASSERT_EQ(region_base[offset], (char)(offset / (4*KB)));
+    }
+    // the parts of a 2MB page cannot have different protections
+    EXPECT_EQ(hpbr.RemapInterval(2*MB, 4*MB, PageSize::HUGE_2MB), -EINVAL);
+    EXPECT_EQ(GetMappingPermissions(region_base + 2*MB), "r--p");
+    EXPECT_EQ(GetMappingPermissions(region_base + 2*MB + 4*KB), "rw-p");
+    EXPECT_EQ(region_base[2*MB], (char)(2*MB / (4*KB)));
+
+    // a page cannot be split
+    EXPECT_EQ(hpbr.RemapInterval(4*MB, 5*MB, PageSize::HUGE_2MB), -EINVAL);
+    EXPECT_EQ(hpbr.RemapInterval(6*MB + 4*KB, 8*MB, PageSize::BASE_4KB), -EINVAL);
+    EXPECT_EQ(hpbr.RemapInterval(0, size + 2*MB, PageSize::BASE_4KB), -EINVAL);
+
+    // the unmapped part is mapped by the new page size when it is extended
+    hpbr.Resize(size);
+    EXPECT_EQ(region_base[11*MB], 0);
+    hpbr.Resize(0);
+}
+
+TEST(HugePageBackedRegionProtectionTest, HugePageIsNotSplit) {
+    size_t size = 8*MB;
+    MemoryIntervalList configurationList;
+    configurationList.Initialize(mmap, munmap, 1);
+    configurationList.AddInterval(2*MB, 6*MB, PageSize::HUGE_2MB);
+
+    HugePageBackedRegion hpbr;
+    hpbr.Initialize(size, configurationList, BasePagesMmap, munmap, mprotect);
+    char *region_base = (char*)hpbr.GetRegionBase();
+    char *huge_page = region_base + 2*MB;
+    hpbr.Resize(size);
+    EXPECT_EQ(hpbr.GetPageSize(huge_page + 4*KB), 2*MB);
+
+    // a 4KB guard page cannot be set inside a 2MB page
+    EXPECT_EQ(hpbr.Protect(huge_page + 8*KB, 4*KB, PROT_NONE), -EINVAL);
+    EXPECT_EQ(GetMappingPermissions(huge_page + 8*KB), "rw-p");
+    EXPECT_EQ(hpbr.Protect(region_base + 1*MB, 2*MB, PROT_NONE), -EINVAL);
+    EXPECT_EQ(GetMappingPermissions(region_base + 1*MB), "rw-p");
+
+    // a part of a page could get the protection of the rest of it
+    ASSERT_EQ(hpbr.Protect(huge_page, 2*MB, PROT_READ), 0);
+    EXPECT_EQ(GetMappingPermissions(huge_page + 1*MB), "r--p");
+    EXPECT_EQ(hpbr.Protect(huge_page + 4*KB, 4*KB, PROT_READ), 0);
+    EXPECT_EQ(hpbr.Protect(huge_page + 4*KB, 4*KB, PROT_READ | PROT_WRITE),
+              -EINVAL);
+    EXPECT_EQ(GetMappingPermissions(huge_page + 4*KB), "r--p");
+
+    // a released part of a page keeps the protection of the rest of it
+    ASSERT_EQ(hpbr.ResetProtection(huge_page, 4*KB), 0);
+    EXPECT_EQ(GetMappingPermissions(huge_page), "r--p");
+    ASSERT_EQ(hpbr.ResetProtection(huge_page, 2*MB), 0);
+    EXPECT_EQ(GetMappingPermissions(huge_page + 1*MB), "rw-p");
+
+    // the memory that a new mapping replaces is cleared, even if it is
+    // protected
+    huge_page[2*MB + 4*KB] = 1;
+    ASSERT_EQ(hpbr.Protect(huge_page + 2*MB, 2*MB, PROT_READ), 0);
+    ASSERT_EQ(hpbr.Clear(huge_page + 2*MB + 4*KB, 4*KB), 0);
+    EXPECT_EQ(GetMappingPermissions(huge_page + 2*MB + 4*KB), "r--p");
+    EXPECT_EQ(huge_page[2*MB + 4*KB], 0);
+    hpbr.Resize(0);
+}
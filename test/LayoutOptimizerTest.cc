@@ -0,0 +1,136 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <fstream>
+#include <string>
+
+#include "gtest/gtest.h"
+
+// the layout optimizer is an offline tool, which is not a part of malloc_auto
+#ifndef MALLOC_AUTO_TEST
+
+#include "LayoutOptimizer.h"
+#include "MemoryIntervalsValidator.h"
+#include "ParseCsv.h"
+
+#define MB (1l << 20)
+#define GB (1l << 30)
+
+TEST(LayoutOptimizerTest, ProfileRowsAreSpreadOverTheChunks) {
+    char path[] = "/tmp/mosalloc-profile-XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    std::ofstream profile(path);
+    profile << "pool,offset,weight\n"
+            << "brk,4MB\n"
+            << "brk,5MB\n"
+            << "brk,8MB,10\n"
+            << "mmap,1MB,4MB,8\n";
+    profile.close();
+
+    LayoutOptimizer optimizer;
+    int brk = optimizer.AddPool("brk", 16*MB);
+    int mmap_pool = optimizer.AddPool("mmap", 16*MB);
+    int error_line = 0;
+    ASSERT_EQ(optimizer.LoadProfile(path, error_line), 0);
+    EXPECT_EQ(optimizer.GetWeight(brk, 2), 2);
+    EXPECT_EQ(optimizer.GetWeight(brk, 4), 10);
+    EXPECT_EQ(optimizer.GetWeight(mmap_pool, 0), 2);
+    EXPECT_EQ(optimizer.GetWeight(mmap_pool, 1), 4);
+    EXPECT_EQ(optimizer.GetWeight(mmap_pool, 2), 2);
+
+    // rows of unknown pools or out of the pool are invalid
+    profile.open(path, std::ios::app);
+    profile << "file,0\n";
+    profile.close();
+    EXPECT_EQ(optimizer.LoadProfile(path, error_line), -EINVAL);
+    EXPECT_EQ(error_line, 6);
+    EXPECT_EQ(optimizer.AddWeight(brk, 12*MB, 8*MB, 1), -EINVAL);
+
+    // the fields are positional, so an empty field is invalid
+    const char *rows[] = {"brk,,8MB\n", "brk,4MB,\n", "brk,4MB,,10\n",
+                          ",4MB\n", "brk,4MB,1MB,10,\n"};
+    for (const char *row : rows) {
+        profile.open(path);
+        profile << "pool,offset,weight\n" << row;
+        profile.close();
+        EXPECT_EQ(optimizer.LoadProfile(path, error_line), -EINVAL) << row;
+        EXPECT_EQ(error_line, 2) << row;
+    }
+    unlink(path);
+}
+
+TEST(LayoutOptimizerTest, HeaviestChunksGet2MBPages) {
+    LayoutOptimizer optimizer;
+    int brk = optimizer.AddPool("brk", 64*MB);
+    int mmap_pool = optimizer.AddPool("mmap", 64*MB);
+    optimizer.AddWeight(brk, 0, 0, 5);
+    optimizer.AddWeight(brk, 6*MB, 0, 50);
+    optimizer.AddWeight(mmap_pool, 10*MB, 0, 20);
+    optimizer.AddWeight(mmap_pool, 12*MB, 0, 1);
+    optimizer.Optimize(2, 0);
+
+    MemoryIntervalList brk_intervals;
+    brk_intervals.Initialize(mmap, munmap, 1);
+    optimizer.ApplyPlan(brk, brk_intervals);
+    ASSERT_EQ(brk_intervals.GetLength(), 1u);
+    EXPECT_EQ(brk_intervals.At(0)._start_offset, 6*MB);
+    EXPECT_EQ(brk_intervals.At(0)._end_offset, 8*MB);
+    EXPECT_EQ(brk_intervals.At(0)._page_size, PageSize::HUGE_2MB);
+    MemoryIntervalList mmap_intervals;
+    mmap_intervals.Initialize(mmap, munmap, 1);
+    optimizer.ApplyPlan(mmap_pool, mmap_intervals);
+    ASSERT_EQ(mmap_intervals.GetLength(), 1u);
+    EXPECT_EQ(mmap_intervals.At(0)._start_offset, 10*MB);
+
+    EXPECT_EQ(optimizer.GetBaseCost(), 76 * DEFAULT_WALK_COST_4KB);
+    EXPECT_EQ(optimizer.GetCost(), 70 * DEFAULT_WALK_COST_2MB +
+                                   6 * DEFAULT_WALK_COST_4KB);
+}
+
+TEST(LayoutOptimizerTest, OneGBPagesAreAlignedToTheirPhase) {
+    LayoutOptimizer optimizer;
+    int pool = optimizer.AddPool("mmap", 4*GB);
+    // a dense 1GB range at 1.5GB, and a few heavy chunks after it
+    optimizer.AddWeight(pool, 1*GB + 512*MB, 1*GB, 512);
+    optimizer.AddWeight(pool, 3*GB, 0, 100);
+    optimizer.AddWeight(pool, 3*GB + 2*MB, 0, 90);
+    optimizer.AddWeight(pool, 3*GB + 4*MB, 0, 80);
+    optimizer.Optimize(2, 1);
+
+    MemoryIntervalList intervals;
+    intervals.Initialize(mmap, munmap, 2);
+    intervals.AddInterval(0, 1*GB, PageSize::HUGE_1GB);
+    optimizer.ApplyPlan(pool, intervals);
+    // the 2MB pages move to the heaviest chunks out of the 1GB page
+    ASSERT_EQ(intervals.GetLength(), 2u);
+    EXPECT_EQ(intervals.At(0)._start_offset, 1*GB + 512*MB);
+    EXPECT_EQ(intervals.At(0)._end_offset, 2*GB + 512*MB);
+    EXPECT_EQ(intervals.At(0)._page_size, PageSize::HUGE_1GB);
+    EXPECT_EQ(intervals.At(1)._start_offset, 3*GB);
+    EXPECT_EQ(intervals.At(1)._end_offset, 3*GB + 4*MB);
+    EXPECT_EQ(intervals.At(1)._page_size, PageSize::HUGE_2MB);
+    MemoryIntervalsValidator validator;
+    EXPECT_EQ(validator.Validate(intervals), ValidatorErrorMessage::SUCCESS);
+
+    // the 1GB intervals are written from their phase
+    char path[] = "/tmp/mosalloc-layout-XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    FILE *file = fdopen(fd, "w");
+    parseCsv::WriteHeader(file);
+    parseCsv::WritePoolRow(file, "mmap", 4*GB, intervals);
+    fclose(file);
+    RoutingTable routes;
+    ConfigurationLoader loader;
+    loader.Load(path, routes);
+    unlink(path);
+    MemoryIntervalList &loaded = loader.GetPool("mmap").intervalList;
+    ASSERT_EQ(loaded.GetLength(), 2u);
+    EXPECT_EQ(loaded.At(0)._start_offset, 1*GB + 512*MB);
+    EXPECT_EQ(loaded.At(0)._end_offset, 2*GB + 512*MB);
+    EXPECT_EQ(loaded.At(1)._end_offset, 3*GB + 4*MB);
+}
+
+#endif // MALLOC_AUTO_TEST
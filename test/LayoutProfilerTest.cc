@@ -0,0 +1,171 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "LayoutProfiler.h"
+#include "ParseCsv.h"
+
+#define MB (1l << 20)
+#define GB (1l << 30)
+
+TEST(LayoutProfilerTest, SampleKeepsThePeakTouchedPages) {
+    void *base = mmap(nullptr, 8*MB, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ASSERT_NE(base, MAP_FAILED);
+    LayoutProfiler profiler;
+    int pool = profiler.AddPool("mmap", base, 8*MB, true,
+                                AllocatorPolicy::FIRST_FIT);
+
+    // touch 10 pages of the first chunk, and all the pages of the third
+    char *memory = static_cast<char*>(base);
+    for (int p = 0; p < 10; p++) {
+        memory[p * 4096] = 1;
+    }
+    memset(memory + 4*MB, 1, 2*MB);
+    profiler.Sample(pool, 0, 8*MB);
+    EXPECT_EQ(profiler.GetChunk(pool, 0), 10u);
+    EXPECT_EQ(profiler.GetChunk(pool, 1), 0u);
+    EXPECT_EQ(profiler.GetChunk(pool, 2), PROFILE_CHUNK_PAGES);
+    EXPECT_EQ(profiler.GetChunk(pool, 3), 0u);
+
+    // the released chunk keeps its peak
+    ASSERT_EQ(madvise(memory + 4*MB, 2*MB, MADV_DONTNEED), 0);
+    profiler.Sample(pool, 4*MB + 4096, 4096);
+    EXPECT_EQ(profiler.GetChunk(pool, 2), PROFILE_CHUNK_PAGES);
+    ASSERT_EQ(munmap(base, 8*MB), 0);
+}
+
+TEST(LayoutProfilerTest, PlanBacksTheDensestChunks) {
+    LayoutProfiler profiler;
+    int brk = profiler.AddPool("brk", nullptr, 4*GB, true,
+                               AllocatorPolicy::FIRST_FIT);
+    int mmap_pool = profiler.AddPool("mmap", nullptr, 4*GB, true,
+                                     AllocatorPolicy::FIRST_FIT);
+    int file = profiler.AddPool("file", nullptr, 1*GB, false,
+                                AllocatorPolicy::FIRST_FIT);
+
+    // the first 1GB of brk is dense, and so are a few chunks of mmap
+    for (size_t c = 0; c < PROFILE_CHUNKS_PER_1GB; c++) {
+        profiler.UpdateChunk(brk, c, 300);
+    }
+    profiler.UpdateChunk(brk, PROFILE_CHUNKS_PER_1GB, 10);
+    profiler.UpdatePeakExtent(brk, 1*GB + 3*MB);
+    profiler.UpdateChunk(mmap_pool, 3, 512);
+    profiler.UpdateChunk(mmap_pool, 4, 512);
+    profiler.UpdateChunk(mmap_pool, 7, 100);
+    profiler.UpdateChunk(mmap_pool, 9, 1);
+    profiler.UpdatePeakExtent(mmap_pool, 20*MB);
+    profiler.UpdatePeakExtent(file, 5*MB);
+
+    // the budget covers all the chunks but the sparsest one
+    profiler.Plan(1*GB + 8*MB);
+    EXPECT_EQ(profiler.GetPlannedSize(brk), 1*GB + 4*MB);
+    EXPECT_EQ(profiler.GetPlannedSize(mmap_pool), 20*MB);
+    EXPECT_EQ(profiler.GetPlannedSize(file), 6*MB);
+
+    MemoryIntervalList &brk_intervals = profiler.GetPlannedIntervals(brk);
+    ASSERT_EQ(brk_intervals.GetLength(), 2u);
+    EXPECT_EQ(brk_intervals.At(0)._end_offset, 1*GB);
+    EXPECT_EQ(brk_intervals.At(0)._page_size, PageSize::HUGE_1GB);
+    EXPECT_EQ(brk_intervals.At(1)._start_offset, 1*GB);
+    EXPECT_EQ(brk_intervals.At(1)._end_offset, 1*GB + 2*MB);
+    EXPECT_EQ(brk_intervals.At(1)._page_size, PageSize::HUGE_2MB);
+
+    MemoryIntervalList &mmap_intervals = profiler.GetPlannedIntervals(mmap_pool);
+    ASSERT_EQ(mmap_intervals.GetLength(), 2u);
+    EXPECT_EQ(mmap_intervals.At(0)._start_offset, 6*MB);
+    EXPECT_EQ(mmap_intervals.At(0)._end_offset, 10*MB);
+    EXPECT_EQ(mmap_intervals.At(1)._start_offset, 14*MB);
+    EXPECT_EQ(mmap_intervals.At(1)._end_offset, 16*MB);
+    EXPECT_EQ(profiler.GetPlannedIntervals(file).GetLength(), 0u);
+}
+
+TEST(LayoutProfilerTest, PlanKeepsTheOffsetsOfTheSampledChunks) {
+    LayoutProfiler profiler;
+    int table = profiler.AddPool("table", nullptr, 64*MB, true,
+                                 AllocatorPolicy::LAST_FIT);
+    int mmap_pool = profiler.AddPool("mmap", nullptr, 64*MB, true,
+                                     AllocatorPolicy::FIRST_FIT);
+
+    // the last-fit pool is allocated from its top, so its extent is the
+    // whole pool although only its two top chunks were used
+    profiler.UpdateChunk(table, 30, 512);
+    profiler.UpdateChunk(table, 31, 512);
+    profiler.UpdatePeakExtent(table, 64*MB);
+    // the fragmented pool has a dense chunk at the top of its extent, and
+    // a sampled chunk above it (which the extent does not cover)
+    profiler.UpdateChunk(mmap_pool, 0, 10);
+    profiler.UpdateChunk(mmap_pool, 9, 400);
+    profiler.UpdateChunk(mmap_pool, 12, 300);
+    profiler.UpdatePeakExtent(mmap_pool, 19*MB);
+
+    profiler.Plan(10*MB);
+    EXPECT_EQ(profiler.GetPlannedSize(table), 64*MB);
+    EXPECT_EQ(profiler.GetPlannedSize(mmap_pool), 26*MB);
+
+    MemoryIntervalList &table_intervals = profiler.GetPlannedIntervals(table);
+    ASSERT_EQ(table_intervals.GetLength(), 1u);
+    EXPECT_EQ(table_intervals.At(0)._start_offset, 60*MB);
+    EXPECT_EQ(table_intervals.At(0)._end_offset, 64*MB);
+    MemoryIntervalList &mmap_intervals = profiler.GetPlannedIntervals(mmap_pool);
+    ASSERT_EQ(mmap_intervals.GetLength(), 3u);
+    EXPECT_EQ(mmap_intervals.At(0)._start_offset, 0);
+    EXPECT_EQ(mmap_intervals.At(0)._end_offset, 2*MB);
+    EXPECT_EQ(mmap_intervals.At(1)._start_offset, 18*MB);
+    EXPECT_EQ(mmap_intervals.At(1)._end_offset, 20*MB);
+    EXPECT_EQ(mmap_intervals.At(2)._start_offset, 24*MB);
+    EXPECT_EQ(mmap_intervals.At(2)._end_offset, 26*MB);
+}
+
+TEST(LayoutProfilerTest, LayoutIsAConfigurationFile) {
+    LayoutProfiler profiler;
+    int brk = profiler.AddPool("brk", nullptr, 1*GB, true,
+                               AllocatorPolicy::FIRST_FIT);
+    int large = profiler.AddPool("large", nullptr, 1*GB, true,
+                                 AllocatorPolicy::PAGE_ALIGNED);
+    profiler.AddPool("file", nullptr, 1*GB, false, AllocatorPolicy::FIRST_FIT);
+    profiler.UpdateChunk(brk, 0, 512);
+    profiler.UpdateChunk(brk, 1, 512);
+    profiler.UpdateChunk(brk, 5, 512);
+    profiler.UpdatePeakExtent(brk, 12*MB);
+    profiler.UpdatePeakExtent(large, 64*MB);
+    profiler.Plan(6*MB);
+
+    RoutingTable routes;
+    routes.AddRoute(RoutingTable::RouteClass::ANONYMOUS, "large", 16*MB, -1);
+    routes.AddRoute(RoutingTable::RouteClass::EXECUTABLE, PASSTHROUGH_NAME, 0, -1);
+
+    char path[] = "/tmp/mosalloc-layout-XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    FILE *file = fdopen(fd, "w");
+    profiler.WriteLayout(file, routes);
+    fclose(file);
+
+    RoutingTable loaded_routes;
+    ConfigurationLoader loader;
+    loader.Load(path, loaded_routes);
+    unlink(path);
+
+    PoolConfigurationData &brk_pool = loader.GetPool("brk");
+    EXPECT_EQ(brk_pool.size, (size_t)12*MB);
+    ASSERT_EQ(brk_pool.intervalList.GetLength(), 2u);
+    EXPECT_EQ(brk_pool.intervalList.At(0)._start_offset, 0);
+    EXPECT_EQ(brk_pool.intervalList.At(0)._end_offset, 4*MB);
+    EXPECT_EQ(brk_pool.intervalList.At(1)._start_offset, 10*MB);
+    EXPECT_EQ(brk_pool.intervalList.At(1)._end_offset, 12*MB);
+    PoolConfigurationData &large_pool = loader.GetPool("large");
+    EXPECT_EQ(large_pool.size, (size_t)64*MB);
+    EXPECT_EQ(large_pool.intervalList.GetLength(), 0u);
+    EXPECT_EQ(large_pool.allocatorPolicy, AllocatorPolicy::PAGE_ALIGNED);
+    EXPECT_EQ(loader.GetPool("file").size, (size_t)2*MB);
+
+    ASSERT_EQ(loaded_routes.GetRoutesCount(), 2);
+    EXPECT_EQ(loaded_routes.At(0)._class, RoutingTable::RouteClass::ANONYMOUS);
+    EXPECT_EQ(loaded_routes.At(0)._min_length, (size_t)16*MB);
+    EXPECT_EQ(loaded_routes.At(0)._max_length, (size_t)-1);
+    EXPECT_STREQ(loaded_routes.GetPoolName(loaded_routes.At(0)._pool), "large");
+    EXPECT_EQ(loaded_routes.At(1)._target, RoutingTable::RouteTarget::PASSTHROUGH);
+}
@@ -0,0 +1,44 @@
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+
+#ifdef MALLOC_AUTO_TEST
+
+extern "C" size_t __malloc_retire_heap(void);
+
+#define CHUNKS_COUNT (16)
+// larger than the tcache and fastbins chunks, so the freed chunks are binned
+#define CHUNK_SIZE (4096)
+
+TEST(MallocRetireHeapTest, RetiredChunksAreNotReused) {
+    void *chunks[CHUNKS_COUNT];
+    for (int i = 0; i < CHUNKS_COUNT; i++) {
+        chunks[i] = malloc(CHUNK_SIZE);
+        ASSERT_NE(chunks[i], nullptr);
+    }
+    // every other chunk is freed, so the free chunks are not coalesced
+    for (int i = 0; i < CHUNKS_COUNT; i += 2) {
+        free(chunks[i]);
+    }
+
+    size_t retired = __malloc_retire_heap();
+    EXPECT_GE(retired, (size_t)(CHUNKS_COUNT / 2) * CHUNK_SIZE);
+
+    // the next allocation is served by a new top chunk from MORECORE
+    void *heap_top = sbrk(0);
+    void *ptr = malloc(CHUNK_SIZE);
+    ASSERT_NE(ptr, nullptr);
+    EXPECT_GE(ptr, heap_top);
+    for (int i = 0; i < CHUNKS_COUNT; i += 2) {
+        EXPECT_NE(ptr, chunks[i]);
+    }
+
+    // the chunks in use are kept
+    for (int i = 1; i < CHUNKS_COUNT; i += 2) {
+        free(chunks[i]);
+    }
+    free(ptr);
+}
+
+#endif // MALLOC_AUTO_TEST
@@ -0,0 +1,475 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "MemoryAllocator.h"
+
+#define KB (1l << 10)
+#define MB (1l << 20)
+
+// builds an allocator of small 4KB pools (which need no hugepages)
+class MemoryAllocatorTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        unsetenv("HPC_CONFIGURATION_FILE");
+        setenv("HPC_LAYOUT", "brk:64MB;mmap:64MB;file:64MB", 1);
+        setenv("HPC_MMAP_FIRST_FIT_LIST_SIZE", "8", 1);
+        setenv("HPC_FILE_BACKED_FIRST_FIT_LIST_SIZE", "8", 1);
+        setenv("HPC_ERROR_POLICY", "return", 1);
+        _allocator = new MemoryAllocator();
+    }
+
+    void TearDown() override {
+        delete _allocator;
+        unsetenv("HPC_FILE_MMAP_MODE");
+        unsetenv("HPC_FORK_POLICY");
+        unsetenv("HPC_LAYOUT");
+        unsetenv("HPC_MMAP_FIRST_FIT_LIST_SIZE");
+        unsetenv("HPC_FILE_BACKED_FIRST_FIT_LIST_SIZE");
+        unsetenv("HPC_ERROR_POLICY");
+    }
+
+    void *Map(void *addr, size_t length, int prot, int flags = MMAP_FLAGS) {
+        return _allocator->AllocateFromAnonymousMmapRegion(addr, length, prot,
+                                                           flags);
+    }
+
+    // builds the allocator again by another configuration
+    void Reset(const char *layout) {
+        delete _allocator;
+        setenv("HPC_LAYOUT", layout, 1);
+        _allocator = new MemoryAllocator();
+    }
+
+    MemoryAllocator *_allocator;
+};
+
+TEST_F(MemoryAllocatorTest, ReservationIsCommittedByTheProtectedRangeOnly) {
+    // a reservation is placed at the top of the pool
+    void *reserved = Map(NULL, 16*MB, PROT_NONE);
+    ASSERT_NE(reserved, MAP_FAILED);
+    EXPECT_EQ(_allocator->GetPoolRegionSize("mmap"), 0ul);
+    EXPECT_EQ(_allocator->GetPoolCommittedSize("mmap"), 0ul);
+
+    // the memory below the slice is not committed along with it
+    void *slice = PTR_ADD(reserved, 8*MB);
+    ASSERT_EQ(_allocator->ProtectMemory(slice, 1*MB, PROT_READ | PROT_WRITE), 0);
+    EXPECT_EQ(_allocator->GetPoolRegionSize("mmap"), 0ul);
+    EXPECT_EQ(_allocator->GetPoolCommittedSize("mmap"), (size_t)(1*MB));
+    memset(slice, 0xab, 1*MB);
+
+    // growing the slice extends its committed range
+    void *next = PTR_ADD(slice, 1*MB);
+    ASSERT_EQ(_allocator->ProtectMemory(next, 1*MB, PROT_READ | PROT_WRITE), 0);
+    EXPECT_EQ(_allocator->GetPoolCommittedSize("mmap"), (size_t)(2*MB));
+    EXPECT_EQ(((char*)slice)[1*MB - 1], (char)0xab);
+
+    // the committed memory is released with the reservation
+    ASSERT_EQ(_allocator->DeallocateFromMmapRegion(reserved, 16*MB), 0);
+    EXPECT_EQ(_allocator->GetPoolCommittedSize("mmap"), 0ul);
+}
+
+TEST_F(MemoryAllocatorTest, AccessibleMappingsExtendTheCommittedPrefix) {
+    void *first = Map(NULL, 1*MB, PROT_READ | PROT_WRITE);
+    ASSERT_NE(first, MAP_FAILED);
+    void *second = Map(NULL, 1*MB, PROT_READ | PROT_WRITE);
+    ASSERT_NE(second, MAP_FAILED);
+    EXPECT_EQ(_allocator->GetPoolRegionSize("mmap"), (size_t)(2*MB));
+    EXPECT_EQ(_allocator->GetPoolCommittedSize("mmap"), (size_t)(2*MB));
+}
+
+TEST_F(MemoryAllocatorTest, FixedMappingReplacesTheRange) {
+    char *ptr = (char*)Map(NULL, 4*4*KB, PROT_READ | PROT_WRITE);
+    ASSERT_NE(ptr, MAP_FAILED);
+    memset(ptr, 1, 4*4*KB);
+
+    void *res = Map(ptr + 4*KB, 2*4*KB, PROT_READ | PROT_WRITE,
+                    MMAP_FLAGS | MAP_FIXED);
+    ASSERT_EQ(res, (void*)(ptr + 4*KB));
+    // the new mapping is zero-filled, and the rest of the range is kept
+    EXPECT_EQ(ptr[0], 1);
+    EXPECT_EQ(ptr[4*KB], 0);
+    EXPECT_EQ(ptr[3*4*KB - 1], 0);
+    EXPECT_EQ(ptr[3*4*KB], 1);
+}
+
+TEST_F(MemoryAllocatorTest, FailedFixedMappingKeepsTheRange) {
+    // each allocation takes a node of the free list (of 8 nodes)
+    char *ptrs[5];
+    for (int i = 0; i < 5; i++) {
+        ptrs[i] = (char*)Map(NULL, 4*4*KB, PROT_READ | PROT_WRITE);
+        ASSERT_NE(ptrs[i], MAP_FAILED);
+        memset(ptrs[i], i + 1, 4*4*KB);
+    }
+
+    // replacing the middle of a mapping splits it, and there are not enough
+    // nodes to allocate the new mapping after the split
+    void *res = Map(ptrs[1] + 4*KB, 4*KB, PROT_READ | PROT_WRITE,
+                    MMAP_FLAGS | MAP_FIXED);
+    EXPECT_EQ(res, MAP_FAILED);
+    EXPECT_EQ(errno, ENOMEM);
+    EXPECT_EQ(ptrs[1][4*KB], 2);
+
+    // the mapping is still allocated, so it could be unmapped
+    EXPECT_EQ(_allocator->DeallocateFromMmapRegion(ptrs[1], 4*4*KB), 0);
+}
+
+TEST_F(MemoryAllocatorTest, FixedMappingAcrossThePoolEndIsPassedThrough) {
+    // the reservation of the last page of the pool finds the pool end
+    void *last_page = Map(NULL, 4*KB, PROT_NONE);
+    ASSERT_NE(last_page, MAP_FAILED);
+    ASSERT_EQ(_allocator->DeallocateFromMmapRegion(last_page, 4*KB), 0);
+    void *pool_end = PTR_ADD(last_page, 4*KB);
+    if (_allocator->IsAddressInHugePageRegions(pool_end)) {
+        GTEST_SKIP() << "the pool is followed by another pool";
+    }
+
+    void *res = Map(last_page, 2*4*KB, PROT_READ | PROT_WRITE,
+                    MMAP_FLAGS | MAP_FIXED_NOREPLACE);
+    if (res == MAP_FAILED) {
+        // the kernel refuses to replace the mapping beyond the pool, and
+        // the part in the pool is not left allocated
+        EXPECT_EQ(errno, EEXIST);
+        EXPECT_EQ(_allocator->GetPoolCommittedSize("mmap"), 0ul);
+        res = Map(last_page, 4*KB, PROT_READ | PROT_WRITE,
+                  MMAP_FLAGS | MAP_FIXED_NOREPLACE);
+        EXPECT_EQ(res, last_page);
+        return;
+    }
+    ASSERT_EQ(res, last_page);
+    memset(res, 1, 2*4*KB);
+    // only the part in the pool is served by the pool
+    EXPECT_EQ(_allocator->GetPoolCommittedSize("mmap"), (size_t)(4*KB));
+
+    EXPECT_EQ(_allocator->DeallocateFromMmapRegion(res, 2*4*KB), 0);
+    EXPECT_EQ(_allocator->GetPoolCommittedSize("mmap"), 0ul);
+    // the part beyond the pool is unmapped by the kernel
+    void *probe = mmap(pool_end, 4*KB, PROT_NONE,
+                       MMAP_FLAGS | MAP_FIXED_NOREPLACE, -1, 0);
+    EXPECT_EQ(probe, pool_end);
+    munmap(probe, 4*KB);
+}
+
+TEST_F(MemoryAllocatorTest, FilePoolIsBoundedByItsOwnBase) {
+    FILE *file = tmpfile();
+    ASSERT_NE(file, nullptr);
+    int fd = fileno(file);
+
+    // the file pool ends at its own base plus its size
+    void *res = _allocator->AllocateFromFileMmapRegion(NULL, 64*MB, PROT_READ,
+                                                       MAP_PRIVATE, fd, 0);
+    ASSERT_NE(res, MAP_FAILED);
+    EXPECT_TRUE(_allocator->IsAddressInHugePageRegions(PTR_ADD(res, 64*MB - 1)));
+    EXPECT_EQ(_allocator->AllocateFromFileMmapRegion(NULL, 4*KB, PROT_READ,
+                                                     MAP_PRIVATE, fd, 0),
+              MAP_FAILED);
+    EXPECT_EQ(errno, ENOMEM);
+
+    EXPECT_EQ(_allocator->DeallocateFromMmapRegion(res, 64*MB), 0);
+    fclose(file);
+}
+
+TEST_F(MemoryAllocatorTest, TransparentFilePoolIgnoresHugePagesIntervals) {
+    // a layout of the pool mode is accepted as is
+    setenv("HPC_FILE_MMAP_MODE", "transparent", 1);
+    Reset("brk:64MB;mmap:64MB;file:64MB:2MB[0-3]");
+
+    FILE *file = tmpfile();
+    ASSERT_NE(file, nullptr);
+    int fd = fileno(file);
+    ASSERT_EQ(ftruncate(fd, 4*MB), 0);
+
+    // the mapping is placed on the 2MB boundary of its file offset
+    char *res = (char*)_allocator->AllocateFromFileMmapRegion(
+        NULL, 4*MB, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 2*MB);
+    ASSERT_NE(res, MAP_FAILED);
+    EXPECT_TRUE(IS_ALIGNED(res, 2*MB));
+    res[0] = 1;
+
+    // the unmapped range is reserved again
+    EXPECT_EQ(_allocator->DeallocateFromMmapRegion(res, 4*MB), 0);
+    EXPECT_TRUE(_allocator->IsAddressInHugePageRegions(res));
+    void *probe = mmap(res, 4*KB, PROT_NONE,
+                       MMAP_FLAGS | MAP_FIXED_NOREPLACE, -1, 0);
+    EXPECT_EQ(probe, MAP_FAILED);
+    EXPECT_EQ(errno, EEXIST);
+    fclose(file);
+}
+
+TEST_F(MemoryAllocatorTest, ChildAllocatesAfterForkWhilePoolIsBusy) {
+    setenv("HPC_FORK_POLICY", "shrink", 1);
+    Reset("brk:64MB;mmap:64MB;file:64MB");
+
+    // the top of the pool is free, but below the resize threshold
+    void *used = Map(NULL, 1*MB, PROT_READ | PROT_WRITE);
+    ASSERT_NE(used, MAP_FAILED);
+    void *top = Map(NULL, 1*MB, PROT_READ | PROT_WRITE);
+    ASSERT_NE(top, MAP_FAILED);
+    ASSERT_EQ(_allocator->DeallocateFromMmapRegion(top, 1*MB), 0);
+    ASSERT_EQ(_allocator->GetPoolRegionSize("mmap"), (size_t)(2*MB));
+
+    // another thread keeps taking the pool lock
+    std::atomic<bool> stop(false);
+    std::thread worker([this, &stop]() {
+        while (!stop.load()) {
+            void *ptr = Map(NULL, 4*KB, PROT_READ | PROT_WRITE);
+            if (ptr != MAP_FAILED) {
+                _allocator->DeallocateFromMmapRegion(ptr, 4*KB);
+            }
+        }
+    });
+
+    // as the fork handlers of the hooks do
+    _allocator->LockPools();
+    pid_t pid = fork();
+    _allocator->UnlockPools();
+    if (pid == 0) {
+        alarm(10);
+        _allocator->ResetAfterFork();
+        // the free memory above the allocations is released (the fork may
+        // have copied a page that the worker had mapped at the time)
+        if (_allocator->GetPoolRegionSize("mmap") > (size_t)(1*MB + 4*KB)) {
+            _exit(2);
+        }
+        void *ptr = Map(NULL, 1*MB, PROT_READ | PROT_WRITE);
+        if (ptr == MAP_FAILED) {
+            _exit(3);
+        }
+        memset(ptr, 1, 1*MB);
+        _exit(_allocator->DeallocateFromMmapRegion(ptr, 1*MB) == 0 ? 0 : 4);
+    }
+    stop.store(true);
+    worker.join();
+    ASSERT_GT(pid, 0);
+
+    int status;
+    ASSERT_EQ(waitpid(pid, &status, 0), pid);
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+    // the parent keeps its pool as is
+    EXPECT_EQ(_allocator->GetPoolRegionSize("mmap"), (size_t)(2*MB));
+}
+
+TEST_F(MemoryAllocatorTest, ForkWhileAnotherThreadGrowsTheHeap) {
+    // the forks run in a child process, so a deadlock fails the test (by
+    // the alarm) rather than hanging it
+    pid_t runner = fork();
+    if (runner == 0) {
+        alarm(10);
+        // malloc grows the heap under its arena lock
+        std::mutex arena;
+        std::atomic<bool> stop(false);
+        std::thread worker([this, &arena, &stop]() {
+            while (!stop.load()) {
+                std::lock_guard<std::mutex> guard(arena);
+                if (_allocator->Morecore(4*KB) != nullptr) {
+                    _allocator->Morecore(-4*KB);
+                }
+            }
+        });
+        int res = 0;
+        for (int i = 0; i < 100 && res == 0; i++) {
+            // as glibc fork does: the prepare handler of the hooks, and
+            // then the arena locks
+            _allocator->LockPools(false);
+            arena.lock();
+            pid_t pid = fork();
+            arena.unlock();
+            _allocator->UnlockPools(false);
+            if (pid == 0) {
+                alarm(10);
+                _exit(_allocator->Morecore(4*KB) != nullptr ? 0 : 1);
+            }
+            int status;
+            if (pid < 0 || waitpid(pid, &status, 0) != pid ||
+                !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                res = 2;
+            }
+        }
+        stop.store(true);
+        worker.join();
+        _exit(res);
+    }
+    ASSERT_GT(runner, 0);
+    int status;
+    ASSERT_EQ(waitpid(runner, &status, 0), runner);
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+}
+
+TEST_F(MemoryAllocatorTest, ChildPassesMappingsThroughByThePassthroughPolicy) {
+    setenv("HPC_FORK_POLICY", "passthrough", 1);
+    Reset("brk:64MB;mmap:64MB;file:64MB");
+
+    int pool;
+    EXPECT_NE(_allocator->RouteMmapRequest(1*MB, PROT_READ, MMAP_FLAGS, -1,
+                                           pool),
+              RoutingTable::RouteTarget::PASSTHROUGH);
+    pid_t pid = fork();
+    if (pid == 0) {
+        _allocator->ResetAfterFork();
+        _exit(_allocator->RouteMmapRequest(1*MB, PROT_READ, MMAP_FLAGS, -1,
+                                           pool) ==
+              RoutingTable::RouteTarget::PASSTHROUGH ? 0 : 1);
+    }
+    ASSERT_GT(pid, 0);
+    int status;
+    ASSERT_EQ(waitpid(pid, &status, 0), pid);
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+}
+
+TEST_F(MemoryAllocatorTest, ArenaHeapsCommitTheirGrownPartOnly) {
+    Reset("brk:64MB;mmap:64MB;file:64MB;arena:512MB");
+    // a heap is reserved twice as large until it is aligned
+    EXPECT_EQ(_allocator->GetArenaHeapsLimit(64*MB), 7ul);
+
+    // as new_heap and grow_heap do
+    void *heaps[2];
+    for (int i = 0; i < 2; i++) {
+        heaps[i] = _allocator->AllocateFromArenaPool(NULL, 128*MB, PROT_NONE,
+                                                     MMAP_FLAGS | MAP_NORESERVE);
+        ASSERT_NE(heaps[i], MAP_FAILED);
+        EXPECT_TRUE(IS_ALIGNED(heaps[i], 128*MB));
+        ASSERT_EQ(_allocator->DeallocateFromMmapRegion(PTR_ADD(heaps[i], 64*MB),
+                                                       64*MB), 0);
+        ASSERT_EQ(_allocator->ProtectMemory(heaps[i], 132*KB,
+                                            PROT_READ | PROT_WRITE), 0);
+    }
+    // the second heap does not commit the first one (which is at the pool
+    // base only if the base is aligned to the heaps)
+    EXPECT_LE(_allocator->GetPoolRegionSize("arena"), (size_t)(132*KB));
+    EXPECT_EQ(_allocator->GetPoolCommittedSize("arena"), (size_t)(2*132*KB));
+
+    ASSERT_EQ(_allocator->ProtectMemory(PTR_ADD(heaps[0], 132*KB), 1*MB,
+                                        PROT_READ | PROT_WRITE), 0);
+    EXPECT_EQ(_allocator->GetPoolCommittedSize("arena"),
+              (size_t)(2*132*KB + 1*MB));
+}
+
+TEST_F(MemoryAllocatorTest, LastFitPoolIsAllocatedFromTheTop) {
+    Reset("brk:64MB;mmap:64MB;file:64MB;table:64MB;table:allocator:last-fit");
+    void *first = _allocator->AllocateFromNamedPool("table", 1*MB,
+                                                    PROT_READ | PROT_WRITE);
+    ASSERT_NE(first, MAP_FAILED);
+    void *second = _allocator->AllocateFromNamedPool("table", 1*MB,
+                                                     PROT_READ | PROT_WRITE);
+    ASSERT_NE(second, MAP_FAILED);
+    // each mapping is placed right below the previous one, and the bottom
+    // of the pool is not committed
+    EXPECT_EQ(PTR_ADD(second, 1*MB), first);
+    EXPECT_EQ(_allocator->GetPoolRegionSize("table"), 0ul);
+    EXPECT_EQ(_allocator->GetPoolCommittedSize("table"), (size_t)(2*MB));
+    memset(second, 1, 2*MB);
+
+    // the default pool is still first fit
+    void *low = Map(NULL, 1*MB, PROT_READ | PROT_WRITE);
+    ASSERT_NE(low, MAP_FAILED);
+    EXPECT_EQ(_allocator->GetPoolRegionSize("mmap"), (size_t)(1*MB));
+}
+
+TEST_F(MemoryAllocatorTest, PeakOfAllocatedBytesIsTracked) {
+    Reset("brk:64MB;mmap:64MB;file:64MB;table:64MB;table:allocator:last-fit");
+    char *first = (char*)_allocator->AllocateFromNamedPool(
+            "table", 1*MB, PROT_READ | PROT_WRITE);
+    ASSERT_NE(first, MAP_FAILED);
+    char *second = (char*)_allocator->AllocateFromNamedPool(
+            "table", 1*MB, PROT_READ | PROT_WRITE);
+    ASSERT_NE(second, MAP_FAILED);
+    // the pool is allocated from its top, so only the allocated bytes (and
+    // not the region top) are counted
+    EXPECT_EQ(_allocator->GetPoolMaxAllocatedSize("table"), (size_t)(2*MB));
+
+    // a fixed mapping that replaces a part of a mapping is not counted twice
+    ASSERT_EQ(Map(second + 256*KB, 256*KB, PROT_READ | PROT_WRITE,
+                  MMAP_FLAGS | MAP_FIXED), (void*)(second + 256*KB));
+    EXPECT_EQ(_allocator->GetPoolMaxAllocatedSize("table"), (size_t)(2*MB));
+
+    // the peak is kept once the mappings are freed
+    ASSERT_EQ(_allocator->DeallocateFromMmapRegion(first, 1*MB), 0);
+    // the replaced mapping is split to three mappings
+    ASSERT_EQ(_allocator->DeallocateFromMmapRegion(second, 256*KB), 0);
+    ASSERT_EQ(_allocator->DeallocateFromMmapRegion(second + 256*KB, 256*KB), 0);
+    ASSERT_EQ(_allocator->DeallocateFromMmapRegion(second + 512*KB, 512*KB), 0);
+    ASSERT_NE(_allocator->AllocateFromNamedPool("table", 1*MB,
+                                                PROT_READ | PROT_WRITE),
+              MAP_FAILED);
+    EXPECT_EQ(_allocator->GetPoolMaxAllocatedSize("table"), (size_t)(2*MB));
+    ASSERT_NE(_allocator->AllocateFromNamedPool("table", 2*MB,
+                                                PROT_READ | PROT_WRITE),
+              MAP_FAILED);
+    EXPECT_EQ(_allocator->GetPoolMaxAllocatedSize("table"), (size_t)(3*MB));
+}
+
+TEST_F(MemoryAllocatorTest, PeakExtentIsTracked) {
+    Reset("brk:64MB;mmap:64MB;file:64MB;table:64MB;table:allocator:last-fit");
+    // the last-fit pool is allocated from its top
+    void *top = _allocator->AllocateFromNamedPool("table", 1*MB,
+                                                  PROT_READ | PROT_WRITE);
+    ASSERT_NE(top, MAP_FAILED);
+    EXPECT_EQ(_allocator->GetPoolMaxAllocatedSize("table"), (size_t)(1*MB));
+    EXPECT_EQ(_allocator->GetPoolMaxExtent("table"), (size_t)(64*MB));
+
+    // the free hole below the top of a fragmented pool is counted
+    char *first = (char*)_allocator->AllocateFromNamedPool(
+            "mmap", 4*MB, PROT_READ | PROT_WRITE);
+    ASSERT_NE(first, MAP_FAILED);
+    char *second = (char*)_allocator->AllocateFromNamedPool(
+            "mmap", 1*MB, PROT_READ | PROT_WRITE);
+    ASSERT_EQ(second, first + 4*MB);
+    ASSERT_EQ(_allocator->DeallocateFromMmapRegion(first, 4*MB), 0);
+    ASSERT_NE(_allocator->AllocateFromNamedPool("mmap", 1*MB,
+                                                PROT_READ | PROT_WRITE),
+              MAP_FAILED);
+    EXPECT_EQ(_allocator->GetPoolMaxAllocatedSize("mmap"), (size_t)(5*MB));
+    EXPECT_EQ(_allocator->GetPoolMaxExtent("mmap"), (size_t)(5*MB));
+    ASSERT_EQ(_allocator->DeallocateFromMmapRegion(second, 1*MB), 0);
+    ASSERT_NE(_allocator->AllocateFromNamedPool("mmap", 3*MB,
+                                                PROT_READ | PROT_WRITE),
+              MAP_FAILED);
+    EXPECT_EQ(_allocator->GetPoolMaxExtent("mmap"), (size_t)(5*MB));
+}
+
+TEST_F(MemoryAllocatorTest, PageAlignedPoolPlacesLargeMappingsOnPages) {
+    // the pool maps its hugepage when it is initialized
+    void *probe = mmap(NULL, 2*MB, MMAP_PROTECTION,
+                       MMAP_FLAGS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+    if (probe == MAP_FAILED) {
+        GTEST_SKIP() << "there is no free 2MB hugepage";
+    }
+    munmap(probe, 2*MB);
+    // the 2MB interval at the top of the pool sets its page alignment
+    Reset("brk:64MB;mmap:64MB;file:64MB;table:64MB:2MB[31];"
+          "table:allocator:page-aligned");
+    void *small = _allocator->AllocateFromNamedPool("table", 4*KB,
+                                                    PROT_READ | PROT_WRITE);
+    ASSERT_NE(small, MAP_FAILED);
+    void *large = _allocator->AllocateFromNamedPool("table", 2*MB,
+                                                    PROT_READ | PROT_WRITE);
+    ASSERT_NE(large, MAP_FAILED);
+    // a first fit would place it right after the small mapping
+    EXPECT_NE(large, PTR_ADD(small, 4*KB));
+    EXPECT_TRUE(IS_ALIGNED(large, 2*MB));
+    // the mappings smaller than a page are placed by first fit
+    void *next = _allocator->AllocateFromNamedPool("table", 4*KB,
+                                                   PROT_READ | PROT_WRITE);
+    EXPECT_EQ(next, PTR_ADD(small, 4*KB));
+}
+
+TEST_F(MemoryAllocatorTest, EmptyPoolThatNoRouteUsesIsSkipped) {
+    Reset("brk:64MB;mmap:64MB;file:64MB;spare:0");
+    errno = 0;
+    EXPECT_EQ(_allocator->AllocateFromNamedPool("spare", 4*KB,
+                                                PROT_READ | PROT_WRITE),
+              MAP_FAILED);
+    EXPECT_EQ(errno, EINVAL);
+    EXPECT_NE(Map(NULL, 4*KB, PROT_READ | PROT_WRITE), MAP_FAILED);
+}
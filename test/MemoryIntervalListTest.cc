@@ -63,3 +63,93 @@ TEST(MemoryIntervalListTest, MixedIntervals) {
     EXPECT_EQ(ls.At(8)._start_offset, (1ul<<36));
     EXPECT_EQ(ls.At(9)._start_offset, (1ul<<38));
 }
+
+TEST(MemoryIntervalListTest, SortManyIntervals) {
+    const size_t count = 100000;
+    MemoryIntervalList l;
+    l.Initialize(mmap, munmap, count);
+    // add the intervals of 2MB pages in a scrambled order
+    for (size_t i = 0; i < count; i++) {
+        size_t page = (i * 7919) % count;
+        l.AddInterval(page << 21, (page + 1) << 21, PageSize::HUGE_2MB);
+    }
+
+    l.Sort();
+
+    ASSERT_EQ(l.GetLength(), count);
+    for (size_t i = 0; i < count; i++) {
+        EXPECT_EQ(l.At(i)._start_offset, (off_t)(i << 21));
+    }
+}
+
+TEST(MemoryIntervalListTest, CoalesceAdjacentIntervals) {
+    MemoryIntervalList l;
+    l.Initialize(mmap, munmap, 10);
+    l.AddInterval(0, 1<<21, PageSize::HUGE_2MB);
+    l.AddInterval(1<<21, 2<<21, PageSize::HUGE_2MB);
+    l.AddInterval(2<<21, 3<<21, PageSize::HUGE_2MB);
+    // adjacent, but of another page size
+    l.AddInterval(3<<21, 1l<<30, PageSize::BASE_4KB);
+    l.AddInterval(1l<<30, 2l<<30, PageSize::HUGE_1GB);
+    // not adjacent
+    l.AddInterval(3l<<30, 4l<<30, PageSize::HUGE_1GB);
+
+    l.Coalesce();
+
+    ASSERT_EQ(l.GetLength(), 4ul);
+    EXPECT_EQ(l.At(0)._start_offset, 0);
+    EXPECT_EQ(l.At(0)._end_offset, 3<<21);
+    EXPECT_EQ(l.At(0)._page_size, PageSize::HUGE_2MB);
+    EXPECT_EQ(l.At(1)._start_offset, 3<<21);
+    EXPECT_EQ(l.At(1)._page_size, PageSize::BASE_4KB);
+    EXPECT_EQ(l.At(2)._start_offset, 1l<<30);
+    EXPECT_EQ(l.At(2)._end_offset, 2l<<30);
+    EXPECT_EQ(l.At(3)._start_offset, 3l<<30);
+    EXPECT_EQ(l.At(3)._end_offset, 4l<<30);
+}
+
+TEST(MemoryIntervalListTest, FillPageSizeFillsGaps) {
+    MemoryIntervalList l;
+    l.Initialize(mmap, munmap, 1);
+    l.AddInterval(4<<21, 6<<21, PageSize::HUGE_2MB);
+
+    // SetPageSize changes the existing intervals only
+    l.SetPageSize(2<<21, 8<<21, PageSize::HUGE_2MB);
+    ASSERT_EQ(l.GetLength(), 1ul);
+    EXPECT_EQ(l.At(0)._start_offset, 4<<21);
+    EXPECT_EQ(l.At(0)._end_offset, 6<<21);
+
+    l.FillPageSize(2<<21, 8<<21, PageSize::HUGE_2MB);
+    ASSERT_EQ(l.GetLength(), 1ul);
+    EXPECT_EQ(l.At(0)._start_offset, 2<<21);
+    EXPECT_EQ(l.At(0)._end_offset, 8<<21);
+
+    l.FillPageSize(1<<30, 2l<<30, PageSize::HUGE_1GB);
+    ASSERT_EQ(l.GetLength(), 2ul);
+    EXPECT_EQ(l.At(1)._start_offset, 1<<30);
+    EXPECT_EQ(l.At(1)._page_size, PageSize::HUGE_1GB);
+}
+
+TEST(MemoryIntervalListTest, SetPageSizeSplitsIntervals) {
+    MemoryIntervalList l;
+    l.Initialize(mmap, munmap, 2);
+    l.AddInterval(0, 8<<21, PageSize::BASE_4KB);
+    l.AddInterval(8<<21, 16<<21, PageSize::HUGE_2MB);
+
+    // the list is full, so it is grown by the split
+    l.SetPageSize(2<<21, 4<<21, PageSize::HUGE_2MB);
+    ASSERT_EQ(l.GetLength(), 4ul);
+    EXPECT_EQ(l.At(0)._end_offset, 2<<21);
+    EXPECT_EQ(l.At(1)._start_offset, 2<<21);
+    EXPECT_EQ(l.At(1)._end_offset, 4<<21);
+    EXPECT_EQ(l.At(1)._page_size, PageSize::HUGE_2MB);
+    EXPECT_EQ(l.At(2)._end_offset, 8<<21);
+    EXPECT_EQ(l.At(2)._page_size, PageSize::BASE_4KB);
+
+    // the adjacent intervals of the same page size are merged
+    l.SetPageSize(4<<21, 8<<21, PageSize::HUGE_2MB);
+    ASSERT_EQ(l.GetLength(), 2ul);
+    EXPECT_EQ(l.At(1)._start_offset, 2<<21);
+    EXPECT_EQ(l.At(1)._end_offset, 16<<21);
+    EXPECT_EQ(l.At(1)._page_size, PageSize::HUGE_2MB);
+}
@@ -5,6 +5,7 @@
 
 #include "gtest/gtest.h"
 #include "ParseCsv.h"
+#include "BinaryLayout.h"
 
 std::string excel_data = "type, page size,start offset,end offset\n"
                          "mmap,2097152,0,16384\n"
@@ -59,4 +60,446 @@ TEST(ParseCsvTest, CsvFiles) {
     EXPECT_EQ(l.intervalList.At(9)._end_offset, (1ul << 40));//38
     EXPECT_EQ(l.size, 50);//38
     remove("csv_file_for_test.csv");
-}
\ No newline at end of file
+}
+std::string routes_data = "type, page size,start offset,end offset\n"
+                          "mmap,-1,0,1073741824\n"
+                          "large,-1,0,4294967296\n"
+                          "large,1073741824,0,4294967296\n"
+                          "passthrough,route:exec,0,-1\n"
+                          "large,route:anon,67108864,-1\n"
+                          "mmap,route:anon,0,65536\n"
+                          "file,-1,0,1048576\n";
+
+TEST(ParseCsvTest, RoutesAreParsedAndSkippedByPools) {
+    std::ofstream myfile;
+    myfile.open ("csv_routes_for_test.csv", std::ios::out);
+    myfile << routes_data;
+    myfile.close();
+
+    std::string cwd(get_current_dir_name());
+    std::string file = cwd + "/" + "csv_routes_for_test.csv";
+
+    RoutingTable routes;
+    parseCsv::ParseRoutes(routes, file.c_str());
+    ASSERT_EQ(routes.GetRoutesCount(), 3);
+    EXPECT_EQ(routes.At(0)._target, RoutingTable::RouteTarget::PASSTHROUGH);
+    EXPECT_EQ(routes.At(0)._class, RoutingTable::RouteClass::EXECUTABLE);
+    EXPECT_EQ(routes.At(0)._max_length, (size_t)-1);
+    EXPECT_EQ(routes.At(1)._target, RoutingTable::RouteTarget::ANONYMOUS_POOL);
+    EXPECT_EQ(routes.At(1)._pool, 1);
+    EXPECT_EQ(routes.At(1)._min_length, 67108864ul);
+    EXPECT_EQ(routes.At(2)._pool, 0);
+    EXPECT_EQ(routes.At(2)._max_length, 65536ul);
+    ASSERT_EQ(routes.GetPoolsCount(), 2);
+    EXPECT_STREQ(routes.GetPoolName(1), "large");
+
+    // the route rows are not part of the pools layout
+    PoolConfigurationData l;
+    l.intervalList.Initialize(mmap, munmap, 16);
+    parseCsv::ParseCsv(l, file.c_str(), "large");
+    EXPECT_EQ(l.size, 4294967296ul);
+    ASSERT_EQ(l.intervalList.GetLength(), 1ul);
+    EXPECT_EQ(l.intervalList.At(0)._page_size, PageSize::HUGE_1GB);
+
+    PoolConfigurationData m;
+    m.intervalList.Initialize(mmap, munmap, 16);
+    parseCsv::ParseCsv(m, file.c_str(), "mmap");
+    EXPECT_EQ(m.size, 1073741824ul);
+    EXPECT_EQ(m.intervalList.GetLength(), 0ul);
+    remove("csv_routes_for_test.csv");
+}
+
+std::string new_format_data = "pool_type,pool_size,ragions_list_2mb,offset_2mb,ragions_list_1gb,offset_1gb\n"
+                              "brk,4GB,[0-4,4-8,16],0,[2],1GB\n"
+                              "mmap,200mb,[],0,[],0\n"
+                              "large,1GB,[0-511],4KB,[],0\n"
+                              "large,route:anon,67108864,-1\n"
+                              "file,100MB,[],0,[],0\n";
+
+TEST(ParseCsvTest, NewFormatIsExpandedToIntervals) {
+    std::ofstream myfile;
+    myfile.open ("csv_new_format_for_test.csv", std::ios::out);
+    myfile << new_format_data;
+    myfile.close();
+
+    std::string cwd(get_current_dir_name());
+    std::string file = cwd + "/" + "csv_new_format_for_test.csv";
+    // the range lists items are counted as windows
+    int max_windows = parseCsv::GetConfigFileMaxWindows(file.c_str());
+    EXPECT_GE(max_windows, 3);
+
+    // contiguous items are merged, and a range excludes its end
+    PoolConfigurationData b;
+    b.intervalList.Initialize(mmap, munmap, max_windows * 2 + 1);
+    parseCsv::ParseCsv(b, file.c_str(), "brk");
+    EXPECT_EQ(b.size, 4ul << 30);
+    ASSERT_EQ(b.intervalList.GetLength(), 3ul);
+    EXPECT_EQ(b.intervalList.At(0)._start_offset, 0);
+    EXPECT_EQ(b.intervalList.At(0)._end_offset, 8 << 21);
+    EXPECT_EQ(b.intervalList.At(0)._page_size, PageSize::HUGE_2MB);
+    EXPECT_EQ(b.intervalList.At(1)._start_offset, 16 << 21);
+    EXPECT_EQ(b.intervalList.At(1)._end_offset, 17 << 21);
+    EXPECT_EQ(b.intervalList.At(2)._start_offset, 3l << 30);
+    EXPECT_EQ(b.intervalList.At(2)._end_offset, 4l << 30);
+    EXPECT_EQ(b.intervalList.At(2)._page_size, PageSize::HUGE_1GB);
+
+    PoolConfigurationData m;
+    m.intervalList.Initialize(mmap, munmap, max_windows * 2 + 1);
+    parseCsv::ParseCsv(m, file.c_str(), "mmap");
+    EXPECT_EQ(m.size, 200ul << 20);
+    EXPECT_EQ(m.intervalList.GetLength(), 0ul);
+
+    PoolConfigurationData l;
+    l.intervalList.Initialize(mmap, munmap, max_windows * 2 + 1);
+    parseCsv::ParseCsv(l, file.c_str(), "large");
+    EXPECT_EQ(l.size, 1ul << 30);
+    ASSERT_EQ(l.intervalList.GetLength(), 1ul);
+    EXPECT_EQ(l.intervalList.At(0)._start_offset, 4096);
+    EXPECT_EQ(l.intervalList.At(0)._end_offset, 4096 + (511l << 21));
+
+    // the routes of the new format are parsed as in the legacy format
+    RoutingTable routes;
+    parseCsv::ParseRoutes(routes, file.c_str());
+    ASSERT_EQ(routes.GetRoutesCount(), 1);
+    EXPECT_STREQ(routes.GetPoolName(routes.At(0)._pool), "large");
+    remove("csv_new_format_for_test.csv");
+}
+
+TEST(ParseCsvTest, LoaderParsesAllPoolsInOnePass) {
+    std::ofstream myfile;
+    myfile.open ("csv_loader_for_test.csv", std::ios::out);
+    myfile << routes_data;
+    myfile.close();
+
+    std::string cwd(get_current_dir_name());
+    std::string file = cwd + "/" + "csv_loader_for_test.csv";
+
+    RoutingTable routes;
+    ConfigurationLoader loader;
+    loader.Load(file.c_str(), routes);
+    EXPECT_EQ(routes.GetRoutesCount(), 3);
+    EXPECT_EQ(loader.GetPoolsCount(), 3);
+
+    // each pool is parsed as by ParseCsv
+    const char *pools[] = {"mmap", "large"};
+    for (const char *pool : pools) {
+        PoolConfigurationData expected;
+        expected.intervalList.Initialize(mmap, munmap, 16);
+        parseCsv::ParseCsv(expected, file.c_str(), pool);
+
+        PoolConfigurationData &loaded = loader.GetPool(pool);
+        EXPECT_EQ(loaded.size, expected.size);
+        ASSERT_EQ(loaded.intervalList.GetLength(),
+                  expected.intervalList.GetLength());
+        for (size_t i = 0; i < loaded.intervalList.GetLength(); i++) {
+            EXPECT_EQ(loaded.intervalList.At(i)._start_offset,
+                      expected.intervalList.At(i)._start_offset);
+            EXPECT_EQ(loaded.intervalList.At(i)._end_offset,
+                      expected.intervalList.At(i)._end_offset);
+            EXPECT_EQ(loaded.intervalList.At(i)._page_size,
+                      expected.intervalList.At(i)._page_size);
+        }
+    }
+
+    // a pool without rows is empty
+    PoolConfigurationData &brk = loader.GetPool("brk");
+    EXPECT_EQ(brk.size, 0ul);
+    EXPECT_EQ(brk.intervalList.GetLength(), 0ul);
+    remove("csv_loader_for_test.csv");
+}
+
+TEST(ParseCsvTest, BinaryLayoutIsLoadedInPlace) {
+    std::ofstream myfile;
+    myfile.open ("csv_binary_layout_for_test.csv", std::ios::out);
+    myfile << new_format_data;
+    myfile.close();
+
+    std::string cwd(get_current_dir_name());
+    std::string file = cwd + "/" + "csv_binary_layout_for_test.csv";
+    std::string binary_file = cwd + "/" + "binary_layout_for_test.bin";
+
+    RoutingTable csv_routes;
+    ConfigurationLoader csv_loader;
+    csv_loader.Load(file.c_str(), csv_routes);
+    BinaryLayout::Write(binary_file.c_str(), csv_loader, csv_routes);
+
+    RoutingTable routes;
+    ConfigurationLoader loader;
+    loader.Load(binary_file.c_str(), routes);
+    ASSERT_EQ(loader.GetPoolsCount(), csv_loader.GetPoolsCount());
+    for (int p = 0; p < loader.GetPoolsCount(); p++) {
+        EXPECT_STREQ(loader.GetPoolName(p), csv_loader.GetPoolName(p));
+        PoolConfigurationData &expected = csv_loader.At(p);
+        PoolConfigurationData &loaded = loader.At(p);
+        EXPECT_EQ(loaded.size, expected.size);
+        ASSERT_EQ(loaded.intervalList.GetLength(),
+                  expected.intervalList.GetLength());
+        for (size_t i = 0; i < loaded.intervalList.GetLength(); i++) {
+            EXPECT_EQ(loaded.intervalList.At(i)._start_offset,
+                      expected.intervalList.At(i)._start_offset);
+            EXPECT_EQ(loaded.intervalList.At(i)._end_offset,
+                      expected.intervalList.At(i)._end_offset);
+            EXPECT_EQ(loaded.intervalList.At(i)._page_size,
+                      expected.intervalList.At(i)._page_size);
+        }
+    }
+    // the intervals are used in place and sorted already
+    loader.GetPool("brk").intervalList.Sort();
+    EXPECT_EQ(loader.GetPool("brk").intervalList.At(2)._page_size,
+              PageSize::HUGE_1GB);
+
+    ASSERT_EQ(routes.GetRoutesCount(), 1);
+    EXPECT_EQ(routes.At(0)._class, RoutingTable::RouteClass::ANONYMOUS);
+    EXPECT_STREQ(routes.GetPoolName(routes.At(0)._pool), "large");
+    EXPECT_EQ(routes.At(0)._min_length, 67108864ul);
+    EXPECT_EQ(routes.At(0)._max_length, (size_t)-1);
+    remove("csv_binary_layout_for_test.csv");
+    remove("binary_layout_for_test.bin");
+}
+
+TEST(ParseCsvTest, CorruptedBinaryLayoutIsRejected) {
+    RoutingTable csv_routes;
+    ConfigurationLoader csv_loader;
+    csv_loader.LoadInline("brk:4GB:2MB[0-4]", csv_routes);
+    std::string cwd(get_current_dir_name());
+    std::string binary_file = cwd + "/" + "binary_corrupted_for_test.bin";
+    BinaryLayout::Write(binary_file.c_str(), csv_loader, csv_routes);
+
+    std::ifstream in(binary_file, std::ios::binary);
+    std::string valid((std::istreambuf_iterator<char>(in)),
+                      std::istreambuf_iterator<char>());
+    in.close();
+    EXPECT_EQ(BinaryLayout::Validate(valid.data(), valid.size()),
+              (const BinaryLayout::Header*)valid.data());
+
+    const BinaryLayout::Header *header =
+            (const BinaryLayout::Header*)valid.data();
+    uint32_t brk = 0;
+    for (; brk < header->_pools_count; brk++) {
+        if (!strcmp(BinaryLayout::GetPool(header, brk)._name, "brk")) break;
+    }
+    ASSERT_LT(brk, header->_pools_count);
+    size_t pool_offset = sizeof(BinaryLayout::Header) +
+                         brk * sizeof(BinaryLayout::Pool);
+    size_t interval_offset = BinaryLayout::GetPool(header, brk)._intervals_offset;
+
+    std::string corrupted[5];
+    for (std::string &layout : corrupted) {
+        layout = valid;
+    }
+    // the intervals offset is past the end of the file
+    ((BinaryLayout::Pool*)&corrupted[0][pool_offset])->_intervals_offset =
+            valid.size() + 8;
+    // an unknown page size
+    ((MemoryInterval*)&corrupted[1][interval_offset])->_page_size =
+            (PageSize)12345;
+    // an empty interval
+    ((MemoryInterval*)&corrupted[2][interval_offset])->_end_offset = 0;
+    // an interval that is not whole pages
+    ((MemoryInterval*)&corrupted[3][interval_offset])->_end_offset -= 4096;
+    // an interval past the end of the pool
+    ((MemoryInterval*)&corrupted[4][interval_offset])->_end_offset = 8l << 30;
+    for (std::string &layout : corrupted) {
+        EXPECT_EXIT(BinaryLayout::Validate(layout.data(), layout.size()),
+                    ::testing::ExitedWithCode(1), "");
+    }
+    remove("binary_corrupted_for_test.bin");
+}
+
+TEST(ParseCsvTest, VersionOneBinaryLayoutGetsTheDefaultPolicy) {
+    // a version 1 layout of a single pool, with no routes
+    struct {
+        BinaryLayout::Header header;
+        BinaryLayout::PoolV1 pool;
+        MemoryInterval interval;
+    } layout;
+    memset((void*)&layout, 0, sizeof(layout));
+    memcpy(layout.header._magic, BINARY_LAYOUT_MAGIC,
+           sizeof(layout.header._magic));
+    layout.header._version = 1;
+    layout.header._pools_count = 1;
+    layout.header._file_size = sizeof(layout);
+    strcpy(layout.pool._name, "table");
+    layout.pool._size = 4l << 30;
+    layout.pool._intervals_offset = offsetof(decltype(layout), interval);
+    layout.pool._intervals_count = 1;
+    layout.interval._start_offset = 0;
+    layout.interval._end_offset = 1l << 30;
+    layout.interval._page_size = PageSize::HUGE_1GB;
+
+    std::string cwd(get_current_dir_name());
+    std::string binary_file = cwd + "/" + "binary_v1_for_test.bin";
+    std::ofstream myfile(binary_file, std::ios::out | std::ios::binary);
+    myfile.write((const char*)&layout, sizeof(layout));
+    myfile.close();
+
+    RoutingTable routes;
+    ConfigurationLoader loader;
+    loader.Load(binary_file.c_str(), routes);
+    ASSERT_EQ(loader.GetPoolsCount(), 1);
+    PoolConfigurationData &table = loader.GetPool("table");
+    EXPECT_EQ(table.size, 4ul << 30);
+    EXPECT_EQ(table.allocatorPolicy, AllocatorPolicy::FIRST_FIT);
+    ASSERT_EQ(table.intervalList.GetLength(), 1ul);
+    EXPECT_EQ(table.intervalList.At(0)._end_offset, 1l << 30);
+    EXPECT_EQ(routes.GetRoutesCount(), 0);
+    remove("binary_v1_for_test.bin");
+}
+
+TEST(ParseCsvTest, InlineLayoutIsParsedWithDefaults) {
+    RoutingTable routes;
+    ConfigurationLoader loader;
+    loader.LoadInline("brk:4GB:2MB[0-4,4-8,16]:1GB[2]@1GB; large:1GB:2MB[0-511]@4KB;"
+                      "large:route:anon:64MB:-1;", routes);
+
+    // the same layout as new_format_data
+    PoolConfigurationData &b = loader.GetPool("brk");
+    EXPECT_EQ(b.size, 4ul << 30);
+    ASSERT_EQ(b.intervalList.GetLength(), 3ul);
+    EXPECT_EQ(b.intervalList.At(0)._end_offset, 8 << 21);
+    EXPECT_EQ(b.intervalList.At(1)._start_offset, 16 << 21);
+    EXPECT_EQ(b.intervalList.At(2)._start_offset, 3l << 30);
+    EXPECT_EQ(b.intervalList.At(2)._page_size, PageSize::HUGE_1GB);
+
+    PoolConfigurationData &l = loader.GetPool("large");
+    EXPECT_EQ(l.size, 1ul << 30);
+    ASSERT_EQ(l.intervalList.GetLength(), 1ul);
+    EXPECT_EQ(l.intervalList.At(0)._start_offset, 4096);
+    EXPECT_EQ(l.intervalList.At(0)._end_offset, 4096 + (511l << 21));
+
+    ASSERT_EQ(routes.GetRoutesCount(), 1);
+    EXPECT_STREQ(routes.GetPoolName(routes.At(0)._pool), "large");
+    EXPECT_EQ(routes.At(0)._min_length, 64ul << 20);
+    EXPECT_EQ(routes.At(0)._max_length, (size_t)-1);
+
+    // the missing pools get their default sizes
+    EXPECT_EQ(loader.GetPool("mmap").size, (size_t)DEFAULT_MMAP_POOL_SIZE);
+    EXPECT_EQ(loader.GetPool("mmap").intervalList.GetLength(), 0ul);
+    EXPECT_EQ(loader.GetPool("file").size, (size_t)DEFAULT_FILE_POOL_SIZE);
+}
+
+TEST(ParseCsvTest, InvalidRangeListsAreRejected) {
+    // a single page, and a range that excludes its end
+    EXPECT_EQ(parseCsv::ParseSize("8GB"), 8ll << 30);
+    RoutingTable routes;
+    ConfigurationLoader loader;
+    loader.LoadInline("brk:8MB:2MB[0,2-4]", routes);
+    ASSERT_EQ(loader.GetPool("brk").intervalList.GetLength(), 2ul);
+    EXPECT_EQ(loader.GetPool("brk").intervalList.At(0)._end_offset, 2 << 20);
+    EXPECT_EQ(loader.GetPool("brk").intervalList.At(1)._start_offset, 4 << 20);
+    EXPECT_EQ(loader.GetPool("brk").intervalList.At(1)._end_offset, 8 << 20);
+
+    // sizes that overflow are invalid
+    EXPECT_EQ(parseCsv::ParseSize("9223372036854775808"), -1);
+    EXPECT_EQ(parseCsv::ParseSize("9007199254740992GB"), -1);
+
+    const char *layouts[] = {
+        "brk:8MB:2MB[2-2]",                     // an empty range
+        "brk:8MB:2MB[0-5]",                     // past the pool end
+        "brk:8MB:2MB[3]@4KB",                   // past the pool end by the offset
+        "brk:8MB:2MB[0]@16MB",                  // an offset past the pool end
+        "brk:8MB:2MB[0-99999999999999999999]",  // an index that overflows
+    };
+    for (const char *layout : layouts) {
+        EXPECT_EXIT({
+            RoutingTable exit_routes;
+            ConfigurationLoader exit_loader;
+            exit_loader.LoadInline(layout, exit_routes);
+        }, ::testing::ExitedWithCode(1), "") << layout;
+    }
+}
+
+TEST(ParseCsvTest, InvalidRouteLengthsAreRejected) {
+    RoutingTable routes;
+    ConfigurationLoader loader;
+    loader.LoadInline("large:1GB;large:route:anon:4KB:1MB;"
+                      "large:route:anon:1MB:-1", routes);
+    ASSERT_EQ(routes.GetRoutesCount(), 2);
+    EXPECT_EQ(routes.At(0)._min_length, 4096ul);
+    EXPECT_EQ(routes.At(0)._max_length, 1ul << 20);
+    EXPECT_EQ(routes.At(1)._max_length, (size_t)-1);
+
+    // a length that is not a size is not taken as -1 (unlimited)
+    const char *layouts[] = {
+        "large:route:anon:64XB:-1",
+        "large:route:anon:0:12abc",
+        "large:route:anon:-1:1MB",
+        "large:route:anon:64MB:1MB",
+    };
+    for (const char *layout : layouts) {
+        EXPECT_EXIT({
+            RoutingTable exit_routes;
+            ConfigurationLoader exit_loader;
+            exit_loader.LoadInline(layout, exit_routes);
+        }, ::testing::ExitedWithCode(1), "") << layout;
+    }
+
+    std::ofstream myfile;
+    myfile.open ("csv_route_lengths_for_test.csv", std::ios::out);
+    myfile << "type,pageSize,startOffset,endOffset\n"
+              "large,-1,0,1073741824\n"
+              "large,route:anon,65536,abc\n";
+    myfile.close();
+    std::string cwd(get_current_dir_name());
+    std::string file = cwd + "/" + "csv_route_lengths_for_test.csv";
+    EXPECT_EXIT({
+        RoutingTable exit_routes;
+        parseCsv::ParseRoutes(exit_routes, file.c_str());
+    }, ::testing::ExitedWithCode(1), "");
+    remove("csv_route_lengths_for_test.csv");
+}
+
+TEST(ParseCsvTest, AllocatorPoliciesAreParsed) {
+    std::ofstream myfile;
+    myfile.open ("csv_allocator_for_test.csv", std::ios::out);
+    myfile << "pool_type,pool_size,ragions_list_2mb,offset_2mb,ragions_list_1gb,offset_1gb\n"
+              "mmap,1GB,[],0,[],0\n"
+              "table,4GB,[],0,[0-4],0\n"
+              "table,allocator:page-aligned\n";
+    myfile.close();
+
+    std::string cwd(get_current_dir_name());
+    std::string file = cwd + "/" + "csv_allocator_for_test.csv";
+    std::string binary_file = cwd + "/" + "binary_allocator_for_test.bin";
+
+    RoutingTable csv_routes;
+    ConfigurationLoader csv_loader;
+    csv_loader.Load(file.c_str(), csv_routes);
+    EXPECT_EQ(csv_loader.GetPool("table").allocatorPolicy,
+              AllocatorPolicy::PAGE_ALIGNED);
+    ASSERT_EQ(csv_loader.GetPool("table").intervalList.GetLength(), 1ul);
+    EXPECT_EQ(csv_loader.GetPool("table").intervalList.At(0)._end_offset, 4l << 30);
+    EXPECT_EQ(csv_loader.GetPool("mmap").allocatorPolicy,
+              AllocatorPolicy::FIRST_FIT);
+    // the pool is not routed
+    EXPECT_EQ(csv_routes.FindPool("table"), -1);
+
+    // the policy is kept by the binary layout
+    BinaryLayout::Write(binary_file.c_str(), csv_loader, csv_routes);
+    RoutingTable routes;
+    ConfigurationLoader loader;
+    loader.Load(binary_file.c_str(), routes);
+    EXPECT_EQ(loader.GetPool("table").allocatorPolicy,
+              AllocatorPolicy::PAGE_ALIGNED);
+
+    // an inline layout sets the policy before or after the pool size
+    RoutingTable inline_routes;
+    ConfigurationLoader inline_loader;
+    inline_loader.LoadInline("mmap:allocator:last-fit;table:4GB:1GB[0-4];"
+                             "table:allocator:page-aligned", inline_routes);
+    EXPECT_EQ(inline_loader.GetPool("mmap").allocatorPolicy,
+              AllocatorPolicy::LAST_FIT);
+    EXPECT_EQ(inline_loader.GetPool("mmap").size, (size_t)DEFAULT_MMAP_POOL_SIZE);
+    EXPECT_EQ(inline_loader.GetPool("table").allocatorPolicy,
+              AllocatorPolicy::PAGE_ALIGNED);
+    EXPECT_EQ(inline_loader.GetPool("table").size, 4ul << 30);
+
+    // a policy of a pool without a size is a mistake of the layout
+    EXPECT_EXIT({
+        RoutingTable exit_routes;
+        ConfigurationLoader exit_loader;
+        exit_loader.LoadInline("spare:allocator:last-fit", exit_routes);
+    }, ::testing::ExitedWithCode(1), "");
+    remove("csv_allocator_for_test.csv");
+    remove("binary_allocator_for_test.bin");
+}
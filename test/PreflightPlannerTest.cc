@@ -0,0 +1,163 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <ftw.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "PreflightPlanner.h"
+#include "MemoryIntervalsValidator.h"
+
+#define MB (1l << 20)
+#define GB (1l << 30)
+
+static int RemoveEntry(const char *path, const struct stat *, int,
+                       struct FTW *) {
+    return remove(path);
+}
+
+// builds a fake sysfs tree with two NUMA nodes
+class PreflightPlannerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        char root[] = "/tmp/mosalloc-sysfs-XXXXXX";
+        ASSERT_NE(mkdtemp(root), nullptr);
+        _root = root;
+        WriteFile("/devices/system/node/online", "0-1\n");
+        WriteCounters("hugepages-2048kB", 100, 20, 0, 0);
+        WriteCounters("hugepages-1048576kB", 3, 0, 0, 0);
+        WriteFile("/devices/system/node/node0/hugepages/hugepages-2048kB/free_hugepages", "60\n");
+        WriteFile("/devices/system/node/node1/hugepages/hugepages-2048kB/free_hugepages", "40\n");
+        WriteFile("/devices/system/node/node0/hugepages/hugepages-1048576kB/free_hugepages", "1\n");
+        WriteFile("/devices/system/node/node1/hugepages/hugepages-1048576kB/free_hugepages", "2\n");
+    }
+
+    void TearDown() override {
+        // remove the tree depth first
+        ASSERT_EQ(nftw(_root.c_str(), RemoveEntry, 16, FTW_DEPTH | FTW_PHYS), 0);
+    }
+
+    void WriteFile(const std::string &path, const std::string &text) {
+        // create the directories of the path (under the root)
+        for (size_t slash = path.find('/', 1); slash != std::string::npos;
+             slash = path.find('/', slash + 1)) {
+            std::string dir = _root + path.substr(0, slash);
+            ASSERT_TRUE(mkdir(dir.c_str(), 0755) == 0 || errno == EEXIST);
+        }
+        std::ofstream file(_root + path);
+        file << text;
+    }
+
+    void WriteCounters(const std::string &size_dir, int free, int reserved,
+                       int overcommit, int surplus) {
+        std::string dir = "/kernel/mm/hugepages/" + size_dir + "/";
+        WriteFile(dir + "free_hugepages", std::to_string(free) + "\n");
+        WriteFile(dir + "resv_hugepages", std::to_string(reserved) + "\n");
+        WriteFile(dir + "nr_overcommit_hugepages", std::to_string(overcommit) + "\n");
+        WriteFile(dir + "surplus_hugepages", std::to_string(surplus) + "\n");
+    }
+
+    std::string _root;
+};
+
+TEST_F(PreflightPlannerTest, DemandIsComparedWithTheAllowedNodes) {
+    MemoryIntervalList intervals;
+    intervals.Initialize(mmap, munmap, 3);
+    intervals.AddInterval(0, 2*GB, PageSize::HUGE_1GB);
+    intervals.AddInterval(2*GB, 2*GB + 100*MB, PageSize::HUGE_2MB);
+    intervals.AddInterval(3*GB, 3*GB + 60*MB, PageSize::HUGE_2MB);
+
+    PreflightPlanner planner;
+    planner.AddDemand(intervals);
+    EXPECT_EQ(planner.GetDemand(PageSize::HUGE_1GB), 2u);
+    EXPECT_EQ(planner.GetDemand(PageSize::HUGE_2MB), 80u);
+
+    ASSERT_EQ(planner.ReadSupply(_root.c_str()), 0);
+    planner.SetMemoryPolicy(~0ull, 1ull << 0);
+    // the reserved pages are not available
+    EXPECT_EQ(planner.GetAvailable(PageSize::HUGE_2MB), 80u);
+    EXPECT_EQ(planner.GetAvailable(PageSize::HUGE_1GB), 3u);
+    EXPECT_TRUE(planner.Fits());
+    // node 0 has a single 1GB page
+    EXPECT_EQ(planner.GetNodeDemand(PageSize::HUGE_1GB, 0), 2u);
+    EXPECT_EQ(planner.GetNodeDemand(PageSize::HUGE_1GB, 1), 0u);
+    EXPECT_FALSE(planner.FitsPreferredNodes());
+
+    // interleaving spreads the demand on both nodes
+    planner.SetMemoryPolicy(~0ull, 3);
+    EXPECT_EQ(planner.GetNodeDemand(PageSize::HUGE_1GB, 0), 1u);
+    EXPECT_EQ(planner.GetNodeDemand(PageSize::HUGE_1GB, 1), 1u);
+    EXPECT_TRUE(planner.FitsPreferredNodes());
+
+    // binding to node 0 leaves its pages only
+    planner.SetMemoryPolicy(1ull << 0, 1ull << 0, true);
+    EXPECT_EQ(planner.GetAvailable(PageSize::HUGE_1GB), 1u);
+    EXPECT_EQ(planner.GetAvailable(PageSize::HUGE_2MB), 60u);
+    EXPECT_FALSE(planner.Fits());
+
+    // the bound nodes serve each other, so their total is checked: node 0
+    // takes its single 1GB page and node 1 the other
+    planner.SetMemoryPolicy(3, 3, true);
+    EXPECT_TRUE(planner.Fits());
+    EXPECT_EQ(planner.GetNodeDemand(PageSize::HUGE_1GB, 0), 1u);
+    EXPECT_EQ(planner.GetNodeDemand(PageSize::HUGE_1GB, 1), 1u);
+    EXPECT_EQ(planner.GetNodeDemand(PageSize::HUGE_2MB, 0), 60u);
+    EXPECT_EQ(planner.GetNodeDemand(PageSize::HUGE_2MB, 1), 20u);
+    EXPECT_TRUE(planner.FitsPreferredNodes());
+    // a demand that exceeds the total is left on the last node
+    WriteFile("/devices/system/node/node1/hugepages/hugepages-2048kB/free_hugepages", "10\n");
+    ASSERT_EQ(planner.ReadSupply(_root.c_str()), 0);
+    EXPECT_EQ(planner.GetNodeDemand(PageSize::HUGE_2MB, 1), 20u);
+    EXPECT_FALSE(planner.FitsPreferredNodes());
+}
+
+TEST_F(PreflightPlannerTest, OvercommitIsAvailable) {
+    WriteCounters("hugepages-1048576kB", 3, 0, 4, 1);
+    PreflightPlanner planner;
+    ASSERT_EQ(planner.ReadSupply(_root.c_str()), 0);
+    EXPECT_EQ(planner.GetAvailable(PageSize::HUGE_1GB), 6u);
+}
+
+TEST_F(PreflightPlannerTest, DegradeKeepsTheLowOffsets) {
+    MemoryIntervalList brk;
+    brk.Initialize(mmap, munmap, 2);
+    brk.AddInterval(0, 2*GB, PageSize::HUGE_1GB);
+    brk.AddInterval(2*GB, 2*GB + 40*MB, PageSize::HUGE_2MB);
+    MemoryIntervalList mmap_pool;
+    mmap_pool.Initialize(mmap, munmap, 1);
+    mmap_pool.AddInterval(0, 4*GB, PageSize::HUGE_1GB);
+
+    PreflightPlanner planner;
+    planner.AddDemand(brk);
+    planner.AddDemand(mmap_pool);
+    ASSERT_EQ(planner.ReadSupply(_root.c_str()), 0);
+    planner.SetMemoryPolicy(~0ull, ~0ull);
+    EXPECT_FALSE(planner.Fits());
+
+    // the brk pool fits: 2 of the 3 1GB pages, and 20 of the 80 2MB pages
+    planner.Degrade(brk);
+    ASSERT_EQ(brk.GetLength(), 2u);
+    EXPECT_EQ(brk.At(0)._end_offset, 2*GB);
+    EXPECT_EQ(brk.At(0)._page_size, PageSize::HUGE_1GB);
+    EXPECT_EQ(brk.At(1)._end_offset, 2*GB + 40*MB);
+
+    // the mmap pool gets the last 1GB page, then the 60 2MB pages that are
+    // left, and the rest of it is backed by 4KB pages
+    planner.Degrade(mmap_pool);
+    ASSERT_EQ(mmap_pool.GetLength(), 2u);
+    EXPECT_EQ(mmap_pool.At(0)._start_offset, 0);
+    EXPECT_EQ(mmap_pool.At(0)._end_offset, 1*GB);
+    EXPECT_EQ(mmap_pool.At(0)._page_size, PageSize::HUGE_1GB);
+    EXPECT_EQ(mmap_pool.At(1)._start_offset, 1*GB);
+    EXPECT_EQ(mmap_pool.At(1)._end_offset, 1*GB + 120*MB);
+    EXPECT_EQ(mmap_pool.At(1)._page_size, PageSize::HUGE_2MB);
+
+    // the degraded lists are still valid
+    MemoryIntervalsValidator validator;
+    EXPECT_EQ(validator.Validate(brk), ValidatorErrorMessage::SUCCESS);
+    EXPECT_EQ(validator.Validate(mmap_pool), ValidatorErrorMessage::SUCCESS);
+}
@@ -0,0 +1,60 @@
+#include <sys/mman.h>
+
+#include "gtest/gtest.h"
+#include "RoutingTable.h"
+
+#define KB (1024)
+#define MB (1048576)
+
+TEST(RoutingTableTest, DefaultPools) {
+    RoutingTable routes;
+    int pool = -1;
+    EXPECT_EQ(routes.GetPoolsCount(), 1);
+    EXPECT_STREQ(routes.GetPoolName(0), DEFAULT_ANONYMOUS_POOL_NAME);
+    EXPECT_EQ(routes.Find(4 * KB, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, pool),
+              RoutingTable::RouteTarget::ANONYMOUS_POOL);
+    EXPECT_EQ(pool, 0);
+    EXPECT_EQ(routes.Find(4 * KB, PROT_READ, MAP_PRIVATE, 3, pool),
+              RoutingTable::RouteTarget::FILE_POOL);
+}
+
+TEST(RoutingTableTest, FirstMatchingRouteWins) {
+    RoutingTable routes;
+    routes.AddRoute(RoutingTable::RouteClass::EXECUTABLE, PASSTHROUGH_NAME, 0, (size_t)-1);
+    routes.AddRoute(RoutingTable::RouteClass::STACK, PASSTHROUGH_NAME, 0, (size_t)-1);
+    routes.AddRoute(RoutingTable::RouteClass::ANONYMOUS, "large", 64 * MB, (size_t)-1);
+    routes.AddRoute(RoutingTable::RouteClass::ANONYMOUS, "small", 0, 64 * KB);
+    ASSERT_EQ(routes.GetPoolsCount(), 3);
+
+    int pool = -1;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    EXPECT_EQ(routes.Find(64 * MB, PROT_READ | PROT_EXEC, flags, -1, pool),
+              RoutingTable::RouteTarget::PASSTHROUGH);
+    EXPECT_EQ(routes.Find(8 * MB, PROT_READ, flags | MAP_STACK, -1, pool),
+              RoutingTable::RouteTarget::PASSTHROUGH);
+
+    EXPECT_EQ(routes.Find(64 * MB, PROT_READ, flags, -1, pool),
+              RoutingTable::RouteTarget::ANONYMOUS_POOL);
+    EXPECT_STREQ(routes.GetPoolName(pool), "large");
+    EXPECT_EQ(routes.Find(64 * KB - 1, PROT_READ, flags, -1, pool),
+              RoutingTable::RouteTarget::ANONYMOUS_POOL);
+    EXPECT_STREQ(routes.GetPoolName(pool), "small");
+    EXPECT_EQ(routes.Find(64 * KB, PROT_READ, flags, -1, pool),
+              RoutingTable::RouteTarget::ANONYMOUS_POOL);
+    EXPECT_EQ(pool, 0);
+
+    // anonymous pools cannot serve file mappings
+    EXPECT_EQ(routes.Find(64 * MB, PROT_READ, MAP_PRIVATE, 3, pool),
+              RoutingTable::RouteTarget::FILE_POOL);
+}
+
+TEST(RoutingTableTest, PoolsAreNamedOnce) {
+    RoutingTable routes;
+    routes.AddRoute(RoutingTable::RouteClass::ANONYMOUS, "large", 64 * MB, (size_t)-1);
+    routes.AddRoute(RoutingTable::RouteClass::STACK, "large", 0, (size_t)-1);
+    routes.AddRoute(RoutingTable::RouteClass::ANONYMOUS, DEFAULT_ANONYMOUS_POOL_NAME, 0, 64 * KB);
+    EXPECT_EQ(routes.GetPoolsCount(), 2);
+    EXPECT_EQ(routes.At(0)._pool, 1);
+    EXPECT_EQ(routes.At(1)._pool, 1);
+    EXPECT_EQ(routes.At(2)._pool, 0);
+}
@@ -0,0 +1,355 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include "LayoutOptimizer.h"
+#include "ParseCsv.h"
+
+#define CHUNK_SIZE ((size_t)PageSize::HUGE_2MB)
+#define CHUNKS_PER_1GB ((size_t)PageSize::HUGE_1GB / CHUNK_SIZE)
+#define MAX_PROFILE_LINE (1024)
+#define MAX_PROFILE_FIELDS (4)
+
+enum WalkCostIndex {
+    COST_4KB,
+    COST_2MB,
+    COST_1GB
+};
+
+LayoutOptimizer::LayoutOptimizer() {
+    SetWalkCosts(DEFAULT_WALK_COST_4KB, DEFAULT_WALK_COST_2MB,
+                 DEFAULT_WALK_COST_1GB);
+}
+
+void LayoutOptimizer::SetWalkCosts(double cost_4kb, double cost_2mb,
+                                   double cost_1gb) {
+    _walk_cost[COST_4KB] = cost_4kb;
+    _walk_cost[COST_2MB] = cost_2mb;
+    _walk_cost[COST_1GB] = cost_1gb;
+}
+
+int LayoutOptimizer::AddPool(const char *name, size_t size) {
+    if (strlen(name) >= MAX_POOL_NAME_LENGTH) {
+        THROW_EXCEPTION("pool name is too long");
+    }
+    _pools.emplace_back();
+    Pool &pool = _pools.back();
+    strcpy(pool._name, name);
+    pool._size = size;
+    // the last chunk of the pool cannot be a 2MB page if it is partial
+    pool._chunks.assign(size / CHUNK_SIZE, 0);
+    return (int)_pools.size() - 1;
+}
+
+int LayoutOptimizer::FindPool(const char *name) const {
+    for (size_t i = 0; i < _pools.size(); i++) {
+        if (!strcmp(_pools[i]._name, name)) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+int LayoutOptimizer::AddWeight(int pool, size_t offset, size_t length,
+                               double weight) {
+    Pool &p = _pools[pool];
+    if (offset >= p._size || length > p._size - offset) {
+        return -EINVAL;
+    }
+    if (length == 0) {
+        size_t chunk = offset / CHUNK_SIZE;
+        if (chunk < p._chunks.size()) {
+            p._chunks[chunk] += weight;
+        }
+        return 0;
+    }
+    size_t end = offset + length;
+    for (size_t chunk = offset / CHUNK_SIZE;
+         chunk < p._chunks.size() && chunk * CHUNK_SIZE < end; chunk++) {
+        size_t overlap = std::min(end, (chunk + 1) * CHUNK_SIZE) -
+                         std::max(offset, chunk * CHUNK_SIZE);
+        p._chunks[chunk] += weight * overlap / length;
+    }
+    return 0;
+}
+
+double LayoutOptimizer::GetWeight(int pool, size_t chunk) const {
+    const Pool &p = _pools[pool];
+    return (chunk < p._chunks.size()) ? p._chunks[chunk] : 0;
+}
+
+int LayoutOptimizer::LoadProfile(const char *path, int &error_line) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return -errno;
+    }
+    char line[MAX_PROFILE_LINE];
+    int res = 0;
+    // the first line is the header
+    for (error_line = 1; fgets(line, sizeof(line), file) != NULL; error_line++) {
+        if (error_line == 1) {
+            continue;
+        }
+        line[strcspn(line, "\r\n")] = 0;
+        if (line[0] == 0) {
+            continue;
+        }
+        // the fields are split by each comma, so an empty field is kept in
+        // its position (and fails to parse) rather than skipped
+        char *fields[MAX_PROFILE_FIELDS];
+        int fields_count = 0;
+        for (char *field = line; field != NULL; fields_count++) {
+            char *separator = strchr(field, ',');
+            if (separator != NULL) {
+                *separator = 0;
+            }
+            if (fields_count < MAX_PROFILE_FIELDS) {
+                fields[fields_count] = field;
+            }
+            field = (separator != NULL) ? separator + 1 : NULL;
+        }
+        if (fields_count < 2 || fields_count > MAX_PROFILE_FIELDS) {
+            res = -EINVAL;
+            break;
+        }
+        int pool = FindPool(fields[0]);
+        long long int offset = parseCsv::ParseSize(fields[1]);
+        long long int length = 0;
+        double weight = 1;
+        if (fields_count == 4) {
+            length = parseCsv::ParseSize(fields[2]);
+        }
+        if (fields_count >= 3) {
+            char *end = nullptr;
+            weight = strtod(fields[fields_count - 1], &end);
+            if (end == fields[fields_count - 1] || *end != 0 || weight < 0) {
+                res = -EINVAL;
+                break;
+            }
+        }
+        if (pool < 0 || offset < 0 || length < 0 ||
+            AddWeight(pool, offset, length, weight) != 0) {
+            res = -EINVAL;
+            break;
+        }
+    }
+    fclose(file);
+    return res;
+}
+
+double LayoutOptimizer::GetRangeWeight(const Pool &pool,
+                                       size_t first_chunk) const {
+    double weight = 0;
+    for (size_t c = first_chunk; c < first_chunk + CHUNKS_PER_1GB; c++) {
+        weight += pool._chunks[c];
+    }
+    return weight;
+}
+
+/*
+ * SelectPhase sets the candidate 1GB ranges of the pool: the ranges (with
+ * some weight) at the phase whose pages_1gb best ranges save the most, less
+ * the saving of the 2MB pages that are selected in them.
+ */
+void LayoutOptimizer::SelectPhase(Pool &pool, size_t pages_1gb,
+                                  double saving_2mb, double saving_1gb) {
+    pool._ranges.clear();
+    size_t chunks = pool._chunks.size();
+    if (pages_1gb == 0 || chunks < CHUNKS_PER_1GB) {
+        return;
+    }
+    std::vector<double> savings(chunks);
+    for (size_t c = 0; c < chunks; c++) {
+        savings[c] = pool._chunks[c] *
+                     (pool._selected[c] ? saving_1gb - saving_2mb : saving_1gb);
+    }
+    // the saving of the range that starts at each chunk
+    std::vector<double> range_savings(chunks - CHUNKS_PER_1GB + 1);
+    double saving = 0;
+    for (size_t c = 0; c < CHUNKS_PER_1GB; c++) {
+        saving += savings[c];
+    }
+    range_savings[0] = saving;
+    for (size_t c = 1; c < range_savings.size(); c++) {
+        saving += savings[c + CHUNKS_PER_1GB - 1] - savings[c - 1];
+        range_savings[c] = saving;
+    }
+
+    size_t best_phase = 0;
+    double best_saving = -1;
+    std::vector<double> phase_savings;
+    for (size_t phase = 0; phase < CHUNKS_PER_1GB; phase++) {
+        phase_savings.clear();
+        for (size_t c = phase; c < range_savings.size(); c += CHUNKS_PER_1GB) {
+            phase_savings.push_back(range_savings[c]);
+        }
+        size_t count = std::min(pages_1gb, phase_savings.size());
+        std::partial_sort(phase_savings.begin(), phase_savings.begin() + count,
+                          phase_savings.end(), std::greater<double>());
+        double saving = 0;
+        for (size_t k = 0; k < count; k++) {
+            saving += phase_savings[k];
+        }
+        if (saving > best_saving) {
+            best_saving = saving;
+            best_phase = phase;
+        }
+    }
+    for (size_t c = best_phase; c < range_savings.size(); c += CHUNKS_PER_1GB) {
+        if (GetRangeWeight(pool, c) > 0) {
+            pool._ranges.push_back(c);
+        }
+    }
+}
+
+/*
+ * Select2MBPages selects the heaviest chunks that are not covered by 1GB
+ * pages, and returns the position of the first chunk that is left in the
+ * sorted chunks.
+ */
+size_t LayoutOptimizer::Select2MBPages(size_t pages_2mb) {
+    for (Pool &pool : _pools) {
+        pool._selected.assign(pool._chunks.size(), false);
+    }
+    size_t next = 0;
+    for (size_t selected = 0; next < _sorted_chunks.size() &&
+                              selected < pages_2mb; next++) {
+        const Chunk &chunk = _sorted_chunks[next];
+        Pool &pool = _pools[chunk._pool];
+        if (!pool._covered[chunk._chunk]) {
+            pool._selected[chunk._chunk] = true;
+            selected++;
+        }
+    }
+    return next;
+}
+
+// the weight of the count heaviest chunks that are left (from next) and
+// are out of the given 1GB range
+double LayoutOptimizer::GetReplacementWeight(size_t next, int pool,
+                                             size_t first_chunk,
+                                             size_t count) const {
+    double weight = 0;
+    for (; next < _sorted_chunks.size() && count > 0; next++) {
+        const Chunk &chunk = _sorted_chunks[next];
+        if (_pools[chunk._pool]._covered[chunk._chunk] ||
+            (chunk._pool == pool && chunk._chunk >= first_chunk &&
+             chunk._chunk < first_chunk + CHUNKS_PER_1GB)) {
+            continue;
+        }
+        weight += chunk._weight;
+        count--;
+    }
+    return weight;
+}
+
+void LayoutOptimizer::Optimize(size_t pages_2mb, size_t pages_1gb) {
+    _sorted_chunks.clear();
+    for (size_t i = 0; i < _pools.size(); i++) {
+        Pool &pool = _pools[i];
+        pool._covered.assign(pool._chunks.size(), false);
+        for (size_t c = 0; c < pool._chunks.size(); c++) {
+            if (pool._chunks[c] > 0) {
+                _sorted_chunks.push_back({(int)i, c, pool._chunks[c]});
+            }
+        }
+    }
+    std::stable_sort(_sorted_chunks.begin(), _sorted_chunks.end(),
+                     [](const Chunk &lhs, const Chunk &rhs) {
+                         return lhs._weight > rhs._weight;
+                     });
+    size_t next = Select2MBPages(pages_2mb);
+
+    double saving_2mb = _walk_cost[COST_4KB] - _walk_cost[COST_2MB];
+    double saving_1gb = _walk_cost[COST_4KB] - _walk_cost[COST_1GB];
+    for (Pool &pool : _pools) {
+        SelectPhase(pool, pages_1gb, saving_2mb, saving_1gb);
+    }
+    for (size_t page = 0; page < pages_1gb; page++) {
+        int best_pool = -1;
+        size_t best_range = 0;
+        double best_gain = 0;
+        for (size_t i = 0; i < _pools.size(); i++) {
+            const Pool &pool = _pools[i];
+            for (size_t range : pool._ranges) {
+                if (pool._covered[range]) {
+                    continue;
+                }
+                // the 2MB pages of the range move to the chunks that are left
+                double selected_weight = 0;
+                size_t selected_count = 0;
+                for (size_t c = range; c < range + CHUNKS_PER_1GB; c++) {
+                    if (pool._selected[c]) {
+                        selected_weight += pool._chunks[c];
+                        selected_count++;
+                    }
+                }
+                double gain = saving_1gb * GetRangeWeight(pool, range) -
+                              saving_2mb * selected_weight +
+                              saving_2mb * GetReplacementWeight(next, (int)i,
+                                                                range,
+                                                                selected_count);
+                if (gain > best_gain) {
+                    best_gain = gain;
+                    best_pool = (int)i;
+                    best_range = range;
+                }
+            }
+        }
+        if (best_pool < 0) {
+            break;
+        }
+        Pool &pool = _pools[best_pool];
+        std::fill(pool._covered.begin() + best_range,
+                  pool._covered.begin() + best_range + CHUNKS_PER_1GB, true);
+        next = Select2MBPages(pages_2mb);
+    }
+}
+
+void LayoutOptimizer::ApplyPlan(int pool, MemoryIntervalList &intervals) const {
+    const Pool &p = _pools[pool];
+    intervals.Sort();
+    intervals.RemoveIntervalsOf(PageSize::HUGE_2MB);
+    intervals.RemoveIntervalsOf(PageSize::HUGE_1GB);
+    size_t chunks = p._covered.size();
+    for (size_t c = 0; c < chunks; ) {
+        if (!p._covered[c] && !p._selected[c]) {
+            c++;
+            continue;
+        }
+        // set the page size of a run of chunks at once
+        bool covered = p._covered[c];
+        size_t end = c;
+        for (; end < chunks && p._covered[end] == covered &&
+               (covered || p._selected[end]); end++);
+        intervals.FillPageSize(c * CHUNK_SIZE, end * CHUNK_SIZE,
+                               covered ? PageSize::HUGE_1GB : PageSize::HUGE_2MB);
+        c = end;
+    }
+}
+
+double LayoutOptimizer::GetCost() const {
+    double cost = 0;
+    for (const Pool &pool : _pools) {
+        for (size_t c = 0; c < pool._chunks.size(); c++) {
+            WalkCostIndex index = COST_4KB;
+            if (c < pool._covered.size() && pool._covered[c]) {
+                index = COST_1GB;
+            } else if (c < pool._selected.size() && pool._selected[c]) {
+                index = COST_2MB;
+            }
+            cost += pool._chunks[c] * _walk_cost[index];
+        }
+    }
+    return cost;
+}
+
+double LayoutOptimizer::GetBaseCost() const {
+    double cost = 0;
+    for (const Pool &pool : _pools) {
+        for (double weight : pool._chunks) {
+            cost += weight * _walk_cost[COST_4KB];
+        }
+    }
+    return cost;
+}
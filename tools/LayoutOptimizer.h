@@ -0,0 +1,109 @@
+#ifndef MOSALLOC_LAYOUTOPTIMIZER_H
+#define MOSALLOC_LAYOUTOPTIMIZER_H
+
+#include <cstddef>
+#include <vector>
+#include "MemoryIntervalList.h"
+#include "RoutingTable.h"
+
+// the page-table levels that a TLB miss walks (x86-64, 4-level paging)
+#define DEFAULT_WALK_COST_4KB (4.0)
+#define DEFAULT_WALK_COST_2MB (3.0)
+#define DEFAULT_WALK_COST_1GB (2.0)
+
+/*
+ * LayoutOptimizer places a budget of 2MB and 1GB pages on the pools so the
+ * predicted page-walk cost of the layout is minimal.
+ * The cost model is linear: the weight of each 2MB chunk of a pool (e.g.,
+ * its TLB misses or accesses in a run with 4KB pages, or its touched pages
+ * in a LayoutProfiler profile) costs its weight times the walk cost of the
+ * page size that backs it (the page-table levels that a miss walks, by
+ * default).
+ * The 1GB pages of a pool are placed at a single phase, as the validator
+ * requires (see MemoryIntervalsValidator): the phase (a multiple of 2MB)
+ * whose best 1GB ranges, as many as the 1GB budget, save the most over the
+ * 2MB pages that would back their chunks otherwise.
+ * The 1GB pages are placed one at a time, on the range of the pools whose
+ * saving is the highest, less the saving of the 2MB pages that it replaces
+ * (which move to the heaviest chunks that are left); the 2MB pages back
+ * the heaviest chunks that the 1GB pages do not cover, which is optimal
+ * for the given placement of the 1GB pages.
+ */
+class LayoutOptimizer {
+public:
+    LayoutOptimizer();
+
+    void SetWalkCosts(double cost_4kb, double cost_2mb, double cost_1gb);
+
+    // AddPool adds a pool of the given size, and returns its index
+    int AddPool(const char *name, size_t size);
+    // returns the index of the pool, or -1 if there is no such pool
+    int FindPool(const char *name) const;
+    int GetPoolsCount() const { return (int)_pools.size(); }
+
+    /*
+     * AddWeight spreads the weight over the chunks of
+     * [offset, offset + length) of the pool by their overlap (a zero
+     * length adds the weight to the chunk of offset). It returns 0 on
+     * success or -EINVAL if the range is out of the pool.
+     */
+    int AddWeight(int pool, size_t offset, size_t length, double weight);
+    double GetWeight(int pool, size_t chunk) const;
+
+    /*
+     * LoadProfile adds the weights of a csv file whose first line is a
+     * header, and whose rows are either an access (of a trace), a weight of
+     * a chunk (e.g., a LayoutProfiler profile), or a weight of a range:
+     *     <pool>,<offset>
+     *     <pool>,<offset>,<weight>
+     *     <pool>,<offset>,<length>,<weight>
+     * where offsets and lengths take an optional unit suffix (KB, MB or
+     * GB). It returns 0 on success, -errno if the file cannot be read, or
+     * -EINVAL on an invalid row (whose line number is set to error_line).
+     */
+    int LoadProfile(const char *path, int &error_line);
+
+    void Optimize(size_t pages_2mb, size_t pages_1gb);
+
+    /*
+     * ApplyPlan replaces the hugepages intervals of a pool configuration
+     * by the intervals that Optimize placed on the pool.
+     */
+    void ApplyPlan(int pool, MemoryIntervalList &intervals) const;
+
+    // the predicted cost of the planned layout, and of 4KB pages only
+    double GetCost() const;
+    double GetBaseCost() const;
+
+private:
+    struct Pool {
+        char _name[MAX_POOL_NAME_LENGTH];
+        size_t _size;
+        // the weight of each (whole) 2MB chunk of the pool
+        std::vector<double> _chunks;
+        // the first chunks of the 1GB ranges at the phase of the pool
+        std::vector<size_t> _ranges;
+        std::vector<bool> _covered;
+        std::vector<bool> _selected;
+    };
+
+    struct Chunk {
+        int _pool;
+        size_t _chunk;
+        double _weight;
+    };
+
+    double GetRangeWeight(const Pool &pool, size_t first_chunk) const;
+    void SelectPhase(Pool &pool, size_t pages_1gb, double saving_2mb,
+                     double saving_1gb);
+    size_t Select2MBPages(size_t pages_2mb);
+    double GetReplacementWeight(size_t next, int pool, size_t first_chunk,
+                                size_t count) const;
+
+    std::vector<Pool> _pools;
+    // the chunks of all the pools, from the heaviest
+    std::vector<Chunk> _sorted_chunks;
+    double _walk_cost[3];
+};
+
+#endif //MOSALLOC_LAYOUTOPTIMIZER_H
@@ -0,0 +1,33 @@
+/*
+ * Converts a csv configuration file (in either the legacy or the new format)
+ * to a binary layout file (see include/BinaryLayout.h), which Mosalloc maps
+ * and uses in place instead of parsing it at startup.
+ * The csv file is parsed by Mosalloc's own parser, so the binary layout has
+ * the same pools and routes that Mosalloc would read from the csv file.
+ *
+ * usage: mosalloc-convert-layout <input.csv> <output.bin>
+ */
+#include <cstdio>
+#include <sys/mman.h>
+#include "BinaryLayout.h"
+#include "ParseCsv.h"
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <input.csv> <output.bin>\n", argv[0]);
+        return 1;
+    }
+
+    RoutingTable routes;
+    ConfigurationLoader loader;
+    loader.Load(argv[1], routes);
+    BinaryLayout::Write(argv[2], loader, routes);
+
+    size_t intervals = 0;
+    for (int p = 0; p < loader.GetPoolsCount(); p++) {
+        intervals += loader.At(p).intervalList.GetLength();
+    }
+    printf("%s: %d pools, %d routes, %zu intervals\n", argv[2],
+           loader.GetPoolsCount(), routes.GetRoutesCount(), intervals);
+    return 0;
+}
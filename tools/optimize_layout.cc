@@ -0,0 +1,98 @@
+/*
+ * Places a budget of 2MB and 1GB pages on the pools of a configuration file
+ * so the predicted page-walk cost is minimal (see tools/LayoutOptimizer.h),
+ * and writes the resulting configuration file (in the new format).
+ * The pools sizes, allocator policies and routes are kept from the input
+ * configuration file, and the hugepages of its pools are replaced. The
+ * profile holds the weights of the address ranges of the pools (e.g., the
+ * TLB misses of a run with 4KB pages, or the profile of a profiling run,
+ * mosalloc_profile.<pid>.csv).
+ *
+ * usage: mosalloc-optimize-layout <config.csv> <profile.csv> <2mb-pages>
+ *            <1gb-pages> <output.csv> [<cost-4kb>,<cost-2mb>,<cost-1gb>]
+ */
+#include <cstdio>
+#include <cstring>
+#include <sys/mman.h>
+#include "LayoutOptimizer.h"
+#include "MemoryIntervalsValidator.h"
+#include "ParseCsv.h"
+
+int main(int argc, char *argv[]) {
+    if (argc != 6 && argc != 7) {
+        fprintf(stderr, "usage: %s <config.csv> <profile.csv> <2mb-pages> "
+                        "<1gb-pages> <output.csv> "
+                        "[<cost-4kb>,<cost-2mb>,<cost-1gb>]\n", argv[0]);
+        return 1;
+    }
+
+    RoutingTable routes;
+    ConfigurationLoader loader;
+    loader.Load(argv[1], routes);
+
+    // file mappings cannot be backed by hugepages
+    LayoutOptimizer optimizer;
+    for (int p = 0; p < loader.GetPoolsCount(); p++) {
+        if (strcmp(loader.GetPoolName(p), FILE_POOL_NAME)) {
+            optimizer.AddPool(loader.GetPoolName(p), loader.At(p).size);
+        }
+    }
+    if (argc == 7) {
+        double costs[3];
+        if (sscanf(argv[6], "%lf,%lf,%lf", &costs[0], &costs[1], &costs[2]) != 3) {
+            fprintf(stderr, "%s: invalid walk costs\n", argv[6]);
+            return 1;
+        }
+        optimizer.SetWalkCosts(costs[0], costs[1], costs[2]);
+    }
+
+    int error_line = 0;
+    int res = optimizer.LoadProfile(argv[2], error_line);
+    if (res != 0) {
+        fprintf(stderr, "%s:%d: %s\n", argv[2], error_line, strerror(-res));
+        return 1;
+    }
+    long long int pages_2mb = parseCsv::ParseSize(argv[3]);
+    long long int pages_1gb = parseCsv::ParseSize(argv[4]);
+    if (pages_2mb < 0 || pages_1gb < 0) {
+        fprintf(stderr, "invalid hugepages budget\n");
+        return 1;
+    }
+    optimizer.Optimize(pages_2mb, pages_1gb);
+
+    FILE *output = fopen(argv[5], "w");
+    if (output == NULL) {
+        perror(argv[5]);
+        return 1;
+    }
+    MemoryIntervalsValidator validator;
+    parseCsv::WriteHeader(output);
+    for (int p = 0; p < loader.GetPoolsCount(); p++) {
+        PoolConfigurationData &pool = loader.At(p);
+        int optimizer_pool = optimizer.FindPool(loader.GetPoolName(p));
+        if (optimizer_pool >= 0) {
+            optimizer.ApplyPlan(optimizer_pool, pool.intervalList);
+        }
+        if (validator.Validate(pool.intervalList) != ValidatorErrorMessage::SUCCESS) {
+            fprintf(stderr, "%s: invalid intervals\n", loader.GetPoolName(p));
+            fclose(output);
+            return 1;
+        }
+        parseCsv::WritePoolRow(output, loader.GetPoolName(p), pool.size,
+                               pool.intervalList);
+    }
+    for (int p = 0; p < loader.GetPoolsCount(); p++) {
+        if (loader.At(p).allocatorPolicy != AllocatorPolicy::FIRST_FIT) {
+            parseCsv::WriteAllocatorRow(output, loader.GetPoolName(p),
+                                        loader.At(p).allocatorPolicy);
+        }
+    }
+    parseCsv::WriteRoutes(output, routes);
+    fclose(output);
+
+    double base_cost = optimizer.GetBaseCost();
+    double cost = optimizer.GetCost();
+    printf("%s: predicted page-walk cost %.0f (%.1f%% of 4KB pages only)\n",
+           argv[5], cost, (base_cost > 0) ? 100 * cost / base_cost : 100.0);
+    return 0;
+}